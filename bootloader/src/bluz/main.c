@@ -72,6 +72,8 @@
 
 #define SCHED_QUEUE_SIZE                20                                                      /**< Maximum number of events in the scheduler queue. */
 
+#define FW_COPY_ATTEMPTS                3                                                       /**< Copies of a staged firmware image tried before falling back to the factory reset firmware. */
+
 void uart_error_handle(app_uart_evt_t * p_event);
 
 void uart_put(char *str) {
@@ -260,7 +262,7 @@ void blink(int times)
 
 void FLASH_Begin(uint32_t sFLASH_Address, uint32_t fileSize);
 uint16_t FLASH_Update(const uint8_t *pBuffer, uint32_t address, uint32_t bufferSize);
-void FLASH_End(void);
+bool FLASH_End(void);
 
 
 uint32_t FLASH_PagesMask(uint32_t fileSize);
@@ -454,10 +456,28 @@ int main(void)
             uint8_t byte3 = sFLASH_ReadSingleByte(FLASH_FW_LENGTH3);
             fw_len = (byte1 << 16) | (byte2 << 8)  |  byte3;
 
-            if (!FLASH_CopyFW(FLASH_FW_ADDRESS, fw_len, false, false)) {
+            //a bad image is dropped before the app is touched, a copy that doesn't match
+            //leaves the status set and the app incomplete, so it is tried again
+            for (int attempt = 0; attempt < FW_COPY_ATTEMPTS; attempt++) {
+                if (FLASH_CopyFW(FLASH_FW_ADDRESS, fw_len, false, false) ||
+                    sFLASH_ReadSingleByte(FLASH_FW_STATUS) != 0x01) {
+                    break;
+                }
+            }
+            
+            if (sFLASH_ReadSingleByte(FLASH_FW_STATUS) == 0x01) {
 //                uart_put("Didn't Copy Module!\n");
+                //never start a half written app, fall back to the factory reset firmware
+                if (!FLASH_CopyFW(FACTORY_RESET_FW_ADDRESS, FACTORY_RESET_FW_SIZE, true, false)) {
+                    Set_RGB_LED_Values(255,0,0);
+                    while (true) {
+                        sd_app_evt_wait();
+                    }
+                }
+                sFLASH_EraseSector(FLASH_FW_STATUS);
+                sFLASH_WriteSingleByte(FLASH_FW_STATUS, 0x00);
             }
-                
+
         }
     }
     //TO DO: Temporary for now, just boot directly into the app.
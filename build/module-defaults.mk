@@ -18,6 +18,14 @@ else
 CFLAGS += -DRELEASE_BUILD
 endif
 
+ifeq ("$(SFLASH_BENCHMARK)","y")
+CFLAGS += -DSFLASH_BENCHMARK
+endif
+
+ifeq ("$(SYSTEM_TIME_BENCHMARK)","y")
+CFLAGS += -DSYSTEM_TIME_BENCHMARK
+endif
+
 ifdef SPARK_TEST_DRIVER
 CFLAGS += -DSPARK_TEST_DRIVER=$(SPARK_TEST_DRIVER)
 endif
@@ -0,0 +1,139 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2013-2015 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#pragma once
+
+#include <string.h>
+#include "protocol_defs.h"
+
+namespace particle
+{
+namespace protocol
+{
+
+/**
+ * Tracks which chunks of a file transfer have been received.
+ * The bits are kept in storage of their own rather than at the tail of the
+ * message buffer, so responses built in the buffer can't overwrite them.
+ */
+class ChunkBitmap
+{
+	uint8_t bits[CHUNK_BITMAP_SIZE];
+	chunk_index_t count;
+
+public:
+
+	ChunkBitmap() : count(0)
+	{
+	}
+
+	static constexpr unsigned capacity()
+	{
+		return CHUNK_BITMAP_SIZE * 8;
+	}
+
+	/**
+	 * Starts tracking a transfer of the given number of chunks, all
+	 * received or all missing.
+	 * @return false if there are more chunks than can be tracked. Only the
+	 * first capacity() chunks are then tracked.
+	 */
+	bool reset(unsigned chunks, bool received)
+	{
+		bool fits = chunks <= capacity();
+		count = fits ? chunks : capacity();
+		memset(bits, received ? 0xFF : 0, (count + 7) / 8);
+		return fits;
+	}
+
+	chunk_index_t size() const
+	{
+		return count;
+	}
+
+	void set(chunk_index_t idx)
+	{
+		if (idx < count)
+			bits[idx >> 3] |= uint8_t(1 << (idx & 7));
+	}
+
+	/**
+	 * Chunks past the end aren't tracked and count as received.
+	 */
+	bool is_set(chunk_index_t idx) const
+	{
+		return idx >= count || (bits[idx >> 3] & uint8_t(1 << (idx & 7)));
+	}
+
+	/**
+	 * @return the first missing chunk from start, or NO_CHUNKS_MISSING.
+	 */
+	chunk_index_t next_missing(chunk_index_t start) const
+	{
+		for (unsigned idx = start; idx < count; idx++)
+		{
+			// skip a whole byte of received chunks at a time
+			if (!(idx & 7) && bits[idx >> 3] == 0xFF)
+			{
+				idx += 7;
+				continue;
+			}
+			if (!is_set(idx))
+				return idx;
+		}
+		return NO_CHUNKS_MISSING;
+	}
+
+	/**
+	 * Encodes a selective acknowledgement of the chunks below limit:
+	 * limit followed by the runs of missing chunks below it, each as the
+	 * first chunk and the number of chunks. All 16 bit big endian.
+	 * Chunks below limit that aren't in a run have been received.
+	 * @param last_missing  set to the start of the last run encoded.
+	 * @return the number of bytes used, at most 2 + max_runs * 4.
+	 */
+	size_t encode_missing(uint8_t* buf, size_t max_runs, chunk_index_t limit,
+			chunk_index_t& last_missing) const
+	{
+		if (limit > count)
+			limit = count;
+		buf[0] = limit >> 8;
+		buf[1] = limit & 0xFF;
+		size_t size = 2;
+		size_t runs = 0;
+		chunk_index_t idx = 0;
+		while (runs < max_runs && (idx = next_missing(idx)) < limit)
+		{
+			chunk_index_t start = idx;
+			while (idx < limit && !is_set(idx))
+				idx++;
+			chunk_index_t length = idx - start;
+			buf[size++] = start >> 8;
+			buf[size++] = start & 0xFF;
+			buf[size++] = length >> 8;
+			buf[size++] = length & 0xFF;
+			last_missing = start;
+			runs++;
+		}
+		return size;
+	}
+};
+
+}
+}
@@ -53,6 +53,11 @@ ProtocolError ChunkedTransfer::handle_update_begin(
 	{
 		success = file.chunk_count(file.chunk_size) < MAX_CHUNKS;
 	}
+	if (file.chunk_count(file.chunk_size) > ChunkBitmap::capacity())
+	{
+		// too many chunks to track, acknowledge each one instead
+		flags &= ~(UpdateFlag::FAST_OTA | UpdateFlag::WINDOWED);
+	}
 	Message response;
 	channel.response(message, response, 16);
 	size_t size = Messages::coded_ack(response.buf(),
@@ -74,19 +79,22 @@ ProtocolError ChunkedTransfer::handle_update_begin(
 			chunk_index = 0;
 			chunk_size = file.chunk_size; // save chunk size since the descriptor size is overwritten
 			updating = 1;
+			// windowed transfers are a mode of fast OTA
+			update_flags = (flags & UpdateFlag::FAST_OTA) ? flags & (UpdateFlag::FAST_OTA | UpdateFlag::WINDOWED) : 0;
+			window_limit = 0;
+			chunks_since_ack = 0;
 			Message updateReady;
 			channel.create(updateReady);
-			// updateReady will have the maximum capacity
-			int offset = updateReady.capacity() - chunk_bitmap_size();
-			bitmap = queue+offset; // this relies on the fact that we know the channels use a static buffer
 
 			// when not in fast OTA mode, the chunk missing buffer is set to 1 since the protocol
 			// handles missing chunks one by one. Also we don't know the actual size of the file to
 			// know the correct size of the bitmap.
-			set_chunks_received(flags & 1 ? 0 : 0xFF);
+			set_chunks_received(flags & UpdateFlag::FAST_OTA ? 0 : 0xFF);
 
 			// send update_reaady - use fast OTA if available
-			size_t size = Messages::update_ready(updateReady.buf(), 0, token, (flags & 0x1), channel.is_unreliable());
+			size_t size = is_windowed_update() ?
+					Messages::update_ready(updateReady.buf(), 0, token, update_flags, uint8_t(OTA_WINDOW_CHUNKS), channel.is_unreliable()) :
+					Messages::update_ready(updateReady.buf(), 0, token, (flags & UpdateFlag::FAST_OTA), channel.is_unreliable());
 			updateReady.set_length(size);
 			updateReady.set_confirm_received(true);
 			error = channel.send(updateReady);
@@ -168,13 +176,30 @@ ProtocolError ChunkedTransfer::handle_chunk(token_t token, Message& message,
 				crc_valid, fast_ota, updating);
 		if (crc_valid)
 		{
-			callbacks->save_firmware_chunk(file, chunk, NULL);
+			// chunks may arrive out of order and more than once, each is written where it belongs, once
+			if (!fast_ota || !is_chunk_received(chunk_index))
+				callbacks->save_firmware_chunk(file, chunk, NULL);
 			if (!fast_ota)
 			{
 				// message is confirmable for regular OTA or when
 				response_size = Messages::chunk_received(response.buf(), 0, token, ChunkReceivedCode::OK, channel.is_unreliable());
 			}
 			flag_chunk_received(chunk_index);
+			if (fast_ota && updating != 2 && is_windowed_update())
+			{
+				// acknowledge a window of chunks at a time, and once the last chunk has arrived
+				if (chunk_index >= window_limit)
+					window_limit = chunk_index + 1;
+				if (++chunks_since_ack >= OTA_WINDOW_CHUNKS || chunk_index + 1 == chunks.size())
+				{
+					error = send_missing_chunks(channel, MISSED_CHUNKS_TO_SEND);
+					if (error)
+					{
+						WARN("send chunk acknowledgement failed");
+						return error;
+					}
+				}
+			}
 			if (updating == 2)
 			{            // clearing up missed chunks at the end of fast OTA
 				chunk_index_t next_missed = next_chunk_missing(0);
@@ -270,7 +295,7 @@ ProtocolError ChunkedTransfer::send_missing_chunks(MessageChannel& channel,
 	size_t sent = 0;
 	chunk_index_t idx = 0;
 	Message message;
-	channel.create(message, 7+(count*2));
+	channel.create(message, 9+(count*2)+2);
 
 	uint8_t* buf = message.buf();
 	buf[0] = 0x40; // confirmable, no token
@@ -279,23 +304,40 @@ ProtocolError ChunkedTransfer::send_missing_chunks(MessageChannel& channel,
 	buf[3] = 0;
 	buf[4] = 0xb1; // one-byte Uri-Path option
 	buf[5] = 'c';
-	buf[6] = 0xff; // payload marker
 
-	while ((idx = next_chunk_missing(chunk_index_t(idx)))
-			!= NO_CHUNKS_MISSING && sent < count)
+	size_t message_size;
+	if (is_windowed_update())
+	{
+		// the chunks received so far and the runs of missing chunks, instead of each missing chunk
+		buf[6] = 0x41; // one-byte Uri-Query option
+		buf[7] = 'r';
+		buf[8] = 0xff; // payload marker
+		chunk_index_t limit = updating == 2 ? chunks.size() : window_limit;
+		message_size = 9 + chunks.encode_missing(buf + 9, count / 2, limit, missed_chunk_index);
+		chunks_since_ack = 0;
+		// the runs encoded, and the acknowledgement is sent even when nothing is missing
+		sent = 1 + (message_size - 11) / 4;
+	}
+	else
 	{
-		buf[(sent * 2) + 7] = idx >> 8;
-		buf[(sent * 2) + 8] = idx & 0xFF;
+		buf[6] = 0xff; // payload marker
+
+		while ((idx = next_chunk_missing(chunk_index_t(idx)))
+				!= NO_CHUNKS_MISSING && sent < count)
+		{
+			buf[(sent * 2) + 7] = idx >> 8;
+			buf[(sent * 2) + 8] = idx & 0xFF;
 
-		missed_chunk_index = idx;
-		idx++;
-		sent++;
+			missed_chunk_index = idx;
+			idx++;
+			sent++;
+		}
+		message_size = 7 + (sent * 2);
 	}
 
 	if (sent > 0)
 	{
 		DEBUG("Sent %d missing chunks", sent);
-		size_t message_size = 7 + (sent * 2);
 		message.set_length(message_size);
 		message.set_confirm_received(true);	// send synchronously
 		ProtocolError error = channel.send(message);
@@ -310,8 +352,9 @@ ProtocolError ChunkedTransfer::idle(MessageChannel& channel)
 	system_tick_t millis_since_last_chunk = callbacks->millis() - last_chunk_millis;
 	if (3000 < millis_since_last_chunk)
 	{
-		if (updating == 2)
-		{    // send missing chunks
+		// send missing chunks, in a windowed transfer this also acknowledges the chunks received
+		if (updating == 2 || is_windowed_update())
+		{
 			WARN("timeout - resending missing chunks");
 			Message message;
 			ProtocolError error = channel.create(message,
@@ -352,26 +395,12 @@ void ChunkedTransfer::cancel()
 
 chunk_index_t ChunkedTransfer::next_chunk_missing(chunk_index_t start)
 {
-	chunk_index_t chunk = NO_CHUNKS_MISSING;
-	chunk_index_t chunks = file.chunk_count(chunk_size);
-	chunk_index_t idx = start;
-	for (; idx < chunks; idx++)
-	{
-		if (!is_chunk_received(idx))
-		{
-			//serial_dump("next missing chunk %d from %d", idx, start);
-			chunk = idx;
-			break;
-		}
-	}
-	return chunk;
+	return chunks.next_missing(start);
 }
 
 void ChunkedTransfer::set_chunks_received(uint8_t value)
 {
-	size_t bytes = chunk_bitmap_size();
-	if (bytes)
-		memset(bitmap, value, bytes);
+	chunks.reset(file.chunk_count(chunk_size), value);
 }
 
 
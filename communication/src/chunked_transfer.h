@@ -24,6 +24,7 @@
 #include "message_channel.h"
 #include "system_tick_hal.h"
 #include "messages.h"
+#include "chunk_bitmap.h"
 
 namespace particle
 {
@@ -78,31 +79,34 @@ private:
 	unsigned short chunk_index;
 	unsigned short chunk_size;
 
-	uint8_t* bitmap;
+	ChunkBitmap chunks;
+	uint8_t update_flags;
+
+	/**
+	 * In a windowed transfer, one past the highest chunk received and the
+	 * chunks received since the last acknowledgement.
+	 */
+	chunk_index_t window_limit;
+	chunk_index_t chunks_since_ack;
 
 	Callbacks* callbacks;
 
 protected:
 
-	unsigned chunk_bitmap_size()
-	{
-		return (file.chunk_count(chunk_size) + 7) / 8;
-	}
-
-	uint8_t* chunk_bitmap()
-	{
-		return bitmap;
-	}
-
 	inline void flag_chunk_received(chunk_index_t idx)
 	{
 		//    serial_dump("flagged chunk %d", idx);
-		chunk_bitmap()[idx >> 3] |= uint8_t(1 << (idx & 7));
+		chunks.set(idx);
 	}
 
 	inline bool is_chunk_received(chunk_index_t idx)
 	{
-		return (chunk_bitmap()[idx >> 3] & uint8_t(1 << (idx & 7)));
+		return chunks.is_set(idx);
+	}
+
+	bool is_windowed_update()
+	{
+		return update_flags & UpdateFlag::WINDOWED;
 	}
 
 	chunk_index_t next_chunk_missing(chunk_index_t start);
@@ -110,7 +114,7 @@ protected:
 public:
 
 	ChunkedTransfer() :
-			updating(false), callbacks(nullptr)
+			updating(false), update_flags(0), callbacks(nullptr)
 	{
 	}
 
@@ -122,7 +126,6 @@ public:
 	void reset()
 	{
 		reset_updating();
-		bitmap = nullptr;
 		last_chunk_millis = 0;
 	}
 
@@ -144,6 +147,7 @@ public:
 	void reset_updating(void)
 	{
 		updating = false;
+		update_flags = 0;
 		last_chunk_millis = 0;    // this is used for the time latency also
 	}
 
@@ -79,4 +79,65 @@ size_t CoAP::option_decode(unsigned char **option)
   return option_length;
 }
 
+CoAPOptionIterator::CoAPOptionIterator(const uint8_t* message, size_t length) :
+    p(message), end(message + length), option_value(nullptr), payload_start(nullptr),
+    option_number(0), option_length(0), malformed(false)
+{
+  size_t token_length = length ? (message[0] & 0x0F) : 0;
+  if (length < 4 || token_length > 8 || length < 4 + token_length)
+  {
+    malformed = true;
+    p = end;
+  }
+  else
+  {
+    p += 4 + token_length;
+  }
+}
+
+bool CoAPOptionIterator::decode_extended(uint32_t& value)
+{
+  if (13 == value)
+  {
+    if (end - p < 1)
+      return false;
+    value = 13 + *p++;
+  }
+  else if (14 == value)
+  {
+    if (end - p < 2)
+      return false;
+    value = 269 + (p[0] << 8 | p[1]);
+    p += 2;
+  }
+  // 15 is reserved for the payload marker
+  return 15 != value;
+}
+
+bool CoAPOptionIterator::next()
+{
+  if (p >= end)
+    return false;
+  if (0xFF == *p)
+  {
+    payload_start = p + 1;
+    p = end;
+    return false;
+  }
+  uint32_t delta = *p >> 4;
+  uint32_t length = *p & 0x0F;
+  p++;
+  if (!decode_extended(delta) || !decode_extended(length) || length > size_t(end - p))
+  {
+    malformed = true;
+    p = end;
+    return false;
+  }
+  option_number += delta;
+  option_value = p;
+  option_length = length;
+  p += length;
+  return true;
+}
+
 }}
@@ -130,6 +130,57 @@ class CoAP
     static size_t option_decode(unsigned char **option);
 };
 
+namespace CoAPOption {
+  enum Enum {
+    URI_PATH = 11,
+    MAX_AGE = 14,
+    URI_QUERY = 15,
+  };
+}
+
+/**
+ * Steps through the options of a CoAP message without modifying it. Each
+ * option is a view of its number and value in the message. Once the options
+ * are exhausted, the payload is available.
+ *
+ * Lengths are checked against the end of the message, so a malformed message
+ * ends the options with is_malformed() set rather than reading past it.
+ */
+class CoAPOptionIterator
+{
+	const uint8_t* p;
+	const uint8_t* end;
+	const uint8_t* option_value;
+	const uint8_t* payload_start;
+	uint32_t option_number;
+	uint16_t option_length;
+	bool malformed;
+
+	bool decode_extended(uint32_t& value);
+
+public:
+
+	CoAPOptionIterator(const uint8_t* message, size_t length);
+
+	/**
+	 * Moves to the next option.
+	 * @return false when there are no more options.
+	 */
+	bool next();
+
+	uint32_t number() const { return option_number; }
+	const uint8_t* value() const { return option_value; }
+	uint16_t length() const { return option_length; }
+
+	bool is_malformed() const { return malformed; }
+
+	/**
+	 * The payload, once the options are exhausted, or nullptr if there is none.
+	 */
+	const uint8_t* payload() const { return payload_start; }
+	size_t payload_length() const { return payload_start ? end - payload_start : 0; }
+};
+
 // this uses version 0 to maintain compatiblity with the original comms lib codes
 #define COAP_MSG_HEADER(type, tokenlen) \
 	((CoAP::VERSION)<<6 | (type)<<4 | ((tokenlen) & 0xF))
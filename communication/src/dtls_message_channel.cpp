@@ -45,9 +45,9 @@ uint32_t compute_checksum(const uint8_t* server, size_t server_len, const uint8_
 
 
 
-void SessionPersist::save(save_fn_t saver)
+bool SessionPersist::save(save_fn_t saver)
 {
-	save_this_with(saver);
+	return save_this_with(saver);
 }
 
 void SessionPersist::prepare_save(const uint8_t* random, uint32_t keys_checksum, mbedtls_ssl_context* context, message_id_t next_id)
@@ -68,16 +68,6 @@ void SessionPersist::prepare_save(const uint8_t* random, uint32_t keys_checksum,
 	}
 }
 
-void SessionPersist::update(mbedtls_ssl_context* context, save_fn_t saver, message_id_t next_id)
-{
-	if (context->state == MBEDTLS_SSL_HANDSHAKE_OVER)
-	{
-		memcpy(out_ctr, context->out_ctr, 8);
-		this->next_coap_id = next_id;
-		save_this_with(saver);
-	}
-}
-
 auto SessionPersist::restore(mbedtls_ssl_context* context, bool renegotiate, uint32_t keys_checksum, message_id_t* next_id,  restore_fn_t restorer) -> RestoreStatus
 {
 	if (!restore_this_from(restorer))
@@ -470,13 +460,14 @@ ProtocolError DTLSMessageChannel::send(Message& message)
       log_direct_("\n");
 #endif
 
+  // persist the counters before they are used, so a resumed session never reuses them
+  sessionPersist.reserve(&ssl_context, callbacks.save, coap_state ? *coap_state : 0);
   int ret = mbedtls_ssl_write(&ssl_context, message.buf(), message.length());
   if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_WRITE)
   {
 	  reset_session();
 	  return IO_ERROR;
   }
-  sessionPersist.update(&ssl_context, callbacks.save, coap_state ? *coap_state : 0);
   return NO_ERROR;
 }
 
@@ -105,6 +105,16 @@ public:
 
 #ifdef MBEDTLS_SSL_H
 
+/**
+ * Counts the writes made to persist the session, for benchmarking.
+ */
+struct SessionPersistStats
+{
+	uint32_t messages;	// messages sent
+	uint32_t writes;	// calls to the save callback
+	uint32_t bytes;		// bytes passed to the save callback
+};
+
 class __attribute__((packed)) SessionPersist : SessionPersistOpaque
 {
 public:
@@ -112,8 +122,31 @@ public:
 	using save_fn_t = decltype(DTLSMessageChannel::Callbacks::save);
 	using restore_fn_t = decltype(DTLSMessageChannel::Callbacks::restore);
 
+	/**
+	 * The number of records and message IDs reserved ahead of those used
+	 * each time the counters are persisted.
+	 */
+	static const unsigned RESERVED_MESSAGES = 64;
+
 private:
 
+	/**
+	 * The 48 bit record sequence number that follows the 16 bit epoch in out_ctr.
+	 */
+	static uint64_t sequence_number(const unsigned char* ctr)
+	{
+		uint64_t n = 0;
+		for (int i=2; i<8; i++)
+			n = (n << 8) | ctr[i];
+		return n;
+	}
+
+	static void set_sequence_number(unsigned char* ctr, uint64_t n)
+	{
+		for (int i=7; i>=2; i--, n >>= 8)
+			ctr[i] = uint8_t(n);
+	}
+
 
 	void restore_session(mbedtls_ssl_session* session)
 	{
@@ -153,6 +186,8 @@ private:
 	{
 		bool success = false;
 		if (saver && persistent) {
+			stats().writes++;
+			stats().bytes += sizeof(*this);
 			success = !saver(this, sizeof(*this), SparkCallbacks::PERSIST_SESSION, nullptr);
 		}
 		return success;
@@ -160,12 +195,19 @@ private:
 
 public:
 
-	void clear(save_fn_t saver)
+	static SessionPersistStats& stats()
+	{
+		static SessionPersistStats counts;
+		return counts;
+	}
+
+	bool clear(save_fn_t saver)
 	{
 		persistent = 1;	// ensure it is saved
 		invalidate();
-		save_this_with(saver);
+		bool success = save_this_with(saver);
 		persistent = 0;	// do not make any subsequent saves until the context is marked as persistent.
+		return success;
 	}
 
 	/**
@@ -175,7 +217,7 @@ public:
 
 	/**
 	 * Flags this context as being persistent. Subsequent calls
-	 * to save and update will persist the state of this context.
+	 * to save and reserve will persist the state of this context.
 	 * To remove persistence, call clear(), which clears the context, persists it,
 	 * and clears the persistence flag.
 	 */
@@ -185,13 +227,33 @@ public:
 	/**
 	 * Persist information in this context .
 	 */
-	void save(save_fn_t saver);
+	bool save(save_fn_t saver);
 
 	/**
-	 * Update information in this context and saves if the context
-	 * is persistent.
+	 * Called before each message is sent, with the ID of that message.
+	 * The record counter and message ID are persisted RESERVED_MESSAGES ahead
+	 * of those in use, and saved again only once the message would use up
+	 * the reservation. A restored session resumes from the reservation, so
+	 * never reuses a record counter or message ID, while the session is
+	 * saved once every RESERVED_MESSAGES messages rather than for each one.
+	 * @return true if the context was saved.
 	 */
-	void update(mbedtls_ssl_context* context, save_fn_t saver, message_id_t next_id);
+	bool reserve(mbedtls_ssl_context* context, save_fn_t saver, message_id_t next_id)
+	{
+		if (context->state != MBEDTLS_SSL_HANDSHAKE_OVER)
+			return false;
+		stats().messages++;
+		uint64_t next = sequence_number(context->out_ctr);
+		uint64_t reserved = sequence_number(out_ctr);
+		message_id_t ids = next_coap_id - next_id;
+		if (!memcmp(context->out_ctr, out_ctr, 2) && next < reserved &&
+				reserved - next <= RESERVED_MESSAGES && ids <= RESERVED_MESSAGES)
+			return false;
+		memcpy(out_ctr, context->out_ctr, 2);
+		set_sequence_number(out_ctr, next + RESERVED_MESSAGES);
+		next_coap_id = next_id + RESERVED_MESSAGES;
+		return save_this_with(saver);
+	}
 
 	enum RestoreStatus
 	{
@@ -0,0 +1,188 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2013-2015 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#pragma once
+
+#include <string.h>
+#include "protocol_defs.h"
+#include "events.h"
+
+namespace particle
+{
+namespace protocol
+{
+
+/**
+ * Events published within a window of time, sent together in one message.
+ *
+ * The message is a POST to the event type Uri-Path ('e' or 'E') with the
+ * Uri-Query 'b' and the TTL as Max-Age, as for a single event. The payload
+ * is a record per event, in the order published:
+ *
+ *     offset  2 bytes, big endian, milliseconds since the first event
+ *     name    1 byte length, then the name
+ *     data    1 byte length, then the data
+ *
+ * Only events of the same type, TTL and flags share a batch. Event data is
+ * at most MAX_EVENT_DATA_LENGTH, longer events are sent on their own.
+ */
+class EventBatch
+{
+	uint8_t records[EVENT_BATCH_SIZE];
+	uint16_t length;
+	uint8_t count;
+	EventType::Enum event_type;
+	uint8_t flags;
+	int ttl;
+	system_tick_t started;
+	system_tick_t window_millis;
+
+	static const size_t HEADER_SIZE = 4 + 2 + 4 + 2 + 1;
+
+	static size_t record_size(size_t name_length, size_t data_length)
+	{
+		return 2 + 1 + name_length + 1 + data_length;
+	}
+
+public:
+
+	EventBatch() : length(0), count(0), event_type(EventType::PUBLIC), flags(0), ttl(0),
+		started(0), window_millis(0)
+	{
+	}
+
+	/**
+	 * Events published within this many milliseconds of the first are
+	 * batched, at most 65535. 0 turns batching off.
+	 */
+	void set_window(system_tick_t window)
+	{
+		window_millis = window < 65535 ? window : 65535;
+	}
+
+	system_tick_t window() const { return window_millis; }
+
+	uint8_t size() const { return count; }
+
+	bool empty() const { return !count; }
+
+	/**
+	 * Determines if an event can be batched at all, whatever is in the batch.
+	 * @param limit The most the message may hold.
+	 */
+	bool accepts(const char* name, const char* data, size_t limit) const
+	{
+		size_t name_length = strnlen(name, MAX_EVENT_NAME_LENGTH);
+		size_t data_length = data ? strnlen(data, MAX_EVENT_DATA_LENGTH+1) : 0;
+		return window_millis && data_length <= MAX_EVENT_DATA_LENGTH &&
+				record_size(name_length, data_length) <= sizeof(records) &&
+				HEADER_SIZE + record_size(name_length, data_length) <= limit;
+	}
+
+	/**
+	 * Adds an event to the batch.
+	 * @return false if the event doesn't fit, or is not like the events already
+	 * batched. The batch is then sent and the event added to the next one.
+	 */
+	bool add(const char* name, const char* data, int ttl, EventType::Enum event_type,
+			int flags, system_tick_t time, size_t limit)
+	{
+		size_t name_length = strnlen(name, MAX_EVENT_NAME_LENGTH);
+		size_t data_length = data ? strnlen(data, MAX_EVENT_DATA_LENGTH) : 0;
+		size_t required = record_size(name_length, data_length);
+		if (count && (event_type != this->event_type || ttl != this->ttl ||
+				flags != this->flags || time - started > window_millis))
+			return false;
+		if (count == 255 || length + required > sizeof(records) ||
+				HEADER_SIZE + length + required > limit)
+			return false;
+
+		if (!count)
+		{
+			this->event_type = event_type;
+			this->ttl = ttl;
+			this->flags = flags;
+			started = time;
+		}
+		uint16_t offset = uint16_t(time - started);
+		uint8_t* p = records + length;
+		*p++ = offset >> 8;
+		*p++ = offset & 0xFF;
+		*p++ = name_length;
+		memcpy(p, name, name_length);
+		p += name_length;
+		*p++ = data_length;
+		memcpy(p, data, data_length);
+		length += required;
+		count++;
+		return true;
+	}
+
+	/**
+	 * Determines if the batch should be sent, once the window has passed
+	 * since the first event.
+	 */
+	bool is_due(system_tick_t time) const
+	{
+		return count && time - started >= window_millis;
+	}
+
+	/**
+	 * The flags of the events in the batch.
+	 */
+	int event_flags() const { return flags; }
+
+	/**
+	 * Writes the batch as a CoAP message.
+	 * @return the length of the message.
+	 */
+	size_t encode(uint8_t* buf, uint16_t message_id, bool confirmable) const
+	{
+		uint8_t* p = buf;
+		*p++ = confirmable ? 0x40 : 0x50; // confirmable/non-confirmable, no token
+		*p++ = 0x02; // code 0.02 POST request
+		*p++ = message_id >> 8;
+		*p++ = message_id & 0xff;
+		*p++ = 0xb1; // one-byte Uri-Path option
+		*p++ = event_type;
+		uint8_t query_delta = 4;
+		if (60 != ttl)
+		{
+			*p++ = 0x33; // Max-Age
+			*p++ = (ttl >> 16) & 0xff;
+			*p++ = (ttl >> 8) & 0xff;
+			*p++ = ttl & 0xff;
+			query_delta = 1;
+		}
+		*p++ = (query_delta << 4) | 1; // one-byte Uri-Query option
+		*p++ = 'b';
+		*p++ = 0xff;
+		memcpy(p, records, length);
+		p += length;
+		return p - buf;
+	}
+
+	void clear()
+	{
+		count = 0;
+		length = 0;
+	}
+};
+
+}}
@@ -0,0 +1,217 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2013-2015 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#pragma once
+
+#include <string.h>
+#include "coap.h"
+#include "protocol_defs.h"
+
+namespace particle
+{
+namespace protocol
+{
+
+/**
+ * An event received from the cloud, decoded without modifying the message.
+ * The name is copied out of the Uri-Path options and terminated, the data
+ * is a view of the payload.
+ */
+struct ReceivedEvent
+{
+	char name[MAX_EVENT_NAME_LENGTH + 1];
+	size_t name_length;
+	const uint8_t* data;
+	size_t data_length;
+
+	/**
+	 * Decodes an event message. The first Uri-Path is the event type, the
+	 * rest are the parts of the name, joined with '/'. Names longer than
+	 * MAX_EVENT_NAME_LENGTH are truncated.
+	 * @return false if the message is malformed or has no name.
+	 */
+	bool decode(const uint8_t* message, size_t length)
+	{
+		CoAPOptionIterator options(message, length);
+		unsigned paths = 0;
+		name_length = 0;
+		while (options.next())
+		{
+			if (options.number() != CoAPOption::URI_PATH || paths++ == 0)
+				continue;
+			if (paths > 2 && name_length < MAX_EVENT_NAME_LENGTH)
+				name[name_length++] = '/';
+			size_t part = options.length();
+			if (part > MAX_EVENT_NAME_LENGTH - name_length)
+				part = MAX_EVENT_NAME_LENGTH - name_length;
+			memcpy(name + name_length, options.value(), part);
+			name_length += part;
+		}
+		name[name_length] = 0;
+		data = options.payload();
+		data_length = options.payload_length();
+		return !options.is_malformed() && name_length;
+	}
+};
+
+/**
+ * A radix trie of subscription filters, finding every filter that is a prefix
+ * of an event name in one pass over the name, however many filters there are.
+ *
+ * The filters stay where they are, each node labels its edge with a range of
+ * one of them. It is passed a function that returns the filter at a position,
+ * or nullptr for an unused position, and is rebuilt when the filters change.
+ */
+template <unsigned filter_count, unsigned max_length> class FilterTrie
+{
+	static_assert(filter_count <= 32, "matches are returned as a 32 bit mask");
+	static_assert(max_length <= 255, "label offsets are 8 bits");
+
+	struct Node
+	{
+		uint32_t matches;		// filters that end at this node
+		uint8_t filter;			// the filter holding the edge label
+		uint8_t start;
+		uint8_t length;
+		uint8_t child;			// 0 for none, the root is never a child
+		uint8_t sibling;
+	};
+
+	// each filter adds at most a leaf and a split
+	Node nodes[2 * filter_count + 1];
+	uint8_t node_count;
+
+	template <typename Filters> const char* label(const Node& node, Filters filters) const
+	{
+		return filters(node.filter) + node.start;
+	}
+
+	template <typename Filters> uint8_t find_child(const Node& node, char c, Filters filters) const
+	{
+		uint8_t child = node.child;
+		while (child && *label(nodes[child], filters) != c)
+			child = nodes[child].sibling;
+		return child;
+	}
+
+	uint8_t add_node(uint8_t filter, size_t start, size_t length)
+	{
+		Node& node = nodes[node_count];
+		node.matches = 0;
+		node.filter = filter;
+		node.start = start;
+		node.length = length;
+		node.child = 0;
+		node.sibling = 0;
+		return node_count++;
+	}
+
+	template <typename Filters> void insert(uint8_t filter, Filters filters)
+	{
+		const char* f = filters(filter);
+		size_t length = strnlen(f, max_length);
+		size_t depth = 0;
+		uint8_t parent = 0;
+		while (depth < length)
+		{
+			uint8_t child = find_child(nodes[parent], f[depth], filters);
+			if (!child)
+			{
+				child = add_node(filter, depth, length - depth);
+				nodes[child].sibling = nodes[parent].child;
+				nodes[parent].child = child;
+				parent = child;
+				break;
+			}
+
+			Node& node = nodes[child];
+			const char* l = label(node, filters);
+			size_t common = 1;
+			while (common < node.length && depth + common < length && l[common] == f[depth + common])
+				common++;
+			if (common < node.length)
+			{
+				// split the edge where the filter leaves it
+				uint8_t split = add_node(node.filter, node.start, common);
+				nodes[split].child = child;
+				uint8_t* link = &nodes[parent].child;
+				while (*link != child)
+					link = &nodes[*link].sibling;
+				*link = split;
+				nodes[split].sibling = node.sibling;
+				node.sibling = 0;
+				node.start += common;
+				node.length -= common;
+				child = split;
+			}
+			depth += common;
+			parent = child;
+		}
+		nodes[parent].matches |= 1u << filter;
+	}
+
+public:
+
+	FilterTrie() : node_count(1)
+	{
+		nodes[0] = Node();
+	}
+
+	/**
+	 * Rebuilds the trie from the filters.
+	 */
+	template <typename Filters> void build(Filters filters)
+	{
+		node_count = 1;
+		nodes[0] = Node();
+		for (unsigned i = 0; i < filter_count; i++)
+		{
+			if (filters(i))
+				insert(i, filters);
+		}
+	}
+
+	/**
+	 * @return a bit for each filter that is a prefix of the name, bit 0 for
+	 * the filter at position 0.
+	 */
+	template <typename Filters> uint32_t match(const char* name, size_t length, Filters filters) const
+	{
+		uint32_t matches = nodes[0].matches;
+		size_t depth = 0;
+		uint8_t child = 0;
+		while (depth < length && (child = find_child(nodes[child], name[depth], filters)))
+		{
+			const Node& node = nodes[child];
+			if (node.length > length - depth ||
+					memcmp(label(node, filters), name + depth, node.length))
+				break;
+			depth += node.length;
+			matches |= node.matches;
+		}
+		return matches;
+	}
+
+	unsigned size() const
+	{
+		return node_count;
+	}
+};
+
+}}
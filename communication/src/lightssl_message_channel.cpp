@@ -65,11 +65,7 @@ namespace protocol
 					error = IO_ERROR;
 				else
 				{
-					unsigned char next_iv[16];
-					memcpy(next_iv, buf, 16);
-					aes_setkey_dec(&aes, key, 128);
-					aes_crypt_cbc(&aes, AES_DECRYPT, packet_size, iv_receive, buf, buf);
-					memcpy(iv_receive, next_iv, 16);
+					cipher.decrypt(buf, packet_size);
 					message.set_length(packet_size-buf[packet_size-1]);
 				}
 			}
@@ -111,9 +107,7 @@ namespace protocol
 			return AUTHENTICATION_ERROR;
 		}
 
-		memcpy(key, credentials, 16);
-		memcpy(iv_send, credentials + 16, 16);
-		memcpy(iv_receive, credentials + 16, 16);
+		cipher.set_key(credentials, credentials + 16);
 		memcpy(salt, credentials + 32, 8);
 		if (counter)
 			*counter = *(message_id_t*)salt;
@@ -139,9 +133,7 @@ namespace protocol
 
 	void LightSSLMessageChannel::encrypt(unsigned char *buf, int length)
 	{
-		aes_setkey_enc(&aes, key, 128);
-		aes_crypt_cbc(&aes, AES_ENCRYPT, length, iv_send, buf, buf);
-		memcpy(iv_send, buf, 16);
+		cipher.encrypt(buf, length);
 	}
 
 	ProtocolError LightSSLMessageChannel::handshake()
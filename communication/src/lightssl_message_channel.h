@@ -27,7 +27,7 @@
 #include "message_channel.h"
 #include "buffer_message_channel.h"
 #include "tropicssl/rsa.h"
-#include "tropicssl/aes.h"
+#include "session_cipher.h"
 
 namespace particle
 {
@@ -58,11 +58,8 @@ private:
 	unsigned char core_private_key[MAX_DEVICE_PRIVATE_KEY_LENGTH];
 	uint8_t device_id[12];
 
-	unsigned char key[16];
-	unsigned char iv_send[16];
-	unsigned char iv_receive[16];
 	unsigned char salt[8];
-	aes_context aes;
+	SessionCipher cipher;
 
 	Callbacks callbacks;
 	message_id_t* counter;
@@ -139,6 +139,15 @@ public:
         return separate_response_with_payload(buf, message_id, token, 0x44, &flags, 1, confirmable);
     }
 
+    /**
+     * Update ready for a windowed transfer, with the number of chunks the server may send ahead of the acknowledgements.
+     */
+    static inline size_t update_ready(unsigned char *buf, message_id_t message_id, token_t token, uint8_t flags, uint8_t window, bool confirmable)
+    {
+        uint8_t payload[2] = { flags, window };
+        return separate_response_with_payload(buf, message_id, token, 0x44, payload, sizeof(payload), confirmable);
+    }
+
     static inline size_t chunk_received(unsigned char *buf, message_id_t message_id, token_t token, ChunkReceivedCode::Enum code, bool confirmable)
     {
        return separate_response(buf, message_id, token, code, confirmable);
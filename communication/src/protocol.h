@@ -204,6 +204,9 @@ protected:
 					{	return ping();});
 			if (error)
 				return error;
+			error = publisher.process(channel, callbacks.millis());
+			if (error)
+				return error;
 		}
 		return NO_ERROR;
 	}
@@ -269,6 +272,11 @@ public:
 		pinger.set_interval(interval);
 	}
 
+	void set_event_batch_window(system_tick_t window)
+	{
+		publisher.set_batch_window(window);
+	}
+
 	void set_handlers(CommunicationsHandlers& handlers)
 	{
 		copy_and_init(&this->handlers, sizeof(this->handlers), &handlers, handlers.size);
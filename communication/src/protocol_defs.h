@@ -1,6 +1,7 @@
 #pragma once
 
 #include <functional>
+#include <stddef.h>
 #include "system_tick_hal.h"
 
 typedef uint16_t product_id_t;
@@ -40,6 +41,11 @@ typedef uint16_t chunk_index_t;
 const chunk_index_t NO_CHUNKS_MISSING = 65535;
 const chunk_index_t MAX_CHUNKS = 65535;
 const size_t MISSED_CHUNKS_TO_SEND = 50;
+/**
+ * Chunks the server may have in flight in a windowed transfer. The device
+ * acknowledges them together, reporting the missing ones as runs.
+ */
+const chunk_index_t OTA_WINDOW_CHUNKS = 16;
 const size_t MAX_FUNCTION_ARG_LENGTH = 64;
 const size_t MAX_FUNCTION_KEY_LENGTH = 12;
 const size_t MAX_VARIABLE_KEY_LENGTH = 12;
@@ -55,6 +61,40 @@ const size_t MAX_EVENT_TTL_SECONDS = 16777215;
     #endif
 #endif
 
+/**
+ * Bytes of the bitmap of chunks received in a fast OTA update. On bluz the
+ * OTA region is 116KB, 232 chunks of 512 bytes, so 256 chunks are tracked.
+ * Updates with more chunks fall back to acknowledging each chunk.
+ */
+#ifndef CHUNK_BITMAP_SIZE
+    #if PLATFORM_ID==103 || PLATFORM_ID==269
+        #define CHUNK_BITMAP_SIZE 32
+    #else
+        #define CHUNK_BITMAP_SIZE 512
+    #endif
+#endif
+
+/**
+ * Bytes of event records in a batch of events.
+ */
+#ifndef EVENT_BATCH_SIZE
+    #if PLATFORM_ID==103 || PLATFORM_ID==269
+        #define EVENT_BATCH_SIZE 256
+    #else
+        #define EVENT_BATCH_SIZE 512
+    #endif
+#endif
+
+/**
+ * Flags in the update begin message, and echoed in update ready when the
+ * device supports them.
+ */
+namespace UpdateFlag {
+  enum Enum {
+    FAST_OTA = 0x01,
+    WINDOWED = 0x02
+  };
+}
 
 namespace ChunkReceivedCode {
   enum Enum {
@@ -73,7 +113,13 @@ namespace Connection
 {
 enum Enum
 {
-    PING = 0
+    PING = 0,
+
+    /**
+     * Milliseconds within which published events are sent together,
+     * 0 to send each event as it is published.
+     */
+    EVENT_BATCH_WINDOW = 1
 };
 }
 
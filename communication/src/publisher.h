@@ -19,6 +19,8 @@
 
 #pragma once
 
+#include "event_batch.h"
+
 namespace particle
 {
 namespace protocol
@@ -30,6 +32,47 @@ namespace protocol
 
 class Publisher
 {
+	/**
+	 * Events waiting to be sent together, when batching is turned on.
+	 */
+	EventBatch batch;
+
+	ProtocolError send_batch(MessageChannel& channel)
+	{
+		Message message;
+		channel.create(message);
+		bool noack = batch.event_flags() & EventType::NO_ACK;
+		bool confirmable = channel.is_unreliable() && !noack;
+		size_t msglen = batch.encode(message.buf(), 0, confirmable);
+		batch.clear();
+		message.set_length(msglen);
+		return channel.send(message);
+	}
+
+	/**
+	 * Adds an event to the batch, sending the batch first when the event
+	 * can't join it. The rate limit applies to each batch rather than to
+	 * each event.
+	 */
+	ProtocolError batch_event(MessageChannel& channel, const char* event_name,
+			const char* data, int ttl, EventType::Enum event_type, int flags,
+			system_tick_t time, size_t limit)
+	{
+		if (!batch.empty())
+		{
+			if (batch.add(event_name, data, ttl, event_type, flags, time, limit))
+				return NO_ERROR;
+			ProtocolError error = send_batch(channel);
+			if (error)
+				return error;
+		}
+		// the event starts a new batch, which is rate limited like a single event
+		if (is_rate_limited(false, time))
+			return BANDWIDTH_EXCEEDED;
+		batch.add(event_name, data, ttl, event_type, flags, time, limit);
+		return NO_ERROR;
+	}
+
 public:
 
 	inline bool is_system(const char* event_name)
@@ -90,12 +133,16 @@ public:
 			system_tick_t time)
 	{
 		bool is_system_event = is_system(event_name);
+		Message message;
+		channel.create(message);
+		if (!is_system_event && batch.accepts(event_name, data, message.capacity()))
+			return batch_event(channel, event_name, data, ttl, event_type, flags,
+					time, message.capacity());
+
 		bool rate_limited = is_rate_limited(is_system_event, time);
 		if (rate_limited)
 			return BANDWIDTH_EXCEEDED;
 
-		Message message;
-		channel.create(message);
 		bool noack = flags & EventType::NO_ACK;
 		bool confirmable = channel.is_unreliable() && !noack;
 		size_t msglen = Messages::event(message.buf(), 0, event_name, data, ttl,
@@ -103,6 +150,23 @@ public:
 		message.set_length(msglen);
 		return channel.send(message);
 	}
+
+	/**
+	 * Sets the window within which events are batched, 0 to send events
+	 * as they are published.
+	 */
+	void set_batch_window(system_tick_t window)
+	{
+		batch.set_window(window);
+	}
+
+	/**
+	 * Sends the batched events once their window has passed.
+	 */
+	ProtocolError process(MessageChannel& channel, system_tick_t time)
+	{
+		return batch.is_due(time) ? send_batch(channel) : NO_ERROR;
+	}
 };
 
 }}
@@ -0,0 +1,86 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2013-2015 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#pragma once
+
+#include <string.h>
+#include "tropicssl/aes.h"
+
+namespace particle
+{
+namespace protocol
+{
+
+/**
+ * The AES-128-CBC state of a TCP cloud session. The key is expanded into the
+ * encryption and decryption round keys once, when the session key arrives,
+ * rather than for each message.
+ *
+ * Each message is chained from the first ciphertext block of the previous
+ * message in the same direction, as the cloud expects.
+ *
+ * Not copyable, the contexts point into themselves.
+ */
+class SessionCipher
+{
+	aes_context encrypt_context;
+	aes_context decrypt_context;
+	unsigned char iv_send[16];
+	unsigned char iv_receive[16];
+
+	SessionCipher(const SessionCipher&) = delete;
+	SessionCipher& operator=(const SessionCipher&) = delete;
+
+public:
+
+	SessionCipher() {}
+
+	/**
+	 * Starts a session with a 16 byte key and IV.
+	 */
+	void set_key(const unsigned char* key, const unsigned char* iv)
+	{
+		aes_setkey_enc(&encrypt_context, key, 128);
+		aes_setkey_dec(&decrypt_context, key, 128);
+		memcpy(iv_send, iv, 16);
+		memcpy(iv_receive, iv, 16);
+	}
+
+	/**
+	 * Encrypts a padded message in place, length a multiple of 16.
+	 */
+	void encrypt(unsigned char* buf, size_t length)
+	{
+		aes_crypt_cbc(&encrypt_context, AES_ENCRYPT, length, iv_send, buf, buf);
+		memcpy(iv_send, buf, 16);
+	}
+
+	/**
+	 * Decrypts a received message in place, length a multiple of 16.
+	 */
+	void decrypt(unsigned char* buf, size_t length)
+	{
+		unsigned char next_iv[16];
+		memcpy(next_iv, buf, 16);
+		aes_crypt_cbc(&decrypt_context, AES_DECRYPT, length, iv_receive, buf, buf);
+		memcpy(iv_receive, next_iv, 16);
+	}
+};
+
+}}
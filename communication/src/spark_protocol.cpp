@@ -57,11 +57,12 @@ bool SparkProtocol::is_initialized(void)
 void SparkProtocol::reset_updating(void)
 {
   updating = false;
+  update_flags = 0;
   last_chunk_millis = 0;    // this is used for the time latency also
 }
 
 SparkProtocol::SparkProtocol() : QUEUE_SIZE(sizeof(queue)), handlers({sizeof(handlers), NULL}), expecting_ping_ack(false),
-                                     initialized(false), updating(false), product_id(PRODUCT_ID), product_firmware_version(PRODUCT_FIRMWARE_VERSION)
+                                     initialized(false), updating(false), product_id(PRODUCT_ID), product_firmware_version(PRODUCT_FIRMWARE_VERSION), update_flags(0)
 {
     queue_init();
 }
@@ -83,6 +84,7 @@ void SparkProtocol::init(const char *id,
   this->descriptor = descriptor;
 
   memset(event_handlers, 0, sizeof(event_handlers));
+  rebuild_event_filters();
 
   initialized = true;
 }
@@ -177,7 +179,8 @@ bool SparkProtocol::event_loop(CoAPMessageType::Enum& message_type)
       system_tick_t millis_since_last_chunk = callbacks.millis() - last_chunk_millis;
       if (3000 < millis_since_last_chunk)
       {
-          if (updating==2) {    // send missing chunks
+          // send missing chunks, in a windowed transfer this also acknowledges the chunks received
+          if (updating==2 || is_windowed_update()) {
               serial_dump("timeout - resending missing chunks");
               if (!send_missing_chunks(MISSED_CHUNKS_TO_SEND))
                   return false;
@@ -200,6 +203,9 @@ bool SparkProtocol::event_loop(CoAPMessageType::Enum& message_type)
     }
     else
     {
+      if (event_batch.is_due(callbacks.millis()) && !send_event_batch())
+        return false;
+
       system_tick_t millis_since_last_message = callbacks.millis() - last_message_millis;
       if (expecting_ping_ack)
       {
@@ -303,13 +309,7 @@ int SparkProtocol::blocking_receive(unsigned char *buf, int length)
 CoAPMessageType::Enum
   SparkProtocol::received_message(unsigned char *buf, size_t length)
 {
-  unsigned char next_iv[16];
-  memcpy(next_iv, buf, 16);
-
-  aes_setkey_dec(&aes, key, 128);
-  aes_crypt_cbc(&aes, AES_DECRYPT, length, iv_receive, buf, buf);
-
-  memcpy(iv_receive, next_iv, 16);
+  cipher.decrypt(buf, length);
 
   return Messages::decodeType(buf, length);
 }
@@ -465,6 +465,18 @@ bool SparkProtocol::send_event(const char *event_name, const char *data,
 
   bool is_system_event = is_system(event_name);
 
+  // the wrapped message, with its length and padding, must fit the queue
+  const size_t limit = sizeof(queue) - 2 - 16;
+  bool batched = !is_system_event && event_batch.accepts(event_name, data, limit);
+  if (batched && !event_batch.empty())
+  {
+      if (event_batch.add(event_name, data, ttl, event_type, 0, callbacks.millis(), limit))
+          return true;
+      if (!send_event_batch())
+          return false;
+  }
+  // an event that starts a new batch is rate limited like a single event
+
   if (is_system_event) {
       static uint16_t lastMinute = 0;
       static uint8_t eventsThisMinute = 0;
@@ -496,6 +508,11 @@ bool SparkProtocol::send_event(const char *event_name, const char *data,
       return false;
     }
   }
+  if (batched)
+  {
+      event_batch.add(event_name, data, ttl, event_type, 0, callbacks.millis(), limit);
+      return true;
+  }
   uint16_t msg_id = next_message_id();
   size_t msglen = Messages::event(queue + 2, msg_id, event_name, data, ttl, event_type, false);
   size_t wrapped_len = wrap(queue, msglen);
@@ -503,6 +520,15 @@ bool SparkProtocol::send_event(const char *event_name, const char *data,
   return (0 <= blocking_send(queue, wrapped_len));
 }
 
+bool SparkProtocol::send_event_batch()
+{
+  size_t msglen = event_batch.encode(queue + 2, next_message_id(), false);
+  event_batch.clear();
+  size_t wrapped_len = wrap(queue, msglen);
+
+  return (0 <= blocking_send(queue, wrapped_len));
+}
+
 size_t SparkProtocol::time_request(unsigned char *buf)
 {
 	  uint16_t msg_id = next_message_id();
@@ -605,6 +631,7 @@ void SparkProtocol::remove_event_handlers(const char* event_name)
           }
         }
     }
+    rebuild_event_filters();
 }
 
 bool SparkProtocol::event_handler_exists(const char *event_name, EventHandler handler,
@@ -654,6 +681,7 @@ bool SparkProtocol::add_event_handler(const char *event_name, EventHandler handl
         memcpy(event_handlers[i].device_id, id, id_len);
         event_handlers[i].device_id[id_len] = 0;
         event_handlers[i].scope = scope;
+      rebuild_event_filters();
       return true;
     }
   }
@@ -681,22 +709,37 @@ int SparkProtocol::send_missing_chunks(int count)
     buf[3] = message_id & 0xff;
     buf[4] = 0xb1; // one-byte Uri-Path option
     buf[5] = 'c';
-    buf[6] = 0xff; // payload marker
 
-    while ((idx=next_chunk_missing(chunk_index_t(idx)))!=NO_CHUNKS_MISSING && sent<count)
-    {
-        buf[(sent*2)+7] = idx >> 8;
-        buf[(sent*2)+8] = idx & 0xFF;
+    size_t message_size;
+    if (is_windowed_update()) {
+        // the chunks received so far and the runs of missing chunks, instead of each missing chunk
+        buf[6] = 0x41; // one-byte Uri-Query option
+        buf[7] = 'r';
+        buf[8] = 0xff; // payload marker
+        chunk_index_t limit = updating==2 ? chunks.size() : window_limit;
+        message_size = 9 + chunks.encode_missing(buf + 9, count / 2, limit, missed_chunk_index);
+        chunks_since_ack = 0;
+        // the runs encoded, and the acknowledgement is sent even when nothing is missing
+        sent = 1 + (message_size - 11) / 4;
+    }
+    else {
+        buf[6] = 0xff; // payload marker
+
+        while ((idx=next_chunk_missing(chunk_index_t(idx)))!=NO_CHUNKS_MISSING && sent<count)
+        {
+            buf[(sent*2)+7] = idx >> 8;
+            buf[(sent*2)+8] = idx & 0xFF;
 
-        missed_chunk_index = idx;
-        idx++;
-        sent++;
+            missed_chunk_index = idx;
+            idx++;
+            sent++;
+        }
+        message_size = 7+(sent*2);
     }
 
     if (sent>0) {
         DEBUG("Sent %d missing chunks", sent);
 
-        size_t message_size = 7+(sent*2);
         message_size = wrap(queue, message_size);
         if (0 > blocking_send(queue, message_size))
             return -1;
@@ -993,6 +1036,10 @@ bool SparkProtocol::handle_update_begin(msg& message)
     if (success) {
         success = file.chunk_count(file.chunk_size) < MAX_CHUNKS;
     }
+    if (file.chunk_count(file.chunk_size) > ChunkBitmap::capacity()) {
+        // too many chunks to track, acknowledge each one instead
+        flags &= ~(UpdateFlag::FAST_OTA | UpdateFlag::WINDOWED);
+    }
 
     coded_ack(msg_to_send+2, success ? 0x00 : RESPONSE_CODE(4,00), queue[2], queue[3]);
     if (0 > blocking_send(msg_to_send, 18))
@@ -1010,13 +1057,24 @@ bool SparkProtocol::handle_update_begin(msg& message)
             chunk_index = 0;
             chunk_size = file.chunk_size;   // save chunk size since the descriptor size is overwritten
             this->updating = 1;
+            // windowed transfers are a mode of fast OTA
+            update_flags = (flags & UpdateFlag::FAST_OTA) ? flags & (UpdateFlag::FAST_OTA | UpdateFlag::WINDOWED) : 0;
+            window_limit = 0;
+            chunks_since_ack = 0;
             // when not in fast OTA mode, the chunk missing buffer is set to 1 since the protocol
             // handles missing chunks one by one. Also we don't know the actual size of the file to
             // know the correct size of the bitmap.
-            set_chunks_received(flags & 1 ? 0 : 0xFF);
+            set_chunks_received(flags & UpdateFlag::FAST_OTA ? 0 : 0xFF);
 
             // send update_reaady - use fast OTA if available
-            update_ready(msg_to_send + 2, message.token, 0);
+            if (is_windowed_update()) {
+                // tell the server how many chunks it may send ahead of the acknowledgements
+                uint8_t ready[2] = { update_flags, uint8_t(OTA_WINDOW_CHUNKS) };
+                separate_response_with_payload(msg_to_send + 2, message.token, 0x44, ready, sizeof(ready));
+            }
+            else {
+                update_ready(msg_to_send + 2, message.token, 0);
+            }
             if (0 > blocking_send(msg_to_send, 18))
             {
               // error
@@ -1082,12 +1140,25 @@ bool SparkProtocol::handle_chunk(msg& message)
         DEBUG("chunk idx=%d crc=%d fast=%d updating=%d", chunk_index, crc_valid, fast_ota, updating);
         if (crc_valid)
         {
-            callbacks.save_firmware_chunk(file, chunk, NULL);
-            if (!fast_ota || (updating!=2 && (true || (chunk_index & 32)==0))) {
+            // chunks may arrive out of order and more than once, each is written where it belongs, once
+            if (!fast_ota || !is_chunk_received(chunk_index))
+                callbacks.save_firmware_chunk(file, chunk, NULL);
+            if (!fast_ota || (updating!=2 && !is_windowed_update())) {
                 chunk_received(msg_to_send + 2, message.token, ChunkReceivedCode::OK);
                 has_response = true;
             }
             flag_chunk_received(chunk_index);
+            if (fast_ota && updating!=2 && is_windowed_update()) {
+                // acknowledge a window of chunks at a time, and once the last chunk has arrived
+                if (chunk_index >= window_limit)
+                    window_limit = chunk_index + 1;
+                if (++chunks_since_ack >= OTA_WINDOW_CHUNKS || chunk_index + 1 == chunks.size()) {
+                    if (0 > send_missing_chunks(MISSED_CHUNKS_TO_SEND)) {
+                        WARN("send chunk acknowledgement failed");
+                        return false;
+                    }
+                }
+            }
             if (updating==2) {                      // clearing up missed chunks at the end of fast OTA
                 chunk_index_t next_missed = next_chunk_missing(0);
                 if (next_missed==NO_CHUNKS_MISSING) {
@@ -1131,36 +1202,22 @@ bool SparkProtocol::handle_chunk(msg& message)
 
 inline void SparkProtocol::flag_chunk_received(chunk_index_t idx)
 {
-    chunk_bitmap()[idx>>3] |= uint8_t(1<<(idx&7));
+    chunks.set(idx);
 }
 
 inline bool SparkProtocol::is_chunk_received(chunk_index_t idx)
 {
-    return (chunk_bitmap()[idx>>3] & uint8_t(1<<(idx&7)));
+    return chunks.is_set(idx);
 }
 
 chunk_index_t SparkProtocol::next_chunk_missing(chunk_index_t start)
 {
-    chunk_index_t chunk = NO_CHUNKS_MISSING;
-    chunk_index_t chunks = file.chunk_count(chunk_size);
-    chunk_index_t idx = start;
-    for (;idx<chunks; idx++)
-    {
-        if (!is_chunk_received(idx))
-        {
-            //TRACE("next missing chunk %d from %d", idx, start);
-            chunk = idx;
-            break;
-        }
-    }
-    return chunk;
+    return chunks.next_missing(start);
 }
 
 void SparkProtocol::set_chunks_received(uint8_t value)
 {
-    size_t bytes = chunk_bitmap_size();
-    if (bytes)
-    	memset(queue+QUEUE_SIZE-bytes, value, bytes);
+    chunks.reset(file.chunk_count(chunk_size), value);
 }
 
 bool SparkProtocol::handle_update_done(msg& message)
@@ -1273,89 +1330,48 @@ void SparkProtocol::handle_event(msg& message)
         return;
     }
     // end of CoAP message
-    unsigned char *end = queue + len - pad;
+    const size_t message_length = len - pad;
 
-    unsigned char *event_name = queue + 6;
-    size_t event_name_length = CoAP::option_decode(&event_name);
-    if (0 == event_name_length)
+    ReceivedEvent event;
+    if (!event.decode(queue, message_length))
     {
         // error, malformed CoAP option
         return;
     }
-
-    unsigned char *next_src = event_name + event_name_length;
-    unsigned char *next_dst = next_src;
-    while (next_src < end && 0x00 == (*next_src & 0xf0))
+    // the data is terminated in the padding, the message itself is left as it is
+    const char* data = NULL;
+    if (event.data)
     {
-      // there's another Uri-Path option, i.e., event name with slashes
-      size_t option_len = CoAP::option_decode(&next_src);
-      *next_dst++ = '/';
-      if (next_dst != next_src)
-      {
-        // at least one extra byte has been used to encode a CoAP Uri-Path option length
-        memmove(next_dst, next_src, option_len);
-      }
-      next_src += option_len;
-      next_dst += option_len;
+        queue[message_length] = 0;
+        data = (const char*)event.data;
     }
-    event_name_length = next_dst - event_name;
+    const char* event_name = event.name;
 
-    if (next_src < end && 0x30 == (*next_src & 0xf0))
-    {
-      // Max-Age option is next, which we ignore
-      size_t next_len = CoAP::option_decode(&next_src);
-      next_src += next_len;
-    }
-
-    unsigned char *data = NULL;
-    if (next_src < end && 0xff == *next_src)
-    {
-      // payload is next
-      data = next_src + 1;
-      // null terminate data string
-      *end = 0;
-    }
-    // null terminate event name string
-    event_name[event_name_length] = 0;
-
-  const int NUM_HANDLERS = sizeof(event_handlers) / sizeof(FilteringEventHandler);
-  for (int i = 0; i < NUM_HANDLERS; i++)
+  uint32_t matches = event_filters.match(event.name, event.name_length,
+          [this](unsigned i) { return event_filter(i); });
+  for (int i = 0; matches; i++, matches >>= 1)
   {
-    if (NULL == event_handlers[i].handler)
+    if (!(matches & 1))
     {
-       break;
-    }
-    const size_t MAX_FILTER_LENGTH = sizeof(event_handlers[i].filter);
-    const size_t filter_length = strnlen(event_handlers[i].filter, MAX_FILTER_LENGTH);
-
-    if (event_name_length < filter_length)
-    {
-      // does not match this filter, try the next event handler
       continue;
     }
-
-    const int cmp = memcmp(event_handlers[i].filter, event_name, filter_length);
-    if (0 == cmp)
+    // don't call the handler directly, use a callback for it.
+    if (!this->descriptor.call_event_handler)
     {
-        // don't call the handler directly, use a callback for it.
-        if (!this->descriptor.call_event_handler)
+        if(event_handlers[i].handler_data)
         {
-            if(event_handlers[i].handler_data)
-            {
-                EventHandlerWithData handler = (EventHandlerWithData) event_handlers[i].handler;
-                handler(event_handlers[i].handler_data, (char *)event_name, (char *)data);
-            }
-            else
-            {
-                event_handlers[i].handler((char *)event_name, (char *)data);
-            }
+            EventHandlerWithData handler = (EventHandlerWithData) event_handlers[i].handler;
+            handler(event_handlers[i].handler_data, event_name, data);
         }
         else
         {
-            descriptor.call_event_handler(sizeof(FilteringEventHandler), &event_handlers[i], (const char*)event_name, (const char*)data, NULL);
+            event_handlers[i].handler(event_name, data);
         }
     }
-    // else continue the for loop to try the next handler
+    else
+    {
+        descriptor.call_event_handler(sizeof(FilteringEventHandler), &event_handlers[i], event_name, data, NULL);
+    }
   }
 }
 
@@ -1557,9 +1573,7 @@ unsigned char SparkProtocol::next_token()
 
 void SparkProtocol::encrypt(unsigned char *buf, int length)
 {
-  aes_setkey_enc(&aes, key, 128);
-  aes_crypt_cbc(&aes, AES_ENCRYPT, length, iv_send, buf, buf);
-  memcpy(iv_send, buf, 16);
+  cipher.encrypt(buf, length);
 }
 
 void SparkProtocol::separate_response(unsigned char *buf,
@@ -1612,9 +1626,7 @@ int SparkProtocol::set_key(const unsigned char *signed_encrypted_credentials)
                             server_public_key,
                             hmac))
   {
-    memcpy(key,        credentials,      16);
-    memcpy(iv_send,    credentials + 16, 16);
-    memcpy(iv_receive, credentials + 16, 16);
+    cipher.set_key(credentials, credentials + 16);
     memcpy(salt,       credentials + 32,  8);
     _message_id = *(credentials + 32) << 8 | *(credentials + 33);
     _token = *(credentials + 34);
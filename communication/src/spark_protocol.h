@@ -31,9 +31,12 @@
 #include "coap.h"
 #include "events.h"
 #include "tropicssl/rsa.h"
-#include "tropicssl/aes.h"
+#include "session_cipher.h"
 #include "device_keys.h"
 #include "file_transfer.h"
+#include "chunk_bitmap.h"
+#include "event_batch.h"
+#include "event_filter.h"
 #include "spark_protocol_functions.h"
 #include <stdint.h>
 
@@ -104,6 +107,7 @@ class SparkProtocol
                        const void *return_value, int length);
     bool send_event(const char *event_name, const char *data,
                     int ttl, EventType::Enum event_type);
+    void set_event_batch_window(system_tick_t window) { event_batch.set_window(window); }
 
     bool add_event_handler(const char *event_name, EventHandler handler) {
         return add_event_handler(event_name, handler, NULL, SubscriptionScope::FIREHOSE, NULL);
@@ -145,6 +149,9 @@ class SparkProtocol
     ProtocolState::Enum state();
 
   private:
+    // the unit tests drive the message handlers directly
+    friend class SparkProtocolTester;
+
     struct msg {
         uint8_t token;
         size_t len;
@@ -156,15 +163,13 @@ class SparkProtocol
     char device_id[12];
     unsigned char server_public_key[MAX_SERVER_PUBLIC_KEY_LENGTH];
     unsigned char core_private_key[MAX_DEVICE_PRIVATE_KEY_LENGTH];
-    aes_context aes;
+    particle::protocol::SessionCipher cipher;
 
     FilteringEventHandler event_handlers[5];    // 1 system event listener + 4 application event listeners
+    FilterTrie<5, sizeof(FilteringEventHandler::filter)> event_filters;
     SparkCallbacks callbacks;
     SparkDescriptor descriptor;
 
-    unsigned char key[16];
-    unsigned char iv_send[16];
-    unsigned char iv_receive[16];
     unsigned char salt[8];
     unsigned short _message_id;
     unsigned char _token;
@@ -222,14 +227,33 @@ class SparkProtocol
     {
     }
 
-    unsigned chunk_bitmap_size()
+    ChunkBitmap chunks;
+    /**
+     * Events waiting to be sent together, when batching is turned on.
+     */
+    EventBatch event_batch;
+    bool send_event_batch();
+    uint8_t update_flags;
+    /**
+     * In a windowed transfer, one past the highest chunk received and the
+     * chunks received since the last acknowledgement.
+     */
+    chunk_index_t window_limit;
+    chunk_index_t chunks_since_ack;
+
+    bool is_windowed_update()
+    {
+        return update_flags & UpdateFlag::WINDOWED;
+    }
+
+    const char* event_filter(unsigned i) const
     {
-        return (file.chunk_count(chunk_size)+7)/8;
+        return event_handlers[i].handler ? event_handlers[i].filter : nullptr;
     }
 
-    uint8_t* chunk_bitmap()
+    void rebuild_event_filters()
     {
-        return &queue[QUEUE_SIZE-chunk_bitmap_size()];
+        event_filters.build([this](unsigned i) { return event_filter(i); });
     }
 
     void set_chunks_received(uint8_t value);
@@ -139,6 +139,10 @@ int spark_protocol_set_connection_property(ProtocolFacade* protocol, unsigned pr
     {
         protocol->set_keepalive(data);
     }
+    else if (property_id == particle::protocol::Connection::EVENT_BATCH_WINDOW)
+    {
+        protocol->set_event_batch_window(data);
+    }
     return 0;
 }
 int spark_protocol_command(ProtocolFacade* protocol, ProtocolCommands::Enum cmd, uint32_t data, void* reserved)
@@ -233,6 +237,10 @@ void spark_protocol_get_product_details(SparkProtocol* protocol, product_details
 int spark_protocol_set_connection_property(ProtocolFacade* protocol, unsigned property_id,
                                            unsigned data, void* datap, void* reserved)
 {
+    if (property_id == particle::protocol::Connection::EVENT_BATCH_WINDOW)
+    {
+        protocol->set_event_batch_window(data);
+    }
     return 0;
 }
 
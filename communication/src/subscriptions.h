@@ -19,6 +19,8 @@
 
 #pragma once
 
+#include "event_filter.h"
+
 namespace particle
 {
 namespace protocol
@@ -30,7 +32,21 @@ namespace protocol
 
 class Subscriptions
 {
-	FilteringEventHandler event_handlers[5];
+	static const unsigned NUM_EVENT_HANDLERS = 5;
+
+	FilteringEventHandler event_handlers[NUM_EVENT_HANDLERS];
+
+	FilterTrie<NUM_EVENT_HANDLERS, sizeof(FilteringEventHandler::filter)> filters;
+
+	void rebuild_filters()
+	{
+		filters.build([this](unsigned i) { return filter(i); });
+	}
+
+	const char* filter(unsigned i) const
+	{
+		return event_handlers[i].handler ? event_handlers[i].filter : nullptr;
+	}
 
 protected:
 
@@ -52,6 +68,7 @@ public:
 	Subscriptions()
 	{
 		memset(&event_handlers, 0, sizeof(event_handlers));
+		rebuild_filters();
 	}
 
 	ProtocolError handle_event(Message& message,
@@ -76,100 +93,47 @@ public:
 			}
 		}
 
-		// end of CoAP message
-		unsigned char *end = queue + len;
-		// start of event name option (location path) - 6 bytes
-		// 4 bytes coap header, 2 bytes for the location path of the message
-		// plus the size of the token.
-		unsigned char *event_name = queue + 6 + (queue[0] & 0xF);
-		size_t event_name_length = CoAP::option_decode(&event_name);
-		if (0 == event_name_length)
+		ReceivedEvent event;
+		if (!event.decode(queue, len))
 		{
 			// error, malformed CoAP option
 			return MALFORMED_MESSAGE;
 		}
-
-		unsigned char *next_src = event_name + event_name_length;
-		unsigned char *next_dst = next_src;
-		while (next_src < end && 0x00 == (*next_src & 0xf0))
+		// the data is terminated just past the end of the message, the
+		// message itself is left as it is
+		const char* data = nullptr;
+		if (event.data)
 		{
-			// there's another Uri-Path option, i.e., event name with slashes
-			size_t option_len = CoAP::option_decode(&next_src);
-			*next_dst++ = '/';
-			if (next_dst != next_src)
-			{
-				// at least one extra byte has been used to encode a CoAP Uri-Path option length
-				memmove(next_dst, next_src, option_len);
-			}
-			next_src += option_len;
-			next_dst += option_len;
+			queue[len] = 0;
+			data = (const char*)event.data;
 		}
-		event_name_length = next_dst - event_name;
+		const char* event_name = event.name;
 
-		if (next_src < end && 0x30 == (*next_src & 0xf0))
+		uint32_t matches = filters.match(event.name, event.name_length,
+				[this](unsigned i) { return filter(i); });
+		for (unsigned i = 0; matches; i++, matches >>= 1)
 		{
-			// Max-Age option is next, which we ignore
-			size_t next_len = CoAP::option_decode(&next_src);
-			next_src += next_len;
-		}
-
-		unsigned char *data = NULL;
-		if (next_src < end && 0xff == *next_src)
-		{
-			// payload is next
-			data = next_src + 1;
-			// null terminate data string
-			*end = 0;
-		}
-		// null terminate event name string
-		event_name[event_name_length] = 0;
-
-		const int NUM_HANDLERS = sizeof(event_handlers)
-				/ sizeof(FilteringEventHandler);
-		for (int i = 0; i < NUM_HANDLERS; i++)
-		{
-			if (NULL == event_handlers[i].handler)
-			{
-				break;
-			}
-			const size_t MAX_FILTER_LENGTH = sizeof(event_handlers[i].filter);
-			const size_t filter_length = strnlen(event_handlers[i].filter,
-					MAX_FILTER_LENGTH);
-
-			if (event_name_length < filter_length)
-			{
-				// does not match this filter, try the next event handler
+			if (!(matches & 1))
 				continue;
-			}
-
-			const int cmp = memcmp(event_handlers[i].filter, event_name,
-					filter_length);
-			if (0 == cmp)
+			// don't call the handler directly, use a callback for it.
+			if (!call_event_handler)
 			{
-				// don't call the handler directly, use a callback for it.
-				if (!call_event_handler)
+				if (event_handlers[i].handler_data)
 				{
-					if (event_handlers[i].handler_data)
-					{
-						EventHandlerWithData handler =
-								(EventHandlerWithData) event_handlers[i].handler;
-						handler(event_handlers[i].handler_data,
-								(char *) event_name, (char *) data);
-					}
-					else
-					{
-						event_handlers[i].handler((char *) event_name,
-								(char *) data);
-					}
+					EventHandlerWithData handler =
+							(EventHandlerWithData) event_handlers[i].handler;
+					handler(event_handlers[i].handler_data, event_name, data);
 				}
 				else
 				{
-					call_event_handler(sizeof(FilteringEventHandler),
-							&event_handlers[i], (const char*) event_name,
-							(const char*) data, NULL);
+					event_handlers[i].handler(event_name, data);
 				}
 			}
-			// else continue the for loop to try the next handler
+			else
+			{
+				call_event_handler(sizeof(FilteringEventHandler),
+						&event_handlers[i], event_name, data, NULL);
+			}
 		}
 		return NO_ERROR;
 	}
@@ -221,6 +185,7 @@ public:
 				}
 			}
 		}
+		rebuild_filters();
 	}
 
 	/**
@@ -280,6 +245,7 @@ public:
 				memcpy(event_handlers[i].device_id, id, id_len);
 				event_handlers[i].device_id[id_len] = 0;
 				event_handlers[i].scope = scope;
+				rebuild_filters();
 				return NO_ERROR;
 			}
 		}
@@ -31,6 +31,16 @@ typedef enum {
     BLUETOOTH_LE_CONNECTED,
 } BLUETOOTH_LE_STATE;
 
+typedef struct {
+    uint32_t messages;          // messages sent, including their end of stream marker
+    uint32_t bytes;             // payload bytes notified
+    uint32_t notifications;     // notifications accepted by the radio
+    uint32_t tx_complete;       // notifications reported as sent
+    uint32_t queue_full_waits;  // times a sender slept waiting for room in the TX queue
+    uint32_t dropped_messages;  // messages that could not be queued or were flushed
+    uint16_t queue_high_water;  // most bytes ever used in the TX queue
+} BLUETOOTH_LE_TX_STATS;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -53,6 +63,8 @@ extern "C" {
 
     void HAL_BLE_Set_Gateway_Target(char* name);
 
+    void HAL_BLE_Get_TX_Stats(BLUETOOTH_LE_TX_STATS* stats);
+
 #ifdef __cplusplus
 }
 #endif
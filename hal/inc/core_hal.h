@@ -124,6 +124,7 @@ void HAL_Handle_Cloud_Disconnect(void);
 void HAL_Loop_Iteration(void);
 void HAL_Set_Cloud_Connection(bool connected);
 uint32_t HAL_Get_Sys_Tick_Interval(void);
+void HAL_Schedule_Sys_Tick(uint32_t milliseconds);
 void HAL_Tick_System_Seconds(void);
 uint32_t HAL_Get_System_Seconds(void);
 void HAL_Register_Platform_Events(void (*event_callback)(uint8_t event, uint8_t *data, uint16_t length));
@@ -55,6 +55,8 @@ DYNALIB_FN(12, hal_socket, socket_handle_invalid, sock_handle_t(void))
 DYNALIB_FN(13, hal_socket, socket_join_multicast, sock_result_t(const HAL_IPAddress*, network_interface_t, void*))
 DYNALIB_FN(14, hal_socket, socket_leave_multicast, sock_result_t(const HAL_IPAddress*, network_interface_t, void*))
 DYNALIB_FN(15, hal_socket, socket_peer, sock_result_t(sock_handle_t, sock_peer_t*, void*))
+DYNALIB_FN(16, hal_socket, socket_peek, sock_result_t(sock_handle_t, const uint8_t**, void*))
+DYNALIB_FN(17, hal_socket, socket_consume, sock_result_t(sock_handle_t, socklen_t, void*))
 
 DYNALIB_END(hal_socket)
 
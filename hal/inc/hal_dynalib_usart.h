@@ -75,6 +75,9 @@ DYNALIB_FN(BASE_IDX + 12, hal_usart, USB_USART_Flush_Data, void(void))
 
 DYNALIB_FN(BASE_IDX2 + 0, hal_usart,HAL_USART_BeginConfig,void(HAL_USART_Serial serial, uint32_t baud, uint32_t config, void *ptr))
 DYNALIB_FN(BASE_IDX2 + 1, hal_usart,HAL_USART_Write_NineBitData, uint32_t(HAL_USART_Serial serial, uint16_t data))
+DYNALIB_FN(BASE_IDX2 + 2, hal_usart, HAL_USART_Write_Block, int32_t(HAL_USART_Serial, const uint8_t*, uint32_t, bool, void*))
+DYNALIB_FN(BASE_IDX2 + 3, hal_usart, HAL_USART_Read_Block, int32_t(HAL_USART_Serial, uint8_t*, uint32_t, void*))
+DYNALIB_FN(BASE_IDX2 + 4, hal_usart, HAL_USART_Get_Stats, int32_t(HAL_USART_Serial, HAL_USART_Stats*, void*))
 
 
 DYNALIB_END(hal_usart)
@@ -124,6 +124,20 @@ typedef struct sock_peer_t {
 } sock_peer_t;
 sock_result_t socket_peer(sock_handle_t sd, sock_peer_t* peer, void* reserved);
 
+/**
+ * Retrieves the received data without copying it.
+ * @param data  Receives a pointer to the oldest received bytes.
+ * @return the number of contiguous bytes at data, which may be less than
+ * socket_bytes_available(), or a negative value when not supported.
+ */
+sock_result_t socket_peek(sock_handle_t sd, const uint8_t** data, void* reserved);
+
+/**
+ * Releases received data returned by socket_peek().
+ * @return the number of bytes released.
+ */
+sock_result_t socket_consume(sock_handle_t sd, socklen_t len, void* reserved);
+
 //------------ Socket Types ------------
 
 // don't redefine when building GCC target on OSX or linux
@@ -56,6 +56,11 @@
 #define SERIAL_PARITY_BITS (uint8_t)0b00001100
 #define SERIAL_NINE_BITS (uint8_t)0b00010000
 
+// Hardware flow control, where the platform supports it
+#define SERIAL_FLOW_CONTROL_NONE    (uint8_t)0b00000000
+#define SERIAL_FLOW_CONTROL_RTS_CTS (uint8_t)0b01000000
+#define SERIAL_FLOW_CONTROL         (uint8_t)0b01000000
+
 /* Exported types ------------------------------------------------------------*/
 typedef struct Ring_Buffer
 {
@@ -74,6 +79,12 @@ typedef enum HAL_USART_Serial {
 #endif
 } HAL_USART_Serial;
 
+typedef struct HAL_USART_Stats {
+  uint32_t tx_dropped;      // bytes a non-blocking write had no room for
+  uint32_t rx_dropped;      // bytes received while the receive buffer was full
+  uint32_t rx_errors;       // framing, parity and overrun errors
+} HAL_USART_Stats;
+
 /* Exported constants --------------------------------------------------------*/
 
 /* Exported macros -----------------------------------------------------------*/
@@ -98,6 +109,27 @@ void HAL_USART_Half_Duplex(HAL_USART_Serial serial, bool Enable);
 void HAL_USART_BeginConfig(HAL_USART_Serial serial, uint32_t baud, uint32_t config, void*);
 uint32_t HAL_USART_Write_NineBitData(HAL_USART_Serial serial, uint16_t data);
 
+/**
+ * Queues a block of bytes for transmission.
+ * @param blocking  When true, waits for room so no bytes are lost. When false, or
+ * when waiting is not possible, e.g. in an interrupt handler, queues what fits and
+ * counts the rest in HAL_USART_Stats.tx_dropped.
+ * @return the number of bytes queued, or a negative value when not supported.
+ */
+int32_t HAL_USART_Write_Block(HAL_USART_Serial serial, const uint8_t* data, uint32_t size, bool blocking, void* reserved);
+
+/**
+ * Reads the received bytes, up to size, without waiting.
+ * @return the number of bytes read, or a negative value when not supported.
+ */
+int32_t HAL_USART_Read_Block(HAL_USART_Serial serial, uint8_t* data, uint32_t size, void* reserved);
+
+/**
+ * Retrieves the counters of lost bytes and receive errors since HAL_USART_Begin().
+ * @return 0, or a negative value when not supported.
+ */
+int32_t HAL_USART_Get_Stats(HAL_USART_Serial serial, HAL_USART_Stats* stats, void* reserved);
+
 #ifdef __cplusplus
 }
 #endif
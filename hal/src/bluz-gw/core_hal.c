@@ -54,6 +54,12 @@ void HAL_Network_Init(void)
     gateway_init();
     data_service_init();
     external_flash_init();
+#ifdef SFLASH_BENCHMARK
+    external_flash_benchmark();
+#endif
+#ifdef SYSTEM_TIME_BENCHMARK
+    system_time_run_benchmark();
+#endif
 
     gateway_scan_start();
 }
@@ -164,6 +170,11 @@ uint32_t HAL_Get_Sys_Tick_Interval(void)
     return TIME_KEPPER_MILLISECONDS;
 }
 
+void HAL_Schedule_Sys_Tick(uint32_t milliseconds)
+{
+    timers_schedule_tick(milliseconds);
+}
+
 void HAL_Tick_System_Seconds(void)
 {
     return tick_system_seconds();
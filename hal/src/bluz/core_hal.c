@@ -53,6 +53,12 @@ void HAL_Network_Init(void)
     external_flash_init();
     
     timers_start();
+#ifdef SFLASH_BENCHMARK
+    external_flash_benchmark();
+#endif
+#ifdef SYSTEM_TIME_BENCHMARK
+    system_time_run_benchmark();
+#endif
     advertising_start();
 }
 
@@ -157,6 +163,11 @@ uint32_t HAL_Get_Sys_Tick_Interval(void)
     return TIME_KEPPER_MILLISECONDS;
 }
 
+void HAL_Schedule_Sys_Tick(uint32_t milliseconds)
+{
+    timers_schedule_tick(milliseconds);
+}
+
 void HAL_Tick_System_Seconds(void)
 {
     return tick_system_seconds();
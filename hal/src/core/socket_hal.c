@@ -211,4 +211,14 @@ sock_result_t socket_leave_multicast(const HAL_IPAddress* addr, network_interfac
 sock_result_t socket_peer(sock_handle_t sd, sock_peer_t* peer, void* reserved)
 {
     return -1;
-}
\ No newline at end of file
+}
+
+sock_result_t socket_peek(sock_handle_t sd, const uint8_t** data, void* reserved)
+{
+    return -1;
+}
+
+sock_result_t socket_consume(sock_handle_t sd, socklen_t len, void* reserved)
+{
+    return -1;
+}
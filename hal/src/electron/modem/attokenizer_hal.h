@@ -0,0 +1,328 @@
+/*
+ ******************************************************************************
+ *  Copyright (c) 2015 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pipe_hal.h"
+#include "enums_hal.h"
+
+/** Splits the modem output in the receive pipe into responses and URCs.
+
+    The responses are a table of patterns tried in order at each position.
+    A trie of the fixed start of every pattern picks out the few that can
+    match at a position in one pass over it, so a position is only matched
+    against those patterns rather than against the whole table.
+*/
+class AtTokenizer
+{
+public:
+    /** Where #getLine puts the socket data of a +USORD or +USORF response,
+        so it goes from the pipe to the caller of socketRecv in one copy.
+    */
+    struct Payload {
+        char* buf;          //!< the buffer for the data
+        int size;           //!< the size of the buffer
+        int len;            //!< the length of the data put in the buffer, -1 until then
+    };
+
+    /** Parse a line from the receiving buffered pipe
+        \param pipe the receiving buffer pipe
+        \param buf the parsed line
+        \param len the size of the parsed line
+        \param payload where to put the data of a socket read response that
+               fits it, leaving the line without the data between the quotes,
+               or NULL to keep the data in the line
+        \return type and length if something was found,
+                WAIT if not enough data is available
+                NOT_FOUND if nothing was found
+    */
+    static int getLine(Pipe<char>* pipe, char* buf, int len, Payload* payload = NULL)
+    {
+        const Trie& trie = _trie();
+        int unkn = 0;
+        int sz = pipe->size();
+        int fr = pipe->free();
+        if (len > sz)
+            len = sz;
+        while (len > 0)
+        {
+            pipe->set(unkn);
+            uint32_t found = trie.candidates(pipe, len);
+            for (int i = 0; found; i ++, found >>= 1) {
+                if (!(found & 1))
+                    continue;
+                const Pattern& p = _patterns()[i];
+                pipe->set(unkn);
+                int data = 0;
+                int ln = p.fmt ? parseFormated(pipe, len, p.fmt, &data) : parseMatch(pipe, len, p.sta, p.end);
+                if (ln == WAIT && fr)
+                    return WAIT;
+                if ((ln != NOT_FOUND) && (unkn > 0))
+                    return TYPE_UNKNOWN | pipe->get(buf, unkn);
+                if (ln > 0 && p.payload && payload && payload->buf && data <= payload->size) {
+                    // the header and opening quote, the data, then the closing quote
+                    int hdr = pipe->get(buf, ln - data - 1);
+                    payload->len = pipe->get(payload->buf, data);
+                    return p.type | (hdr + pipe->get(buf + hdr, 1));
+                }
+                if (ln > 0)
+                    return p.type | pipe->get(buf, ln);
+            }
+            // UNKNOWN
+            unkn ++;
+            len--;
+        }
+        return WAIT;
+    }
+
+    /** Parse a match from the pipe
+        \param pipe the buffered pipe
+        \param number of bytes to parse at maximum,
+        \param sta the starting string, NULL if none
+        \param end the terminating string, NULL if none
+        \return size of parsed match
+    */
+    static int parseMatch(Pipe<char>* pipe, int len, const char* sta, const char* end)
+    {
+        int o = 0;
+        if (sta) {
+            while (*sta) {
+                if (++o > len)                  return WAIT;
+                char ch = pipe->next();
+                if (*sta++ != ch)               return NOT_FOUND;
+            }
+        }
+        if (!end)                               return o; // no termination
+        // at least any char
+        if (++o > len)                      return WAIT;
+        pipe->next();
+        // check the end
+        int x = 0;
+        while (end[x]) {
+            if (++o > len)                      return WAIT;
+            char ch = pipe->next();
+            x = (end[x] == ch) ? x + 1 :
+                (end[0] == ch) ? 1 :
+                                0;
+        }
+        return o;
+    }
+
+    /** Parse a match from the pipe
+        \param pipe the buffered pipe
+        \param number of bytes to parse at maximum,
+        \param fmt the formating string (%d any number, %c any char of last %d len)
+        \param data set to the length of the %c chars, if not NULL
+        \return size of parsed match
+    */
+    static int parseFormated(Pipe<char>* pipe, int len, const char* fmt, int* data = NULL)
+    {
+        int o = 0;
+        int num = 0;
+        if (fmt) {
+            while (*fmt) {
+                if (++o > len)                  return WAIT;
+                char ch = pipe->next();
+                if (*fmt == '%') {
+                    fmt++;
+                    if (*fmt == 'd') { // numeric
+                        fmt ++;
+                        num = 0;
+                        while (ch >= '0' && ch <= '9') {
+                            num = num * 10 + (ch - '0');
+                            if (++o > len)      return WAIT;
+                            ch = pipe->next();
+                        }
+                    }
+                    else if (*fmt == 'c') { // char buffer (takes last numeric as length)
+                        fmt ++;
+                        if (data)
+                            *data = num;
+                        while (num --) {
+                            if (++o > len)      return WAIT;
+                            ch = pipe->next();
+                        }
+                    }
+                    else if (*fmt == 's') {
+                        fmt ++;
+                        if (ch != '\"')         return NOT_FOUND;
+                        do {
+                            if (++o > len)      return WAIT;
+                            ch = pipe->next();
+                        } while (ch != '\"');
+                        if (++o > len)          return WAIT;
+                        ch = pipe->next();
+                    }
+                }
+                if (*fmt++ != ch)               return NOT_FOUND;
+            }
+        }
+        return o;
+    }
+
+    /** Find the handler for an unsolicited result code or information
+        response in a table keyed by its name, e.g. "UUSORD" for
+        "+UUSORD: 0,12".
+        \param cmd the line after the "\r\n+"
+        \param len the length of the line after the "\r\n+"
+        \param table the handlers, each starting with the name it handles
+        \return the handler or NULL if there is none for the name
+    */
+    template <typename T, int N>
+    static const T* findUrc(const char* cmd, int len, const T (&table)[N])
+    {
+        const char* colon = (const char*)memchr(cmd, ':', len);
+        if (!colon)
+            return NULL;
+        size_t name = colon - cmd;
+        for (int i = 0; i < N; i ++) {
+            if (!strncmp(table[i].name, cmd, name) && !table[i].name[name])
+                return &table[i];
+        }
+        return NULL;
+    }
+
+private:
+    struct Pattern {
+        const char* fmt;    //!< format for parseFormated, NULL to match sta and end
+        const char* sta;
+        const char* end;
+        int type;
+        bool payload;       //!< the %c chars are socket data for a #Payload
+    };
+
+    //! the patterns, in the order they are tried at each position
+    static const Pattern* _patterns(void)
+    {
+        static const Pattern patterns[] = {
+            { "\r\n+USORD: %d,%d,\"%c\"",   NULL,                   NULL,   TYPE_PLUS,  true },
+            { "\r\n+USORF: %d,\"" IPSTR "\",%d,%d,\"%c\"", NULL,    NULL,   TYPE_PLUS,  true },
+            { "\r\n+URDFILE: %s,%d,\"%c\"", NULL,                   NULL,   TYPE_PLUS       },
+            { NULL,     "\r\nOK\r\n",               NULL,                   TYPE_OK         },
+            { NULL,     "\r\nERROR\r\n",            NULL,                   TYPE_ERROR      },
+            { NULL,     "\r\n+CME ERROR:",          "\r\n",                 TYPE_ERROR      },
+            { NULL,     "\r\n+CMS ERROR:",          "\r\n",                 TYPE_ERROR      },
+            { NULL,     "\r\nRING\r\n",             NULL,                   TYPE_RING       },
+            { NULL,     "\r\nCONNECT\r\n",          NULL,                   TYPE_CONNECT    },
+            { NULL,     "\r\nNO CARRIER\r\n",       NULL,                   TYPE_NOCARRIER  },
+            { NULL,     "\r\nNO DIALTONE\r\n",      NULL,                   TYPE_NODIALTONE },
+            { NULL,     "\r\nBUSY\r\n",             NULL,                   TYPE_BUSY       },
+            { NULL,     "\r\nNO ANSWER\r\n",        NULL,                   TYPE_NOANSWER   },
+            { NULL,     "\r\n+",                    "\r\n",                 TYPE_PLUS       },
+            { NULL,     "\r\n@",                    NULL,                   TYPE_PROMPT     }, // Sockets
+            { NULL,     "\r\n>",                    NULL,                   TYPE_PROMPT     }, // SMS
+            { NULL,     "\n>",                      NULL,                   TYPE_PROMPT     }, // File
+            { NULL,     "\r\nABORTED\r\n",          NULL,                   TYPE_ABORTED    }, // Current command aborted
+            { NULL,     NULL,                       NULL,                   0               }
+        };
+        return patterns;
+    }
+
+    /** A trie of the fixed start of each pattern, the characters before
+        any format conversion.
+    */
+    class Trie
+    {
+        struct Node {
+            char c;
+            uint8_t child;      //!< 0 for none, the root is never a child
+            uint8_t sibling;
+            uint32_t ends;      //!< patterns whose fixed start ends here
+            uint32_t below;     //!< patterns whose fixed start is longer
+        };
+        enum { MAX_NODES = 128 };
+        Node _nodes[MAX_NODES];
+        int _count;
+
+        int _child(int node, char c) const
+        {
+            int child = _nodes[node].child;
+            while (child && _nodes[child].c != c)
+                child = _nodes[child].sibling;
+            return child;
+        }
+
+        void _insert(const char* s, int pattern)
+        {
+            uint32_t bit = 1u << pattern;
+            int node = 0;
+            for (; *s && *s != '%'; s ++) {
+                _nodes[node].below |= bit;
+                int child = _child(node, *s);
+                if (!child && _count < MAX_NODES) {
+                    child = _count++;
+                    Node& n = _nodes[child];
+                    n.c = *s;
+                    n.child = 0;
+                    n.ends = n.below = 0;
+                    n.sibling = _nodes[node].child;
+                    _nodes[node].child = child;
+                }
+                if (!child) // out of nodes, always try the pattern from here
+                    break;
+                node = child;
+            }
+            _nodes[node].ends |= bit;
+        }
+
+    public:
+        Trie()
+        {
+            memset(_nodes, 0, sizeof(_nodes));
+            _count = 1;
+            const Pattern* p = _patterns();
+            for (int i = 0; p[i].fmt || p[i].sta; i ++)
+                _insert(p[i].fmt ? p[i].fmt : p[i].sta, i);
+        }
+
+        /** The patterns that may match at the parsing position of the pipe,
+            as a bit for each pattern, bit 0 for the first. Those left out
+            differ from the data available in their fixed start.
+            \param pipe the buffered pipe, set to the position to match
+            \param len the number of bytes available from the position
+        */
+        uint32_t candidates(Pipe<char>* pipe, int len) const
+        {
+            uint32_t found = 0;
+            int node = 0;
+            for (int o = 0; ; o ++) {
+                found |= _nodes[node].ends;
+                if (o == len) {
+                    // the longer patterns wait for more data
+                    found |= _nodes[node].below;
+                    break;
+                }
+                node = _child(node, pipe->next());
+                if (!node)
+                    break;
+            }
+            return found;
+        }
+    };
+
+    static const Trie& _trie(void)
+    {
+        static const Trie trie;
+        return trie;
+    }
+};
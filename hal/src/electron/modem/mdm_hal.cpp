@@ -30,6 +30,7 @@
 #include "pinmap_impl.h"
 #include "gpio_hal.h"
 #include "mdmapn_hal.h"
+#include "socketwrite_hal.h"
 #include "stm32f2xx.h"
 #include "service_debug.h"
 #include "concurrent_hal.h"
@@ -46,6 +47,7 @@ std::recursive_mutex mdm_mutex;
 #define PROFILE         "0"   //!< this is the psd profile used
 #define MAX_SIZE        1024  //!< max expected messages (used with RX)
 #define USO_MAX_WRITE   1024  //!< maximum number of bytes to write to socket (used with TX)
+#define USO_MAX_READ    960   //!< maximum number of bytes to read from socket, the response must fit the rx pipe
 // num sockets
 #define NUMSOCKETS      ((int)(sizeof(_sockets)/sizeof(*_sockets)))
 //! test if it is a socket is ok to use
@@ -173,6 +175,7 @@ MDMParser::MDMParser(void)
     memset(_sockets, 0, sizeof(_sockets));
     for (int socket = 0; socket < NUMSOCKETS; socket ++)
         _sockets[socket].handle = MDM_SOCKET_ERROR;
+    _payload = NULL;
 #ifdef MDM_DEBUG
     _debugLevel = 3;
     _debugTime = HAL_Timer_Get_Milli_Seconds();
@@ -254,90 +257,24 @@ int MDMParser::waitFinalResp(_CALLBACKPTR cb /* = NULL*/,
             int type = TYPE(ret);
             // handle unsolicited commands here
             if (type == TYPE_PLUS) {
+                typedef void (MDMParser::*URCPTR)(const char* name, const char* args);
+                static const struct {
+                    const char* name;   URCPTR handler;
+                } urcs[] = {
+                    { "CMTI",           &MDMParser::_urcCMTI    },
+                    { "CIEV",           &MDMParser::_urcCIEV    },
+                    { "UUSORD",         &MDMParser::_urcUUSORD  },
+                    { "UUSORF",         &MDMParser::_urcUUSORD  },
+                    { "UUSOCL",         &MDMParser::_urcUUSOCL  },
+                    { "UUPSDD",         &MDMParser::_urcUUPSDD  },
+                    { "CREG",           &MDMParser::_urcCREG    },
+                    { "CGREG",          &MDMParser::_urcCREG    },
+                };
                 const char* cmd = buf+3;
-                int a, b, c, d, r;
-                char s[32];
-
-                // SMS Command ---------------------------------
-                // +CNMI: <mem>,<index>
-                if (sscanf(cmd, "CMTI: \"%*[^\"]\",%d", &a) == 1) {
-                    DEBUG_D("New SMS at index %d\r\n", a);
-                }
-                else if ((sscanf(cmd, "CIEV: 9,%d", &a) == 1)) {
-                    DEBUG_D("CIEV matched: 9,%d\r\n", a);
-                    // Wait until the system is attached before attempting to act on GPRS detach
-                    if (_attached) {
-                        _attached_urc = (a==2)?1:0;
-                        if (!_attached_urc) ARM_GPRS_TIMEOUT(15*1000); // If detached, set WDT
-                        else CLR_GPRS_TIMEOUT(); // else if re-attached clear WDT.
-                    }
-                // Socket Specific Command ---------------------------------
-                // +UUSORD: <socket>,<length>
-                } else if ((sscanf(cmd, "UUSORD: %d,%d", &a, &b) == 2)) {
-                    int socket = _findSocket(a);
-                    DEBUG_D("Socket %d: handle %d has %d bytes pending\r\n", socket, a, b);
-                    if (socket != MDM_SOCKET_ERROR)
-                        _sockets[socket].pending = b;
-                // +UUSORF: <socket>,<length>
-                } else if ((sscanf(cmd, "UUSORF: %d,%d", &a, &b) == 2)) {
-                    int socket = _findSocket(a);
-                    DEBUG_D("Socket %d: handle %d has %d bytes pending\r\n", socket, a, b);
-                    if (socket != MDM_SOCKET_ERROR)
-                        _sockets[socket].pending = b;
-                // +UUSOCL: <socket>
-                } else if ((sscanf(cmd, "UUSOCL: %d", &a) == 1)) {
-                    int socket = _findSocket(a);
-                    DEBUG_D("Socket %d: handle %d closed by remote host\r\n", socket, a);
-                    if (socket != MDM_SOCKET_ERROR) {
-                        _socketFree(socket);
-                    }
-                }
-
-                // GSM/UMTS Specific -------------------------------------------
-                // +UUPSDD: <profile_id>
-                if (sscanf(cmd, "UUPSDD: %s", s) == 1) {
-                    DEBUG_D("UUPSDD: %s matched\r\n", PROFILE);
-                    if ( !strcmp(s, PROFILE) ) {
-                        _ip = NOIP;
-                        _attached = false;
-                        DEBUG("PDP context deactivated remotely!\r\n");
-                        // PDP context was remotely deactivated via URC,
-                        // Notify system of disconnect.
-                        HAL_NET_notify_dhcp(false);
-                    }
-                } else {
-                    // +CREG|CGREG: <n>,<stat>[,<lac>,<ci>[,AcT[,<rac>]]] // reply to AT+CREG|AT+CGREG
-                    // +CREG|CGREG: <stat>[,<lac>,<ci>[,AcT[,<rac>]]]     // URC
-                    b = (int)0xFFFF; c = (int)0xFFFFFFFF; d = -1;
-                    r = sscanf(cmd, "%s %*d,%d,\"%x\",\"%x\",%d",s,&a,&b,&c,&d);
-                    if (r <= 1)
-                        r = sscanf(cmd, "%s %d,\"%x\",\"%x\",%d",s,&a,&b,&c,&d);
-                    if (r >= 2) {
-                        Reg *reg = !strcmp(s, "CREG:")  ? &_net.csd :
-                                   !strcmp(s, "CGREG:") ? &_net.psd : NULL;
-                        if (reg) {
-                            // network status
-                            if      (a == 0) *reg = REG_NONE;     // 0: not registered, home network
-                            else if (a == 1) *reg = REG_HOME;     // 1: registered, home network
-                            else if (a == 2) *reg = REG_NONE;     // 2: not registered, but MT is currently searching a new operator to register to
-                            else if (a == 3) *reg = REG_DENIED;   // 3: registration denied
-                            else if (a == 4) *reg = REG_UNKNOWN;  // 4: unknown
-                            else if (a == 5) *reg = REG_ROAMING;  // 5: registered, roaming
-                            if ((r >= 3) && (b != (int)0xFFFF))      _net.lac = b; // location area code
-                            if ((r >= 4) && (c != (int)0xFFFFFFFF))  _net.ci  = c; // cell ID
-                            // access technology
-                            if (r >= 5) {
-                                if      (d == 0) _net.act = ACT_GSM;      // 0: GSM
-                                else if (d == 1) _net.act = ACT_GSM;      // 1: GSM COMPACT
-                                else if (d == 2) _net.act = ACT_UTRAN;    // 2: UTRAN
-                                else if (d == 3) _net.act = ACT_EDGE;     // 3: GSM with EDGE availability
-                                else if (d == 4) _net.act = ACT_UTRAN;    // 4: UTRAN with HSDPA availability
-                                else if (d == 5) _net.act = ACT_UTRAN;    // 5: UTRAN with HSUPA availability
-                                else if (d == 6) _net.act = ACT_UTRAN;    // 6: UTRAN with HSDPA and HSUPA availability
-                            }
-                        }
-                    }
-                }
+                int len = LENGTH(ret) - 3;
+                const auto* urc = AtTokenizer::findUrc(cmd, len, urcs);
+                if (urc)
+                    (this->*urc->handler)(urc->name, cmd + strlen(urc->name) + 1);
             } // end ==TYPE_PLUS
             if (cb) {
                 int len = LENGTH(ret);
@@ -362,6 +299,109 @@ int MDMParser::waitFinalResp(_CALLBACKPTR cb /* = NULL*/,
     return WAIT;
 }
 
+// SMS Command ---------------------------------
+// +CMTI: <mem>,<index>
+void MDMParser::_urcCMTI(const char* name, const char* args)
+{
+    int a;
+    if (sscanf(args, " \"%*[^\"]\",%d", &a) == 1) {
+        DEBUG_D("New SMS at index %d\r\n", a);
+    }
+}
+
+// +CIEV: <descr>,<value>
+void MDMParser::_urcCIEV(const char* name, const char* args)
+{
+    int a;
+    if (sscanf(args, " 9,%d", &a) == 1) {
+        DEBUG_D("CIEV matched: 9,%d\r\n", a);
+        // Wait until the system is attached before attempting to act on GPRS detach
+        if (_attached) {
+            _attached_urc = (a==2)?1:0;
+            if (!_attached_urc) ARM_GPRS_TIMEOUT(15*1000); // If detached, set WDT
+            else CLR_GPRS_TIMEOUT(); // else if re-attached clear WDT.
+        }
+    }
+}
+
+// Socket Specific Command ---------------------------------
+// +UUSORD: <socket>,<length>
+// +UUSORF: <socket>,<length>
+void MDMParser::_urcUUSORD(const char* name, const char* args)
+{
+    int a, b;
+    if (sscanf(args, " %d,%d", &a, &b) == 2) {
+        int socket = _findSocket(a);
+        DEBUG_D("Socket %d: handle %d has %d bytes pending\r\n", socket, a, b);
+        if (socket != MDM_SOCKET_ERROR)
+            _sockets[socket].pending = b;
+    }
+}
+
+// +UUSOCL: <socket>
+void MDMParser::_urcUUSOCL(const char* name, const char* args)
+{
+    int a;
+    if (sscanf(args, " %d", &a) == 1) {
+        int socket = _findSocket(a);
+        DEBUG_D("Socket %d: handle %d closed by remote host\r\n", socket, a);
+        if (socket != MDM_SOCKET_ERROR) {
+            _socketFree(socket);
+        }
+    }
+}
+
+// GSM/UMTS Specific -------------------------------------------
+// +UUPSDD: <profile_id>
+void MDMParser::_urcUUPSDD(const char* name, const char* args)
+{
+    char s[32];
+    if (sscanf(args, " %31s", s) == 1) {
+        DEBUG_D("UUPSDD: %s matched\r\n", PROFILE);
+        if ( !strcmp(s, PROFILE) ) {
+            _ip = NOIP;
+            _attached = false;
+            DEBUG("PDP context deactivated remotely!\r\n");
+            // PDP context was remotely deactivated via URC,
+            // Notify system of disconnect.
+            HAL_NET_notify_dhcp(false);
+        }
+    }
+}
+
+// +CREG|CGREG: <n>,<stat>[,<lac>,<ci>[,AcT[,<rac>]]] // reply to AT+CREG|AT+CGREG
+// +CREG|CGREG: <stat>[,<lac>,<ci>[,AcT[,<rac>]]]     // URC
+void MDMParser::_urcCREG(const char* name, const char* args)
+{
+    int a, b = (int)0xFFFF, c = (int)0xFFFFFFFF, d = -1;
+    // r counts the name, as the fields are numbered from it
+    int r = sscanf(args, " %*d,%d,\"%x\",\"%x\",%d",&a,&b,&c,&d) + 1;
+    if (r <= 1)
+        r = sscanf(args, " %d,\"%x\",\"%x\",%d",&a,&b,&c,&d) + 1;
+    if (r >= 2) {
+        Reg *reg = !strcmp(name, "CREG") ? &_net.csd : &_net.psd;
+        // network status
+        if      (a == 0) *reg = REG_NONE;     // 0: not registered, home network
+        else if (a == 1) *reg = REG_HOME;     // 1: registered, home network
+        else if (a == 2) *reg = REG_NONE;     // 2: not registered, but MT is currently searching a new operator to register to
+        else if (a == 3) *reg = REG_DENIED;   // 3: registration denied
+        else if (a == 4) *reg = REG_UNKNOWN;  // 4: unknown
+        else if (a == 5) *reg = REG_ROAMING;  // 5: registered, roaming
+        if ((r >= 3) && (b != (int)0xFFFF))      _net.lac = b; // location area code
+        if ((r >= 4) && (c != (int)0xFFFFFFFF))  _net.ci  = c; // cell ID
+        // access technology
+        if (r >= 5) {
+            if      (d == 0) _net.act = ACT_GSM;      // 0: GSM
+            else if (d == 1) _net.act = ACT_GSM;      // 1: GSM COMPACT
+            else if (d == 2) _net.act = ACT_UTRAN;    // 2: UTRAN
+            else if (d == 3) _net.act = ACT_EDGE;     // 3: GSM with EDGE availability
+            else if (d == 4) _net.act = ACT_UTRAN;    // 4: UTRAN with HSDPA availability
+            else if (d == 5) _net.act = ACT_UTRAN;    // 5: UTRAN with HSUPA availability
+            else if (d == 6) _net.act = ACT_UTRAN;    // 6: UTRAN with HSDPA and HSUPA availability
+        }
+    }
+}
+
 int MDMParser::_cbString(int type, const char* buf, int len, char* str)
 {
     if (str && (type == TYPE_UNKNOWN)) {
@@ -1661,61 +1701,49 @@ bool MDMParser::socketFree(int socket)
 int MDMParser::socketSend(int socket, const char * buf, int len)
 {
     //DEBUG_D("socketSend(%d,,%d)\r\n", socket,len);
-    int cnt = len;
-    while (cnt > 0) {
-        int blk = USO_MAX_WRITE;
-        if (cnt < blk)
-            blk = cnt;
-        bool ok = false;
-        {
-            LOCK();
-            if (ISSOCKET(socket)) {
-                sendFormated("AT+USOWR=%d,%d\r\n",_sockets[socket].handle,blk);
-                if (RESP_PROMPT == waitFinalResp()) {
-                    HAL_Delay_Milliseconds(50);
-                    send(buf, blk);
-                    if (RESP_OK == waitFinalResp())
-                        ok = true;
-                }
-            }
-            UNLOCK();
+    struct Modem {
+        MDMParser* mdm;
+        int handle;
+        void command(int blk) { mdm->sendFormated("AT+USOWR=%d,%d\r\n", handle, blk); }
+        void data(const char* buf, int blk) { HAL_Delay_Milliseconds(50); mdm->send(buf, blk); }
+        int response(void) { return mdm->waitFinalResp(); }
+    };
+    int ret = MDM_SOCKET_ERROR;
+    {
+        // held for the whole write, the next command is sent before the previous one completes
+        LOCK();
+        if (ISSOCKET(socket)) {
+            Modem modem = { this, _sockets[socket].handle };
+            ret = socketWritePipelined(modem, buf, len, USO_MAX_WRITE);
         }
-        if (!ok)
-            return MDM_SOCKET_ERROR;
-        buf += blk;
-        cnt -= blk;
+        UNLOCK();
     }
-    return (len - cnt);
+    return ret;
 }
 
 int MDMParser::socketSendTo(int socket, MDM_IP ip, int port, const char * buf, int len)
 {
     DEBUG_D("socketSendTo(%d," IPSTR ",%d,,%d)\r\n", socket,IPNUM(ip),port,len);
-    int cnt = len;
-    while (cnt > 0) {
-        int blk = USO_MAX_WRITE;
-        if (cnt < blk)
-            blk = cnt;
-        bool ok = false;
-        {
-            LOCK();
-            if (ISSOCKET(socket)) {
-                sendFormated("AT+USOST=%d,\"" IPSTR "\",%d,%d\r\n",_sockets[socket].handle,IPNUM(ip),port,blk);
-                if (RESP_PROMPT == waitFinalResp()) {
-                    HAL_Delay_Milliseconds(50);
-                    send(buf, blk);
-                    if (RESP_OK == waitFinalResp())
-                        ok = true;
-                }
-            }
-            UNLOCK();
+    struct Modem {
+        MDMParser* mdm;
+        int handle;
+        MDM_IP ip;
+        int port;
+        void command(int blk) { mdm->sendFormated("AT+USOST=%d,\"" IPSTR "\",%d,%d\r\n", handle, IPNUM(ip), port, blk); }
+        void data(const char* buf, int blk) { HAL_Delay_Milliseconds(50); mdm->send(buf, blk); }
+        int response(void) { return mdm->waitFinalResp(); }
+    };
+    int ret = MDM_SOCKET_ERROR;
+    {
+        // held for the whole write, the next command is sent before the previous one completes
+        LOCK();
+        if (ISSOCKET(socket)) {
+            Modem modem = { this, _sockets[socket].handle, ip, port };
+            ret = socketWritePipelined(modem, buf, len, USO_MAX_WRITE);
         }
-        if (!ok)
-            return MDM_SOCKET_ERROR;
-        buf += blk;
-        cnt -= blk;
+        UNLOCK();
     }
-    return (len - cnt);
+    return ret;
 }
 
 int MDMParser::socketReadable(int socket)
@@ -1739,8 +1767,12 @@ int MDMParser::_cbUSORD(int type, const char* buf, int len, USORDparam* param)
 {
     if ((type == TYPE_PLUS) && param) {
         int sz, sk;
-        if ((sscanf(buf, "\r\n+USORD: %d,%d,", &sk, &sz) == 2) &&
-            (buf[len-sz-2] == '\"') && (buf[len-1] == '\"')) {
+        if (sscanf(buf, "\r\n+USORD: %d,%d,", &sk, &sz) != 2) {
+            param->len = 0;
+        } else if (param->payload.len == sz) {
+            // the data went straight to param->buf
+            param->len = sz;
+        } else if ((buf[len-sz-2] == '\"') && (buf[len-1] == '\"')) {
             memcpy(param->buf, &buf[len-1-sz], sz);
             param->len = sz;
         } else {
@@ -1762,7 +1794,7 @@ int MDMParser::socketRecv(int socket, char* buf, int len)
     system_tick_t start = HAL_Timer_Get_Milli_Seconds();
     while (len) {
         // DEBUG_D("socketRecv: LEN: %d\r\n", len);
-        int blk = MAX_SIZE; // still need space for headers and unsolicited  commands
+        int blk = USO_MAX_READ;
         if (len < blk) blk = len;
         bool ok = false;
         {
@@ -1787,7 +1819,12 @@ int MDMParser::socketRecv(int socket, char* buf, int len)
                             sendFormated("AT+USORD=%d,%d\r\n",_sockets[socket].handle, blk);
                             USORDparam param;
                             param.buf = buf;
-                            if (RESP_OK == waitFinalResp(_cbUSORD, &param)) {
+                            param.len = 0;
+                            param.payload = { buf, blk, -1 };
+                            _payload = &param.payload;
+                            int resp = waitFinalResp(_cbUSORD, &param);
+                            _payload = NULL;
+                            if (RESP_OK == resp) {
                                 blk = param.len;
                                 _sockets[socket].pending -= blk;
                                 len -= blk;
@@ -1827,8 +1864,10 @@ int MDMParser::_cbUSORF(int type, const char* buf, int len, USORFparam* param)
         int sz, sk, p, a,b,c,d;
         int r = sscanf(buf, "\r\n+USORF: %d,\"" IPSTR "\",%d,%d,",
             &sk,&a,&b,&c,&d,&p,&sz);
-        if ((r == 7) && (buf[len-sz-2] == '\"') && (buf[len-1] == '\"')) {
-            memcpy(param->buf, &buf[len-1-sz], sz);
+        bool direct = (r == 7) && (param->payload.len == sz);
+        if (direct || ((r == 7) && (buf[len-sz-2] == '\"') && (buf[len-1] == '\"'))) {
+            if (!direct)
+                memcpy(param->buf, &buf[len-1-sz], sz);
             param->ip = IPADR(a,b,c,d);
             param->port = p;
             param->len = sz;
@@ -1848,7 +1887,7 @@ int MDMParser::socketRecvFrom(int socket, MDM_IP* ip, int* port, char* buf, int
 #endif
     system_tick_t start = HAL_Timer_Get_Milli_Seconds();
     while (len) {
-        int blk = MAX_SIZE; // still need space for headers and unsolicited commands
+        int blk = USO_MAX_READ;
         if (len < blk) blk = len;
         bool ok = false;
         {
@@ -1858,7 +1897,12 @@ int MDMParser::socketRecvFrom(int socket, MDM_IP* ip, int* port, char* buf, int
                     sendFormated("AT+USORF=%d,%d\r\n",_sockets[socket].handle, blk);
                     USORFparam param;
                     param.buf = buf;
-                    if (RESP_OK == waitFinalResp(_cbUSORF, &param)) {
+                    param.len = 0;
+                    param.payload = { buf, blk, -1 };
+                    _payload = &param.payload;
+                    int resp = waitFinalResp(_cbUSORF, &param);
+                    _payload = NULL;
+                    if (RESP_OK == resp) {
                         *ip = param.ip;
                         *port = param.port;
                         blk = param.len;
@@ -2137,135 +2181,9 @@ void MDMParser::dumpIp(MDM_IP ip)
 }
 
 // ----------------------------------------------------------------
-int MDMParser::_parseMatch(Pipe<char>* pipe, int len, const char* sta, const char* end)
-{
-    int o = 0;
-    if (sta) {
-        while (*sta) {
-            if (++o > len)                  return WAIT;
-            char ch = pipe->next();
-            if (*sta++ != ch)               return NOT_FOUND;
-        }
-    }
-    if (!end)                               return o; // no termination
-    // at least any char
-    if (++o > len)                      return WAIT;
-    pipe->next();
-    // check the end
-    int x = 0;
-    while (end[x]) {
-        if (++o > len)                      return WAIT;
-        char ch = pipe->next();
-        x = (end[x] == ch) ? x + 1 :
-            (end[0] == ch) ? 1 :
-                            0;
-    }
-    return o;
-}
-
-int MDMParser::_parseFormated(Pipe<char>* pipe, int len, const char* fmt)
-{
-    int o = 0;
-    int num = 0;
-    if (fmt) {
-        while (*fmt) {
-            if (++o > len)                  return WAIT;
-            char ch = pipe->next();
-            if (*fmt == '%') {
-                fmt++;
-                if (*fmt == 'd') { // numeric
-                    fmt ++;
-                    num = 0;
-                    while (ch >= '0' && ch <= '9') {
-                        num = num * 10 + (ch - '0');
-                        if (++o > len)      return WAIT;
-                        ch = pipe->next();
-                    }
-                }
-                else if (*fmt == 'c') { // char buffer (takes last numeric as length)
-                    fmt ++;
-                    while (num --) {
-                        if (++o > len)      return WAIT;
-                        ch = pipe->next();
-                    }
-                }
-                else if (*fmt == 's') {
-                    fmt ++;
-                    if (ch != '\"')         return NOT_FOUND;
-                    do {
-                        if (++o > len)      return WAIT;
-                        ch = pipe->next();
-                    } while (ch != '\"');
-                    if (++o > len)          return WAIT;
-                    ch = pipe->next();
-                }
-            }
-            if (*fmt++ != ch)               return NOT_FOUND;
-        }
-    }
-    return o;
-}
-
-int MDMParser::_getLine(Pipe<char>* pipe, char* buf, int len)
+int MDMParser::_getLine(Pipe<char>* pipe, char* buf, int len, AtTokenizer::Payload* payload)
 {
-    int unkn = 0;
-    int sz = pipe->size();
-    int fr = pipe->free();
-    if (len > sz)
-        len = sz;
-    while (len > 0)
-    {
-        static struct {
-              const char* fmt;                              int type;
-        } lutF[] = {
-            { "\r\n+USORD: %d,%d,\"%c\"",                   TYPE_PLUS       },
-            { "\r\n+USORF: %d,\"" IPSTR "\",%d,%d,\"%c\"",  TYPE_PLUS       },
-            { "\r\n+URDFILE: %s,%d,\"%c\"",                 TYPE_PLUS       },
-        };
-        static struct {
-              const char* sta;          const char* end;    int type;
-        } lut[] = {
-            { "\r\nOK\r\n",             NULL,               TYPE_OK         },
-            { "\r\nERROR\r\n",          NULL,               TYPE_ERROR      },
-            { "\r\n+CME ERROR:",        "\r\n",             TYPE_ERROR      },
-            { "\r\n+CMS ERROR:",        "\r\n",             TYPE_ERROR      },
-            { "\r\nRING\r\n",           NULL,               TYPE_RING       },
-            { "\r\nCONNECT\r\n",        NULL,               TYPE_CONNECT    },
-            { "\r\nNO CARRIER\r\n",     NULL,               TYPE_NOCARRIER  },
-            { "\r\nNO DIALTONE\r\n",    NULL,               TYPE_NODIALTONE },
-            { "\r\nBUSY\r\n",           NULL,               TYPE_BUSY       },
-            { "\r\nNO ANSWER\r\n",      NULL,               TYPE_NOANSWER   },
-            { "\r\n+",                  "\r\n",             TYPE_PLUS       },
-            { "\r\n@",                  NULL,               TYPE_PROMPT     }, // Sockets
-            { "\r\n>",                  NULL,               TYPE_PROMPT     }, // SMS
-            { "\n>",                    NULL,               TYPE_PROMPT     }, // File
-            { "\r\nABORTED\r\n",        NULL,               TYPE_ABORTED    }, // Current command aborted
-        };
-        for (int i = 0; i < (int)(sizeof(lutF)/sizeof(*lutF)); i ++) {
-            pipe->set(unkn);
-            int ln = _parseFormated(pipe, len, lutF[i].fmt);
-            if (ln == WAIT && fr)
-                return WAIT;
-            if ((ln != NOT_FOUND) && (unkn > 0))
-                return TYPE_UNKNOWN | pipe->get(buf, unkn);
-            if (ln > 0)
-                return lutF[i].type  | pipe->get(buf, ln);
-        }
-        for (int i = 0; i < (int)(sizeof(lut)/sizeof(*lut)); i ++) {
-            pipe->set(unkn);
-            int ln = _parseMatch(pipe, len, lut[i].sta, lut[i].end);
-            if (ln == WAIT && fr)
-                return WAIT;
-            if ((ln != NOT_FOUND) && (unkn > 0))
-                return TYPE_UNKNOWN | pipe->get(buf, unkn);
-            if (ln > 0)
-                return lut[i].type | pipe->get(buf, ln);
-        }
-        // UNKNOWN
-        unkn ++;
-        len--;
-    }
-    return WAIT;
+    return AtTokenizer::getLine(pipe, buf, len, payload);
 }
 
 // ----------------------------------------------------------------
@@ -2294,5 +2212,5 @@ int MDMElectronSerial::_send(const void* buf, int len)
 
 int MDMElectronSerial::getLine(char* buffer, int length)
 {
-    return _getLine(&_pipeRx, buffer, length);
+    return _getLine(&_pipeRx, buffer, length, _payload);
 }
@@ -29,6 +29,7 @@
 #include "pinmap_hal.h"
 #include "system_tick_hal.h"
 #include "enums_hal.h"
+#include "attokenizer_hal.h"
 
 /* Include for debug capabilty */
 #define MDM_DEBUG
@@ -447,28 +448,12 @@ protected:
         \param pipe the receiving buffer pipe
         \param buf the parsed line
         \param len the size of the parsed line
+        \param payload where to put the data of a socket read, see AtTokenizer::getLine
         \return type and length if something was found,
                 WAIT if not enough data is available
                 NOT_FOUND if nothing was found
     */
-    static int _getLine(Pipe<char>* pipe, char* buffer, int length);
-
-    /** Helper: Parse a match from the pipe
-        \param pipe the buffered pipe
-        \param number of bytes to parse at maximum,
-        \param sta the starting string, NULL if none
-        \param end the terminating string, NULL if none
-        \return size of parsed match
-    */
-    static int _parseMatch(Pipe<char>* pipe, int len, const char* sta, const char* end);
-
-    /** Helper: Parse a match from the pipe
-        \param pipe the buffered pipe
-        \param number of bytes to parse at maximum,
-        \param fmt the formating string (%d any number, %c any char of last %d len)
-        \return size of parsed match
-    */
-    static int _parseFormated(Pipe<char>* pipe, int len, const char* fmt);
+    static int _getLine(Pipe<char>* pipe, char* buffer, int length, AtTokenizer::Payload* payload = NULL);
 
 protected:
     // for rtos over riding by useing Rtos<MDMxx>
@@ -500,9 +485,9 @@ protected:
     static int _cbUDNSRN(int type, const char* buf, int len, MDM_IP* ip);
     static int _cbUSOCR(int type, const char* buf, int len, int* handle);
     static int _cbUSOCTL(int type, const char* buf, int len, int* handle);
-    typedef struct { char* buf; int len; } USORDparam;
+    typedef struct { char* buf; int len; AtTokenizer::Payload payload; } USORDparam;
     static int _cbUSORD(int type, const char* buf, int len, USORDparam* param);
-    typedef struct { char* buf; MDM_IP ip; int port; int len; } USORFparam;
+    typedef struct { char* buf; MDM_IP ip; int port; int len; AtTokenizer::Payload payload; } USORFparam;
     static int _cbUSORF(int type, const char* buf, int len, USORFparam* param);
     typedef struct { char* buf; char* num; } CMGRparam;
     static int _cbCUSD(int type, const char* buf, int len, char* resp);
@@ -530,11 +515,20 @@ protected:
     // LISA-C has 6 TCP and 6 UDP sockets
     // LISA-U and SARA-G have 7 sockets
     SockCtrl _sockets[7];
+    //! where the data of the socket read in progress goes, NULL when there is none
+    AtTokenizer::Payload* _payload;
     int _findSocket(int handle = MDM_SOCKET_ERROR/* = CREATE*/);
     int _socketCloseHandleIfOpen(int socket);
     int _socketCloseUnusedHandles(void);
     int _socketSocket(int socket, IpProtocol ipproto, int port);
     bool _socketFree(int socket);
+    // unsolicited result codes and registration responses, dispatched by name from #waitFinalResp
+    void _urcCMTI(const char* name, const char* args);
+    void _urcCIEV(const char* name, const char* args);
+    void _urcUUSORD(const char* name, const char* args);
+    void _urcUUSOCL(const char* name, const char* args);
+    void _urcUUPSDD(const char* name, const char* args);
+    void _urcCREG(const char* name, const char* args);
     bool _powerOn(void);
     void _setBandSelectString(MDM_BandSelect &data, char* bands, int index=0); // private helper to create bands strings
     static MDMParser* inst;
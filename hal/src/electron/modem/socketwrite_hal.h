@@ -0,0 +1,82 @@
+/*
+ ******************************************************************************
+ *  Copyright (c) 2015 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#pragma once
+
+#include "enums_hal.h"
+
+/** Writes socket data a block at a time with a command such as AT+USOWR or
+    AT+USOST, each answered with the "@" prompt for the data of the block
+    and then the final response once the data is written.
+
+    The command for the next block is sent right after the data of a block,
+    so the modem has it queued while the block is written and prompts for
+    the next block straight after the final response, rather than after a
+    round trip to the host and back.
+
+    \param modem provides
+           void command(int blk)                - sends the command for a block of blk bytes
+           void data(const char* buf, int blk)  - sends the data of a block after its prompt
+           int response()                       - waits for the next final response or prompt,
+                                                  the result of #waitFinalResp
+    \param buf the data to write
+    \param len the length of the data
+    \param max_block the most bytes the command takes at a time
+    \return len, or MDM_SOCKET_ERROR if any block was not written
+*/
+template <typename Modem>
+int socketWritePipelined(Modem& modem, const char* buf, int len, int max_block)
+{
+    int offset = 0;     // the bytes sent as data
+    int queued = 0;     // the block with its command sent, waiting for the prompt
+    int written = 0;    // the block with its data sent, waiting for the final response
+    bool ok = true;
+    if (len > 0) {
+        queued = (len < max_block) ? len : max_block;
+        modem.command(queued);
+    }
+    while (queued || written) {
+        int ret = modem.response();
+        if ((ret == RESP_OK) && written) {
+            written = 0;
+        }
+        else if ((ret == RESP_PROMPT) && queued && !written) {
+            // a prompted modem waits for the data, even when an earlier block failed
+            modem.data(buf + offset, queued);
+            offset += queued;
+            written = queued;
+            queued = 0;
+            if (ok && (offset < len)) {
+                queued = (len - offset < max_block) ? len - offset : max_block;
+                modem.command(queued);
+            }
+        }
+        else {
+            ok = false;
+            if (ret == WAIT)
+                break;
+            // the response is for the oldest block outstanding
+            if (written)
+                written = 0;
+            else
+                queued = 0;
+        }
+    }
+    return ok ? len : MDM_SOCKET_ERROR;
+}
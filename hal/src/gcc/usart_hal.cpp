@@ -240,3 +240,18 @@ uint32_t HAL_USART_Write_NineBitData(HAL_USART_Serial serial, uint16_t data)
 {
     return usartMap(serial).write((uint8_t) data);
 }
+
+int32_t HAL_USART_Write_Block(HAL_USART_Serial serial, const uint8_t* data, uint32_t size, bool blocking, void* reserved)
+{
+    return -1;
+}
+
+int32_t HAL_USART_Read_Block(HAL_USART_Serial serial, uint8_t* data, uint32_t size, void* reserved)
+{
+    return -1;
+}
+
+int32_t HAL_USART_Get_Stats(HAL_USART_Serial serial, HAL_USART_Stats* stats, void* reserved)
+{
+    return -1;
+}
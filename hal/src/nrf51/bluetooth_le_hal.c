@@ -16,6 +16,7 @@
  */
 
 /* Includes ------------------------------------------------------------------*/
+#include <string.h>
 #include "bluetooth_le_hal.h"
 #include "hw_config.h"
 #include "hw_gateway_config.h"
@@ -86,4 +87,20 @@ void HAL_BLE_Set_Gateway_Target(char* name)
 #if PLATFORM_ID==269
     set_gateway_target_name(name);
 #endif
-}
\ No newline at end of file
+}
+
+void HAL_BLE_Get_TX_Stats(BLUETOOTH_LE_TX_STATS* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+#if PLATFORM_ID==103
+    scs_tx_stats_t scs_stats;
+    scs_tx_stats(&scs_stats);
+    stats->messages = scs_stats.messages;
+    stats->bytes = scs_stats.bytes;
+    stats->notifications = scs_stats.notifications;
+    stats->tx_complete = scs_stats.tx_complete;
+    stats->queue_full_waits = scs_stats.queue_full_waits;
+    stats->dropped_messages = scs_stats.dropped_messages;
+    stats->queue_high_water = scs_stats.queue_high_water;
+#endif
+}
@@ -0,0 +1,127 @@
+/**
+ Copyright (c) 2015 MidAir Technology, LLC.  All rights reserved.
+ 
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+ 
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "eeprom_hal.h"
+#include "eeprom_emulation_impl.h"
+#include <stdint.h>
+#include <string.h>
+
+FlashEEPROM flashEEPROM;
+
+/*
+ * The external flash isn't available yet when the EEPROM object is
+ * constructed, so the emulation is initialized on first use.
+ */
+static bool eeprom_initialized = false;
+
+/*
+ * Earlier firmware stored the EEPROM as a raw 512 byte image at the start of
+ * the first sector, followed by a byte set to 1 when the image was valid.
+ * Move that data into the record format so it survives the upgrade.
+ *
+ * The records are built in the swap sector and the image is only erased
+ * once they are active, so a reset during the move repeats it on the next
+ * boot rather than losing the data.
+ */
+static bool has_legacy_image()
+{
+    uint32_t status = flashEEPROM.readPageStatus(FlashEEPROM::LogicalPage::Page1);
+    if (status == FlashEEPROM::PageHeader::COPY ||
+        status == FlashEEPROM::PageHeader::ACTIVE ||
+        status == FlashEEPROM::PageHeader::INACTIVE) {
+        return false;
+    }
+    // moved, but reset before the image was erased
+    status = flashEEPROM.readPageStatus(FlashEEPROM::LogicalPage::Page2);
+    if (status == FlashEEPROM::PageHeader::ACTIVE ||
+        status == FlashEEPROM::PageHeader::INACTIVE) {
+        return false;
+    }
+    return sFLASH_ReadSingleByte(FLASH_STORAGE_ADDRESS + USER_STORAGE_AVAILABLE) == 1;
+}
+
+static void migrate_legacy_image()
+{
+    uint8_t buf[FlashEEPROM::Capacity];
+    sFLASH_ReadBuffer(buf, FLASH_STORAGE_ADDRESS, sizeof(buf));
+    flashEEPROM.importToPage2(buf, sizeof(buf));
+}
+
+static void ensure_initialized()
+{
+    if (!eeprom_initialized) {
+        eeprom_initialized = true;
+        if (has_legacy_image()) {
+            migrate_legacy_image();
+        }
+        flashEEPROM.init();
+    }
+}
+
+void HAL_EEPROM_Init(void)
+{
+}
+
+size_t HAL_EEPROM_Length()
+{
+    return flashEEPROM.capacity();
+}
+
+uint8_t HAL_EEPROM_Read(uint32_t address)
+{
+    ensure_initialized();
+    uint8_t value = 0xFF;
+    flashEEPROM.get(address, value);
+    return value;
+}
+
+void HAL_EEPROM_Write(uint32_t address, uint8_t data)
+{
+    ensure_initialized();
+    flashEEPROM.put(address, data);
+}
+
+void HAL_EEPROM_Get(uint32_t index, void *data, size_t length)
+{
+    ensure_initialized();
+    flashEEPROM.get(index, data, length);
+}
+
+void HAL_EEPROM_Put(uint32_t index, const void *data, size_t length)
+{
+    ensure_initialized();
+    flashEEPROM.put(index, data, length);
+}
+
+void HAL_EEPROM_Clear()
+{
+    ensure_initialized();
+    flashEEPROM.clear();
+}
+
+bool HAL_EEPROM_Has_Pending_Erase()
+{
+    ensure_initialized();
+    return flashEEPROM.hasPendingErase();
+}
+
+void HAL_EEPROM_Perform_Pending_Erase()
+{
+    ensure_initialized();
+    flashEEPROM.performPendingErase();
+}
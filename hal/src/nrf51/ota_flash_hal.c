@@ -219,7 +219,8 @@ int HAL_FLASH_Update(const uint8_t *pBuffer, uint32_t address, uint32_t length,
 
 hal_update_complete_t HAL_FLASH_End(void* reserved)
 {
-    FLASH_End();
+    if (!FLASH_End())
+        return HAL_UPDATE_ERROR;
     return HAL_UPDATE_APPLIED_PENDING_RESTART;
 }
 
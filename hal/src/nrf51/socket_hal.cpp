@@ -34,6 +34,16 @@ sock_result_t socket_receive(sock_handle_t sd, void* buffer, socklen_t len, syst
   return SocketManager::instance()->receive(sd, buffer, len, _timeout);
 }
 
+sock_result_t socket_peek(sock_handle_t sd, const uint8_t** data, void* reserved)
+{
+    return SocketManager::instance()->peek(sd, data);
+}
+
+sock_result_t socket_consume(sock_handle_t sd, socklen_t len, void* reserved)
+{
+    return SocketManager::instance()->consume(sd, len);
+}
+
 sock_result_t socket_create_nonblocking_server(sock_handle_t sock, uint16_t port)
 {
     return 0;
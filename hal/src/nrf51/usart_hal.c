@@ -24,15 +24,75 @@
 #undef MISO
 #undef SS
 #include "gpio_hal.h"
+#include "timer_hal.h"
 #include "app_uart.h"
 #include "nrf51_callbacks.h"
 #include "pinmap_impl.h"
+#include <string.h>
+
+/* FIFO sizes in bytes, powers of two. Define them in the build to trade RAM for
+ * headroom, e.g. for a sensor streaming at 115200 baud. */
+#ifndef USART_RX_FIFO_SIZE
+#if PLATFORM_ID==269
+#define USART_RX_FIFO_SIZE 64
+#else
+#define USART_RX_FIFO_SIZE 128
+#endif
+#endif
+
+#ifndef USART_TX_FIFO_SIZE
+#if PLATFORM_ID==269
+#define USART_TX_FIFO_SIZE 128
+#else
+#define USART_TX_FIFO_SIZE 256
+#endif
+#endif
+
+/* A blocking write or flush gives up when the TX FIFO hasn't drained for this
+ * long, e.g. when CTS is never asserted. A byte takes under 10ms at 1200 baud. */
+#ifndef USART_TX_STALL_TIMEOUT_MS
+#define USART_TX_STALL_TIMEOUT_MS 100
+#endif
+
+/* The pins used with SERIAL_FLOW_CONTROL_RTS_CTS */
+#ifndef USART_RTS_PIN
+#define USART_RTS_PIN D2
+#endif
+#ifndef USART_CTS_PIN
+#define USART_CTS_PIN D3
+#endif
+
+static HAL_USART_Stats usartStats;
+
+static void usart_event_handler(app_uart_evt_t * p_event)
+{
+    if (p_event->evt_type == APP_UART_FIFO_ERROR) {
+        usartStats.rx_dropped++;
+    }
+    else if (p_event->evt_type == APP_UART_COMMUNICATION_ERROR) {
+        usartStats.rx_errors++;
+    }
+}
+
+/* Waiting for the UART interrupt to make room only works from thread mode
+ * with the interrupt able to run. A SoftDevice critical region disables the
+ * application interrupts in the NVIC rather than with PRIMASK. */
+static bool usart_can_wait()
+{
+    return !__get_IPSR() && !(__get_PRIMASK() & 1) &&
+            (NVIC->ISER[0] & (1u << UART0_IRQn));
+}
 
 void HAL_USART_Init(HAL_USART_Serial serial, Ring_Buffer *rx_buffer, Ring_Buffer *tx_buffer)
 {
 }
 bool uartConfigured = false;
 void HAL_USART_Begin(HAL_USART_Serial serial, uint32_t baud)
+{
+    HAL_USART_BeginConfig(serial, baud, SERIAL_8N1, 0);
+}
+
+void HAL_USART_BeginConfig(HAL_USART_Serial serial, uint32_t baud, uint32_t config, void *ptr)
 {
     if (uartConfigured) {return;}
 
@@ -75,23 +135,19 @@ void HAL_USART_Begin(HAL_USART_Serial serial, uint32_t baud)
       {
           PIN_MAP[RX].gpio_pin,
           PIN_MAP[TX].gpio_pin,
-          11, /*random unused pin*/
-          20, /*random unused pin*/
-          APP_UART_FLOW_CONTROL_DISABLED,
+          PIN_MAP[USART_RTS_PIN].gpio_pin,
+          PIN_MAP[USART_CTS_PIN].gpio_pin,
+          (config & SERIAL_FLOW_CONTROL) == SERIAL_FLOW_CONTROL_RTS_CTS ?
+                  APP_UART_FLOW_CONTROL_ENABLED : APP_UART_FLOW_CONTROL_DISABLED,
           false,
           nrfBaudRate
       };
 
+    memset(&usartStats, 0, sizeof(usartStats));
     APP_UART_FIFO_INIT(&comm_params,
-#if PLATFORM_ID==103
-                       128,
-                       256,
-#endif
-#if PLATFORM_ID==269
-                       16,
-                       64,
-#endif
-                  uart_error_handle,
+                  USART_RX_FIFO_SIZE,
+                  USART_TX_FIFO_SIZE,
+                  usart_event_handler,
                   APP_IRQ_PRIORITY_LOW,
                   err_code);
 
@@ -106,11 +162,45 @@ void HAL_USART_End(HAL_USART_Serial serial)
 }
 
 uint32_t HAL_USART_Write_Data(HAL_USART_Serial serial, uint8_t data)
+{
+    return HAL_USART_Write_Block(serial, &data, 1, true, NULL);
+}
+
+int32_t HAL_USART_Write_Block(HAL_USART_Serial serial, const uint8_t* data, uint32_t size, bool blocking, void* reserved)
 {
     if (!uartConfigured) {return -1;}
-//    while (app_uart_put(data) == NRF_ERROR_NO_MEM) { }
-    app_uart_put(data);
-    return 1;
+    blocking = blocking && usart_can_wait();
+    uint32_t queued = 0;
+    system_tick_t progress = HAL_Timer_Get_Milli_Seconds();
+    while (queued < size) {
+        uint32_t length = size - queued;
+        if (app_uart_write(data + queued, &length) == NRF_SUCCESS) {
+            queued += length;
+            progress = HAL_Timer_Get_Milli_Seconds();
+        }
+        else if (!blocking ||
+                HAL_Timer_Get_Milli_Seconds() - progress >= USART_TX_STALL_TIMEOUT_MS) {
+            usartStats.tx_dropped += size - queued;
+            break;
+        }
+    }
+    return queued;
+}
+
+int32_t HAL_USART_Read_Block(HAL_USART_Serial serial, uint8_t* data, uint32_t size, void* reserved)
+{
+    if (!uartConfigured) {return -1;}
+    uint32_t length = size;
+    if (app_uart_read(data, &length) != NRF_SUCCESS) {
+        return 0;
+    }
+    return length;
+}
+
+int32_t HAL_USART_Get_Stats(HAL_USART_Serial serial, HAL_USART_Stats* stats, void* reserved)
+{
+    *stats = usartStats;
+    return 0;
 }
 
 int32_t HAL_USART_Available_Data(HAL_USART_Serial serial)
@@ -122,7 +212,7 @@ int32_t HAL_USART_Read_Data(HAL_USART_Serial serial)
 {
     if (!uartConfigured) {return -1;}
     uint8_t byte;
-    app_uart_get(&byte);
+    if (app_uart_get(&byte) != NRF_SUCCESS) {return -1;}
     return byte;
 }
 
@@ -133,7 +223,22 @@ int32_t HAL_USART_Peek_Data(HAL_USART_Serial serial)
 
 void HAL_USART_Flush_Data(HAL_USART_Serial serial)
 {
-    app_uart_flush();
+    // wait for the queued bytes to go out, as on the other platforms
+    uint32_t pending = 0;
+    system_tick_t progress = HAL_Timer_Get_Milli_Seconds();
+    while (uartConfigured && usart_can_wait()) {
+        uint32_t remaining = app_uart_tx_pending();
+        if (!remaining) {
+            break;
+        }
+        if (remaining != pending) {
+            pending = remaining;
+            progress = HAL_Timer_Get_Milli_Seconds();
+        }
+        else if (HAL_Timer_Get_Milli_Seconds() - progress >= USART_TX_STALL_TIMEOUT_MS) {
+            break;
+        }
+    }
 }
 
 bool HAL_USART_Is_Enabled(HAL_USART_Serial serial)
@@ -147,12 +252,8 @@ void HAL_USART_Half_Duplex(HAL_USART_Serial serial, bool Enable)
 
 int32_t HAL_USART_Available_Data_For_Write(HAL_USART_Serial serial)
 {
-    return 0;
-}
-
-void HAL_USART_BeginConfig(HAL_USART_Serial serial, uint32_t baud, uint32_t config, void *ptr)
-{
-    HAL_USART_Begin(serial, baud);
+    if (!uartConfigured) {return 0;}
+    return app_uart_tx_free();
 }
 
 uint32_t HAL_USART_Write_NineBitData(HAL_USART_Serial serial, uint16_t data)
@@ -1104,3 +1104,13 @@ sock_result_t socket_peer(sock_handle_t sd, sock_peer_t* peer, void* reserved)
     }
     return result;
 }
+
+sock_result_t socket_peek(sock_handle_t sd, const uint8_t** data, void* reserved)
+{
+    return -1;
+}
+
+sock_result_t socket_consume(sock_handle_t sd, socklen_t len, void* reserved)
+{
+    return -1;
+}
@@ -362,6 +362,21 @@ uint32_t HAL_USART_Write_NineBitData(HAL_USART_Serial serial, uint16_t data)
 	return 1;
 }
 
+int32_t HAL_USART_Write_Block(HAL_USART_Serial serial, const uint8_t* data, uint32_t size, bool blocking, void* reserved)
+{
+	return -1;
+}
+
+int32_t HAL_USART_Read_Block(HAL_USART_Serial serial, uint8_t* data, uint32_t size, void* reserved)
+{
+	return -1;
+}
+
+int32_t HAL_USART_Get_Stats(HAL_USART_Serial serial, HAL_USART_Stats* stats, void* reserved)
+{
+	return -1;
+}
+
 int32_t HAL_USART_Available_Data(HAL_USART_Serial serial)
 {
 	return (unsigned int)(SERIAL_BUFFER_SIZE + usartMap[serial]->usart_rx_buffer->head - usartMap[serial]->usart_rx_buffer->tail) % SERIAL_BUFFER_SIZE;
@@ -300,6 +300,41 @@ uint32_t app_uart_close(uint16_t app_uart_id);
 
 uint32_t app_uart_bytes_available();
 
+/**@brief Function for getting bytes from the UART.
+ *
+ * @details Copies up to *p_length bytes from the RX FIFO. When flow control is enabled, a full
+ *          RX FIFO leaves bytes in the UART so RTS holds off the sender, and reading resumes
+ *          reception.
+ *
+ * @param[out]   p_data    Memory the bytes are copied to.
+ * @param[inout] p_length  In: the most bytes to read. Out: the bytes read.
+ *
+ * @retval NRF_SUCCESS          If at least one byte was read.
+ * @retval NRF_ERROR_NOT_FOUND  If the RX FIFO is empty.
+ */
+uint32_t app_uart_read(uint8_t * p_data, uint32_t * p_length);
+
+/**@brief Function for putting bytes on the UART.
+ *
+ * @details This call is non-blocking. It adds as many bytes as fit in the TX FIFO and starts
+ *          transmission once.
+ *
+ * @param[in]    p_data    The bytes to transmit.
+ * @param[inout] p_length  In: the bytes to transmit. Out: the bytes added to the TX FIFO.
+ *
+ * @retval NRF_SUCCESS        If at least one byte was added.
+ * @retval NRF_ERROR_NO_MEM   If the TX FIFO is full.
+ */
+uint32_t app_uart_write(uint8_t const * p_data, uint32_t * p_length);
+
+/**@brief Function for the free space in the TX FIFO.
+ */
+uint32_t app_uart_tx_free(void);
+
+/**@brief Function for the bytes still to be transmitted, including one on the line.
+ */
+uint32_t app_uart_tx_pending(void);
+
 
 #endif //APP_UART_H__
 
@@ -97,6 +97,34 @@ uint32_t app_fifo_get(app_fifo_t * p_fifo, uint8_t * p_byte);
  */
 uint32_t app_fifo_flush(app_fifo_t * p_fifo);
 
+/**@brief Function for reading bytes from the FIFO.
+ *
+ * @details The bytes are copied with at most two memcpy calls, one each side of the wrap.
+ *          Passing NULL for p_byte_array only reports how many bytes are available.
+ *
+ * @param[in]    p_fifo        Pointer to the FIFO.
+ * @param[out]   p_byte_array  Memory the bytes are copied to, or NULL.
+ * @param[inout] p_size        In: the most bytes to read. Out: the bytes read, or available.
+ *
+ * @retval     NRF_SUCCESS              If at least one byte was read, or is available.
+ * @retval     NRF_ERROR_NOT_FOUND      If the FIFO is empty.
+ */
+uint32_t app_fifo_read(app_fifo_t * p_fifo, uint8_t * p_byte_array, uint32_t * p_size);
+
+/**@brief Function for writing bytes to the FIFO.
+ *
+ * @details Writes as many of the bytes as fit. Passing NULL for p_byte_array only reports
+ *          the free space.
+ *
+ * @param[in]    p_fifo        Pointer to the FIFO.
+ * @param[in]    p_byte_array  The bytes to write, or NULL.
+ * @param[inout] p_size        In: the bytes to write. Out: the bytes written, or the free space.
+ *
+ * @retval     NRF_SUCCESS              If at least one byte was written, or fits.
+ * @retval     NRF_ERROR_NO_MEM         If the FIFO is full.
+ */
+uint32_t app_fifo_write(app_fifo_t * p_fifo, uint8_t const * p_byte_array, uint32_t * p_size);
+
 #endif // APP_FIFO_H__
 
 /** @} */
@@ -30,6 +30,7 @@
  *
  */
 
+#include <string.h>
 #include "app_fifo.h"
 #include "nrf_error.h"
 #include "app_util.h"
@@ -97,3 +98,66 @@ uint32_t app_fifo_flush(app_fifo_t * p_fifo)
     p_fifo->read_pos = p_fifo->write_pos;
     return NRF_SUCCESS;
 }
+
+
+/**@brief Function for the number of bytes from a free running position to the end of the buffer.
+ */
+static __INLINE uint32_t fifo_contiguous(app_fifo_t * p_fifo, uint32_t pos, uint32_t size)
+{
+    uint32_t to_end = p_fifo->buf_size_mask + 1 - (pos & p_fifo->buf_size_mask);
+    return (size < to_end) ? size : to_end;
+}
+
+
+uint32_t app_fifo_read(app_fifo_t * p_fifo, uint8_t * p_byte_array, uint32_t * p_size)
+{
+    uint32_t available = FIFO_LENGTH;
+    uint32_t size = (*p_size < available) ? *p_size : available;
+
+    if (p_byte_array == NULL)
+    {
+        *p_size = available;
+        return available ? NRF_SUCCESS : NRF_ERROR_NOT_FOUND;
+    }
+
+    *p_size = size;
+    if (size == 0)
+    {
+        return NRF_ERROR_NOT_FOUND;
+    }
+
+    uint32_t first = fifo_contiguous(p_fifo, p_fifo->read_pos, size);
+    memcpy(p_byte_array, &p_fifo->p_buf[p_fifo->read_pos & p_fifo->buf_size_mask], first);
+    memcpy(p_byte_array + first, p_fifo->p_buf, size - first);
+    // The bytes are copied out before the space is handed back to the writer.
+    __asm__ volatile ("" ::: "memory");
+    p_fifo->read_pos += size;
+    return NRF_SUCCESS;
+}
+
+
+uint32_t app_fifo_write(app_fifo_t * p_fifo, uint8_t const * p_byte_array, uint32_t * p_size)
+{
+    uint32_t available = p_fifo->buf_size_mask + 1 - FIFO_LENGTH;
+    uint32_t size = (*p_size < available) ? *p_size : available;
+
+    if (p_byte_array == NULL)
+    {
+        *p_size = available;
+        return available ? NRF_SUCCESS : NRF_ERROR_NO_MEM;
+    }
+
+    *p_size = size;
+    if (size == 0)
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+
+    uint32_t first = fifo_contiguous(p_fifo, p_fifo->write_pos, size);
+    memcpy(&p_fifo->p_buf[p_fifo->write_pos & p_fifo->buf_size_mask], p_byte_array, first);
+    memcpy(p_fifo->p_buf, p_byte_array + first, size - first);
+    // The bytes are in place before the reader can see them.
+    __asm__ volatile ("" ::: "memory");
+    p_fifo->write_pos += size;
+    return NRF_SUCCESS;
+}
@@ -75,6 +75,7 @@ static app_fifo_t                  m_tx_fifo;                               /**<
 static uint8_t                     m_instance_counter = 1;                        /**< CTS pin mask for UART module. */
 static app_uart_event_handler_t    m_event_handler;                         /**< Event handler function. */
 static volatile app_uart_states_t  m_current_state = UART_OFF;              /**< State of the state machine. */
+static bool                        m_rx_hold;                               /**< With flow control, leave bytes in the UART when the RX FIFO is full so RTS holds off the sender. */
 
 /**@brief Function for disabling the UART when entering the UART_OFF state.
  */
@@ -291,7 +292,13 @@ static void gpiote_uart_event_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polar
 void UART0_IRQHandler(void)
 {
     // Handle reception
-    if (NRF_UART0->EVENTS_RXDRDY != 0)
+    if (NRF_UART0->EVENTS_RXDRDY != 0 && m_rx_hold && FIFO_LENGTH(m_rx_fifo) > m_rx_fifo.buf_size_mask)
+    {
+        // Stop taking bytes until the application reads some. The event stays set, so
+        // re-enabling the interrupt picks up where this left off.
+        NRF_UART0->INTENCLR = (UART_INTENSET_RXDRDY_Set << UART_INTENSET_RXDRDY_Pos);
+    }
+    else if (NRF_UART0->EVENTS_RXDRDY != 0)
     {
         uint32_t err_code;
 
@@ -395,6 +402,7 @@ uint32_t app_uart_init(const app_uart_comm_params_t * p_comm_params,
 
     m_current_state = UART_OFF;
     m_event_handler = event_handler;
+    m_rx_hold       = (p_comm_params->flow_control == APP_UART_FLOW_CONTROL_ENABLED);
 
     if (p_buffers == NULL)
     {
@@ -512,9 +520,33 @@ uint32_t app_uart_init(const app_uart_comm_params_t * p_comm_params,
 }
 
 
+/**@brief Function for taking bytes from the UART again once the application has made room.
+ */
+static void rx_resume(void)
+{
+    if (m_rx_hold)
+    {
+        NRF_UART0->INTENSET = (UART_INTENSET_RXDRDY_Set << UART_INTENSET_RXDRDY_Pos);
+    }
+}
+
+
+/**@brief Function for starting transmission after bytes are added to the TX FIFO, without the
+ *        UART interrupt changing the state under it.
+ */
+static void tx_kick(void)
+{
+    NVIC_DisableIRQ(UART0_IRQn);
+    on_uart_event(ON_UART_PUT);
+    NVIC_EnableIRQ(UART0_IRQn);
+}
+
+
 uint32_t app_uart_get(uint8_t * p_byte)
 {
-    return app_fifo_get(&m_rx_fifo, p_byte);
+    uint32_t err_code = app_fifo_get(&m_rx_fifo, p_byte);
+    rx_resume();
+    return err_code;
 }
 
 
@@ -530,6 +562,37 @@ uint32_t app_uart_put(uint8_t byte)
 }
 
 
+uint32_t app_uart_read(uint8_t * p_data, uint32_t * p_length)
+{
+    uint32_t err_code = app_fifo_read(&m_rx_fifo, p_data, p_length);
+    rx_resume();
+    return err_code;
+}
+
+
+uint32_t app_uart_write(uint8_t const * p_data, uint32_t * p_length)
+{
+    uint32_t err_code = app_fifo_write(&m_tx_fifo, p_data, p_length);
+    if (err_code == NRF_SUCCESS)
+    {
+        tx_kick();
+    }
+    return err_code;
+}
+
+
+uint32_t app_uart_tx_free(void)
+{
+    return m_tx_fifo.buf_size_mask + 1 - FIFO_LENGTH(m_tx_fifo);
+}
+
+
+uint32_t app_uart_tx_pending(void)
+{
+    return FIFO_LENGTH(m_tx_fifo) + (m_current_state == UART_ON);
+}
+
+
 uint32_t app_uart_flush(void)
 {
     uint32_t err_code;
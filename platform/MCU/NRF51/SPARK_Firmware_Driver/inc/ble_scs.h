@@ -22,6 +22,7 @@
 #include <stdbool.h>
 #include "ble.h"
 #include "ble_srv_common.h"
+#include "io_vector.h"
 
 #define BLE_SCS_UUID_BASE {{0xB2, 0x2D, 0x14, 0xAA, 0xB3, 0x9F, 0x41, 0xED, 0xB1, 0x77, 0xFF, 0x38, 0xD8, 0x17, 0x1E, 0x87}};
 #define BLE_SCS_UUID_SERVICE 0x0223
@@ -38,6 +39,18 @@ typedef struct
     scs_data_write_handler_t data_write_handler;                    /**< Event handler to be called when data is written to characteristic. */
 } scs_init_t;
 
+/**@brief Transmit statistics of the data up characteristic. */
+typedef struct
+{
+    uint32_t messages;          /**< Messages sent, including their end of stream marker. */
+    uint32_t bytes;             /**< Payload bytes notified. */
+    uint32_t notifications;     /**< Notifications accepted by the SoftDevice. */
+    uint32_t tx_complete;       /**< Notifications reported sent by TX complete events. */
+    uint32_t queue_full_waits;  /**< Times a sender slept waiting for room in the queue. */
+    uint32_t dropped_messages;  /**< Messages rejected from interrupt context or flushed on disconnect/error. */
+    uint16_t queue_high_water;  /**< Most bytes ever used in the queue. */
+} scs_tx_stats_t;
+
 /**@brief SparkLE Communication Service. This contains various status information for the service. */
 typedef struct scs_s
 {
@@ -71,9 +84,26 @@ uint32_t scs_init(scs_t * p_scs, const scs_init_t * p_scs_init);
 void scs_on_ble_evt(scs_t * p_scs, ble_evt_t * p_ble_evt);
 
 /**@brief Function for sending a data chunk
+ *
+ * @details The data is queued and notified as TX buffers become available,
+ *          followed by the end of stream marker. From thread context this
+ *          sleeps until the queue has room; from an interrupt handler the
+ *          message is dropped with NRF_ERROR_NO_MEM when it doesn't fit.
+ *          When the SoftDevice refuses a notification for any reason but
+ *          running out of TX buffers, the queued data is dropped and that
+ *          error is returned, so the caller can send the message again.
  */
 uint32_t scs_data_send(scs_t * p_scs, uint8_t* data, uint16_t len);
 
+/**@brief Function for sending a message made of count parts, gathered
+ *        directly into the notification queue. Same behavior as scs_data_send().
+ */
+uint32_t scs_data_sendv(scs_t * p_scs, const io_vector_t *vector, uint8_t count);
+
+/**@brief Function for reading the transmit statistics
+ */
+void scs_tx_stats(scs_tx_stats_t * p_stats);
+
 #endif // BLE_SCS_H__
 
 /** @} */
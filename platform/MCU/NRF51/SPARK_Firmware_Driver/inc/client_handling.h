@@ -64,11 +64,23 @@ uint32_t client_handling_destroy(const dm_handle_t * p_handle);
 void client_handling_ble_evt_handler(ble_evt_t * p_ble_evt);
 
 /**@brief Funtion for sending data to the client
+ *
+ * @details The data is queued for the client addressed by the SPI header and
+ *          written from the TX complete events, round-robin across clients.
+ *          A frame is for one client: chunks in it addressed to another
+ *          client are dropped, so a frame that doesn't fit only holds up
+ *          its own client.
+ *          Never waits: when the client's queue is full the call returns
+ *          false after queuing what fits, and must be repeated later with
+ *          the same data to queue the rest. Data for the other clients may
+ *          be sent in between, the position is kept for each client.
  *
  * @param[in] data  Data to be sent to the client.
  * @param[in] len   Lengthof the data to be sent to the client.
+ *
+ * @return  true when all the data was queued.
  */
-void client_send_data(uint8_t *data, uint16_t len);
+bool client_send_data(uint8_t *data, uint16_t len);
 
 
 /**@brief Funtion for handling device manager events.
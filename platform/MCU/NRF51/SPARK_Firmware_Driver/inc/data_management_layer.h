@@ -20,6 +20,7 @@
 
 #include <stdint.h>
 #include "data_service.h"
+#include "io_vector.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -33,6 +34,16 @@ extern "C" {
 
 
 static const int32_t MAX_NUMBER_OF_SERVICES = 32;
+//service IDs are the first byte of each packet
+static const int32_t SERVICE_ID_COUNT = 256;
+
+//traffic received for a service
+typedef struct {
+    uint32_t packets;       //packets delivered to the service
+    uint32_t bytes;         //payload bytes delivered to the service
+    uint32_t drops;         //packets the service rejected, or for an unregistered ID
+} data_service_stats_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -48,14 +59,26 @@ class DataManagementLayer
 {
 public:
     DataManagementLayer();
-    static void registerService(DataService* service);
-    static void sendData(int16_t length, uint8_t *data);
+    //false if the service ID is out of range or already taken, or the table is full
+    static bool registerService(DataService* service);
+    //false if the message could not be queued and should be sent again
+    static bool sendData(int16_t length, uint8_t *data);
+    //send a message made of count parts without copying them together first
+    static bool sendDatav(const io_vector_t *vector, uint8_t count);
     
     static void feedData(int16_t length, uint8_t *data);
     
+    //false if no service is registered with this ID, stats then has the
+    //packets received for unregistered IDs
+    static bool getServiceStats(uint8_t serviceID, data_service_stats_t* stats);
+    
 private:
     static int16_t dataServicesRegistered;
     static DataService* services[MAX_NUMBER_OF_SERVICES];
+    static data_service_stats_t serviceStats[MAX_NUMBER_OF_SERVICES];
+    static data_service_stats_t unregisteredStats;
+    //index in services plus one for each service ID, 0 if not registered
+    static uint8_t dispatch[SERVICE_ID_COUNT];
 };
 
 #endif
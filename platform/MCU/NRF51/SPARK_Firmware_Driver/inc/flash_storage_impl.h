@@ -0,0 +1,65 @@
+/**
+ Copyright (c) 2015 MidAir Technology, LLC.  All rights reserved.
+ 
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+ 
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+ 
+ You should have received a copy of the GNU Lesser General Public
+ License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __NRF_FLASH_STORAGE_IMPL_H
+#define __NRF_FLASH_STORAGE_IMPL_H
+
+#include "sst25vf_spi.h"
+#include <string.h>
+
+/**
+ * Implements access to the external SST25 SPI flash, providing the interface
+ * expected by eeprom_emulation.h. The external flash is not memory mapped so
+ * there is no dataAt(), all accesses go through read().
+ */
+class ExternalFlashStore
+{
+public:
+    int eraseSector(unsigned address)
+    {
+        sFLASH_EraseSector(address);
+        return 0;
+    }
+
+    int write(const unsigned offset, const void* data, const unsigned size)
+    {
+        sFLASH_WriteBuffer((const uint8_t*)data, offset, size);
+
+        //read the data back to catch marginal writes/erases
+        const uint8_t* data_ptr = (const uint8_t*)data;
+        uint8_t readback[16];
+        for (unsigned done = 0; done < size; done += sizeof(readback))
+        {
+            unsigned chunk = size - done;
+            if (chunk > sizeof(readback))
+                chunk = sizeof(readback);
+
+            sFLASH_ReadBuffer(readback, offset + done, chunk);
+            if (memcmp(readback, data_ptr + done, chunk))
+                return -1;
+        }
+        return 0;
+    }
+
+    int read(unsigned offset, void* data, unsigned size)
+    {
+        sFLASH_ReadBuffer((uint8_t*)data, offset, size);
+        return 0;
+    }
+};
+
+#endif  /*__NRF_FLASH_STORAGE_IMPL_H*/
@@ -53,6 +53,8 @@ void timers_init(void);
 void gpiote_init(void);
 void buttons_init(void);
 void external_flash_init(void);
+void external_flash_benchmark(void);
+void system_time_run_benchmark(void);
 void gap_params_init(void);
 void device_manager_init(void);
 void scheduler_init(void);
@@ -71,6 +73,7 @@ void advertising_stop(void);
 void ble_disconnect(void);
 uint32_t timers_start(void);
 uint32_t timers_stop(void);
+void timers_schedule_tick(uint32_t milliseconds);
 
 int register_radio_callback(void (*radio_callback)(bool radio_active));
 void register_data_callback(void (*data_callback)(uint8_t *data, uint16_t length));
@@ -105,7 +108,7 @@ uint32_t OTA_FlashLength(void);
 void FLASH_Begin(uint32_t sFLASH_Address, uint32_t fileSize);
 uint32_t FLASH_PagesMask(uint32_t fileSize);
 uint16_t FLASH_Update(const uint8_t *pBuffer, uint32_t address, uint32_t bufferSize);
-void FLASH_End(void);
+bool FLASH_End(void);
 
 /* Exported functions ------------------------------------------------------- */
 void Set_System(void);
@@ -125,6 +128,24 @@ void Save_SystemFlags(void);
 void Bootloader_Update_Version(uint16_t bootloaderVersion);
 
 /* External variables --------------------------------------------------------*/
+/* External flash throughput measured at boot when built with SFLASH_BENCHMARK=y */
+typedef struct {
+    uint32_t read_kbps;
+    uint32_t program_kbps;
+    uint32_t erase_kbps;
+    bool verified;
+} flash_benchmark_t;
+extern flash_benchmark_t flash_benchmark;
+
+/* Cycles per system_millis/system_micros call measured at boot when built with
+ * SYSTEM_TIME_BENCHMARK=y, with the integer and the former floating point conversion */
+typedef struct {
+    uint32_t millis_cycles;
+    uint32_t micros_cycles;
+    uint32_t millis_float_cycles;
+    uint32_t micros_float_cycles;
+} system_time_benchmark_t;
+extern system_time_benchmark_t system_time_benchmark;
 extern uint8_t USE_SYSTEM_FLAGS;
 extern uint16_t Bootloader_Version_SysFlag;
 extern uint16_t NVMEM_SPARK_Reset_SysFlag;
@@ -25,13 +25,13 @@
 #include <string.h>
 #include "ble_gap.h"
 #include "app_util.h"
+#include "frame_ring.h"
 
 #define MAX_CLIENTS  3  /**< Max number of clients. */
 #define GATEWAY_ID MAX_CLIENTS
 
 //Gateway Constants
-#define SPI_SLAVE_TX_BUF_SIZE   1096                        /**< SPI TX buffer size. */
-#define SPI_SLAVE_RX_BUF_SIZE   SPI_SLAVE_TX_BUF_SIZE       /**< SPI RX buffer size. */
+#define SPI_SLAVE_RX_BUF_SIZE   1096                        /**< SPI RX buffer size, the TX queue is SPI_SLAVE_TX_QUEUE_SIZE. */
 
 #define INFO_DATA_SERVICE_BUF_SIZE  8
 
@@ -61,7 +61,8 @@ typedef enum
 {
     SPI_BUS_DATA,
     SPI_BUS_CONNECT,
-    SPI_BUS_DISCONNECT
+    SPI_BUS_DISCONNECT,
+    SPI_BUS_CREDIT                                  /**< Socket flow control from a client, for the gateway only. */
 } gateway_function_t;
 
 /**@brief Variable length data encapsulation in terms of length and pointer to data */
@@ -103,6 +104,9 @@ void gateway_cancel_connect_and_start_scanning(void);
 void set_gateway_target_name(char* name);
 char* get_gateway_target_name();
 
+//High-water mark and drop counters of the SPI staging buffers
+void gateway_spi_buffer_stats(frame_ring_stats_t* tx, frame_ring_stats_t* rx);
+
 //Gateway Callback Functions
 #if PLATFORM_ID==269
 void spi_slave_tx_data(uint8_t* tx_buffer, uint16_t size);
@@ -30,7 +30,13 @@ typedef enum {
     SET_MODE,
     SET_CONNECTION_PARAMETERS,
     POLL_CONNECTIONS,
-    CONNECTION_RESULTS
+    CONNECTION_RESULTS,
+    GET_SERVICE_STATS,
+    SERVICE_STATS_RESULTS,
+    GET_POWER_STATS,
+    POWER_STATS_RESULTS,
+    GET_SOCKET_STATS,
+    SOCKET_STATS_RESULTS
 } INFO_COMMAND;
 
 
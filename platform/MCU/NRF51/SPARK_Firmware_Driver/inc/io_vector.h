@@ -0,0 +1,73 @@
+/**
+ Copyright (c) 2015 MidAir Technology, LLC.  All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _IO_VECTOR_H
+#define	_IO_VECTOR_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A message made of scattered parts, e.g. a service header and the caller's
+ * payload, so it can be sent down the stack without first copying it into
+ * one contiguous buffer. Only the final copy into the radio queue or the SPI
+ * hardware buffer gathers the parts.
+ */
+typedef struct {
+    const uint8_t* data;
+    uint16_t length;
+} io_vector_t;
+
+/* Most parts in a vector, a header added by each layer plus the payload */
+#define IO_VECTOR_MAX_COUNT 4
+
+static inline uint16_t io_vector_length(const io_vector_t* vector, uint8_t count)
+{
+    uint16_t length = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        length += vector[i].length;
+    }
+    return length;
+}
+
+/* Copy length bytes starting offset bytes into the message to dest */
+static inline void io_vector_copy(const io_vector_t* vector, uint8_t count, uint16_t offset, uint8_t* dest, uint16_t length)
+{
+    for (uint8_t i = 0; i < count && length > 0; i++) {
+        if (offset >= vector[i].length) {
+            offset -= vector[i].length;
+            continue;
+        }
+        uint16_t part = vector[i].length - offset;
+        if (part > length) {
+            part = length;
+        }
+        memcpy(dest, vector[i].data + offset, part);
+        dest += part;
+        length -= part;
+        offset = 0;
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _IO_VECTOR_H */
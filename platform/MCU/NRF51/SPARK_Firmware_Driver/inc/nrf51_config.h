@@ -43,7 +43,8 @@
 #endif
 
 
-#define TIME_KEPPER_MILLISECONDS     	100                                         /**< Keep track of time in roughly 100 mSecond intervals. */
+#define TIME_KEPPER_MILLISECONDS     	100                                         /**< First system tick, after that each tick schedules the next one when something is due. */
+#define TIME_KEPPER_MAX_MILLISECONDS 	1000                                        /**< Longest interval between system ticks. */
 #define TIME_KEPPER_INTERVAL     		APP_TIMER_TICKS(TIME_KEPPER_MILLISECONDS, APP_TIMER_PRESCALER)     /**< Convert to clock ticks. */
 
 #define APP_GPIOTE_MAX_USERS            1                                           /**< Maximum number of users of the GPIOTE handler. */
@@ -21,6 +21,7 @@
 #include "ble_scs.h"
 
 //Data Services Functions
-void particle_service_send_data(uint8_t* data, uint16_t len);
+uint32_t particle_service_send_data(uint8_t* data, uint16_t len);
+uint32_t particle_service_send_datav(const io_vector_t* vector, uint8_t count);
 
 #endif
\ No newline at end of file
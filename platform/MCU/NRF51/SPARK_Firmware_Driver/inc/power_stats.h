@@ -0,0 +1,44 @@
+/**
+ Copyright (c) 2015 MidAir Technology, LLC.  All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _POWER_STATS_H
+#define	_POWER_STATS_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Counters of how often and how long the CPU sleeps, read over the info data
+ * service. The system tick only runs when something is due, so a mostly idle
+ * device should show few ticks and wakes and a sleep time close to uptime.
+ */
+typedef struct {
+    uint32_t wakes;             // returns from sd_app_evt_wait
+    uint32_t ticks;             // system ticks
+    uint32_t sleep_ms;          // time spent in sd_app_evt_wait
+    uint32_t tick_interval_ms;  // time until the tick after the last one
+} power_stats_t;
+
+void get_power_stats(power_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _POWER_STATS_H */
@@ -0,0 +1,72 @@
+/**
+ Copyright (c) 2015 MidAir Technology, LLC.  All rights reserved.
+
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RTC_TIME_H
+#define	_RTC_TIME_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Time from the app timer RTC, a 24 bit counter at 32768Hz (prescaler 0)
+ * extended by a count of its overflows.
+ *
+ * The conversions are exact integer math on 32 bit values, which the M0
+ * does in a few cycles. The results wrap at 2^32 like millis() and micros().
+ * Each overflow is 2^24 ticks = 512 seconds.
+ */
+#define RTC_COUNTER_BITS            24
+#define RTC_COUNTER_MASK            ((1UL << RTC_COUNTER_BITS) - 1)
+#define RTC_MILLIS_PER_OVERFLOW     512000UL
+#define RTC_MICROS_PER_OVERFLOW     512000000UL
+
+/* The overflow count that goes with counter. The overflow interrupt may not
+ * have run yet when the counter has already wrapped, e.g. when called with
+ * interrupts disabled or from a higher priority. An overflow still pending
+ * when counter is in its lower half belongs to this reading. In the upper
+ * half the counter was read before it wrapped.
+ */
+static inline uint32_t rtc_resolve_overflows(uint32_t overflows, uint32_t counter, bool overflow_pending)
+{
+    if (overflow_pending && counter < (1UL << (RTC_COUNTER_BITS - 1))) {
+        overflows++;
+    }
+    return overflows;
+}
+
+/* ticks * 1000 / 32768 = ticks * 125 / 4096, and counter * 125 < 2^31 */
+static inline uint32_t rtc_ticks_to_millis(uint32_t overflows, uint32_t counter)
+{
+    return overflows * RTC_MILLIS_PER_OVERFLOW + ((counter * 125) >> 12);
+}
+
+/* ticks * 1000000 / 32768 = ticks * 15625 / 512. counter * 15625 needs 38 bits,
+ * so the counter is split at 512 ticks: high * 15625 is exact and the low
+ * part is below 512 */
+static inline uint32_t rtc_ticks_to_micros(uint32_t overflows, uint32_t counter)
+{
+    return overflows * RTC_MICROS_PER_OVERFLOW + (counter >> 9) * 15625 + (((counter & 0x1FF) * 15625) >> 9);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* _RTC_TIME_H */
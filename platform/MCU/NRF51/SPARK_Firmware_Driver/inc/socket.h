@@ -26,7 +26,8 @@
 enum SOCKET_COMMANDS {
     SOCKET_DATA,
     SOCKET_CONNECT,
-    SOCKET_DISCONNECT
+    SOCKET_DISCONNECT,
+    SOCKET_CREDIT
 };
 
 typedef struct
@@ -46,13 +47,25 @@ public:
     int32_t receive(void* buffer, uint32_t len, unsigned long _timeout);
     int32_t close();
     int32_t bytes_available();
+    //bytes the gateway sent that didn't fit in the buffer, since init()
+    uint32_t dropped_bytes() { return droppedBytes; }
+    
+    //zero copy reads: peek returns the number of contiguous bytes at data,
+    //consume releases them once they've been processed
+    int32_t peek(const uint8_t** data);
+    int32_t consume(uint32_t len);
     
     int32_t feed(uint8_t* buffer, uint32_t len);
     
+    //must be a power of 2, the buffer is a ring indexed by free running counters
     static const int32_t SOCKET_BUFFER_SIZE = 1024;
+    //tell the gateway about consumed bytes once this many have been read since the last credit
+    static const int32_t CREDIT_THRESHOLD = SOCKET_BUFFER_SIZE / 4;
     bool inUse;
     
 private:
+    void sendCredit();
+    
     uint32_t id;
     
     uint8_t family;
@@ -61,7 +74,10 @@ private:
     uint16_t port;
     uint32_t nif;
     
-    uint16_t bufferLength, bufferStart;
+    //bytesFed is only written by feed() (BLE event context), bytesRead only by consume()
+    volatile uint32_t bytesFed, bytesRead;
+    uint32_t creditSent;
+    uint32_t droppedBytes;
     uint8_t buffer[SOCKET_BUFFER_SIZE];
 };
 
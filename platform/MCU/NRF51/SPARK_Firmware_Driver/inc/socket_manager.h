@@ -36,9 +36,12 @@ public:
     int32_t connect(uint32_t sd, const sockaddr_b *addr, long addrlen);
     int32_t send(uint32_t sockid, const void* buffer, uint32_t len);
     int32_t receive(uint32_t sockid, void* buffer, uint32_t len, unsigned long _timeout);
+    int32_t peek(uint32_t sockid, const uint8_t** data);
+    int32_t consume(uint32_t sockid, uint32_t len);
     int32_t active_status(uint32_t sockid);
     int32_t close(uint32_t sockid);
     int32_t bytes_available(uint32_t sockid);
+    uint32_t dropped_bytes(uint32_t sockid);
     
     static const int32_t MAX_NUMBER_OF_SOCKETS = 1;
     
@@ -8,9 +8,13 @@
 #include "app_error.h"
 #include "nrf_gpio.h"
 #include "ble_radio_notification.h"
+#include "io_vector.h"
+#include "frame_ring.h"
+#include "spi_stream_tx.h"
 
 #define SPI_SLAVE_HW_TX_BUF_SIZE 255u
 #define SPI_SLAVE_HW_RX_BUF_SIZE SPI_SLAVE_HW_TX_BUF_SIZE
+#define SPI_SLAVE_TX_QUEUE_SIZE 1096u   /**< Frames queued for the master, with a 2 byte length each. */
 
 #define DEF_CHARACTER 0xAAu             /**< SPI default character. Character clocked out in case of an ignored transaction. */
 #define ORC_CHARACTER 0x55u             /**< SPI over-read character. Character clocked out after an over-read of the transmit buffer. */
@@ -24,7 +28,9 @@
 #define SPIS_CSN_PIN 8
 
 uint32_t spi_slave_stream_init(void (*a)(uint8_t *m_tx_buf, uint16_t size));
-void spi_slave_send_data(uint8_t *buf, uint16_t size);
+bool spi_slave_send_data(uint8_t *buf, uint16_t size);
+bool spi_slave_send_datav(const io_vector_t *vector, uint8_t count);
+void spi_slave_stream_stats(spi_stream_tx_stats_t *stats, frame_ring_stats_t *queue);
 
 
 #endif
@@ -56,7 +56,6 @@
 #define sFLASH_SST25VF020_ID			0xBF258C	/* JEDEC Read-ID Data */
 #define sFLASH_SST25VF040_ID			0xBF258D	/* JEDEC Read-ID Data */
 #define sFLASH_SST25VF016_ID			0xBF2541	/* JEDEC Read-ID Data */
-#define TX_RX_MSG_LENGTH				1			/*Only transmitting one byte at a time for now*/
 
 #ifdef __cplusplus
 extern "C" {
@@ -67,6 +66,7 @@ uint32_t *spi_base_address;
 /* High level functions. */
 void sFLASH_Init(void);
 void sFLASH_EraseSector(uint32_t SectorAddr);
+void sFLASH_EraseSectorStart(uint32_t SectorAddr);
 void sFLASH_EraseBulk(void);
 void sFLASH_WriteBuffer(const uint8_t *pBuffer, uint32_t WriteAddr, uint32_t NumByteToWrite);
 void sFLASH_ReadBuffer(uint8_t *pBuffer, uint32_t ReadAddr, uint32_t NumByteToRead);
@@ -20,10 +20,148 @@
 #include "nordic_common.h"
 #include "ble_srv_common.h"
 #include "app_util.h"
+#include "app_util_platform.h"
 #include "nrf_gpio.h"
-#include "nrf_delay.h"
+#include "frame_ring.h"
 
-bool waitForTxComplete = true;
+#define SCS_NOTIFICATION_SIZE   20      /* characteristic max_len */
+#define SCS_TX_SEGMENT_SIZE     100     /* payload bytes per queued segment */
+#define SCS_TX_QUEUE_SIZE       1024
+#define SCS_SEGMENT_LAST        0x01    /* segment ends the message, send the EOS marker after it */
+
+/* Outgoing messages are split into segments of [flags, payload...] in a
+ * ring and notified 20 bytes at a time from scs_data_send() and from the
+ * TX complete events, so the sender never polls the SoftDevice buffers.
+ */
+static uint8_t tx_queue_buffer[SCS_TX_QUEUE_SIZE];
+static frame_ring_t tx_queue;
+static uint16_t tx_offset;                  /* payload bytes of the front segment already notified */
+static volatile bool tx_message_open;       /* a message is being queued from thread context */
+static scs_tx_stats_t tx_stats;
+
+static const uint8_t eos_marker[2] = {3, 4};
+
+/**@brief Drop every queued segment, e.g. after a disconnect.
+ */
+static void tx_flush(void)
+{
+    CRITICAL_REGION_ENTER();
+    uint16_t size;
+    uint8_t *segment;
+    while ((segment = frame_ring_peek(&tx_queue, &size)) != NULL) {
+        if (segment[0] & SCS_SEGMENT_LAST) {
+            tx_stats.dropped_messages++;
+        }
+        frame_ring_consume(&tx_queue);
+    }
+    tx_offset = 0;
+    CRITICAL_REGION_EXIT();
+}
+
+static uint32_t notify(scs_t * p_scs, const uint8_t *data, uint16_t size)
+{
+    ble_gatts_hvx_params_t params;
+
+    memset(&params, 0, sizeof(params));
+    params.type = BLE_GATT_HVX_NOTIFICATION;
+    params.handle = p_scs->data_up_handles.value_handle;
+    params.p_data = (uint8_t*)data;
+    params.p_len = &size;
+
+    // the SoftDevice copies the value, so the data may point into the queue
+    return sd_ble_gatts_hvx(p_scs->conn_handle, &params);
+}
+
+/**@brief Hand queued data to the SoftDevice until it runs out of TX buffers.
+ *
+ * @details Called after queuing data and on every TX complete event. Any
+ *          error other than running out of buffers (e.g. notifications
+ *          disabled by the central) drops the queue, since no TX complete
+ *          event will come to drain it.
+ *
+ * @return  NRF_SUCCESS, or the error that dropped the queue.
+ */
+static uint32_t tx_pump(scs_t * p_scs)
+{
+    uint32_t err_code = NRF_SUCCESS;
+
+    CRITICAL_REGION_ENTER();
+    while (err_code == NRF_SUCCESS) {
+        uint16_t size;
+        uint8_t *segment = frame_ring_peek(&tx_queue, &size);
+        if (segment == NULL) {
+            break;
+        }
+
+        uint8_t *payload = segment + 1;
+        uint16_t payload_size = size - 1;
+
+        if (tx_offset < payload_size) {
+            uint16_t chunk = MIN(payload_size - tx_offset, SCS_NOTIFICATION_SIZE);
+            err_code = notify(p_scs, payload + tx_offset, chunk);
+            if (err_code == NRF_SUCCESS) {
+                tx_offset += chunk;
+                tx_stats.bytes += chunk;
+                tx_stats.notifications++;
+            }
+            continue;
+        }
+
+        if (segment[0] & SCS_SEGMENT_LAST) {
+            err_code = notify(p_scs, eos_marker, sizeof(eos_marker));
+            if (err_code != NRF_SUCCESS) {
+                continue;
+            }
+            tx_stats.notifications++;
+            tx_stats.messages++;
+        }
+        frame_ring_consume(&tx_queue);
+        tx_offset = 0;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (err_code != NRF_SUCCESS && err_code != BLE_ERROR_NO_TX_BUFFERS) {
+        tx_flush();
+        return err_code;
+    }
+    return NRF_SUCCESS;
+}
+
+/**@brief Queue size bytes of a message, starting offset bytes in, as one
+ * segment. Must be called in a critical region.
+ */
+static bool tx_enqueue(const io_vector_t *vector, uint8_t count, uint16_t offset, uint16_t size, bool last)
+{
+    // check the room first so waiting for the queue isn't counted as a drop
+    uint16_t needed = size + 1 + FRAME_RING_HEADER_SIZE;
+    if (frame_ring_used(&tx_queue) + needed + SCS_TX_SEGMENT_SIZE + 1 + FRAME_RING_HEADER_SIZE >= SCS_TX_QUEUE_SIZE) {
+        return false;
+    }
+
+    // gather the segment straight into the queue
+    uint8_t *segment = frame_ring_alloc(&tx_queue, size + 1);
+    if (segment == NULL) {
+        return false;
+    }
+    segment[0] = last ? SCS_SEGMENT_LAST : 0;
+    io_vector_copy(vector, count, offset, segment + 1, size);
+    frame_ring_commit(&tx_queue);
+
+    if (tx_queue.stats.high_water > tx_stats.queue_high_water) {
+        tx_stats.queue_high_water = tx_queue.stats.high_water;
+    }
+    return true;
+}
+
+/**@brief Whether a whole message fits in the queue, with room for the
+ * unused space at the end of the ring when a segment wraps.
+ */
+static bool tx_fits(uint16_t len)
+{
+    uint32_t segments = len ? (len + SCS_TX_SEGMENT_SIZE - 1) / SCS_TX_SEGMENT_SIZE : 1;
+    uint32_t needed = len + segments * (1 + FRAME_RING_HEADER_SIZE) + SCS_TX_SEGMENT_SIZE + 1 + FRAME_RING_HEADER_SIZE;
+    return frame_ring_used(&tx_queue) + needed < SCS_TX_QUEUE_SIZE;
+}
 
 /**@brief Function for handling the Connect event.
  *
@@ -45,6 +183,7 @@ static void on_disconnect(scs_t * p_scs, ble_evt_t * p_ble_evt)
 {
     UNUSED_PARAMETER(p_ble_evt);
     p_scs->conn_handle = BLE_CONN_HANDLE_INVALID;
+    tx_flush();
 }
 
 uint16_t readBufferLength = 0;
@@ -92,8 +231,9 @@ void scs_on_ble_evt(scs_t * p_scs, ble_evt_t * p_ble_evt)
             break;
 
         case BLE_EVT_TX_COMPLETE:
-        	waitForTxComplete = false;
-			break;
+            tx_stats.tx_complete += p_ble_evt->evt.common_evt.params.tx_complete.count;
+            tx_pump(p_scs);
+            break;
 
         default:
             // No implementation needed.
@@ -211,6 +351,10 @@ uint32_t scs_init(scs_t * p_scs, const scs_init_t * p_scs_init)
     p_scs->conn_handle       = BLE_CONN_HANDLE_INVALID;
     p_scs->data_write_handler = p_scs_init->data_write_handler;
 
+    frame_ring_init(&tx_queue, tx_queue_buffer, sizeof(tx_queue_buffer));
+    tx_offset = 0;
+    memset(&tx_stats, 0, sizeof(tx_stats));
+
     // Add service
     ble_uuid128_t base_uuid = BLE_SCS_UUID_BASE;
     err_code = sd_ble_uuid_vs_add(&base_uuid, &p_scs->uuid_type);
@@ -245,57 +389,81 @@ uint32_t scs_init(scs_t * p_scs, const scs_init_t * p_scs_init)
 
 uint32_t scs_data_send(scs_t * p_scs, uint8_t *data, uint16_t len)
 {
-    ble_gatts_hvx_params_t params;
-    //uint16_t len = sizeof(data);
-    int error = NRF_SUCCESS;
-    uint8_t buffer[20];
-
-    for (int i = 0; i < len; i+=20) {
-    	uint16_t size = (len-i > 20 ? 20 : len-i);
-    	memcpy(buffer, data+i, size);
-
-		memset(&params, 0, sizeof(params));
-		params.type = BLE_GATT_HVX_NOTIFICATION;
-		params.handle = p_scs->data_up_handles.value_handle;
-		params.p_data = buffer;
-		params.p_len = &size;
-
-		int error = sd_ble_gatts_hvx(p_scs->conn_handle, &params);
-
-		//when sending data very fast, we can use up all the buffers. this should protect us as we wait for the TX complete event
-		while (error == BLE_ERROR_NO_TX_BUFFERS) {
-			while (waitForTxComplete) {
-				uint8_t bufferCount = 0;
-				sd_ble_tx_buffer_count_get(&bufferCount);
-                //TO DO: This can probably be reduced...
-				nrf_delay_us(500000);
-			}
-			waitForTxComplete = true;
-			error = sd_ble_gatts_hvx(p_scs->conn_handle, &params);
-		}
-
-
-		if (error != NRF_SUCCESS) {
-			return error;
-		}
+    io_vector_t vector = { data, len };
+    return scs_data_sendv(p_scs, &vector, 1);
+}
+
+uint32_t scs_data_sendv(scs_t * p_scs, const io_vector_t *vector, uint8_t count)
+{
+    uint32_t err_code = NRF_SUCCESS;
+    uint16_t len = io_vector_length(vector, count);
+
+    if (p_scs->conn_handle == BLE_CONN_HANDLE_INVALID) {
+        return NRF_ERROR_INVALID_STATE;
     }
 
-    //send the end of transmission characters
-    uint8_t eotBuffer[2] = {3, 4};
-    uint16_t eotSize = sizeof(eotBuffer);
-    memset(&params, 0, sizeof(params));
-	params.type = BLE_GATT_HVX_NOTIFICATION;
-	params.handle = p_scs->data_up_handles.value_handle;
-	params.p_data = eotBuffer;
-	params.p_len = &eotSize;
-	error = sd_ble_gatts_hvx(p_scs->conn_handle, &params);
-
-	while (error == BLE_ERROR_NO_TX_BUFFERS) {
-		while (waitForTxComplete) {
-			nrf_delay_us(500);
-		}
-		waitForTxComplete = true;
-		error = sd_ble_gatts_hvx(p_scs->conn_handle, &params);
-	}
-    return error;
+    // BLE events (and so TX complete) can't be handled while we're called
+    // from an event handler: queue the whole message or nothing
+    if (current_int_priority_get() != NRF_APP_PRIORITY_THREAD) {
+        err_code = NRF_ERROR_NO_MEM;
+        CRITICAL_REGION_ENTER();
+        if (!tx_message_open && tx_fits(len)) {
+            uint16_t offset = 0;
+            do {
+                uint16_t size = MIN(len - offset, SCS_TX_SEGMENT_SIZE);
+                tx_enqueue(vector, count, offset, size, offset + size == len);
+                offset += size;
+            } while (offset < len);
+            err_code = NRF_SUCCESS;
+        }
+        else {
+            tx_stats.dropped_messages++;
+        }
+        CRITICAL_REGION_EXIT();
+
+        uint32_t pump_err_code = tx_pump(p_scs);
+        return (err_code == NRF_SUCCESS) ? pump_err_code : err_code;
+    }
+
+    // from thread context, sleep until TX complete events have made room
+    tx_message_open = true;
+    uint16_t offset = 0;
+    do {
+        uint16_t size = MIN(len - offset, SCS_TX_SEGMENT_SIZE);
+        bool queued;
+
+        CRITICAL_REGION_ENTER();
+        queued = tx_enqueue(vector, count, offset, size, offset + size == len);
+        CRITICAL_REGION_EXIT();
+
+        if (queued) {
+            offset += size;
+            err_code = tx_pump(p_scs);
+            if (err_code != NRF_SUCCESS) {
+                break;
+            }
+        }
+        else if (p_scs->conn_handle == BLE_CONN_HANDLE_INVALID) {
+            err_code = NRF_ERROR_INVALID_STATE;
+            break;
+        }
+        else {
+            tx_stats.queue_full_waits++;
+            err_code = tx_pump(p_scs);
+            if (err_code != NRF_SUCCESS) {
+                break;
+            }
+            sd_app_evt_wait();
+        }
+    } while (offset < len);
+    tx_message_open = false;
+
+    return err_code;
+}
+
+void scs_tx_stats(scs_tx_stats_t * p_stats)
+{
+    CRITICAL_REGION_ENTER();
+    *p_stats = tx_stats;
+    CRITICAL_REGION_EXIT();
 }
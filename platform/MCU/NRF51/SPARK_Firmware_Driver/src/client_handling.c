@@ -12,6 +12,8 @@
 #include <stdbool.h>
 #include "nrf.h"
 #include "app_error.h"
+#include "app_util_platform.h"
+#include "nordic_common.h"
 #include "nrf_gpio.h"
 #include "app_trace.h"
 #include "ble_db_discovery.h"
@@ -30,8 +32,12 @@
 #define BLE_SCS_UUID_DATA_UP_CHAR 0x0225
 
 #define RX_BUFFER_SIZE 					  512
-
-bool waitForTxComplete = true;
+#define TX_QUEUE_SIZE                     384     /**< Downlink queue per client. */
+#define TX_SEGMENT_SIZE                   100     /**< Payload bytes per queued segment. */
+#define TX_WRITE_SIZE                     20
+#define TX_SEGMENT_LAST                   0x01    /**< Segment ends a message, write the EOS characters after it. */
+#define TX_CREDIT_SOCKETS                 1       /**< Client sockets under flow control, as many as a bluz DK has. */
+#define CREDIT_SIZE                       6       /**< Credit message after the BLE header: <bytes consumed><buffer size>. */
 
 /**@brief Client states. */
 typedef enum
@@ -43,6 +49,15 @@ typedef enum
     STATE_ERROR                                     /**< Error state. */
 } client_state_t;
 
+/**@brief Flow control of the socket data sent to one client socket. */
+typedef struct
+{
+    uint32_t                     sent;              /**< Socket data bytes queued for the client since the socket connected. */
+    uint32_t                     consumed;          /**< Bytes the client has read, from its last credit. */
+    uint16_t                     window;            /**< Bytes the client can buffer past consumed. */
+    bool                         credited;          /**< The client sends credits. Until then, data isn't held back. */
+} socket_credit_t;
+
 /**@brief Client context information. */
 typedef struct
 {
@@ -56,11 +71,17 @@ typedef struct
     uint8_t                      id;
     bool                         socketedParticle;
     bool                         peripheralConnected;
+    frame_ring_t                 tx_queue;          /**< Downlink segments of [flags, payload...]. */
+    uint8_t                      tx_queue_buffer[TX_QUEUE_SIZE];
+    uint16_t                     tx_offset;         /**< Payload bytes of the front segment already written. */
+    socket_credit_t              tx_credit[TX_CREDIT_SOCKETS];
 } client_t;
 
 static client_t         m_client[MAX_CLIENTS];      /**< Client context information list. */
 static uint8_t          m_client_count;             /**< Number of clients. */
 static uint8_t          m_base_uuid_type;           /**< UUID type. */
+static uint8_t          m_next_client;              /**< Client served first by the next client_tx_pump(). */
+static uint16_t         m_send_position[MAX_CLIENTS]; /**< Per client, bytes of its frame passed to client_send_data() already queued. */
 
 static void blink_led(int count)
 {
@@ -144,6 +165,67 @@ void spi_slave_set_tx_buffer(client_t * p_client, gateway_function_t type, uint8
 	tx_callback(data, len);
 }
 
+/**@brief Function for finding the flow control of the socket a message is for.
+ *
+ * @return NULL when the message isn't for a socket under flow control.
+ */
+static socket_credit_t * client_credit_find(client_t * p_client, const uint8_t * message, uint16_t size)
+{
+    if (size < BLE_HEADER_SIZE || message[0] != SOCKET_DATA_SERVICE || (message[1] & 0x0F) >= TX_CREDIT_SOCKETS) {
+        return NULL;
+    }
+    return &p_client->tx_credit[message[1] & 0x0F];
+}
+
+/**@brief Function for reading the socket flow control in a message from a client.
+ *
+ * @details A socket connecting starts counting from zero again, and the credit
+ *          that follows it sets the window.
+ *
+ * @return true when the message is a credit, which isn't passed on to the Photon.
+ */
+static bool client_credit_update(client_t * p_client, const uint8_t * message, uint16_t size)
+{
+    socket_credit_t * p_credit = client_credit_find(p_client, message, size);
+    bool credit = size >= BLE_HEADER_SIZE && message[0] == SOCKET_DATA_SERVICE && (message[1] >> 4) == SPI_BUS_CREDIT;
+
+    if (p_credit == NULL) {
+        return credit;
+    }
+
+    if ((message[1] >> 4) == SPI_BUS_CONNECT) {
+        memset(p_credit, 0, sizeof(*p_credit));
+    } else if (credit && size >= BLE_HEADER_SIZE + CREDIT_SIZE) {
+        const uint8_t * p = message + BLE_HEADER_SIZE;
+        p_credit->consumed = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+        p_credit->window = (p[4] << 8) | p[5];
+        p_credit->credited = true;
+    }
+    return credit;
+}
+
+/**@brief Function for checking that a client socket has room for a downlink message.
+ *
+ * @details A message bigger than the whole window goes once nothing is in
+ *          flight, rather than never.
+ */
+static bool client_credit_allows(const socket_credit_t * p_credit, uint16_t size)
+{
+    uint32_t in_flight = p_credit->sent - p_credit->consumed;
+    return !p_credit->credited || in_flight == 0 || in_flight + size <= p_credit->window;
+}
+
+/**@brief Function for passing a message from a client on to the Photon.
+ */
+static void client_forward(client_t * p_client, gateway_function_t type)
+{
+    if (!client_credit_update(p_client, p_client->ble_read_buffer + SPI_HEADER_SIZE,
+                              p_client->ble_read_buffer_length - SPI_HEADER_SIZE)) {
+        spi_slave_set_tx_buffer(p_client, type, p_client->ble_read_buffer, p_client->ble_read_buffer_length);
+    }
+    p_client->ble_read_buffer_length = SPI_HEADER_SIZE;
+}
+
 /**@brief Funtion for sending data to the client
  *
  * @param[in] data  Data to be sent to the client.
@@ -160,74 +242,208 @@ void on_write(client_t * p_client, ble_evt_t * p_ble_evt)
 
 	if (p_evt_write->len == 2 && p_evt_write->data[0] == 0x03 && p_evt_write->data[1] == 0x04) {
 		//got the EOS characters, write this to UART
-		spi_slave_set_tx_buffer(p_client, SPI_BUS_DATA, p_client->ble_read_buffer, p_client->ble_read_buffer_length);
-        p_client->ble_read_buffer_length = SPI_HEADER_SIZE;
+		client_forward(p_client, SPI_BUS_DATA);
 	}
 }
 
+/**@brief Function for dropping the downlink data of a client.
+ */
+static void client_tx_flush(client_t * p_client)
+{
+    CRITICAL_REGION_ENTER();
+    while (!frame_ring_empty(&p_client->tx_queue)) {
+        frame_ring_consume(&p_client->tx_queue);
+    }
+    p_client->tx_offset = 0;
+    CRITICAL_REGION_EXIT();
+}
+
+/**@brief Function for writing the next 20 bytes (or the EOS characters) queued for a client.
+ *
+ * @return NRF_ERROR_NOT_FOUND when the queue is empty, NRF_ERROR_BUSY when the client
+ *         isn't ready for data yet, otherwise the result of the write.
+ */
+static uint32_t client_tx_write(client_t * p_client)
+{
+    static const uint8_t eotBuffer[2] = {3, 4};
+    ble_gattc_write_params_t write_params;
+    uint16_t size;
+    uint8_t *segment = frame_ring_peek(&p_client->tx_queue, &size);
+
+    if (segment == NULL) {
+        return NRF_ERROR_NOT_FOUND;
+    }
+
+    // data queued during service discovery waits for the notifications to be enabled
+    if (p_client->state != STATE_RUNNING) {
+        return NRF_ERROR_BUSY;
+    }
+
+    uint8_t *payload = segment + 1;
+    uint16_t payload_size = size - 1;
+
+    write_params.write_op = BLE_GATT_OP_WRITE_CMD;
+    write_params.handle = p_client->srv_db.services[0].charateristics[p_client->up_char_index].characteristic.handle_value;
+    write_params.offset = 0;
+
+    if (p_client->tx_offset < payload_size) {
+        write_params.len = MIN(payload_size - p_client->tx_offset, TX_WRITE_SIZE);
+        write_params.p_value = payload + p_client->tx_offset;
+
+        uint32_t err_code = sd_ble_gattc_write(p_client->srv_db.conn_handle, &write_params);
+        if (err_code == NRF_SUCCESS) {
+            p_client->tx_offset += write_params.len;
+        }
+        return err_code;
+    }
+
+    if (segment[0] & TX_SEGMENT_LAST) {
+        write_params.len = sizeof(eotBuffer);
+        write_params.p_value = (uint8_t*)eotBuffer;
+
+        uint32_t err_code = sd_ble_gattc_write(p_client->srv_db.conn_handle, &write_params);
+        if (err_code != NRF_SUCCESS) {
+            return err_code;
+        }
+    }
+
+    frame_ring_consume(&p_client->tx_queue);
+    p_client->tx_offset = 0;
+    return NRF_SUCCESS;
+}
+
+/**@brief Function for handing queued downlink data to the SoftDevice.
+ *
+ * @details Writes one packet per client in turn until every client is either
+ *          idle or out of TX buffers, so all the links get packets in each
+ *          connection event. Called when data is queued and on TX complete.
+ */
+static void client_tx_pump(void)
+{
+    bool blocked[MAX_CLIENTS] = {false};
+    bool progress;
+
+    CRITICAL_REGION_ENTER();
+    do {
+        progress = false;
+        for (uint8_t i = 0; i < MAX_CLIENTS; i++) {
+            uint8_t index = (m_next_client + i) % MAX_CLIENTS;
+            if (blocked[index]) {
+                continue;
+            }
+
+            uint32_t err_code = client_tx_write(&m_client[index]);
+            if (err_code == NRF_SUCCESS) {
+                progress = true;
+            } else if (err_code == BLE_ERROR_NO_TX_BUFFERS || err_code == NRF_ERROR_BUSY) {
+                blocked[index] = true;
+            } else if (err_code != NRF_ERROR_NOT_FOUND) {
+                DEBUG("Dropping data for client %d, error %d", index, err_code);
+                client_tx_flush(&m_client[index]);
+            }
+        }
+    } while (progress);
+    m_next_client = (m_next_client + 1) % MAX_CLIENTS;
+    CRITICAL_REGION_EXIT();
+}
+
+/**@brief Function for queuing one segment of downlink data for a client.
+ */
+static bool client_tx_enqueue(client_t * p_client, const uint8_t *data, uint16_t size, bool last)
+{
+    uint8_t segment[TX_SEGMENT_SIZE + 1];
+
+    // leave room for the unused end of the ring when a segment wraps, so
+    // a full queue isn't counted as a drop by the ring
+    uint16_t needed = size + 1 + FRAME_RING_HEADER_SIZE;
+    if (frame_ring_used(&p_client->tx_queue) + needed + TX_SEGMENT_SIZE + 1 + FRAME_RING_HEADER_SIZE >= TX_QUEUE_SIZE) {
+        return false;
+    }
+
+    segment[0] = last ? TX_SEGMENT_LAST : 0;
+    memcpy(segment + 1, data, size);
+    return frame_ring_put(&p_client->tx_queue, segment, size + 1);
+}
+
 /**@brief Funtion for sending data to the client
  *
  * @param[in] data  Data to be sent to the client.
  * @param[in] len   Lengthof the data to be sent to the client.
  */
-void client_send_data(uint8_t *data, uint16_t len)
+bool client_send_data(uint8_t *data, uint16_t len)
 {
-    while (len > 0) {
-        int chunkLength = (data[0] << 8) | data[1];
-        int id = data[2];
-
-        int err_code = 0;
-        ble_gattc_write_params_t write_params;
-        uint8_t buffer[20];
-
-        int actualBytesSent = 0;
-
-        int formattedLength = chunkLength + BLE_HEADER_SIZE;
-        DEBUG("Sending data of size %d", formattedLength);
-        for (int i = 0; i < formattedLength; i += 20) {
-            uint16_t size = (formattedLength - i > 20 ? 20 : formattedLength - i);
-            actualBytesSent += size;
-            memcpy(buffer, data + i + SPI_HEADER_SIZE, size);
-            DEBUG("Sending packaet of size %d", size);
-            write_params.write_op = BLE_GATT_OP_WRITE_CMD;
-            write_params.handle = m_client[id].srv_db.services[0].charateristics[m_client[id].up_char_index].characteristic.handle_value;
-            write_params.offset = 0;
-            write_params.len = size;
-            write_params.p_value = buffer;
-
-            err_code = sd_ble_gattc_write(m_client[id].srv_db.conn_handle, &write_params);
-            while (err_code == BLE_ERROR_NO_TX_BUFFERS) {
-                uint8_t bufferCount = 0;
-                //8000 chunks of 500 microseconds is 4 seconds, the longest this should possibly take
-                int timeout = 8000;
-                while (timeout-- > 0 && waitForTxComplete) {
-                    sd_ble_tx_buffer_count_get(&bufferCount);
-                    nrf_delay_us(500);
-                }
-                waitForTxComplete = true;
-                err_code = sd_ble_gattc_write(m_client[id].srv_db.conn_handle, &write_params);
-            }
+    uint16_t position = 0;
+
+    if (len < SPI_HEADER_SIZE || data[2] >= MAX_CLIENTS) {
+        DEBUG("Dropping data of size %d", len);
+        return true;
+    }
+    // a frame is for one client, so it is the one blocked when the frame doesn't fit
+    uint8_t frame_id = data[2];
+    uint16_t *send_position = &m_send_position[frame_id];
+
+    while (position + SPI_HEADER_SIZE <= len) {
+        uint16_t formattedLength = ((data[position] << 8) | data[position+1]) + BLE_HEADER_SIZE;
+        uint8_t id = data[position+2];
+        uint16_t start = position + SPI_HEADER_SIZE;
+        uint16_t end = start + formattedLength;
+
+        if (end > len) {
+            DEBUG("Dropping truncated data of size %d", len);
+            break;
+        }
+
+        if (id != frame_id) {
+            DEBUG("Dropping data of size %d for client %d in a frame for client %d", formattedLength, id, frame_id);
+            position = end;
+            continue;
         }
 
-        //now send the EOS characters
-        uint8_t eotBuffer[2] = {3, 4};
-        write_params.write_op = BLE_GATT_OP_WRITE_CMD;
-        write_params.handle = m_client[id].srv_db.services[0].charateristics[m_client[id].up_char_index].characteristic.handle_value;
-        write_params.offset = 0;
-        write_params.len = 2;
-        write_params.p_value = eotBuffer;
-
-        err_code = sd_ble_gattc_write(m_client[id].srv_db.conn_handle, &write_params);
-        while (err_code == BLE_ERROR_NO_TX_BUFFERS) {
-            int timeout = 8000;
-            while (timeout-- > 0 && waitForTxComplete) {
-                nrf_delay_us(500);
+        if (m_client[id].state == IDLE || m_client[id].state == STATE_ERROR) {
+            DEBUG("Dropping data of size %d for client %d", formattedLength, id);
+            position = end;
+            continue;
+        }
+
+        // resume where the previous call ran out of room in the client's queue
+        bool resumed = *send_position > start;
+        if (resumed) {
+            start = *send_position;
+        }
+
+        // socket data waits for the client to have room for all of it
+        socket_credit_t *p_credit = NULL;
+        if (!resumed && (data[start+1] >> 4) == SPI_BUS_DATA) {
+            p_credit = client_credit_find(&m_client[id], data + start, formattedLength);
+        }
+        if (p_credit != NULL && !client_credit_allows(p_credit, formattedLength - BLE_HEADER_SIZE)) {
+            *send_position = start;
+            client_tx_pump();
+            return false;
+        }
+
+        while (start < end) {
+            uint16_t size = MIN(end - start, TX_SEGMENT_SIZE);
+            if (!client_tx_enqueue(&m_client[id], data + start, size, start + size == end)) {
+                *send_position = start;
+                client_tx_pump();
+                return false;
+            }
+            // the credit is taken with the first segment, so a retry doesn't take it again
+            if (p_credit != NULL) {
+                CRITICAL_REGION_ENTER();
+                p_credit->sent += formattedLength - BLE_HEADER_SIZE;
+                CRITICAL_REGION_EXIT();
+                p_credit = NULL;
             }
-            waitForTxComplete = true;
-            err_code = sd_ble_gattc_write(m_client[id].srv_db.conn_handle, &write_params);
+            start += size;
         }
-        len-=(chunkLength+SPI_HEADER_SIZE + BLE_HEADER_SIZE);
+        position = end;
     }
+
+    *send_position = 0;
+    client_tx_pump();
+    return true;
 }
 
 
@@ -300,6 +516,7 @@ static void on_evt_write_rsp(ble_evt_t * p_ble_evt, client_t * p_client)
         {
             p_client->state = STATE_RUNNING;
             p_client->peripheralConnected = true;
+            client_tx_pump();
         }
     }
 }
@@ -325,12 +542,11 @@ static void on_evt_hvx(ble_evt_t * p_ble_evt, client_t * p_client, uint32_t inde
                     //this is a hack-fx. v1.0.47 of bluz FW didn't properly fill out the connection field of the BLE header, so we have to do it here
                     p_client->ble_read_buffer[SPI_HEADER_SIZE+1] = ((SPI_BUS_CONNECT << 4) & 0xF0) | (p_client->ble_read_buffer[1] & 0x0F);
 
-                    spi_slave_set_tx_buffer(p_client, SPI_BUS_CONNECT, p_client->ble_read_buffer, p_client->ble_read_buffer_length);
+                    client_forward(p_client, SPI_BUS_CONNECT);
 				} else {
 					//got the EOS characters, write this to UART
-					spi_slave_set_tx_buffer(p_client, SPI_BUS_DATA, p_client->ble_read_buffer, p_client->ble_read_buffer_length);
+					client_forward(p_client, SPI_BUS_DATA);
 				}
-                p_client->ble_read_buffer_length = SPI_HEADER_SIZE;
 			} else {
 				memcpy(p_client->ble_read_buffer+p_client->ble_read_buffer_length, p_evt_write->data, p_evt_write->len);
                 p_client->ble_read_buffer_length += p_evt_write->len;
@@ -412,8 +628,8 @@ void client_handling_ble_evt_handler(ble_evt_t * p_ble_evt)
             break;
 
         case BLE_EVT_TX_COMPLETE:
-			waitForTxComplete = false;
-			break;
+            client_tx_pump();
+            break;
 
         case BLE_GAP_EVT_DISCONNECTED:
 			break;
@@ -460,6 +676,8 @@ void client_handling_init(void (*b)(uint8_t *m_tx_buf, uint16_t size))
     for (i = 0; i < MAX_CLIENTS; i++)
     {
         m_client[i].state  = IDLE;
+        frame_ring_init(&m_client[i].tx_queue, m_client[i].tx_queue_buffer, TX_QUEUE_SIZE);
+        m_client[i].tx_offset = 0;
     }
 
     m_client_count = 0;
@@ -498,6 +716,8 @@ uint32_t client_handling_create(const dm_handle_t * p_handle, uint16_t conn_hand
     m_client[p_handle->connection_id].id                 = p_handle->connection_id;
     m_client[p_handle->connection_id].socketedParticle   = false;
     m_client[p_handle->connection_id].peripheralConnected = false;
+    memset(m_client[p_handle->connection_id].tx_credit, 0, sizeof(m_client[p_handle->connection_id].tx_credit));
+    client_tx_flush(&m_client[p_handle->connection_id]);
     service_discover(&m_client[p_handle->connection_id]);
 
     return NRF_SUCCESS;
@@ -515,6 +735,7 @@ uint32_t client_handling_destroy(const dm_handle_t * p_handle)
     {
         m_client_count--;
         p_client->state = IDLE;
+        client_tx_flush(p_client);
         //first 3 bytes are SPI header, will get filled in by function. next two bytes are BLE header
         uint8_t dummy[6] = {0, 0, 0, SOCKET_DATA_SERVICE, (((SPI_BUS_DISCONNECT << 4) & 0xF0) | (0 & 0x0F)), 22};
         spi_slave_set_tx_buffer(p_client, SPI_BUS_DISCONNECT, dummy, 6);
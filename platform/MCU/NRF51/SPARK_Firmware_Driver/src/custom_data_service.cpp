@@ -36,11 +36,13 @@ void CustomDataService::registerCallback(void (*dc)(uint8_t *data, uint16_t leng
 
 void CustomDataService::sendData(uint8_t *data, uint16_t length)
 {
-    uint8_t rsp[length+1];
-    rsp[0] = CUSTOM_DATA_SERVICE & 0xFF;
-    memcpy(rsp+1, data, length);
+    uint8_t header = CUSTOM_DATA_SERVICE & 0xFF;
+    io_vector_t vector[2] = {
+        { &header, 1 },
+        { data, length }
+    };
 
-    DataManagementLayer::sendData(length+1, rsp);
+    DataManagementLayer::sendDatav(vector, 2);
 }
 
 void customDataServiceRegisterCallback(void (*data_callback)(uint8_t *data, uint16_t length))
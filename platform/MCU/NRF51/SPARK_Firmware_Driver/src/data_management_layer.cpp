@@ -17,6 +17,7 @@
 
 #include <stdint.h>
 #include <cstdlib>
+#include <cstring>
 #include "data_management_layer.h"
 #include "socket.h"
 extern "C" {
@@ -29,39 +30,109 @@ extern "C" {
 
 int16_t DataManagementLayer::dataServicesRegistered = 0;
 DataService* DataManagementLayer::services[MAX_NUMBER_OF_SERVICES] = {NULL};
+data_service_stats_t DataManagementLayer::serviceStats[MAX_NUMBER_OF_SERVICES];
+data_service_stats_t DataManagementLayer::unregisteredStats;
+uint8_t DataManagementLayer::dispatch[SERVICE_ID_COUNT] = {0};
 
-DataManagementLayer::DataManagementLayer() { dataServicesRegistered=0; }
+DataManagementLayer::DataManagementLayer() { dataServicesRegistered=0; memset(dispatch, 0, sizeof(dispatch)); }
 
-void DataManagementLayer::registerService(DataService* service)
+bool DataManagementLayer::registerService(DataService* service)
 {
-    services[dataServicesRegistered++] = service;
+    if (service == NULL) {
+        return false;
+    }
+    int32_t serviceID = service->getServiceID();
+    if (serviceID < 0 || serviceID >= SERVICE_ID_COUNT) {
+        DEBUG("Service ID %d out of range", serviceID);
+        return false;
+    }
+    if (dispatch[serviceID] != 0) {
+        DEBUG("Service ID %d already registered", serviceID);
+        return false;
+    }
+    if (dataServicesRegistered >= MAX_NUMBER_OF_SERVICES) {
+        DEBUG("No room to register service ID %d", serviceID);
+        return false;
+    }
+    
+    int16_t index = dataServicesRegistered++;
+    services[index] = service;
+    memset(&serviceStats[index], 0, sizeof(serviceStats[index]));
+    dispatch[serviceID] = index + 1;
+    return true;
 }
 
 void DataManagementLayer::feedData(int16_t length, uint8_t *data)
 {
-    uint16_t serviceID = 0x00 | data[0];
-    for (int i = 0; i < dataServicesRegistered; i++)
-    {
-        if (services[i] != NULL && serviceID == services[i]->getServiceID()) {
-            services[i]->DataCallback(data+1, length-1);
-            break;
-        }
+    if (length < 1) {
+        return;
+    }
+    
+    uint8_t slot = dispatch[data[0]];
+    if (slot == 0) {
+        unregisteredStats.packets++;
+        unregisteredStats.bytes += length-1;
+        unregisteredStats.drops++;
+        return;
+    }
+    
+    data_service_stats_t& stats = serviceStats[slot-1];
+    stats.packets++;
+    stats.bytes += length-1;
+    if (services[slot-1]->DataCallback(data+1, length-1) < 0) {
+        stats.drops++;
     }
 }
 
-void DataManagementLayer::sendData(int16_t length, uint8_t *data)
+bool DataManagementLayer::getServiceStats(uint8_t serviceID, data_service_stats_t* stats)
+{
+    uint8_t slot = dispatch[serviceID];
+    *stats = slot ? serviceStats[slot-1] : unregisteredStats;
+    return slot != 0;
+}
+
+bool DataManagementLayer::sendData(int16_t length, uint8_t *data)
 {
 //a bit of a hack for now, should HAL this out, but it'll work for the time being
 #if PLATFORM_ID==103
-    particle_service_send_data(data, length);
+    return particle_service_send_data(data, length) == NRF_SUCCESS;
 #endif
 #if PLATFORM_ID==269
     data[0] = (( (length-BLE_HEADER_SIZE-SPI_HEADER_SIZE) & 0xFF00) >> 8);
     data[1] = ( (length-BLE_HEADER_SIZE-SPI_HEADER_SIZE) & 0xFF);
     data[2] = GATEWAY_ID;
 
-    spi_slave_send_data(data, length);
+    return spi_slave_send_data(data, length);
+#endif
+    return true;
+}
+
+bool DataManagementLayer::sendDatav(const io_vector_t *vector, uint8_t count)
+{
+#if PLATFORM_ID==103
+    return particle_service_send_datav(vector, count) == NRF_SUCCESS;
+#endif
+#if PLATFORM_ID==269
+    if (count > IO_VECTOR_MAX_COUNT) {
+        DEBUG("Too many parts to send: %d", count);
+        return false;
+    }
+
+    //prepend the SPI header instead of asking the callers to leave room for it
+    uint16_t length = io_vector_length(vector, count);
+    uint8_t header[SPI_HEADER_SIZE];
+    header[0] = (( (length-BLE_HEADER_SIZE) & 0xFF00) >> 8);
+    header[1] = ( (length-BLE_HEADER_SIZE) & 0xFF);
+    header[2] = GATEWAY_ID;
+
+    io_vector_t spiVector[IO_VECTOR_MAX_COUNT + 1];
+    spiVector[0].data = header;
+    spiVector[0].length = sizeof(header);
+    memcpy(spiVector+1, vector, count*sizeof(io_vector_t));
+
+    return spi_slave_send_datav(spiVector, count+1);
 #endif
+    return true;
 }
 
 void dataManagementFeedData(int16_t length, uint8_t *data)
@@ -74,7 +145,7 @@ void dataManagementSendData(int16_t length, uint8_t *data)
     DataManagementLayer::sendData(length, data);
 }
 
-void dataManagementRegisterService(DataService* service)
+bool dataManagementRegisterService(DataService* service)
 {
-    DataManagementLayer::registerService(service);
+    return DataManagementLayer::registerService(service);
 }
\ No newline at end of file
@@ -54,7 +54,8 @@ const module_info_t* FLASH_ModuleInfo(uint8_t flashDeviceID, uint32_t startAddre
         return module_info;
     } else {
         //largest possible location for module_info is 0xc0 + 0x18, so 256 bytes is plenty
-        uint8_t buf[256];
+        //static since the returned module_info points into it
+        static uint8_t buf[256];
         uint32_t moduleInfoAddress = 0;
         
         //read the buffer from external flash
@@ -91,6 +92,24 @@ bool FLASH_VerifyCRC32(uint8_t flashDeviceID, uint32_t startAddress, uint32_t le
             return true;
         }
     }
+    else if (flashDeviceID == FLASH_SERIAL && length > 0)
+    {
+        //one pass over the SPI Flash image, a chunk at a time
+        uint8_t buf[256];
+        uint32_t computedCRC = 0;
+        for (uint32_t offset = 0; offset < length; offset += sizeof(buf))
+        {
+            uint32_t size = length - offset < sizeof(buf) ? length - offset : sizeof(buf);
+            sFLASH_ReadBuffer(buf, startAddress + offset, size);
+            computedCRC = Compute_CRC32(computedCRC, buf, size);
+        }
+        sFLASH_ReadBuffer(buf, startAddress + length, 4);
+        
+        if (decode_uint32(buf) == computedCRC)
+        {
+            return true;
+        }
+    }
     
     return false;
 }
@@ -145,70 +164,108 @@ static void pstorage_callback_handler(pstorage_handle_t * p_handle,
     APP_ERROR_CHECK(result);
 }
 
+/**@brief Runs the scheduler until all the queued pstorage operations are done.
+ */
+static void FLASH_WaitForStorage(void)
+{
+    uint32_t ops_count;
+    do {
+        app_sched_execute();
+        pstorage_access_status_get(&ops_count);
+    }
+    while(ops_count != 0);
+}
+
+/**@brief Marks the image staged at FLASH_FW_ADDRESS as handled, so the bootloader doesn't
+ *        copy it again.
+ */
+static void FLASH_ClearFWStatus(void)
+{
+    sFLASH_EraseSector(FLASH_FW_STATUS);
+    sFLASH_WriteSingleByte(FLASH_FW_STATUS, 0x00);
+}
+
+/**@brief Copies a firmware image from SPI Flash to internal flash.
+ *
+ * @details The image CRC is checked in SPI Flash before anything is erased, so a bad image
+ *          never replaces the current app. Each internal page is then erased just before it
+ *          is programmed, rather than clearing the whole image up front, and the copy is
+ *          checked against the CRC once it is done.
+ *
+ * @return false if the image isn't valid or the copy doesn't match it. A staged image that
+ *         isn't valid is dropped and the current app is left alone. When the copy doesn't
+ *         match, the app is incomplete and FLASH_FW_STATUS is left set, so that the copy can
+ *         be tried again.
+ */
 bool FLASH_CopyFW(uint32_t flashFWLocation, uint32_t fw_len, bool wipeUserApp, bool bootloader)
 {
     uint32_t         err_code;
     
     Set_RGB_LED_Values(0,0,255);
     
+    const module_info_t* modinfo = FLASH_ModuleInfo(FLASH_SERIAL, flashFWLocation);
+    uint32_t start_address = (uint32_t)modinfo->module_start_address;
+    //the CRC covers the module and is stored big endian right after it
+    uint32_t crc_length = (uint32_t)modinfo->module_end_address - start_address;
+    
+    if ((!bootloader && modinfo->module_function == MODULE_FUNCTION_BOOTLOADER) ||
+        !FLASH_isUserModuleInfoValid(FLASH_SERIAL, flashFWLocation, 0x00) ||
+        crc_length + 4 > fw_len ||
+        !FLASH_VerifyCRC32(FLASH_SERIAL, flashFWLocation, crc_length)) {
+        if (flashFWLocation == FLASH_FW_ADDRESS) {
+            FLASH_ClearFWStatus();
+        }
+        Set_RGB_LED_Values(0,0,0);
+        return false;
+    }
+    
     //let's init the pstorage
     pstorage_handle_t m_storage_handle_app;
     pstorage_module_param_t storage_module_param = {.cb = pstorage_callback_handler};
     
+    uint32_t wipe_len = fw_len;
     if (wipeUserApp) {
         //hack for now...
-        fw_len += 0x4000;
+        wipe_len += 0x4000;
     }
     storage_module_param.block_size = 0x100;
-    storage_module_param.block_count = fw_len / 256;
+    storage_module_param.block_count = wipe_len / 256;
     
     err_code = pstorage_raw_register(&storage_module_param, &m_storage_handle_app);
     APP_ERROR_CHECK(err_code);
     
-    const module_info_t* modinfo = FLASH_ModuleInfo(FLASH_SERIAL, flashFWLocation);
-    if (!bootloader && modinfo->module_function == MODULE_FUNCTION_BOOTLOADER) {
-        return false;
-    }
-    
-    m_storage_handle_app.block_id  = (uint32_t)modinfo->module_start_address;
-    
-    if (!FLASH_isUserModuleInfoValid(FLASH_SERIAL, flashFWLocation, 0x00)) {
-        return false;
-    }
-    uint32_t    ops_count = 7;
-    //now clear the nrf51 flash
-    stillWorking = true;
-    err_code = pstorage_raw_clear(&m_storage_handle_app, fw_len);
-    do {
-        app_sched_execute();
-        err_code = pstorage_access_status_get(&ops_count);
-    }
-    while(ops_count != 0);
+    m_storage_handle_app.block_id = start_address;
     
-    app_sched_execute();
-    APP_ERROR_CHECK(err_code);
-    //now read from SPI Flash one page at a time and copy over to internal flash
+    //reading a page from SPI Flash takes about 1ms, against some 25ms for the SoftDevice
+    //to erase and program it, so the page isn't read ahead into a second buffer
+    const uint32_t page_size = PSTORAGE_FLASH_PAGE_SIZE;
     uint8_t buf[PSTORAGE_FLASH_PAGE_SIZE];
-    uint32_t addr = flashFWLocation;
-    for (int i = 0; i < fw_len; i+=PSTORAGE_FLASH_PAGE_SIZE) {
-        sFLASH_ReadBuffer(buf, addr, PSTORAGE_FLASH_PAGE_SIZE);
-        err_code = pstorage_raw_store(&m_storage_handle_app,
-                                      (uint8_t *)buf,
-                                      PSTORAGE_FLASH_PAGE_SIZE,
-                                      i);
+    pstorage_handle_t page_handle = m_storage_handle_app;
+    
+    for (uint32_t i = 0; i < wipe_len; i += page_size) {
+        page_handle.block_id = m_storage_handle_app.block_id + i;
+        err_code = pstorage_raw_clear(&page_handle, page_size);
         APP_ERROR_CHECK(err_code);
         
-        do {
-            app_sched_execute();
-            pstorage_access_status_get(&ops_count);
+        //past the image, only erase
+        if (i < fw_len) {
+            sFLASH_ReadBuffer(buf, flashFWLocation + i, page_size);
+            err_code = pstorage_raw_store(&m_storage_handle_app,
+                                          buf,
+                                          page_size,
+                                          i);
+            APP_ERROR_CHECK(err_code);
         }
-        while(ops_count != 0);
-        
         
-        addr+=PSTORAGE_FLASH_PAGE_SIZE;
+        FLASH_WaitForStorage();
     }
-    sFLASH_EraseSector(FLASH_FW_STATUS);
-    sFLASH_WriteSingleByte(FLASH_FW_STATUS, 0x00);
+    
+    if (!FLASH_VerifyCRC32(FLASH_INTERNAL, start_address, crc_length)) {
+        Set_RGB_LED_Values(0,0,0);
+        return false;
+    }
+    
+    FLASH_ClearFWStatus();
     Set_RGB_LED_Values(0,0,0);
     return true;
 }
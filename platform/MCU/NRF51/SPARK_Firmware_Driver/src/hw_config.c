@@ -24,6 +24,9 @@
 #include "data_management_layer.h"
 #include "socket_manager.h"
 #include "debug.h"
+#include "crc32.h"
+#include "rtc_time.h"
+#include "power_stats.h"
 #include "rgbled.h"
 #include "device_manager.h"
 #include "pstorage.h"
@@ -41,6 +44,18 @@ uint16_t Flash_Update_Index = 0;
 uint32_t External_Flash_Address = 0;
 uint32_t External_Flash_Start_Address = 0;
 
+/* OTA image state. Sectors are erased on demand, External_Flash_Erased_Address is the first
+ * address not erased yet and External_Flash_Erase_Limit the end of the image's sectors.
+ * The image CRC is computed on the chunks as they arrive, as long as they come in order,
+ * up to the module end once it is known from the module info in the first chunk. */
+static uint32_t External_Flash_Erased_Address = 0;
+static uint32_t External_Flash_Erase_Limit = 0;
+static uint32_t Flash_Update_CRC = 0;
+static uint32_t Flash_CRC_Address = 0;
+static uint32_t Flash_CRC_Limit = 0;
+static bool Flash_CRC_Valid = false;
+static volatile power_stats_t power_stats;
+
 static void blink_led(int count)
 {
     for (int i = 0; i < count; i++) {
@@ -62,16 +77,91 @@ uint32_t get_system_seconds(void)
     return system_seconds;
 }
 
+#if APP_TIMER_PRESCALER != 0
+#error "rtc_time.h converts ticks of the RTC running at 32768Hz"
+#endif
+
+/* Reads the RTC counter and its overflow count as one value. Retries if the
+ * overflow interrupt ran in between, and accounts for an overflow that hasn't
+ * been counted yet */
+static uint32_t rtc_read(uint32_t* counter)
+{
+    uint32_t overflows;
+    bool pending;
+    do {
+        overflows = RTC_OVERFLOW_COUNT;
+        *counter = NRF_RTC1->COUNTER;
+        pending = NRF_RTC1->EVENTS_OVRFLW;
+    } while (overflows != RTC_OVERFLOW_COUNT);
+    return rtc_resolve_overflows(overflows, *counter, pending);
+}
+
 uint32_t system_millis(void)
 {
-    return (( (((uint64_t)RTC_OVERFLOW_COUNT << 24) | (uint64_t)NRF_RTC1->COUNTER) * 1.0 ) / (APP_TIMER_CLOCK_FREQ * 1.0)) * 1000.0;
+    uint32_t counter;
+    uint32_t overflows = rtc_read(&counter);
+    return rtc_ticks_to_millis(overflows, counter);
 }
 
 uint32_t system_micros(void)
+{
+    uint32_t counter;
+    uint32_t overflows = rtc_read(&counter);
+    return rtc_ticks_to_micros(overflows, counter);
+}
+
+#ifdef SYSTEM_TIME_BENCHMARK
+#define SYSTEM_TIME_BENCHMARK_CALLS 1000
+
+system_time_benchmark_t system_time_benchmark;
+
+/* The former conversion, for comparison */
+static uint32_t system_millis_float(void)
+{
+    return (( (((uint64_t)RTC_OVERFLOW_COUNT << 24) | (uint64_t)NRF_RTC1->COUNTER) * 1.0 ) / (APP_TIMER_CLOCK_FREQ * 1.0)) * 1000.0;
+}
+
+static uint32_t system_micros_float(void)
 {
     return (( (((uint64_t)RTC_OVERFLOW_COUNT << 24) | (uint64_t)NRF_RTC1->COUNTER) * 1.0 ) / (APP_TIMER_CLOCK_FREQ * 1.0)) * 1000000.0;
 }
 
+/* Average CPU cycles of a call, counted by TIMER2 at 16MHz */
+static uint32_t system_time_cycles(uint32_t (*now)(void))
+{
+    volatile uint32_t sink = 0;
+    NRF_TIMER2->TASKS_CLEAR = 1;
+    NRF_TIMER2->TASKS_START = 1;
+    for (uint32_t i = 0; i < SYSTEM_TIME_BENCHMARK_CALLS; i++) {
+        sink += now();
+    }
+    NRF_TIMER2->TASKS_CAPTURE[0] = 1;
+    NRF_TIMER2->TASKS_STOP = 1;
+    (void)sink;
+    return NRF_TIMER2->CC[0] / SYSTEM_TIME_BENCHMARK_CALLS;
+}
+
+/* Logs the per call cost of system_millis and system_micros before and after
+ * the integer conversion */
+void system_time_run_benchmark(void)
+{
+    NRF_TIMER2->MODE = TIMER_MODE_MODE_Timer;
+    NRF_TIMER2->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+    NRF_TIMER2->PRESCALER = 0;
+
+    system_time_benchmark.millis_float_cycles = system_time_cycles(system_millis_float);
+    system_time_benchmark.micros_float_cycles = system_time_cycles(system_micros_float);
+    system_time_benchmark.millis_cycles = system_time_cycles(system_millis);
+    system_time_benchmark.micros_cycles = system_time_cycles(system_micros);
+
+    NRF_TIMER2->TASKS_SHUTDOWN = 1;
+
+    DEBUG("Cycles per call, millis: %lu (float %lu) micros: %lu (float %lu)",
+          system_time_benchmark.millis_cycles, system_time_benchmark.millis_float_cycles,
+          system_time_benchmark.micros_cycles, system_time_benchmark.micros_float_cycles);
+}
+#endif
+
 /**@brief Function for error handling, which is called when an error has occurred.
  *
  * @warning This handler is an example only and does not fit a final product. You need to analyze
@@ -169,14 +259,16 @@ void FLASH_Begin(uint32_t sFLASH_Address, uint32_t fileSize)
     External_Flash_Start_Address = sFLASH_Address;
     External_Flash_Address = External_Flash_Start_Address;
 
-    /* Define the number of External Flash pages to be erased */
+    /* Define the number of External Flash pages the image covers. They are erased by
+     * FLASH_Update just before the first write into each of them. */
     NbrOfPage = FLASH_PagesMask(fileSize);
+    External_Flash_Erased_Address = External_Flash_Start_Address;
+    External_Flash_Erase_Limit = External_Flash_Start_Address + (sFLASH_PAGESIZE * NbrOfPage);
 
-    /* Erase the SPI Flash pages */
-    for (uint32_t EraseCounter = 0; (EraseCounter < NbrOfPage); EraseCounter++)
-    {
-        sFLASH_EraseSector(External_Flash_Start_Address + (sFLASH_PAGESIZE * EraseCounter));
-    }
+    Flash_Update_CRC = 0;
+    Flash_CRC_Address = External_Flash_Start_Address;
+    Flash_CRC_Limit = 0;
+    Flash_CRC_Valid = true;
 }
 
 uint32_t FLASH_PagesMask(uint32_t fileSize)
@@ -196,39 +288,105 @@ uint32_t FLASH_PagesMask(uint32_t fileSize)
     return numPages;
 }
 
-uint16_t FLASH_Update(const uint8_t *pBuffer, uint32_t address, uint32_t bufferSize)
+/* Starts erasing the sectors of the image up to endAddress that haven't been erased yet.
+ * Each erase waits for the previous one, the last one is left running. */
+static void FLASH_EraseThrough(uint32_t endAddress)
 {
-    const uint8_t *writeBuffer = pBuffer;
-    uint8_t readBuffer[bufferSize];
+    while (External_Flash_Erased_Address < endAddress && External_Flash_Erased_Address < External_Flash_Erase_Limit)
+    {
+        sFLASH_EraseSectorStart(External_Flash_Erased_Address);
+        External_Flash_Erased_Address += sFLASH_PAGESIZE;
+    }
+}
 
-    /* Write Data Buffer to SPI Flash memory */
-    sFLASH_WriteBuffer(writeBuffer, address, bufferSize);
+/* Adds the chunk to the running image CRC. Only the module is covered, its length comes
+ * from the module info once the start of the image has been written. */
+static void FLASH_UpdateCRC(const uint8_t *pBuffer, uint32_t address, uint32_t bufferSize)
+{
+    if (!Flash_CRC_Valid)
+        return;
 
-    /* Read Data Buffer from SPI Flash memory */
-    sFLASH_ReadBuffer(readBuffer, address, bufferSize);
+    if (address != Flash_CRC_Address)
+    {
+        /* a chunk out of order, FLASH_End reads the image back instead */
+        Flash_CRC_Valid = false;
+        return;
+    }
 
-    /* Is the Data Buffer successfully programmed to SPI Flash memory */
-    if (0 == memcmp(writeBuffer, readBuffer, bufferSize))
+    uint32_t length = bufferSize;
+    if (Flash_CRC_Limit && address + length > Flash_CRC_Limit)
+        length = address < Flash_CRC_Limit ? Flash_CRC_Limit - address : 0;
+    Flash_Update_CRC = Compute_CRC32(Flash_Update_CRC, pBuffer, length);
+    Flash_CRC_Address += bufferSize;
+
+    /* module_info is within the first 256 bytes */
+    if (!Flash_CRC_Limit && Flash_CRC_Address >= External_Flash_Start_Address + 256)
     {
-        External_Flash_Address += bufferSize;
-        Flash_Update_Index += 1;
+        Flash_CRC_Limit = External_Flash_Start_Address + FLASH_ModuleLength(FLASH_SERIAL, External_Flash_Start_Address);
+        if (Flash_CRC_Limit < Flash_CRC_Address)
+            Flash_CRC_Valid = false;
     }
-    else
+}
+
+uint16_t FLASH_Update(const uint8_t *pBuffer, uint32_t address, uint32_t bufferSize)
+{
+    uint32_t endAddress = address + bufferSize;
+
+    /* Erase the sectors the chunk lands in, and write it once the erase is done */
+    FLASH_EraseThrough(endAddress);
+    sFLASH_WriteBuffer(pBuffer, address, bufferSize);
+
+    /* The chunk isn't read back, the image CRC is checked by FLASH_End */
+    FLASH_UpdateCRC(pBuffer, address, bufferSize);
+
+    /* If the next chunk starts a new sector, erase it while that chunk is received */
+    FLASH_EraseThrough(endAddress + bufferSize);
+
+    if (endAddress > External_Flash_Address)
     {
-        /* Erase the problematic SPI Flash pages and back off the chunk index */
-        External_Flash_Address = ((uint32_t)(External_Flash_Address / sFLASH_PAGESIZE)) * sFLASH_PAGESIZE;
-        sFLASH_EraseSector(External_Flash_Address);
-        Flash_Update_Index = (uint16_t)((External_Flash_Address - External_Flash_Start_Address) / bufferSize);
+        External_Flash_Address = endAddress;
     }
+    Flash_Update_Index += 1;
     return Flash_Update_Index;
 }
 
-void FLASH_End(void)
+/* Checks the image against the CRC stored after the module, using the CRC computed while
+ * it was received when the chunks came in order and reading it back otherwise. */
+static bool FLASH_VerifyImage(uint32_t fw_len)
+{
+    uint32_t crc_length = FLASH_ModuleLength(FLASH_SERIAL, External_Flash_Start_Address);
+    if (crc_length == 0 || crc_length + 4 > fw_len)
+        return false;
+
+    uint8_t buf[256];
+    sFLASH_ReadBuffer(buf, External_Flash_Start_Address + crc_length, 4);
+    uint32_t expected_crc = (buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+
+    uint32_t crc_end = External_Flash_Start_Address + crc_length;
+    if (Flash_CRC_Valid && Flash_CRC_Limit == crc_end && Flash_CRC_Address >= crc_end)
+        return Flash_Update_CRC == expected_crc;
+
+    uint32_t crc = 0;
+    for (uint32_t offset = 0; offset < crc_length; offset += sizeof(buf))
+    {
+        uint32_t length = crc_length - offset < sizeof(buf) ? crc_length - offset : sizeof(buf);
+        sFLASH_ReadBuffer(buf, External_Flash_Start_Address + offset, length);
+        crc = Compute_CRC32(crc, buf, length);
+    }
+    return crc == expected_crc;
+}
+
+bool FLASH_End(void)
 {
     const module_info_t* module_info = FLASH_ModuleInfo(FLASH_SERIAL, FLASH_FW_ADDRESS);
     
     if (module_info != NULL) {
         uint32_t fw_len = (uint32_t)(External_Flash_Address - External_Flash_Start_Address);
+        if (!FLASH_VerifyImage(fw_len)) {
+            DEBUG("OTA image CRC mismatch, not applying the update");
+            return false;
+        }
+        module_info = FLASH_ModuleInfo(FLASH_SERIAL, FLASH_FW_ADDRESS);
         if (module_info->module_function==MODULE_FUNCTION_BOOTLOADER) {
             FLASH_CopyFW(FLASH_FW_ADDRESS, fw_len, false, true);
         } else {
@@ -249,6 +407,7 @@ void FLASH_End(void)
         //reboot
         NVIC_SystemReset();
     }
+    return false;
 }
 
 void system_init()
@@ -275,7 +434,7 @@ void timers_init(void)
       uint32_t err_code;
     // Initialize timer module, making it NOT use the scheduler
     APP_TIMER_INIT(APP_TIMER_PRESCALER, APP_TIMER_MAX_TIMERS, APP_TIMER_OP_QUEUE_SIZE, false);
-    err_code = app_timer_create(&millis_timer, APP_TIMER_MODE_REPEATED, millis_timer_timeout);
+    err_code = app_timer_create(&millis_timer, APP_TIMER_MODE_SINGLE_SHOT, millis_timer_timeout);
     APP_ERROR_CHECK(err_code);
     
     //start a Timer for uSec resolution
@@ -316,6 +475,60 @@ void external_flash_init(void)
     sFLASH_Init();
 }
 
+#ifdef SFLASH_BENCHMARK
+/* Last sector of the OTA download area, which holds nothing at boot */
+#define FLASH_BENCHMARK_ADDRESS (FLASH_STORAGE_ADDRESS - sFLASH_PAGESIZE)
+#define FLASH_BENCHMARK_BLOCK 256
+
+flash_benchmark_t flash_benchmark;
+
+static uint32_t flash_benchmark_kbps(uint32_t bytes, uint32_t start)
+{
+    uint32_t elapsed = system_micros() - start;
+    if (elapsed == 0) {
+        elapsed = 1;
+    }
+    return (uint32_t)(((uint64_t)bytes * 1000000) / ((uint64_t)elapsed * 1024));
+}
+
+/* Erases, programs and reads back a scratch sector and logs the throughput
+ * of each, needs the app timer running for system_micros() */
+void external_flash_benchmark(void)
+{
+    static uint8_t block[FLASH_BENCHMARK_BLOCK];
+    uint32_t offset, start;
+
+    start = system_micros();
+    sFLASH_EraseSector(FLASH_BENCHMARK_ADDRESS);
+    flash_benchmark.erase_kbps = flash_benchmark_kbps(sFLASH_PAGESIZE, start);
+
+    for (offset = 0; offset < FLASH_BENCHMARK_BLOCK; offset++) {
+        block[offset] = offset;
+    }
+    start = system_micros();
+    for (offset = 0; offset < sFLASH_PAGESIZE; offset += FLASH_BENCHMARK_BLOCK) {
+        sFLASH_WriteBuffer(block, FLASH_BENCHMARK_ADDRESS + offset, FLASH_BENCHMARK_BLOCK);
+    }
+    flash_benchmark.program_kbps = flash_benchmark_kbps(sFLASH_PAGESIZE, start);
+
+    flash_benchmark.verified = true;
+    start = system_micros();
+    for (offset = 0; offset < sFLASH_PAGESIZE; offset += FLASH_BENCHMARK_BLOCK) {
+        sFLASH_ReadBuffer(block, FLASH_BENCHMARK_ADDRESS + offset, FLASH_BENCHMARK_BLOCK);
+        if (block[FLASH_BENCHMARK_BLOCK - 1] != (uint8_t)(FLASH_BENCHMARK_BLOCK - 1)) {
+            flash_benchmark.verified = false;
+        }
+    }
+    flash_benchmark.read_kbps = flash_benchmark_kbps(sFLASH_PAGESIZE, start);
+
+    sFLASH_EraseSector(FLASH_BENCHMARK_ADDRESS);
+
+    DEBUG("External flash KB/s read: %lu program: %lu erase: %lu verified: %d",
+          flash_benchmark.read_kbps, flash_benchmark.program_kbps,
+          flash_benchmark.erase_kbps, flash_benchmark.verified);
+}
+#endif
+
 /**@brief Function for the Event Scheduler initialization.
  */
 void scheduler_init(void)
@@ -459,6 +672,22 @@ uint32_t timers_stop(void)
     return app_timer_stop(millis_timer);
 }
 
+/* Called from the system tick with the time until the next thing it has to
+ * do, so an idle device isn't woken up just to count time */
+void timers_schedule_tick(uint32_t milliseconds)
+{
+    if (milliseconds < 1) {
+        milliseconds = 1;
+    } else if (milliseconds > TIME_KEPPER_MAX_MILLISECONDS) {
+        milliseconds = TIME_KEPPER_MAX_MILLISECONDS;
+    }
+    power_stats.ticks++;
+    power_stats.tick_interval_ms = milliseconds;
+
+    uint32_t err_code = app_timer_start(millis_timer, APP_TIMER_TICKS(milliseconds, APP_TIMER_PRESCALER), NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
 int register_radio_callback(void (*radio_callback)(bool radio_active))
 {
     return ble_radio_notification_init(NRF_APP_PRIORITY_LOW,NRF_RADIO_NOTIFICATION_DISTANCE_800US,radio_callback);
@@ -628,13 +857,26 @@ void power_manage(void)
 //    
 //    sd_nvic_ClearPendingIRQ(RTC1_IRQn);
 //    nrf_drv_timer_disable(&micros_timer);
+    uint32_t start = system_millis();
     uint32_t err_code = sd_app_evt_wait();
     APP_ERROR_CHECK(err_code);
+    power_stats.wakes++;
+    power_stats.sleep_ms += system_millis() - start;
 //    nrf_drv_timer_enable(&micros_timer);
 //    err_code = timers_start();
 //    APP_ERROR_CHECK(err_code);
 }
 
+void get_power_stats(power_stats_t* stats)
+{
+    CRITICAL_REGION_ENTER();
+    stats->wakes = power_stats.wakes;
+    stats->ticks = power_stats.ticks;
+    stats->sleep_ms = power_stats.sleep_ms;
+    stats->tick_interval_ms = power_stats.tick_interval_ms;
+    CRITICAL_REGION_EXIT();
+}
+
 void shutdown(void)
 {
     nrf_drv_wdt_channel_feed(m_channel_id);
@@ -654,60 +896,8 @@ void FLASH_WriteProtection_Disable(uint32_t FLASH_Sectors)
     
 }
 
-static uint32_t crc32_tab[] = {
-    0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
-    0xe963a535, 0x9e6495a3,	0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
-    0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 0x1db71064, 0x6ab020f2,
-    0xf3b97148, 0x84be41de,	0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
-    0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec,	0x14015c4f, 0x63066cd9,
-    0xfa0f3d63, 0x8d080df5,	0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172,
-    0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b,	0x35b5a8fa, 0x42b2986c,
-    0xdbbbc9d6, 0xacbcf940,	0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
-    0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423,
-    0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924,
-    0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d,	0x76dc4190, 0x01db7106,
-    0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
-    0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d,
-    0x91646c97, 0xe6635c01, 0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e,
-    0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950,
-    0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
-    0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7,
-    0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0,
-    0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9, 0x5005713c, 0x270241aa,
-    0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
-    0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81,
-    0xb7bd5c3b, 0xc0ba6cad, 0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a,
-    0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683, 0xe3630b12, 0x94643b84,
-    0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
-    0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb,
-    0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc,
-    0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5, 0xd6d6a3e8, 0xa1d1937e,
-    0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
-    0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55,
-    0x316e8eef, 0x4669be79, 0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236,
-    0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28,
-    0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
-    0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f,
-    0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38,
-    0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21, 0x86d3d2d4, 0xf1d4e242,
-    0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
-    0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69,
-    0x616bffd3, 0x166ccf45, 0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2,
-    0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc,
-    0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
-    0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693,
-    0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
-    0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
-};
-
 uint32_t Compute_CRC32(uint32_t crc, const uint8_t* buf, size_t size)
 {
-    const uint8_t *p = buf;
-    crc = crc ^ ~0U;
-    
-    while (size--)
-        crc = crc32_tab[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
-    
-    return crc ^ ~0U;
+    return crc32_update(crc, buf, size);
 }
 
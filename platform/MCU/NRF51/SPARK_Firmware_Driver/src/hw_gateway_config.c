@@ -28,6 +28,7 @@
 #include "nrf_delay.h"
 #include "data_management_layer.h"
 #include "registered_data_services.h"
+#include "frame_ring.h"
 
 #include "debug.h"
 
@@ -38,15 +39,14 @@ bool m_memory_access_in_progress = false;
 //connection parameters
 ble_gap_conn_params_t m_connection_param;
 
-//Buffers needed for callbacks from SPI and BLE events, this is where data passes through
-uint8_t spi_slave_tx_buffer[SPI_SLAVE_TX_BUF_SIZE];
-volatile uint16_t spi_slave_tx_buffer_size;
-volatile uint16_t spi_slave_tx_buffer_start;
-
-
+//Buffer needed for callbacks from SPI events, this is where data for the clients passes through
+//it is filled from interrupt context and drained from gateway_loop, one frame per record
+//data for the Photon is queued by spi_slave_stream and sent from its interrupts
 uint8_t spi_slave_rx_buffer[SPI_SLAVE_RX_BUF_SIZE];
-volatile uint16_t spi_slave_rx_buffer_size;
-volatile uint16_t spi_slave_rx_buffer_start;
+frame_ring_t spi_slave_rx_ring;
+
+//client ID written over a frame in the ring once it is queued for its client
+#define SPI_FRAME_DONE 0xFF
 
 uint8_t info_data_service_buffer_size;
 uint8_t info_data_service_buffer[INFO_DATA_SERVICE_BUF_SIZE];
@@ -110,11 +110,7 @@ void gateway_init(void)
     connectionErrors = 0;
     m_peer_count = 0;
     m_memory_access_in_progress = false;
-    spi_slave_tx_buffer_size = 0;
-    spi_slave_tx_buffer_start = 0;
-    
-    spi_slave_rx_buffer_size = 0;
-    spi_slave_rx_buffer_start = 0;
+    frame_ring_init(&spi_slave_rx_ring, spi_slave_rx_buffer, SPI_SLAVE_RX_BUF_SIZE);
 
     info_data_service_buffer_size = 0;
     
@@ -144,13 +140,10 @@ void gateway_scan_start(void)
     state = BLE_SCANNING;
 }
 
-//interrupt driven function to put data into buffers for process in gateway_loop
+//interrupt driven function to queue data from the clients for the Photon
 void spi_slave_tx_data(uint8_t* tx_buffer, uint16_t size)
 {
-    if (spi_slave_tx_buffer_start+spi_slave_tx_buffer_size+size <= SPI_SLAVE_TX_BUF_SIZE) {
-        memcpy(spi_slave_tx_buffer+spi_slave_tx_buffer_start+spi_slave_tx_buffer_size, tx_buffer, size);
-        spi_slave_tx_buffer_size += size;
-    }
+    spi_slave_send_data(tx_buffer, size);
 }
 
 void spi_slave_rx_data(uint8_t *rx_buffer, uint16_t size)
@@ -168,9 +161,8 @@ void spi_slave_rx_data(uint8_t *rx_buffer, uint16_t size)
             dataManagementFeedData(length + BLE_HEADER_SIZE, rx_buffer + SPI_HEADER_SIZE);
         }
     } else {
-        if (spi_slave_rx_buffer_start+spi_slave_rx_buffer_size+size <= SPI_SLAVE_RX_BUF_SIZE) {
-            memcpy(spi_slave_rx_buffer+spi_slave_rx_buffer_start+spi_slave_rx_buffer_size, rx_buffer, size);
-            spi_slave_rx_buffer_size += size;
+        if (!frame_ring_put(&spi_slave_rx_ring, rx_buffer, size)) {
+            DEBUG("SPI RX ring full, dropped %d bytes", size);
         }
     }
 }
@@ -178,31 +170,31 @@ void spi_slave_rx_data(uint8_t *rx_buffer, uint16_t size)
 //needs to be called in the main loop to process data through the gateway
 void gateway_loop(void)
 {
-    if (spi_slave_rx_buffer_size > 0) {
-        int id = spi_slave_rx_buffer[2];
-        int bytesRx = spi_slave_rx_buffer_size;
-        DEBUG("Starting!");
-        if (id < MAX_CLIENTS) {
-            DEBUG("Sending down data of size %d on id %d", spi_slave_rx_buffer_size, id);
-            //this data is for one of the connected bluz DK boards
-            client_send_data(spi_slave_rx_buffer + spi_slave_rx_buffer_start, bytesRx);
-            spi_slave_rx_buffer_size -= bytesRx;
-            spi_slave_rx_buffer_start += bytesRx;
-            if (spi_slave_rx_buffer_size == 0) {
-                spi_slave_rx_buffer_start = 0;
-            }
+    uint8_t* frame;
+    uint16_t frameSize;
+    bool blocked[MAX_CLIENTS] = {false};
+
+    //this data is for the connected bluz DK boards
+    //a frame stays in the ring until its client's downlink queue has room for it,
+    //the frames behind it for the other clients are queued in the meantime
+    for (frame = frame_ring_peek(&spi_slave_rx_ring, &frameSize); frame != NULL;
+         frame = frame_ring_peek_next(&spi_slave_rx_ring, frame, &frameSize)) {
+        int id = frame[2];
+        if (id >= MAX_CLIENTS || blocked[id]) {
+            continue;
         }
-    }
-    
-    if (spi_slave_tx_buffer_size > 0) {
-        int bytesTx = spi_slave_tx_buffer_size;
-        spi_slave_send_data(spi_slave_tx_buffer+spi_slave_tx_buffer_start, bytesTx);
-
-        spi_slave_tx_buffer_size -= bytesTx;
-        spi_slave_tx_buffer_start += bytesTx;
-        if (spi_slave_tx_buffer_size == 0) {
-            spi_slave_tx_buffer_start = 0;
+        if (!client_send_data(frame, frameSize)) {
+            //keep the later frames for this client in order behind this one
+            blocked[id] = true;
+            continue;
         }
+        DEBUG("Queued down data of size %d on id %d", frameSize, id);
+        frame[2] = SPI_FRAME_DONE;
+    }
+
+    //free the frames that are done, up to the oldest one still waiting
+    while ((frame = frame_ring_peek(&spi_slave_rx_ring, &frameSize)) != NULL && frame[2] >= MAX_CLIENTS) {
+        frame_ring_consume(&spi_slave_rx_ring);
     }
 
     if (info_data_service_buffer_size > 0) {
@@ -270,6 +262,16 @@ void setGatewayConnParameters(int minimum, int maximum)
     m_connection_param.max_conn_interval = MSEC_TO_UNITS(maximum, UNIT_1_25_MS);
 }
 
+void gateway_spi_buffer_stats(frame_ring_stats_t* tx, frame_ring_stats_t* rx)
+{
+    if (tx) {
+        spi_slave_stream_stats(NULL, tx);
+    }
+    if (rx) {
+        *rx = spi_slave_rx_ring.stats;
+    }
+}
+
 ble_gap_conn_params_t get_gw_conn_params(void)
 {
     return m_connection_param;
@@ -20,6 +20,8 @@
 #include "registered_data_services.h"
 #include "deviceid_hal.h"
 #include "bluetooth_le_hal.h"
+#include "power_stats.h"
+#include "socket_manager.h"
 //#include "system_mode.h"
 
 extern "C" {
@@ -29,6 +31,14 @@ extern "C" {
 
 InfoDataService* InfoDataService::m_pInstance = NULL;
 
+static void write_be32(uint8_t* p, uint32_t value)
+{
+    p[0] = (value >> 24) & 0xFF;
+    p[1] = (value >> 16) & 0xFF;
+    p[2] = (value >> 8) & 0xFF;
+    p[3] = value & 0xFF;
+}
+
 InfoDataService* InfoDataService::instance()
 {
     if (!m_pInstance) {  // Only allow one instance of class to be generated.
@@ -92,6 +102,58 @@ int32_t InfoDataService::DataCallback(uint8_t *data, int16_t length)
             break;
         }
 #endif
+        case GET_SERVICE_STATS: {
+            if (length < 2) {
+                break;
+            }
+            //[service][SERVICE_STATS_RESULTS][service ID][registered][packets][bytes][drops], counters big endian
+            data_service_stats_t stats;
+            bool registered = DataManagementLayer::getServiceStats(data[1], &stats);
+
+            uint8_t rsp[16 + offset];
+            rsp[0 + offset] = INFO_DATA_SERVICE & 0xFF;
+            rsp[1 + offset] = SERVICE_STATS_RESULTS & 0xFF;
+            rsp[2 + offset] = data[1];
+            rsp[3 + offset] = registered;
+            uint32_t counters[3] = { stats.packets, stats.bytes, stats.drops };
+            for (int i = 0; i < 3; i++) {
+                write_be32(rsp + 4 + offset + i*4, counters[i]);
+            }
+
+            DataManagementLayer::sendData(16 + offset, rsp);
+            break;
+        }
+        case GET_POWER_STATS: {
+            //[service][POWER_STATS_RESULTS][wakes][ticks][sleep ms][tick interval ms], counters big endian
+            power_stats_t stats;
+            get_power_stats(&stats);
+
+            uint8_t rsp[18 + offset];
+            rsp[0 + offset] = INFO_DATA_SERVICE & 0xFF;
+            rsp[1 + offset] = POWER_STATS_RESULTS & 0xFF;
+            uint32_t counters[4] = { stats.wakes, stats.ticks, stats.sleep_ms, stats.tick_interval_ms };
+            for (int i = 0; i < 4; i++) {
+                write_be32(rsp + 2 + offset + i*4, counters[i]);
+            }
+
+            DataManagementLayer::sendData(18 + offset, rsp);
+            break;
+        }
+        case GET_SOCKET_STATS: {
+            if (length < 2 || data[1] >= SocketManager::MAX_NUMBER_OF_SOCKETS) {
+                break;
+            }
+            //[service][SOCKET_STATS_RESULTS][socket ID][buffered bytes][dropped bytes], counters big endian
+            uint8_t rsp[11 + offset];
+            rsp[0 + offset] = INFO_DATA_SERVICE & 0xFF;
+            rsp[1 + offset] = SOCKET_STATS_RESULTS & 0xFF;
+            rsp[2 + offset] = data[1];
+            write_be32(rsp + 3 + offset, SocketManager::instance()->bytes_available(data[1]));
+            write_be32(rsp + 7 + offset, SocketManager::instance()->dropped_bytes(data[1]));
+
+            DataManagementLayer::sendData(11 + offset, rsp);
+            break;
+        }
     }
     return 1;
 }
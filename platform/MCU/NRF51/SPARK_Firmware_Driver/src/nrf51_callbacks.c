@@ -68,9 +68,7 @@ void button_event_handler(uint8_t pin_no, uint8_t button_action)
 
 void millis_timer_timeout(void * p_context)
 {
-    //TO DO
-    //This will get called every ms from the RTC, keep track of time
-//    system_milliseconds++;
+    //Single shot from the RTC, the system tick schedules the next one
     HAL_SysTick_Handler();
 }
 
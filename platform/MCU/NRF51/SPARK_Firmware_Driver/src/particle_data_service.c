@@ -18,7 +18,12 @@
 #include "particle_data_service.h"
 #include "nrf51_config.h"
 
-void particle_service_send_data(uint8_t* data, uint16_t len)
+uint32_t particle_service_send_data(uint8_t* data, uint16_t len)
 {
-    scs_data_send(&m_scs, data, len);
+    return scs_data_send(&m_scs, data, len);
+}
+
+uint32_t particle_service_send_datav(const io_vector_t* vector, uint8_t count)
+{
+    return scs_data_sendv(&m_scs, vector, count);
 }
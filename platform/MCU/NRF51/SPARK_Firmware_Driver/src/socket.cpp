@@ -22,12 +22,19 @@
 #include <cstring>
 #include <stdio.h>
 
-Socket::Socket() { id=-1;inUse=false; bufferLength=0;bufferStart=0; }
+//feed() and consume() run in different contexts, the data must be visible before the counter that publishes it
+#define socket_barrier() __sync_synchronize()
+
+static_assert((Socket::SOCKET_BUFFER_SIZE & (Socket::SOCKET_BUFFER_SIZE - 1)) == 0, "SOCKET_BUFFER_SIZE must be a power of 2");
+
+Socket::Socket() { id=-1;inUse=false; bytesFed=0;bytesRead=0;creditSent=0;droppedBytes=0; }
 
 int32_t Socket::init(uint8_t family, uint8_t type, uint8_t protocol, uint16_t port, uint32_t nif)
 {
-    bufferLength=0;
-    bufferStart=0;
+    bytesFed=0;
+    bytesRead=0;
+    creditSent=0;
+    droppedBytes=0;
     inUse = true;
     this->family = family;
     this->type = type;
@@ -68,59 +75,114 @@ int32_t Socket::connect(uint32_t sockid, const sockaddr_b *addr, long addrlen)
     memcpy(data+9+offset, addr, addrlen);
     
     DataManagementLayer::sendData(9+addrlen+offset, data);
+    
+    //advertise the whole receive buffer
+    sendCredit();
     return 0;
 }
-int32_t Socket::send(const void* data, uint32_t len)
+
+void Socket::sendCredit()
 {
-    int offset = 0;
-#if PLATFORM_ID==269
-    offset = 3;
+    uint32_t consumed = bytesRead;
+    
+#if PLATFORM_ID!=269
+    //format of the credit is: <total bytes consumed><buffer size>
+    //the gateway may have up to <buffer size> bytes in flight past <total bytes consumed>
+    uint8_t data[8];
+    data[0] = SOCKET_DATA_SERVICE & 0xFF;
+    data[1] = ((SOCKET_CREDIT << 4) & 0xF0) | (id & 0x0F);
+
+    data[2] = (consumed >> 24) & 0xFF;
+    data[3] = (consumed >> 16) & 0xFF;
+    data[4] = (consumed >> 8) & 0xFF;
+    data[5] = consumed & 0xFF;
+
+    data[6] = (SOCKET_BUFFER_SIZE & 0xFF00) >> 8;
+    data[7] = SOCKET_BUFFER_SIZE & 0xFF;
+
+    DataManagementLayer::sendData(sizeof(data), data);
 #endif
+    //on the gateway itself the socket is served by the Photon, which doesn't read credits
+    creditSent = consumed;
+}
 
+int32_t Socket::send(const void* data, uint32_t len)
+{
     DEBUG("Sending on socket %d data of size %d!", id, len);
-    uint8_t dataPlusID[len+2+offset];
-    dataPlusID[0+offset] = SOCKET_DATA_SERVICE & 0xFF;
-    dataPlusID[1+offset] = ((SOCKET_DATA << 4) & 0xF0) | (id & 0x0F);
-    
-    memcpy(dataPlusID+2+offset, data, len);
+    uint8_t header[2];
+    header[0] = SOCKET_DATA_SERVICE & 0xFF;
+    header[1] = ((SOCKET_DATA << 4) & 0xF0) | (id & 0x0F);
     
-//    uint8_t dataPlusID[len];
-//    memcpy(dataPlusID, data, len);
+    //the payload is only copied once, into the radio queue or the SPI buffer
+    io_vector_t vector[2] = {
+        { header, sizeof(header) },
+        { (const uint8_t*)data, (uint16_t)len }
+    };
     
-    DataManagementLayer::sendData(len+2+offset, dataPlusID);
+    if (!DataManagementLayer::sendDatav(vector, 2)) {
+        return -1;
+    }
     return len;
 }
 int32_t Socket::receive(void* data, uint32_t len, unsigned long _timeout)
 {
-    if (bufferLength > 0) {
-        DEBUG("When entering receive, buffer length is %d and buffer start is %d", bufferLength, bufferStart);
+    uint32_t bytesCopied = 0;
+    const uint8_t* span;
+    int32_t spanLength;
+    
+    //at most two spans when the data wraps around the end of the buffer
+    while (bytesCopied < len && (spanLength = peek(&span)) > 0) {
+        uint32_t bytesToCopy = spanLength;
+        if (bytesToCopy > len - bytesCopied) {
+            bytesToCopy = len - bytesCopied;
+        }
+        memcpy((uint8_t*)data + bytesCopied, span, bytesToCopy);
+        consume(bytesToCopy);
+        bytesCopied += bytesToCopy;
     }
     
-    int bytesToCopy = len;
-    if (len > bufferLength) {
-        //they are asking for too much data
-        bytesToCopy = bufferLength;
+    if (bytesCopied > 0) {
+        DEBUG("Socket data was received from id %d, read %d bytes. Leaving us %d bytes left", id, bytesCopied, bytes_available());
     }
     
-    memcpy(data, buffer+bufferStart, bytesToCopy);
-    bufferStart += bytesToCopy;
-    bufferLength -= bytesToCopy;
+    return bytesCopied;
+}
+
+int32_t Socket::peek(const uint8_t** data)
+{
+    uint32_t start = bytesRead;
+    uint32_t length = bytesFed - start;
+    socket_barrier();
     
-    if (bufferLength == 0) {
-        bufferStart = 0;
+    uint32_t position = start % SOCKET_BUFFER_SIZE;
+    if (length > SOCKET_BUFFER_SIZE - position) {
+        length = SOCKET_BUFFER_SIZE - position;
+    }
+    *data = buffer + position;
+    return length;
+}
+
+int32_t Socket::consume(uint32_t len)
+{
+    uint32_t available = bytes_available();
+    if (len > available) {
+        len = available;
     }
     
+    socket_barrier();
+    bytesRead += len;
     
-    if (bytesToCopy > 0) {
-        DEBUG("Socket data was received from id %d, read %d bytes. Leaving us %d bytes left, starting at %d", id, bytesToCopy, bufferLength, bufferStart);
+    if (inUse && bytesRead - creditSent >= (uint32_t)CREDIT_THRESHOLD) {
+        sendCredit();
     }
-    
-    return bytesToCopy;
+    return len;
 }
+
 int32_t Socket::close()
 {
-    bufferLength=0;
-    bufferStart=0;
+    bytesFed=0;
+    bytesRead=0;
+    creditSent=0;
     inUse = false;
 //    uint8_t data[2];
 //    data[0] = SOCKET_DATA_SERVICE & 0xFF;
@@ -132,19 +194,30 @@ int32_t Socket::close()
 
 int32_t Socket::bytes_available()
 {
-    return bufferLength;
+    return bytesFed - bytesRead;
 }
 
 int32_t Socket::feed(uint8_t* data, uint32_t len)
 {
-    if (bufferLength+len > SOCKET_BUFFER_SIZE) {
-        //can't put all this data in.
+    uint32_t head = bytesFed;
+    if (head - bytesRead + len > SOCKET_BUFFER_SIZE) {
+        //can't put all this data in: the gateway sent past the credit, or it doesn't read credits
+        droppedBytes += len;
+        DEBUG("Socket id %d dropped %d bytes, %d in total", id, len, droppedBytes);
         return -1;
     }
     
-    memcpy(buffer+bufferStart+bufferLength, data, len);
-    bufferLength+=len;
-//    DEBUG("Fed %d bytes to socket id %d, leaving it with %d bytes", len, id, bufferLength);
+    uint32_t position = head % SOCKET_BUFFER_SIZE;
+    uint32_t firstPart = SOCKET_BUFFER_SIZE - position;
+    if (firstPart > len) {
+        firstPart = len;
+    }
+    memcpy(buffer+position, data, firstPart);
+    memcpy(buffer, data+firstPart, len-firstPart);
+    
+    socket_barrier();
+    bytesFed = head + len;
+//    DEBUG("Fed %d bytes to socket id %d, leaving it with %d bytes", len, id, bytes_available());
     
     return 0;
 }
@@ -52,6 +52,18 @@ int32_t SocketManager::receive(uint32_t sd, void* buffer, uint32_t len, unsigned
 {
     return sockets[sd].receive(buffer, len, _timeout);
 }
+int32_t SocketManager::peek(uint32_t sd, const uint8_t** data)
+{
+    return sockets[sd].peek(data);
+}
+int32_t SocketManager::consume(uint32_t sd, uint32_t len)
+{
+    return sockets[sd].consume(len);
+}
+uint32_t SocketManager::dropped_bytes(uint32_t sd)
+{
+    return sockets[sd].dropped_bytes();
+}
 int32_t SocketManager::close(uint32_t sockid)
 {
     sockets[sockid].close();
@@ -83,9 +95,9 @@ int32_t SocketManager::getServiceID()
 int32_t SocketManager::DataCallback(uint8_t *data, int16_t length)
 {
     uint16_t socketID = 0x00 | data[0];
-    if (sockets[socketID].inUse)
+    if (length >= 1 && socketID < MAX_NUMBER_OF_SOCKETS && sockets[socketID].inUse)
     {
-        sockets[socketID].feed(data+1, length-1);
+        return sockets[socketID].feed(data+1, length-1);
     }
     return -1;
 }
@@ -17,7 +17,6 @@
 
 static SPI_config_t spi_config_table[2];
 static NRF_SPI_Type *spi_base[2] = {NRF_SPI0, NRF_SPI1};
-static NRF_SPI_Type *SPI;
 
 uint32_t* spi_master_init(SPI_module_number_t spi_num, SPI_config_t *spi_config)
 {
@@ -63,26 +62,34 @@ bool spi_master_disable(SPI_module_number_t spi_num)
 
 bool spi_master_tx_rx(SPI_module_number_t spi_num, uint16_t transfer_size, const uint8_t *tx_data, uint8_t *rx_data)
 {
+    /* the register block is local so that a transfer on one module interrupted
+     * by a transfer on the other (e.g. the external flash accessed from an
+     * event handler) keeps writing to its own module */
+    NRF_SPI_Type *spi;
     volatile uint32_t *SPI_DATA_READY;
-    uint32_t tmp; 
     if(tx_data == 0 || rx_data == 0)
     {
         return false;
     }
+    if(transfer_size == 0)
+    {
+        return true;
+    }
     
-    SPI = spi_base[spi_num];
-    SPI_DATA_READY = &SPI->EVENTS_READY;
+    spi = spi_base[spi_num];
+    SPI_DATA_READY = &spi->EVENTS_READY;
     /* enable slave (slave select active low) */
 //    nrf_gpio_pin_clear(spi_config_table[spi_num].pin_CSN);
     
     *SPI_DATA_READY = 0; 
     
-    SPI->TXD = (uint32_t)*tx_data++;
-    tmp = (uint32_t)*tx_data++;
+    /* TXD is double buffered, the next byte is queued before the previous one
+     * is read back. A byte is always read from tx_data before the byte at the
+     * same index is written to rx_data, so both may be the same buffer */
+    spi->TXD = (uint32_t)*tx_data++;
     while(--transfer_size)
     {
-        SPI->TXD =  tmp;
-        tmp = (uint32_t)*tx_data++;
+        spi->TXD = (uint32_t)*tx_data++;
         
         /* Wait for the transaction complete or timeout (about 10ms - 20 ms) */
         while (*SPI_DATA_READY == 0);
@@ -90,13 +97,13 @@ bool spi_master_tx_rx(SPI_module_number_t spi_num, uint16_t transfer_size, const
         /* clear the event to be ready to receive next messages */
         *SPI_DATA_READY = 0;
         
-        *rx_data++ = SPI->RXD; 
+        *rx_data++ = spi->RXD; 
     }
       
     /* Wait for the transaction complete or timeout (about 10ms - 20 ms) */
     while (*SPI_DATA_READY == 0);
 
-    *rx_data = SPI->RXD;
+    *rx_data = spi->RXD;
 
     /* disable slave (slave select active low) */
 //    nrf_gpio_pin_set(spi_config_table[spi_num].pin_CSN);
@@ -113,32 +120,32 @@ bool spi_master_tx(SPI_module_number_t spi_num, uint16_t transfer_size, const ui
         return false;
     }
     
-    SPI = spi_base[spi_num];
+    NRF_SPI_Type *spi = spi_base[spi_num];
     
     /* enable slave (slave select active low) */
     nrf_gpio_pin_clear(spi_config_table[spi_num].pin_CSN);
     
-    SPI->EVENTS_READY = 0; 
+    spi->EVENTS_READY = 0; 
     
-    SPI->TXD = (uint32_t)*tx_data++;
+    spi->TXD = (uint32_t)*tx_data++;
     
     while(--transfer_size)
     {
-        SPI->TXD =  (uint32_t)*tx_data++;
+        spi->TXD =  (uint32_t)*tx_data++;
 
         /* Wait for the transaction complete or timeout (about 10ms - 20 ms) */
-        while (SPI->EVENTS_READY == 0);
+        while (spi->EVENTS_READY == 0);
         
         /* clear the event to be ready to receive next messages */
-        SPI->EVENTS_READY = 0;
+        spi->EVENTS_READY = 0;
         
-//        dummyread = SPI->RXD;
+//        dummyread = spi->RXD;
     }
     
     /* Wait for the transaction complete or timeout (about 10ms - 20 ms) */
-    while (SPI->EVENTS_READY == 0);
+    while (spi->EVENTS_READY == 0);
 
-//    dummyread = SPI->RXD;
+//    dummyread = spi->RXD;
 
     /* disable slave (slave select active low) */
     nrf_gpio_pin_set(spi_config_table[spi_num].pin_CSN);
@@ -153,32 +160,32 @@ bool spi_master_rx(SPI_module_number_t spi_num, uint16_t transfer_size, uint8_t
         return false;
     }
     
-    SPI = spi_base[spi_num];
+    NRF_SPI_Type *spi = spi_base[spi_num];
     
     /* enable slave (slave select active low) */
     nrf_gpio_pin_clear(spi_config_table[spi_num].pin_CSN);
 
-    SPI->EVENTS_READY = 0; 
+    spi->EVENTS_READY = 0; 
     
-    SPI->TXD = 0;
+    spi->TXD = 0;
     
     while(--transfer_size)
     {
-        SPI->TXD = 0;
+        spi->TXD = 0;
 
         /* Wait for the transaction complete or timeout (about 10ms - 20 ms) */
-        while (SPI->EVENTS_READY == 0);
+        while (spi->EVENTS_READY == 0);
         
         /* clear the event to be ready to receive next messages */
-        SPI->EVENTS_READY = 0;
+        spi->EVENTS_READY = 0;
         
-        *rx_data++ = SPI->RXD;
+        *rx_data++ = spi->RXD;
     }
     
     /* Wait for the transaction complete or timeout (about 10ms - 20 ms) */
-    while (SPI->EVENTS_READY == 0);
+    while (spi->EVENTS_READY == 0);
 
-    *rx_data = SPI->RXD;
+    *rx_data = spi->RXD;
 
     /* disable slave (slave select active low) */
     nrf_gpio_pin_set(spi_config_table[spi_num].pin_CSN);
@@ -4,10 +4,12 @@
 #include "spi_slave_stream.h"
 #include "spi_slave.h"
 #include "nrf_delay.h"
+#include "nrf_drv_gpiote.h"
+#include "app_util_platform.h"
+#include "spi_stream_tx.h"
 
 #include "debug.h"
 
-volatile bool busy;
 uint8_t m_tx_buf[SPI_SLAVE_HW_TX_BUF_SIZE];   /**< SPI TX buffer. */
 uint8_t m_rx_buf[SPI_SLAVE_HW_RX_BUF_SIZE];   /**< SPI RX buffer. */
 
@@ -15,8 +17,37 @@ uint8_t m_rx_buf[SPI_SLAVE_HW_RX_BUF_SIZE];   /**< SPI RX buffer. */
 uint8_t buf[768];
 int currentSPISlaveBufferSize;
 
+//frames waiting for the Photon, sent from the SPI and MR interrupts
+static uint8_t tx_queue_buf[SPI_SLAVE_TX_QUEUE_SIZE];
+static spi_stream_tx_t stream;
+
 void (*rx_callback)(uint8_t *m_tx_buf, uint16_t size);
 
+static void set_pts(bool level)
+{
+	if (level) {
+		nrf_gpio_pin_set(SPIS_PTS_PIN);
+	} else {
+		nrf_gpio_pin_clear(SPIS_PTS_PIN);
+	}
+}
+
+static void set_sa(bool level)
+{
+	if (level) {
+		nrf_gpio_pin_set(SPIS_SA_PIN);
+	} else {
+		nrf_gpio_pin_clear(SPIS_SA_PIN);
+	}
+}
+
+static bool master_ready(void)
+{
+	return nrf_gpio_pin_read(SPIS_MR_PIN) != 0;
+}
+
+static const spi_stream_tx_ops_t stream_ops = { set_pts, set_sa, master_ready };
+
 void ble_radio_ntf_handler(bool radio_state)
 {
 //	if(radio_state==true)
@@ -29,38 +60,76 @@ void ble_radio_ntf_handler(bool radio_state)
 //	}
 }
 
-/**@brief Function to set the tx buffer for next transaction.
- *
- * This will fill the tx buffer with data that will be sent to the master on the next transaction.
+/**@brief Function to queue data for the master.
  *
  * @param[in] data buffer
  * @param[in] data buffer
+ *
+ * @return true when the data was queued
  */
-void spi_slave_send_data(uint8_t *buf, uint16_t size)
+bool spi_slave_send_data(uint8_t *buf, uint16_t size)
 {
-	DEBUG("Entering spi_send, size %d", size);
-	//let the Photon know we are about to transmit
-	nrf_gpio_pin_set(SPIS_PTS_PIN);
-
-	while (nrf_gpio_pin_read(SPIS_MR_PIN) == 0) { }
-
-	//now let's send the size of the data first
-	m_tx_buf[0] = (( (size) & 0xFF00) >> 8);
-	m_tx_buf[1] = ( (size) & 0xFF);
-	busy = true;
-	nrf_gpio_pin_set(SPIS_SA_PIN);
-	while (busy) { }
-
-	//now lets send the data one chunk at a time
-	for (int i = 0; i < size; i+=SPI_SLAVE_HW_TX_BUF_SIZE) {
-		uint16_t chunkLength = (size-i > SPI_SLAVE_HW_TX_BUF_SIZE ? SPI_SLAVE_HW_TX_BUF_SIZE : size-i);
-		memcpy(m_tx_buf, buf+i, chunkLength);
-		//alert the particle board we have data to send
-		busy = true;
-		nrf_gpio_pin_set(SPIS_SA_PIN);
-		while (busy) { }
+	io_vector_t vector = { buf, size };
+	return spi_slave_send_datav(&vector, 1);
+}
+
+/**@brief Function to queue a message made of scattered parts for the master.
+ *
+ * The message is gathered into the queue and sent from the SPI interrupts, so
+ * this returns without waiting for the master. From the main loop it waits
+ * for room in the queue, from an event handler the message is dropped and
+ * counted when the queue is full.
+ *
+ * @param[in] vector parts of the message
+ * @param[in] count number of parts
+ *
+ * @return true when the message was queued
+ */
+bool spi_slave_send_datav(const io_vector_t *vector, uint8_t count)
+{
+	uint16_t size = io_vector_length(vector, count);
+
+	if (current_int_priority_get() == NRF_APP_PRIORITY_THREAD) {
+		while (!spi_stream_tx_fits(&stream, size) && !spi_stream_tx_idle(&stream)) { }
 	}
-	DEBUG("Done in spi_slave_send_data");
+
+	uint8_t *frame;
+	CRITICAL_REGION_ENTER();
+	frame = spi_stream_tx_alloc(&stream, size);
+	if (frame != NULL) {
+		io_vector_copy(vector, count, 0, frame, size);
+		spi_stream_tx_commit(&stream);
+	}
+	CRITICAL_REGION_EXIT();
+
+	if (frame == NULL) {
+		DEBUG("SPI TX queue full, dropped %d bytes", size);
+		return false;
+	}
+	return true;
+}
+
+void spi_slave_stream_stats(spi_stream_tx_stats_t *stats, frame_ring_stats_t *queue)
+{
+	CRITICAL_REGION_ENTER();
+	if (stats) {
+		*stats = stream.stats;
+	}
+	if (queue) {
+		*queue = stream.queue.stats;
+	}
+	CRITICAL_REGION_EXIT();
+}
+
+/**@brief Function for the MR pin event.
+ *
+ * The master is ready for the frame announced with PTS.
+ */
+static void master_ready_handle(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
+{
+	CRITICAL_REGION_ENTER();
+	spi_stream_tx_master_ready(&stream);
+	CRITICAL_REGION_EXIT();
 }
 
 /**@brief Function for SPI slave event callback.
@@ -73,10 +142,15 @@ static void spi_slave_event_handle(spi_slave_evt_t event)
 {
     if (event.evt_type == SPI_SLAVE_XFER_DONE)
     {
-    	if (busy) {
-    		nrf_gpio_pin_clear(SPIS_SA_PIN);
-			nrf_gpio_pin_clear(SPIS_PTS_PIN);
-    	} else {
+    	bool sent;
+    	const uint8_t *tx_data;
+    	uint16_t tx_size;
+    	CRITICAL_REGION_ENTER();
+    	sent = spi_stream_tx_transfer_done(&stream);
+    	//the next chunk of a frame is clocked out of the queue where it sits
+    	tx_size = spi_stream_tx_buffer(&stream, &tx_data);
+    	CRITICAL_REGION_EXIT();
+    	if (!sent) {
 			if (event.rx_amount == 255) {
 				memcpy(buf+currentSPISlaveBufferSize, m_rx_buf, 254);
 				currentSPISlaveBufferSize+=254;
@@ -88,11 +162,11 @@ static void spi_slave_event_handle(spi_slave_evt_t event)
 			}
     	}
 		//Set buffers.
-		spi_slave_buffers_set(m_tx_buf, m_rx_buf, SPI_SLAVE_HW_TX_BUF_SIZE, SPI_SLAVE_HW_RX_BUF_SIZE);
+		spi_slave_buffers_set((uint8_t *)tx_data, m_rx_buf, tx_size, SPI_SLAVE_HW_RX_BUF_SIZE);
     } else if (event.evt_type == SPI_SLAVE_BUFFERS_SET_DONE) {
-		if (busy) {
-			busy = false;
-		}
+    	CRITICAL_REGION_ENTER();
+    	spi_stream_tx_buffers_set_done(&stream);
+    	CRITICAL_REGION_EXIT();
     } else if (event.evt_type == SPI_SLAVE_RESOURCE_HELD) {
     }
 }
@@ -108,15 +182,24 @@ uint32_t spi_slave_stream_init(void (*a)(uint8_t *m_tx_buf, uint16_t size))
     nrf_gpio_cfg_output(SPIS_PTS_PIN);
     nrf_gpio_pin_clear(SPIS_PTS_PIN);
 
-	nrf_gpio_cfg_input(SPIS_MR_PIN, NRF_GPIO_PIN_PULLDOWN);
-
 	currentSPISlaveBufferSize = 0;
     // Enable Radio Notification, allows us to alert the master when we are busy
 	err_code = ble_radio_notification_init(NRF_APP_PRIORITY_LOW,NRF_RADIO_NOTIFICATION_DISTANCE_800US,ble_radio_ntf_handler);
 	APP_ERROR_CHECK(err_code);
 
     rx_callback = a;
-	busy = false;
+	spi_stream_tx_init(&stream, &stream_ops, m_tx_buf, SPI_SLAVE_HW_TX_BUF_SIZE, tx_queue_buf, sizeof(tx_queue_buf));
+
+	//the master raising MR moves the transmitter on instead of a busy wait
+	if (!nrf_drv_gpiote_is_init()) {
+		err_code = nrf_drv_gpiote_init();
+		APP_ERROR_CHECK(err_code);
+	}
+	nrf_drv_gpiote_in_config_t mr_config = GPIOTE_CONFIG_IN_SENSE_LOTOHI(false);
+	mr_config.pull = NRF_GPIO_PIN_PULLDOWN;
+	err_code = nrf_drv_gpiote_in_init(SPIS_MR_PIN, &mr_config, master_ready_handle);
+	APP_ERROR_CHECK(err_code);
+	nrf_drv_gpiote_in_event_enable(SPIS_MR_PIN, true);
 
 	spi_slave_set_cs_pull_up_config(NRF_GPIO_PIN_PULLUP);
 
@@ -136,12 +219,11 @@ uint32_t spi_slave_stream_init(void (*a)(uint8_t *m_tx_buf, uint16_t size))
     APP_ERROR_CHECK(err_code);
 
     //Set buffers.
-	busy = true;
     err_code = spi_slave_buffers_set(m_tx_buf, m_rx_buf, sizeof(m_tx_buf), sizeof(m_rx_buf));
     APP_ERROR_CHECK(err_code);
 
 	//wait for the buffers to get set, otherwise we can cause weird race conditions
-	while (busy) { }
+	while (!stream.buffers_ready) { }
 
 
     return NRF_SUCCESS;
@@ -26,7 +26,7 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "sst25vf_spi.h"
-#include "spi_master.h"
+#include "spi_master_fast.h"
 #include "nrf_gpio.h"
 #include "nrf_error.h"
 #include "nrf_delay.h"
@@ -37,34 +37,21 @@ static void sFLASH_WriteByte(uint32_t WriteAddr, uint8_t byte);
 static void sFLASH_WriteBytes(const uint8_t *pBuffer, uint32_t WriteAddr, uint32_t NumByteToWrite);
 static void sFLASH_WriteEnable(void);
 static void sFLASH_WriteDisable(void);
-static uint8_t sFLASH_SendByte(uint8_t byte);\
+static void sFLASH_WaitForWordEnd(void);
+static void sFLASH_WaitForErase(void);
+static void sFLASH_SendCommand(uint8_t command, uint32_t address);
+static void sFLASH_Transfer(const uint8_t *pTxBuffer, uint8_t *pRxBuffer, uint32_t NumByteToTransfer);
+static uint8_t sFLASH_SendByte(uint8_t byte);
 static void sFLASH_CS_LOW(void);
 static void sFLASH_CS_HIGH(void);
 
-static uint8_t tx_data[TX_RX_MSG_LENGTH]; /**< SPI TX buffer. */
-static uint8_t rx_data[TX_RX_MSG_LENGTH]; /**< SPI RX buffer. */
+/* Longest transfer handed to spi_master_tx_rx, which takes a 16 bit size */
+#define sFLASH_MAX_TRANSFER             0x8000
 
-/**
-  * @brief Callback from SPI
-  * @param void
-  * @return void
-  */
-volatile bool spi_transmission_completed = false;
-void spi_master_event_handler(spi_master_evt_t spi_master_evt)
-{
-    switch (spi_master_evt.evt_type)
-    {
-        case SPI_MASTER_EVT_TRANSFER_COMPLETED:
-            //Data transmission is ended successful. 'rx_buffer' has data received from SPI slave.
-
-            spi_transmission_completed = true;
-            break;
-
-        default:
-            //No implementation needed.
-            break;
-    }
-}
+/* A sector erase was started with sFLASH_EraseSectorStart and nothing has
+ * waited for it yet. The chip ignores everything but a status read while
+ * busy, so each access waits for it first. */
+static bool sFLASH_ErasePending = false;
 
 /**
   * @brief Initializes SPI Flash
@@ -74,17 +61,19 @@ void spi_master_event_handler(spi_master_evt_t spi_master_evt)
 void sFLASH_Init(void)
 {
 	uint32_t Device_ID = 0;
-//	spi_base_address = spi_master_init(SFLASH_SPI, SPI_MODE0, (bool)0);
-	spi_master_config_t spi_config = SPI_MASTER_INIT_DEFAULT;
-	spi_config.SPI_Pin_SCK = SPIM0_SCK_PIN;
-	spi_config.SPI_Pin_MISO = SPIM0_MISO_PIN;
-	spi_config.SPI_Pin_MOSI = SPIM0_MOSI_PIN;
-	spi_config.SPI_Pin_SS = SPIM0_SS_PIN;
-	spi_config.SPI_CONFIG_ORDER = SPI_CONFIG_ORDER_MsbFirst;
-	spi_config.SPI_PriorityIRQ = APP_IRQ_PRIORITY_HIGH;
-
-	spi_master_open(SPI_MASTER_0, &spi_config);
-	spi_master_evt_handler_reg(SPI_MASTER_0, spi_master_event_handler);
+	/* Polled transfers, Chip Select is driven by this driver so that a
+	 * command can span several transfers */
+	SPI_config_t spi_config = {
+		.pin_SCK = SPIM0_SCK_PIN,
+		.pin_MOSI = SPIM0_MOSI_PIN,
+		.pin_MISO = SPIM0_MISO_PIN,
+		.pin_CSN = SPIM0_SS_PIN,
+		.frequency = SPI_FREQ_8MBPS,
+		.config.fields.mode = SPI_MODE_ZERO,
+		.config.fields.bit_order = SPI_BITORDER_MSB_LSB
+	};
+
+	spi_base_address = spi_master_init(SPI0, &spi_config);
 
 	/* Disable the write access to the FLASH */
 	sFLASH_WriteDisable();
@@ -124,6 +113,19 @@ void sFLASH_Init(void)
   * @retval None
   */
 void sFLASH_EraseSector(uint32_t SectorAddr)
+{
+  sFLASH_EraseSectorStart(SectorAddr);
+  /* Wait for the busy status to clear */
+  sFLASH_WaitForErase();
+}
+
+/**
+  * @brief  Starts erasing the specified FLASH sector and returns while the
+  *         FLASH is busy. The next access to the FLASH waits for the erase.
+  * @param  SectorAddr: address of the sector to erase.
+  * @retval None
+  */
+void sFLASH_EraseSectorStart(uint32_t SectorAddr)
 {
   /* Enable the write access to the FLASH */
   sFLASH_WriteEnable();
@@ -131,18 +133,12 @@ void sFLASH_EraseSector(uint32_t SectorAddr)
   /* Sector Erase */
   /* Select the FLASH: Chip Select low */
   sFLASH_CS_LOW();
-  /* Send Sector Erase instruction */
-  sFLASH_SendByte(sFLASH_CMD_SE);
-  /* Send SectorAddr high nibble address byte */
-  sFLASH_SendByte((SectorAddr & 0xFF0000) >> 16);
-  /* Send SectorAddr medium nibble address byte */
-  sFLASH_SendByte((SectorAddr & 0xFF00) >> 8);
-  /* Send SectorAddr low nibble address byte */
-  sFLASH_SendByte(SectorAddr & 0xFF);
+  /* Send Sector Erase instruction and SectorAddr */
+  sFLASH_SendCommand(sFLASH_CMD_SE, SectorAddr);
   /* Deselect the FLASH: Chip Select high */
   sFLASH_CS_HIGH();
-  /* Wait for the busy status to clear */
-  sFLASH_WaitForWriteEnd();
+
+  sFLASH_ErasePending = true;
 }
 
 /**
@@ -180,14 +176,8 @@ static void sFLASH_WriteByte(uint32_t WriteAddr, uint8_t byte)
 
   /* Select the FLASH: Chip Select low */
   sFLASH_CS_LOW();
-  /* Send "Byte Program" instruction */
-  sFLASH_SendByte(sFLASH_CMD_WRITE);
-  /* Send WriteAddr high nibble address byte to write to */
-  sFLASH_SendByte((WriteAddr & 0xFF0000) >> 16);
-  /* Send WriteAddr medium nibble address byte to write to */
-  sFLASH_SendByte((WriteAddr & 0xFF00) >> 8);
-  /* Send WriteAddr low nibble address byte to write to */
-  sFLASH_SendByte(WriteAddr & 0xFF);
+  /* Send "Byte Program" instruction and WriteAddr */
+  sFLASH_SendCommand(sFLASH_CMD_WRITE, WriteAddr);
   /* Send the byte */
   sFLASH_SendByte(byte);
   /* Deselect the FLASH: Chip Select high */
@@ -201,6 +191,9 @@ static void sFLASH_WriteByte(uint32_t WriteAddr, uint8_t byte)
   * @note   The address must be even and the number of bytes must be a multiple
   *         of two.
   * @note   Addresses to be written must be in the erased state
+  * @note   Uses the hardware end-of-write detection: while in AAI mode SO
+  *         outputs the RY/BY# status, so the end of each word program is a
+  *         GPIO read instead of a Read Status Register transaction.
   * @param  pBuffer: pointer to the buffer containing the data to be written
   *         to the FLASH.
   * @param  WriteAddr: FLASH's internal address to write to, must be even.
@@ -209,54 +202,62 @@ static void sFLASH_WriteByte(uint32_t WriteAddr, uint8_t byte)
   */
 static void sFLASH_WriteBytes(const uint8_t *pBuffer, uint32_t WriteAddr, uint32_t NumByteToWrite)
 {
+  uint8_t word[3] = { sFLASH_CMD_AAIP };
+  uint8_t rx[3];
+
+  sFLASH_WaitForErase();
+
+  /* Select the FLASH: Chip Select low */
+  sFLASH_CS_LOW();
+  /* Send "Enable SO RY/BY# Status" instruction */
+  sFLASH_SendByte(sFLASH_CMD_EBSY);
+  /* Deselect the FLASH: Chip Select high */
+  sFLASH_CS_HIGH();
+
   /* Enable the write access to the FLASH */
   sFLASH_WriteEnable();
 
   /* Select the FLASH: Chip Select low */
   sFLASH_CS_LOW();
-  /* Send "Auto Address Increment Word-Program" instruction */
-  sFLASH_SendByte(sFLASH_CMD_AAIP);
-  /* Send WriteAddr high nibble address byte to write to */
-  sFLASH_SendByte((WriteAddr & 0xFF0000) >> 16);
-  /* Send WriteAddr medium nibble address byte to write to */
-  sFLASH_SendByte((WriteAddr & 0xFF00) >> 8);
-  /* Send WriteAddr low nibble address byte to write to */
-  sFLASH_SendByte(WriteAddr & 0xFF);
-  /* Send the first byte */
-  sFLASH_SendByte(*pBuffer++);
-  /* Send the second byte */
-  sFLASH_SendByte(*pBuffer++);
+  /* Send "Auto Address Increment Word-Program" instruction and WriteAddr */
+  sFLASH_SendCommand(sFLASH_CMD_AAIP, WriteAddr);
+  /* Send the first two bytes */
+  sFLASH_Transfer(pBuffer, rx, 2);
+  pBuffer += 2;
   /* Update NumByteToWrite */
   NumByteToWrite -= 2;
   /* Deselect the FLASH: Chip Select high */
   sFLASH_CS_HIGH();
-  /* Wait for the busy status to clear */
-  sFLASH_WaitForWriteEnd();
+  /* Wait for RY/BY# */
+  sFLASH_WaitForWordEnd();
 
   /* while there is data to be written on the FLASH */
   while (NumByteToWrite)
   {
-	/* Select the FLASH: Chip Select low */
-	sFLASH_CS_LOW();
-	/* Send "Auto Address Increment Word-Program" instruction */
-	sFLASH_SendByte(sFLASH_CMD_AAIP);
-    /* Send the next byte and point on the next byte */
-    sFLASH_SendByte(*pBuffer++);
-    /* Send the next byte and point on the next byte */
-    sFLASH_SendByte(*pBuffer++);
+    /* The instruction and the next two bytes in one transfer */
+    word[1] = *pBuffer++;
+    word[2] = *pBuffer++;
     /* Update NumByteToWrite */
     NumByteToWrite -= 2;
+
+    /* Select the FLASH: Chip Select low */
+    sFLASH_CS_LOW();
+    sFLASH_Transfer(word, rx, sizeof(word));
     /* Deselect the FLASH: Chip Select high */
     sFLASH_CS_HIGH();
-    /* Wait for the busy status to clear */
-    sFLASH_WaitForWriteEnd();
+    /* Wait for RY/BY# */
+    sFLASH_WaitForWordEnd();
   }
 
+  /* Disable the write access to the FLASH, which ends AAI mode */
+  sFLASH_WriteDisable();
+
+  /* Select the FLASH: Chip Select low */
+  sFLASH_CS_LOW();
+  /* Send "Disable SO RY/BY# Status" instruction */
+  sFLASH_SendByte(sFLASH_CMD_DBSY);
   /* Deselect the FLASH: Chip Select high */
   sFLASH_CS_HIGH();
-
-  /* Disable the write access to the FLASH */
-  sFLASH_WriteDisable();
 }
 
 /**
@@ -309,26 +310,17 @@ void sFLASH_WriteBuffer(const uint8_t *pBuffer, uint32_t WriteAddr, uint32_t Num
   */
 void sFLASH_ReadBuffer(uint8_t* pBuffer, uint32_t ReadAddr, uint32_t NumByteToRead)
 {
+  sFLASH_WaitForErase();
+
   /* Select the FLASH: Chip Select low */
   sFLASH_CS_LOW();
 
-  /* Send "Read from Memory " instruction */
-  sFLASH_SendByte(sFLASH_CMD_READ);
+  /* Send "Read from Memory " instruction and ReadAddr */
+  sFLASH_SendCommand(sFLASH_CMD_READ, ReadAddr);
 
-  /* Send ReadAddr high nibble address byte to read from */
-  sFLASH_SendByte((ReadAddr & 0xFF0000) >> 16);
-  /* Send ReadAddr medium nibble address byte to read from */
-  sFLASH_SendByte((ReadAddr& 0xFF00) >> 8);
-  /* Send ReadAddr low nibble address byte to read from */
-  sFLASH_SendByte(ReadAddr & 0xFF);
-
-  while (NumByteToRead) /* while there is data to be read */
-  {
-    /* Read a byte from the FLASH and point to the next location */
-    *pBuffer++ = sFLASH_SendByte(sFLASH_DUMMY_BYTE);
-    /* Decrement NumByteToRead */
-    NumByteToRead--;
-  }
+  /* Read the data in place: the buffer's current contents are clocked out
+   * as dummy bytes while it is filled */
+  sFLASH_Transfer(pBuffer, pBuffer, NumByteToRead);
 
   /* Deselect the FLASH: Chip Select high */
   sFLASH_CS_HIGH();
@@ -343,6 +335,8 @@ uint32_t sFLASH_ReadID(void)
 {
   uint8_t byte[3];
 
+  sFLASH_WaitForErase();
+
   /* Select the FLASH: Chip Select low */
   sFLASH_CS_LOW();
 
@@ -396,20 +390,43 @@ uint32_t sFLASH_ReadStatus(void)
   */
 static uint8_t sFLASH_SendByte(uint8_t byte)
 {
-	tx_data[0] = byte;
-	rx_data[0] = 0x0;
+	uint8_t rx = 0;
+	sFLASH_Transfer(&byte, &rx, 1);
+	return rx;
+}
+
+/**
+  * @brief  Sends an instruction followed by a 24 bit address in one transfer.
+  * @note   Chip Select must already be low.
+  * @param  command: instruction to send.
+  * @param  address: FLASH's internal address.
+  * @retval None
+  */
+static void sFLASH_SendCommand(uint8_t command, uint32_t address)
+{
+	uint8_t tx[4] = { command, (address & 0xFF0000) >> 16, (address & 0xFF00) >> 8, address & 0xFF };
+	uint8_t rx[4];
+	sFLASH_Transfer(tx, rx, sizeof(tx));
+}
 
-	spi_transmission_completed = false;
-	uint32_t err_code = spi_master_send_recv(SPI_MASTER_0,(uint8_t *)tx_data, 1, rx_data, 1);
-	if (err_code == NRF_SUCCESS)
+/**
+  * @brief  Clocks a block of bytes through the SPI interface.
+  * @note   Chip Select must already be low.
+  * @param  pTxBuffer: bytes to send.
+  * @param  pRxBuffer: receives the bytes from the SPI bus, may be pTxBuffer.
+  * @param  NumByteToTransfer: number of bytes to transfer.
+  * @retval None
+  */
+static void sFLASH_Transfer(const uint8_t *pTxBuffer, uint8_t *pRxBuffer, uint32_t NumByteToTransfer)
+{
+	while (NumByteToTransfer)
 	{
-        long timeout = 100000;
-		while(spi_transmission_completed == false && timeout-- > 0) {
-            nrf_delay_us(1);
-        }
+		uint16_t length = NumByteToTransfer > sFLASH_MAX_TRANSFER ? sFLASH_MAX_TRANSFER : NumByteToTransfer;
+		spi_master_tx_rx(SPI0, length, pTxBuffer, pRxBuffer);
+		pTxBuffer += length;
+		pRxBuffer += length;
+		NumByteToTransfer -= length;
 	}
-	else { }
-	return rx_data[0];
 }
 
 /**
@@ -439,6 +456,8 @@ static void sFLASH_CS_HIGH(void)
   */
 static void sFLASH_WriteEnable(void)
 {
+  sFLASH_WaitForErase();
+
   /* Select the FLASH: Chip Select low */
   sFLASH_CS_LOW();
 
@@ -495,6 +514,39 @@ void sFLASH_WaitForWriteEnd(void)
   sFLASH_CS_HIGH();
 }
 
+/**
+  * @brief  Waits for the end of a sector erase started with
+  *         sFLASH_EraseSectorStart, if there is one.
+  * @param  None
+  * @retval None
+  */
+static void sFLASH_WaitForErase(void)
+{
+  if (sFLASH_ErasePending)
+  {
+    sFLASH_WaitForWriteEnd();
+    sFLASH_ErasePending = false;
+  }
+}
+
+/**
+  * @brief  Waits for the end of an AAI word program on the SO RY/BY# output,
+  *         enabled with sFLASH_CMD_EBSY.
+  * @param  None
+  * @retval None
+  */
+static void sFLASH_WaitForWordEnd(void)
+{
+  /* Select the FLASH: Chip Select low */
+  sFLASH_CS_LOW();
+
+  /* SO is low while busy and goes high once the word is programmed */
+  while (nrf_gpio_pin_read(SPIM0_MISO_PIN) == 0);
+
+  /* Deselect the FLASH: Chip Select high */
+  sFLASH_CS_HIGH();
+}
+
 int sFLASH_SelfTest(void)
 {
   uint32_t FLASH_TestAddress = 0x000000;
@@ -0,0 +1,69 @@
+/**
+ ******************************************************************************
+ * @file    crc32.h
+ ******************************************************************************
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef CRC32_H
+#define	CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The CRC-32 used for module images and OTA chunks (IEEE 802.3, the same
+ * as zlib's crc32()).
+ *
+ * The update is streaming: pass 0 for the first block and the previous
+ * result for the next ones, so
+ *   crc32_update(crc32_update(0, a, na), b, nb)
+ * is the CRC of a followed by b.
+ *
+ * CRC32_SLICES picks the table size at compile time:
+ * - 1: one 1KB table, one byte per lookup. The default on Cortex-M0
+ *   where flash is scarce and loads are slow.
+ * - 4: 4KB of tables, 4 bytes per 32-bit load (slice-by-4).
+ * - 8: 8KB of tables, 8 bytes per two 32-bit loads (slice-by-8). The
+ *   default elsewhere (Cortex-M3/M4 and the host).
+ */
+#ifndef CRC32_SLICES
+#if defined(__ARM_ARCH_6M__)
+#define CRC32_SLICES 1
+#else
+#define CRC32_SLICES 8
+#endif
+#endif
+
+uint32_t crc32_update(uint32_t crc, const void* data, size_t length);
+
+/* The individual variants, for testing and benchmarking. Only those that
+ * fit in the compiled tables are available. */
+uint32_t crc32_update_bytewise(uint32_t crc, const void* data, size_t length);
+#if CRC32_SLICES >= 4
+uint32_t crc32_update_slice4(uint32_t crc, const void* data, size_t length);
+#endif
+#if CRC32_SLICES >= 8
+uint32_t crc32_update_slice8(uint32_t crc, const void* data, size_t length);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* CRC32_H */
@@ -20,6 +20,8 @@
  ******************************************************************************
  */
 
+#pragma once
+
 #include <cstring>
 #include <memory>
 #include <vector>
@@ -89,6 +91,11 @@
  * not call performPendingErase() before the next page swap, the
  * alternate page will be erased just before the page swap.
  *
+ * All accesses to the Flash go through the Store read/write API so that
+ * the emulation also works with stores that are not memory mapped, like
+ * an external SPI Flash. Records are read in small batches to limit the
+ * number of bus transactions on those stores.
+ *
  */
 
 template <typename Store, uintptr_t PageBase1, size_t PageSize1, uintptr_t PageBase2, size_t PageSize2>
@@ -110,6 +117,9 @@ public:
 
     static const uint8_t FLASH_ERASED = 0xFF;
 
+    // Number of records read from the store at once when walking a page
+    static const size_t RecordReadBatch = 8;
+
     // Stores the status of a page of emulated EEPROM
     //
     // WARNING: Do not change the size of struct or order of elements since
@@ -224,6 +234,47 @@ public:
         updateActivePage();
     }
 
+    // Replaces all the data with a block starting at index 0
+    //
+    // The records are written to page 2, which only becomes active once
+    // they are all written, and page 1 is erased last. Data kept in
+    // another format in page 1 survives a reset at any point before the
+    // new page is active, so the import can be retried from it.
+    bool importToPage2(const void *data, uint16_t length)
+    {
+        if(length > capacity())
+        {
+            return false;
+        }
+
+        for(int tries = 0; tries < 2; tries++)
+        {
+            erasePage(LogicalPage::Page2);
+
+            Address writeAddress = getPageBegin(LogicalPage::Page2);
+            bool success = writePageStatus(LogicalPage::Page2, PageHeader::COPY);
+
+            writeAddress += sizeof(PageHeader);
+
+            success = success && writeRangeDirect(writeAddress,
+                                                  getPageEnd(LogicalPage::Page2),
+                                                  0,
+                                                  (const Data *)data,
+                                                  length);
+
+            success = success && writePageStatus(LogicalPage::Page2, PageHeader::ACTIVE);
+
+            if(success)
+            {
+                erasePage(LogicalPage::Page1);
+                updateActivePage();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
     // Returns number of bytes that can be stored in EEPROM
     // The actual capacity is set to 50% of the records that fit in the smallest page
     constexpr size_t capacity()
@@ -323,8 +374,9 @@ public:
     // Get the current status of a page (empty, active, being copied, ...)
     uint32_t readPageStatus(LogicalPage page)
     {
-        PageHeader *header = (PageHeader *) store.dataAt(getPageBegin(page));
-        return header->status;
+        PageHeader header;
+        store.read(getPageBegin(page), &header, sizeof(header));
+        return header.status;
     }
 
     // Update the status of a page
@@ -504,19 +556,33 @@ public:
         // Skip page header
         address += sizeof(PageHeader);
 
-        // Walk through record list
+        // Walk through record list, a batch of records at a time
+        Record records[RecordReadBatch];
         while(address < endAddress)
         {
-            const Record &record = *(const Record *) store.dataAt(address);
-
-            // Yield record and potentially break early
-            if(f(address, record))
+            size_t count = (endAddress - address) / sizeof(Record);
+            if(count == 0)
             {
                 return;
             }
+            if(count > RecordReadBatch)
+            {
+                count = RecordReadBatch;
+            }
+
+            store.read(address, records, count * sizeof(Record));
 
-            // Skip over record
-            address += sizeof(record);
+            for(size_t i = 0; i < count; i++)
+            {
+                // Yield record and potentially break early
+                if(f(address, records[i]))
+                {
+                    return;
+                }
+
+                // Skip over record
+                address += sizeof(Record);
+            }
         }
     }
 
@@ -597,7 +663,8 @@ public:
             {
                 if(addressOffset != 0) {
                     Address address = baseAddress + addressOffset;
-                    const Record &record = *(const Record *) store.dataAt(address);
+                    Record record;
+                    store.read(address, &record, sizeof(record));
 
                     // Yield record
                     f(address, record);
@@ -615,14 +682,26 @@ public:
     // during page erase
     bool verifyPage(LogicalPage page)
     {
-        const uint8_t *begin = store.dataAt(getPageBegin(page));
-        const uint8_t *end = store.dataAt(getPageEnd(page));
-        while(begin < end)
+        Address address = getPageBegin(page);
+        Address endAddress = getPageEnd(page);
+        uint8_t buffer[RecordReadBatch * sizeof(Record)];
+        while(address < endAddress)
         {
-            if(*begin++ != FLASH_ERASED)
+            size_t count = endAddress - address;
+            if(count > sizeof(buffer))
             {
-                return false;
+                count = sizeof(buffer);
+            }
+
+            store.read(address, buffer, count);
+            for(size_t i = 0; i < count; i++)
+            {
+                if(buffer[i] != FLASH_ERASED)
+                {
+                    return false;
+                }
             }
+            address += count;
         }
 
         return true;
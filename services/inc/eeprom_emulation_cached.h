@@ -0,0 +1,182 @@
+/**
+ ******************************************************************************
+ * @file    eeprom_emulation_cached.h
+ ******************************************************************************
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#pragma once
+
+#include "eeprom_emulation.h"
+
+/* EEPROM Emulation with a RAM index
+ *
+ * Uses the same log-structured record format as EEPROMEmulation but
+ * keeps the current value of every emulated byte and the address of
+ * the next empty record in RAM. This is intended for stores where each
+ * access is a bus transaction (e.g. an external SPI Flash):
+ * - reads are served from RAM and never touch the store
+ * - writes of unchanged values don't touch the store
+ * - writes append records for the changed bytes only, without walking
+ *   the page first to find the end of the record list
+ * - the records are compacted to the alternate page only when the
+ *   active page is full, which is the only time a page is erased
+ *
+ * The RAM index is rebuilt from the store in init() and after each
+ * page swap, so the Flash contents stay the single source of truth and
+ * the power failure guarantees of EEPROMEmulation are unchanged.
+ *
+ * The RAM cost is one byte per emulated EEPROM byte.
+ */
+
+template <typename Store, uintptr_t PageBase1, size_t PageSize1, uintptr_t PageBase2, size_t PageSize2>
+class CachedEEPROMEmulation : public EEPROMEmulation<Store, PageBase1, PageSize1, PageBase2, PageSize2>
+{
+    using Base = EEPROMEmulation<Store, PageBase1, PageSize1, PageBase2, PageSize2>;
+
+public:
+    using Address = typename Base::Address;
+    using Index = typename Base::Index;
+    using Data = typename Base::Data;
+    using PageHeader = typename Base::PageHeader;
+    using Record = typename Base::Record;
+
+    // Same as EEPROMEmulation::capacity(), usable as an array size
+    static constexpr size_t Capacity = (Base::SmallestPageSize - sizeof(PageHeader)) / sizeof(Record) / 2;
+
+    /* Public API */
+
+    // Initialize the EEPROM pages and load the RAM index
+    // Call at boot
+    void init()
+    {
+        Base::init();
+        reloadIndex();
+    }
+
+    // Read the latest value of a byte of EEPROM in data or 0xFF if the
+    // value was not programmed
+    void get(Index index, Data &data)
+    {
+        readRange(index, &data, sizeof(data));
+    }
+
+    // Reads the latest values of a block of EEPROM into data.
+    // Fills data with 0xFF for values that were not programmed
+    void get(Index index, void *data, uint16_t length)
+    {
+        readRange(index, (Data *)data, length);
+    }
+
+    // Writes a new value for a byte of EEPROM
+    void put(Index index, Data data)
+    {
+        writeRange(index, &data, sizeof(data));
+    }
+
+    // Writes new values for a block of EEPROM
+    // The write will be atomic (all or nothing) even if a reset occurs
+    // during the write
+    void put(Index index, const void *data, uint16_t length)
+    {
+        writeRange(index, (const Data *)data, length);
+    }
+
+    // Destroys all the data 💣
+    void clear()
+    {
+        Base::clear();
+        reloadIndex();
+    }
+
+    /* Implementation */
+
+    // Copy values from the RAM index
+    void readRange(Index indexBegin, Data *data, uint16_t length)
+    {
+        for(uint16_t i = 0; i < length; i++)
+        {
+            size_t index = size_t(indexBegin) + i;
+            data[i] = (index < Capacity) ? values[index] : Base::FLASH_ERASED;
+        }
+    }
+
+    // Append records for the changed bytes to the active page, or do a
+    // page swap when there isn't enough room left (or a write failed)
+    void writeRange(Index indexBegin, const Data *data, uint16_t length)
+    {
+        // don't write anything if index is out of range
+        if(size_t(indexBegin) + length > Capacity)
+        {
+            return;
+        }
+
+        Data *existingData = values + indexBegin;
+
+        uint16_t changedCount = 0;
+        for(uint16_t i = 0; i < length; i++)
+        {
+            if(existingData[i] != data[i])
+            {
+                changedCount++;
+            }
+        }
+
+        if(changedCount == 0)
+        {
+            return;
+        }
+
+        bool success = appendable && this->writeRangeChanged(writeAddress,
+                indexBegin, data, existingData, length);
+
+        if(success)
+        {
+            writeAddress += changedCount * sizeof(Record);
+            std::memcpy(existingData, data, length);
+        }
+        else
+        {
+            this->swapPagesAndWrite(indexBegin, data, length);
+            reloadIndex();
+        }
+    }
+
+    // Rebuild the RAM index from the active page in a single pass
+    void reloadIndex()
+    {
+        Address emptyAddress;
+
+        // Records after an invalid record are ignored, and the next
+        // write will do a page swap to get rid of the invalid record
+        appendable = this->readRangeAndFindEmpty(this->getActivePage(),
+                values, 0, Capacity, emptyAddress);
+        writeAddress = emptyAddress;
+    }
+
+    // Address where the next record will be appended
+    Address getWriteAddress()
+    {
+        return writeAddress;
+    }
+
+protected:
+    Data values[Capacity];
+    Address writeAddress = 0;
+    bool appendable = false;
+};
+
+template <typename Store, uintptr_t PageBase1, size_t PageSize1, uintptr_t PageBase2, size_t PageSize2>
+constexpr size_t CachedEEPROMEmulation<Store, PageBase1, PageSize1, PageBase2, PageSize2>::Capacity;
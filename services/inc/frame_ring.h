@@ -0,0 +1,124 @@
+/**
+ ******************************************************************************
+ * @file    frame_ring.h
+ ******************************************************************************
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef FRAME_RING_H
+#define	FRAME_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A lock-free ring buffer of variable length frames for a single producer
+ * and a single consumer, e.g. an interrupt handler filling the ring and the
+ * main loop draining it.
+ *
+ * Each frame is stored contiguously behind a 2 byte length so the consumer
+ * can process it in place. When a frame doesn't fit before the end of the
+ * storage, a wrap marker is written and the frame starts over at the
+ * beginning of the storage.
+ *
+ * Only the producer writes head and the statistics, only the consumer writes
+ * tail. When the ring is full, the new frame is dropped and counted.
+ */
+
+typedef struct {
+    uint16_t high_water;        /* most bytes ever in use, including framing */
+    uint32_t frames;            /* frames accepted */
+    uint32_t dropped_frames;    /* frames rejected because the ring was full */
+    uint32_t dropped_bytes;     /* payload bytes of the rejected frames */
+} frame_ring_stats_t;
+
+typedef struct {
+    uint8_t* buffer;
+    uint16_t capacity;
+    volatile uint16_t head;     /* next write position, owned by the producer */
+    volatile uint16_t tail;     /* next read position, owned by the consumer */
+    uint16_t pending;           /* head after the frame being written by the producer */
+    frame_ring_stats_t stats;
+} frame_ring_t;
+
+#define FRAME_RING_HEADER_SIZE 2
+
+void frame_ring_init(frame_ring_t* ring, uint8_t* buffer, uint16_t capacity);
+
+/**
+ * Producer side: append a frame. Returns false and counts a drop when
+ * there is not enough room.
+ */
+bool frame_ring_put(frame_ring_t* ring, const uint8_t* data, uint16_t size);
+
+/**
+ * Producer side: reserve a frame of size bytes to fill in place, e.g. by
+ * gathering scattered data. Returns NULL and counts a drop when there is not
+ * enough room. The frame is invisible to the consumer until committed.
+ */
+uint8_t* frame_ring_alloc(frame_ring_t* ring, uint16_t size);
+
+/**
+ * Producer side: publish the frame returned by the last frame_ring_alloc().
+ */
+void frame_ring_commit(frame_ring_t* ring);
+
+/**
+ * Producer side: whether a frame of size bytes would be accepted now. The
+ * room can only grow until the producer adds a frame.
+ */
+bool frame_ring_fits(const frame_ring_t* ring, uint16_t size);
+
+/**
+ * Consumer side: get the oldest frame without removing it.
+ * Returns NULL when the ring is empty.
+ */
+uint8_t* frame_ring_peek(frame_ring_t* ring, uint16_t* size);
+
+/**
+ * Consumer side: get the frame added after frame, a frame returned by
+ * frame_ring_peek() or by this function, without removing anything.
+ * Returns NULL when frame is the newest. Lets the consumer serve frames
+ * behind one it can't process yet; they are still removed in order.
+ */
+uint8_t* frame_ring_peek_next(frame_ring_t* ring, const uint8_t* frame, uint16_t* size);
+
+/**
+ * Consumer side: remove the frame returned by the last frame_ring_peek().
+ */
+void frame_ring_consume(frame_ring_t* ring);
+
+bool frame_ring_empty(const frame_ring_t* ring);
+
+/**
+ * Start an empty ring over at the beginning of the storage, so the largest
+ * frame fits again. Only for rings whose producer and consumer never run
+ * at the same time.
+ */
+void frame_ring_rewind(frame_ring_t* ring);
+
+/**
+ * Number of bytes in use, including framing.
+ */
+uint16_t frame_ring_used(const frame_ring_t* ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* FRAME_RING_H */
@@ -0,0 +1,136 @@
+/**
+ ******************************************************************************
+ * @file    spi_stream_tx.h
+ ******************************************************************************
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#ifndef SPI_STREAM_TX_H
+#define	SPI_STREAM_TX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "frame_ring.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Sending side of a framed stream over SPI where this end is the slave.
+ *
+ * For each frame the slave raises PTS and waits for the master to raise MR.
+ * It then loads the 2 byte frame length into the hardware tx buffer and
+ * raises SA, and the master clocks it out. The frame follows in chunks of
+ * the tx buffer size, one transfer per SA. SA and PTS are lowered after each
+ * transfer. The driver is pointed at the next chunk where it sits in the
+ * queue, so a frame is only copied once, into the queue, and the chunk is
+ * sent once the driver has handed the buffers back.
+ *
+ * Nothing here waits: the state machine advances on the MR edge and on the
+ * transfer done and buffers set events of the SPI slave driver. Senders
+ * only copy their frame into the queue.
+ *
+ * The pins are reached through the ops so the state machine can run against
+ * a stand-in master off device. The caller serializes the calls, e.g. by
+ * making all of them from interrupts of the same priority or in a critical
+ * region.
+ */
+
+typedef struct {
+    void (*set_pts)(bool level);
+    void (*set_sa)(bool level);
+    bool (*master_ready)(void);
+} spi_stream_tx_ops_t;
+
+typedef enum {
+    SPI_STREAM_TX_IDLE,         /* nothing queued */
+    SPI_STREAM_TX_WAIT_MASTER,  /* PTS raised, waiting for MR */
+    SPI_STREAM_TX_TRANSFER,     /* tx buffer loaded and SA raised */
+    SPI_STREAM_TX_RELOAD,       /* waiting for the driver to hand the buffers back */
+} spi_stream_tx_state_t;
+
+typedef struct {
+    uint32_t frames;            /* frames sent */
+    uint32_t bytes;             /* frame bytes sent, without the lengths */
+    uint32_t transfers;         /* SPI transfers, including the lengths */
+} spi_stream_tx_stats_t;
+
+typedef struct {
+    const spi_stream_tx_ops_t* ops;
+    uint8_t* tx_buf;            /* hardware tx buffer */
+    uint16_t chunk_size;        /* bytes clocked out per transfer */
+    frame_ring_t queue;
+    volatile spi_stream_tx_state_t state;
+    volatile bool buffers_ready;    /* the tx buffer may be loaded */
+    uint16_t offset;            /* bytes of the current frame sent */
+    uint16_t loaded;            /* bytes of the chunk the driver was pointed at, 0 for tx_buf */
+    spi_stream_tx_stats_t stats;
+} spi_stream_tx_t;
+
+/**
+ * The driver doesn't own the buffers yet: call spi_stream_tx_buffers_set_done()
+ * once they are set.
+ */
+void spi_stream_tx_init(spi_stream_tx_t* tx, const spi_stream_tx_ops_t* ops,
+        uint8_t* tx_buf, uint16_t chunk_size, uint8_t* queue_buf, uint16_t queue_size);
+
+/**
+ * Queue a frame and start sending if the transmitter is idle. Returns false
+ * and counts a drop in the queue statistics when the queue is full.
+ */
+bool spi_stream_tx_send(spi_stream_tx_t* tx, const uint8_t* data, uint16_t size);
+
+/**
+ * Reserve a frame to fill in place, publish it with spi_stream_tx_commit().
+ * Returns NULL and counts a drop when the queue is full.
+ */
+uint8_t* spi_stream_tx_alloc(spi_stream_tx_t* tx, uint16_t size);
+void spi_stream_tx_commit(spi_stream_tx_t* tx);
+
+bool spi_stream_tx_fits(const spi_stream_tx_t* tx, uint16_t size);
+
+/**
+ * Nothing queued or being sent.
+ */
+bool spi_stream_tx_idle(const spi_stream_tx_t* tx);
+
+/**
+ * MR went high.
+ */
+void spi_stream_tx_master_ready(spi_stream_tx_t* tx);
+
+/**
+ * A transfer completed. Returns true when it was one of ours, false when the
+ * master was sending to us.
+ */
+bool spi_stream_tx_transfer_done(spi_stream_tx_t* tx);
+
+/**
+ * The tx buffer to set in the driver after a transfer, called right after
+ * spi_stream_tx_transfer_done(): the next chunk of the current frame in the
+ * queue, or tx_buf. Returns the number of bytes at data.
+ */
+uint16_t spi_stream_tx_buffer(spi_stream_tx_t* tx, const uint8_t** data);
+
+/**
+ * The driver owns the buffers again, after init or after a transfer.
+ */
+void spi_stream_tx_buffers_set_done(spi_stream_tx_t* tx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* SPI_STREAM_TX_H */
@@ -0,0 +1,113 @@
+/**
+ ******************************************************************************
+ * @file    crc32.c
+ ******************************************************************************
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "crc32.h"
+#include "crc32_tables.h"
+
+#if CRC32_SLICES != 1 && CRC32_SLICES != 4 && CRC32_SLICES != 8
+#error "CRC32_SLICES must be 1, 4 or 8"
+#endif
+
+/* The sliced loops combine whole words with the CRC, which only works
+ * when the bytes of a word are in stream order */
+#if CRC32_SLICES > 1 && defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "Sliced CRC32 needs a little endian target, build with CRC32_SLICES=1"
+#endif
+
+static inline uint32_t crc32_bytes(uint32_t crc, const uint8_t* p, size_t length)
+{
+    while (length--) {
+        crc = crc32_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+/* Bytes needed to bring p to a word boundary, capped at length */
+static inline size_t crc32_align(const uint8_t* p, size_t length)
+{
+    size_t head = (-(uintptr_t)p) & 3;
+    return head < length ? head : length;
+}
+
+uint32_t crc32_update_bytewise(uint32_t crc, const void* data, size_t length)
+{
+    return crc32_bytes(crc ^ ~0U, (const uint8_t*)data, length) ^ ~0U;
+}
+
+#if CRC32_SLICES >= 4
+uint32_t crc32_update_slice4(uint32_t crc, const void* data, size_t length)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    size_t head = crc32_align(p, length);
+
+    crc = crc32_bytes(crc ^ ~0U, p, head);
+    p += head;
+    length -= head;
+
+    const uint32_t* words = (const uint32_t*)p;
+    for (; length >= 4; length -= 4) {
+        crc ^= *words++;
+        crc = crc32_table[3][crc & 0xFF] ^
+              crc32_table[2][(crc >> 8) & 0xFF] ^
+              crc32_table[1][(crc >> 16) & 0xFF] ^
+              crc32_table[0][crc >> 24];
+    }
+
+    return crc32_bytes(crc, (const uint8_t*)words, length) ^ ~0U;
+}
+#endif
+
+#if CRC32_SLICES >= 8
+uint32_t crc32_update_slice8(uint32_t crc, const void* data, size_t length)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    size_t head = crc32_align(p, length);
+
+    crc = crc32_bytes(crc ^ ~0U, p, head);
+    p += head;
+    length -= head;
+
+    const uint32_t* words = (const uint32_t*)p;
+    for (; length >= 8; length -= 8) {
+        uint32_t low = *words++ ^ crc;
+        uint32_t high = *words++;
+        crc = crc32_table[7][low & 0xFF] ^
+              crc32_table[6][(low >> 8) & 0xFF] ^
+              crc32_table[5][(low >> 16) & 0xFF] ^
+              crc32_table[4][low >> 24] ^
+              crc32_table[3][high & 0xFF] ^
+              crc32_table[2][(high >> 8) & 0xFF] ^
+              crc32_table[1][(high >> 16) & 0xFF] ^
+              crc32_table[0][high >> 24];
+    }
+
+    return crc32_bytes(crc, (const uint8_t*)words, length) ^ ~0U;
+}
+#endif
+
+uint32_t crc32_update(uint32_t crc, const void* data, size_t length)
+{
+#if CRC32_SLICES == 8
+    return crc32_update_slice8(crc, data, length);
+#elif CRC32_SLICES == 4
+    return crc32_update_slice4(crc, data, length);
+#else
+    return crc32_update_bytewise(crc, data, length);
+#endif
+}
@@ -0,0 +1,230 @@
+/**
+ ******************************************************************************
+ * @file    frame_ring.c
+ ******************************************************************************
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include <string.h>
+#include "frame_ring.h"
+
+#define FRAME_RING_WRAP 0xFFFF
+
+/* Frame contents must be visible before the index that publishes them */
+#define frame_ring_barrier() __sync_synchronize()
+
+static inline uint16_t read_length(const uint8_t* p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static inline void write_length(uint8_t* p, uint16_t length)
+{
+    p[0] = (length >> 8) & 0xFF;
+    p[1] = length & 0xFF;
+}
+
+static uint16_t used(uint16_t head, uint16_t tail, uint16_t capacity)
+{
+    return head >= tail ? head - tail : capacity - tail + head;
+}
+
+void frame_ring_init(frame_ring_t* ring, uint8_t* buffer, uint16_t capacity)
+{
+    ring->buffer = buffer;
+    ring->capacity = capacity;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->pending = 0;
+    memset(&ring->stats, 0, sizeof(ring->stats));
+}
+
+/**
+ * Find where a frame of needed bytes, including its length header, goes.
+ * Returns false when there is not enough room.
+ */
+static bool place(const frame_ring_t* ring, uint32_t needed, uint16_t* position)
+{
+    uint16_t head = ring->head;
+    uint16_t tail = ring->tail;
+
+    // head never catches up with tail, otherwise a full ring would look empty
+    if (head >= tail) {
+        uint16_t to_end = ring->capacity - head;
+        if (needed < to_end || (needed == to_end && tail != 0)) {
+            *position = head;
+            return true;
+        }
+        if (needed < tail) {
+            // start over at the beginning
+            *position = 0;
+            return true;
+        }
+        return false;
+    }
+    if (needed < (uint32_t)(tail - head)) {
+        *position = head;
+        return true;
+    }
+    return false;
+}
+
+uint8_t* frame_ring_alloc(frame_ring_t* ring, uint16_t size)
+{
+    uint16_t head = ring->head;
+    uint16_t capacity = ring->capacity;
+    uint32_t needed = (uint32_t)size + FRAME_RING_HEADER_SIZE;
+    uint16_t position;
+
+    if (!place(ring, needed, &position)) {
+        ring->stats.dropped_frames++;
+        ring->stats.dropped_bytes += size;
+        return NULL;
+    }
+
+    // leave a marker for the consumer if the frame starts over and there is room for one
+    if (position != head && capacity - head >= FRAME_RING_HEADER_SIZE) {
+        write_length(ring->buffer + head, FRAME_RING_WRAP);
+    }
+    write_length(ring->buffer + position, size);
+
+    ring->pending = position + needed;
+    if (ring->pending == capacity) {
+        ring->pending = 0;
+    }
+    return ring->buffer + position + FRAME_RING_HEADER_SIZE;
+}
+
+bool frame_ring_fits(const frame_ring_t* ring, uint16_t size)
+{
+    uint16_t position;
+    return place(ring, (uint32_t)size + FRAME_RING_HEADER_SIZE, &position);
+}
+
+void frame_ring_commit(frame_ring_t* ring)
+{
+    uint16_t position = ring->pending;
+
+    frame_ring_barrier();
+    ring->head = position;
+
+    ring->stats.frames++;
+    uint16_t in_use = used(position, ring->tail, ring->capacity);
+    if (in_use > ring->stats.high_water) {
+        ring->stats.high_water = in_use;
+    }
+}
+
+bool frame_ring_put(frame_ring_t* ring, const uint8_t* data, uint16_t size)
+{
+    uint8_t* frame = frame_ring_alloc(ring, size);
+    if (frame == NULL) {
+        return false;
+    }
+    memcpy(frame, data, size);
+    frame_ring_commit(ring);
+    return true;
+}
+
+/**
+ * Find the position of the length header of the oldest frame.
+ * Returns false when the ring is empty.
+ */
+static bool front(frame_ring_t* ring, uint16_t* position, uint16_t* size)
+{
+    uint16_t tail = ring->tail;
+    uint16_t head = ring->head;
+    if (tail == head) {
+        return false;
+    }
+    frame_ring_barrier();
+
+    uint16_t length = FRAME_RING_WRAP;
+    if (ring->capacity - tail >= FRAME_RING_HEADER_SIZE) {
+        length = read_length(ring->buffer + tail);
+    }
+    if (length == FRAME_RING_WRAP) {
+        tail = 0;
+        length = read_length(ring->buffer);
+    }
+    *position = tail;
+    *size = length;
+    return true;
+}
+
+uint8_t* frame_ring_peek(frame_ring_t* ring, uint16_t* size)
+{
+    uint16_t position;
+    if (!front(ring, &position, size)) {
+        return NULL;
+    }
+    return ring->buffer + position + FRAME_RING_HEADER_SIZE;
+}
+
+uint8_t* frame_ring_peek_next(frame_ring_t* ring, const uint8_t* frame, uint16_t* size)
+{
+    uint16_t position = frame - ring->buffer - FRAME_RING_HEADER_SIZE;
+    position += read_length(ring->buffer + position) + FRAME_RING_HEADER_SIZE;
+    if (position == ring->capacity) {
+        position = 0;
+    }
+    if (position == ring->head) {
+        return NULL;
+    }
+    frame_ring_barrier();
+
+    uint16_t length = FRAME_RING_WRAP;
+    if (ring->capacity - position >= FRAME_RING_HEADER_SIZE) {
+        length = read_length(ring->buffer + position);
+    }
+    if (length == FRAME_RING_WRAP) {
+        position = 0;
+        length = read_length(ring->buffer);
+    }
+    *size = length;
+    return ring->buffer + position + FRAME_RING_HEADER_SIZE;
+}
+
+void frame_ring_consume(frame_ring_t* ring)
+{
+    uint16_t position, size;
+    if (front(ring, &position, &size)) {
+        position += size + FRAME_RING_HEADER_SIZE;
+        if (position == ring->capacity) {
+            position = 0;
+        }
+        frame_ring_barrier();
+        ring->tail = position;
+    }
+}
+
+bool frame_ring_empty(const frame_ring_t* ring)
+{
+    return ring->head == ring->tail;
+}
+
+void frame_ring_rewind(frame_ring_t* ring)
+{
+    if (frame_ring_empty(ring)) {
+        ring->head = 0;
+        ring->tail = 0;
+        ring->pending = 0;
+    }
+}
+
+uint16_t frame_ring_used(const frame_ring_t* ring)
+{
+    return used(ring->head, ring->tail, ring->capacity);
+}
@@ -0,0 +1,171 @@
+/**
+ ******************************************************************************
+ * @file    spi_stream_tx.c
+ ******************************************************************************
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include <string.h>
+#include "spi_stream_tx.h"
+
+static void arm(spi_stream_tx_t* tx)
+{
+    tx->state = SPI_STREAM_TX_TRANSFER;
+    tx->ops->set_sa(true);
+}
+
+/* The master is ready for the frame at the front of the queue */
+static void load_length(spi_stream_tx_t* tx)
+{
+    // a transfer from the master may still be handing the buffers back
+    if (!tx->buffers_ready) {
+        return;
+    }
+    uint16_t size;
+    frame_ring_peek(&tx->queue, &size);
+    tx->tx_buf[0] = (size >> 8) & 0xFF;
+    tx->tx_buf[1] = size & 0xFF;
+    tx->offset = 0;
+    arm(tx);
+}
+
+static void start(spi_stream_tx_t* tx)
+{
+    if (tx->state != SPI_STREAM_TX_IDLE || frame_ring_empty(&tx->queue)) {
+        return;
+    }
+    tx->state = SPI_STREAM_TX_WAIT_MASTER;
+    tx->ops->set_pts(true);
+    if (tx->ops->master_ready()) {
+        load_length(tx);
+    }
+}
+
+/* Send the chunk of the current frame the driver was pointed at, or move on to the next frame */
+static void next(spi_stream_tx_t* tx)
+{
+    if (tx->loaded) {
+        tx->offset += tx->loaded;
+        tx->loaded = 0;
+        arm(tx);
+        return;
+    }
+
+    uint16_t size;
+    frame_ring_peek(&tx->queue, &size);
+
+    tx->stats.frames++;
+    tx->stats.bytes += size;
+    frame_ring_consume(&tx->queue);
+    // the calls are serialized, so the queue can start over and take the largest frame again
+    frame_ring_rewind(&tx->queue);
+    tx->state = SPI_STREAM_TX_IDLE;
+    start(tx);
+}
+
+void spi_stream_tx_init(spi_stream_tx_t* tx, const spi_stream_tx_ops_t* ops,
+        uint8_t* tx_buf, uint16_t chunk_size, uint8_t* queue_buf, uint16_t queue_size)
+{
+    tx->ops = ops;
+    tx->tx_buf = tx_buf;
+    tx->chunk_size = chunk_size;
+    frame_ring_init(&tx->queue, queue_buf, queue_size);
+    tx->state = SPI_STREAM_TX_IDLE;
+    tx->buffers_ready = false;
+    tx->offset = 0;
+    tx->loaded = 0;
+    memset(&tx->stats, 0, sizeof(tx->stats));
+}
+
+bool spi_stream_tx_send(spi_stream_tx_t* tx, const uint8_t* data, uint16_t size)
+{
+    if (!frame_ring_put(&tx->queue, data, size)) {
+        return false;
+    }
+    start(tx);
+    return true;
+}
+
+uint8_t* spi_stream_tx_alloc(spi_stream_tx_t* tx, uint16_t size)
+{
+    return frame_ring_alloc(&tx->queue, size);
+}
+
+void spi_stream_tx_commit(spi_stream_tx_t* tx)
+{
+    frame_ring_commit(&tx->queue);
+    start(tx);
+}
+
+bool spi_stream_tx_fits(const spi_stream_tx_t* tx, uint16_t size)
+{
+    return frame_ring_fits(&tx->queue, size);
+}
+
+bool spi_stream_tx_idle(const spi_stream_tx_t* tx)
+{
+    return tx->state == SPI_STREAM_TX_IDLE && frame_ring_empty(&tx->queue);
+}
+
+void spi_stream_tx_master_ready(spi_stream_tx_t* tx)
+{
+    if (tx->state == SPI_STREAM_TX_WAIT_MASTER) {
+        load_length(tx);
+    }
+}
+
+bool spi_stream_tx_transfer_done(spi_stream_tx_t* tx)
+{
+    tx->buffers_ready = false;
+    if (tx->state != SPI_STREAM_TX_TRANSFER) {
+        return false;
+    }
+    tx->ops->set_sa(false);
+    tx->ops->set_pts(false);
+    tx->stats.transfers++;
+    tx->state = SPI_STREAM_TX_RELOAD;
+    return true;
+}
+
+uint16_t spi_stream_tx_buffer(spi_stream_tx_t* tx, const uint8_t** data)
+{
+    uint16_t size;
+    uint8_t* frame;
+
+    tx->loaded = 0;
+    if (tx->state == SPI_STREAM_TX_RELOAD && (frame = frame_ring_peek(&tx->queue, &size)) != NULL &&
+            tx->offset < size) {
+        // the frame stays in the queue until its last chunk is sent
+        uint16_t length = size - tx->offset;
+        if (length > tx->chunk_size) {
+            length = tx->chunk_size;
+        }
+        tx->loaded = length;
+        *data = frame + tx->offset;
+        return length;
+    }
+    *data = tx->tx_buf;
+    return tx->chunk_size;
+}
+
+void spi_stream_tx_buffers_set_done(spi_stream_tx_t* tx)
+{
+    tx->buffers_ready = true;
+    if (tx->state == SPI_STREAM_TX_RELOAD) {
+        next(tx);
+    } else if (tx->state == SPI_STREAM_TX_WAIT_MASTER && tx->ops->master_ready()) {
+        load_length(tx);
+    }
+}
@@ -21,13 +21,38 @@
 
 #if PLATFORM_THREADING
 
+#include <atomic>
+#include <cstddef>
 #include <functional>
 #include <mutex>
+#include <new>
 #include <thread>
 #include <future>
+#include <type_traits>
 #include "channel.h"
 #include "concurrent_hal.h"
 
+/**
+ * Size of the storage for each message in an active object's pool, enough for
+ * the message and a callable capturing a dozen or so words.
+ */
+#ifndef ACTIVE_OBJECT_POOL_SLOT_SIZE
+#define ACTIVE_OBJECT_POOL_SLOT_SIZE (16*sizeof(void*))
+#endif
+
+/**
+ * Number of messages each active object can have in flight from its pool,
+ * at most 32, or 0 for no pool. Each slot also has a semaphore once it has
+ * been used for a synchronous call.
+ */
+#ifndef ACTIVE_OBJECT_POOL_SLOTS
+    #if PLATFORM_ID==10
+        #define ACTIVE_OBJECT_POOL_SLOTS 8     // the Electron has the least free RAM
+    #else
+        #define ACTIVE_OBJECT_POOL_SLOTS 16
+    #endif
+#endif
+
 /**
  * Configuratino data for an active object.
  */
@@ -80,6 +105,134 @@ public:
     virtual ~Message() {}
 };
 
+/**
+ * A fixed pool of storage for the messages passed to an active object, so that
+ * calling into another thread doesn't allocate. Slots are claimed and released
+ * from any thread with an atomic mask of the free slots.
+ *
+ * Each slot also has a semaphore for synchronous calls, created the first time
+ * the slot is used for one and then kept.
+ */
+template <size_t slot_size, unsigned slot_count>
+class MessagePool
+{
+    static_assert(slot_count <= 32, "the free slots are kept in a 32 bit mask");
+
+    typedef typename std::aligned_storage<slot_size, alignof(std::max_align_t)>::type Slot;
+
+    Slot slots[slot_count];
+    os_semaphore_t semaphores[slot_count];
+    std::atomic<uint32_t> free_slots;
+    std::atomic<uint32_t> pooled;
+    std::atomic<uint32_t> fallbacks;
+
+    unsigned index(void* slot)
+    {
+        return (Slot*)slot - slots;
+    }
+
+public:
+
+    MessagePool() : semaphores(), free_slots(slot_count == 32 ? 0xFFFFFFFF : (1u << slot_count) - 1),
+        pooled(0), fallbacks(0) {}
+
+    /**
+     * Claims a slot for an object of the given size.
+     * @return nullptr when the object is too big or all the slots are in use,
+     * the caller then falls back to allocating it. This is counted.
+     */
+    void* allocate(size_t size)
+    {
+        if (size <= slot_size)
+        {
+            uint32_t mask = free_slots.load();
+            while (mask)
+            {
+                uint32_t bit = mask & -mask;
+                if (free_slots.compare_exchange_weak(mask, mask & ~bit))
+                {
+                    pooled++;
+                    return &slots[__builtin_ctz(bit)];
+                }
+            }
+        }
+        fallbacks++;
+        return nullptr;
+    }
+
+    void release(void* slot)
+    {
+        free_slots.fetch_or(1u << index(slot));
+    }
+
+    /**
+     * The semaphore of a claimed slot, or nullptr if it couldn't be created.
+     */
+    os_semaphore_t semaphore(void* slot)
+    {
+        os_semaphore_t& semaphore = semaphores[index(slot)];
+        if (!semaphore && os_semaphore_create(&semaphore, 1, 0))
+            semaphore = nullptr;
+        return semaphore;
+    }
+
+    /**
+     * The number of messages placed in the pool, and allocated instead.
+     */
+    uint32_t pooled_count() const { return pooled; }
+    uint32_t fallback_count() const { return fallbacks; }
+};
+
+/**
+ * An asynchronous task held in a MessagePool slot. Returns the slot to the pool
+ * when complete.
+ */
+template <typename F, typename Pool>
+class PooledTask : public Message
+{
+    F work;
+    Pool& pool;
+
+public:
+    template <typename Fn> PooledTask(Fn&& fn, Pool& pool_) : work(std::forward<Fn>(fn)), pool(pool_) {}
+
+    void operator()() override
+    {
+        work();
+        Pool& p = pool;
+        this->~PooledTask();
+        p.release(this);
+    }
+};
+
+/**
+ * A synchronous task held in a MessagePool slot. The caller waits on the slot's
+ * semaphore so the result is stored directly in the caller's variable, and the
+ * caller disposes of the task.
+ */
+template <typename F, typename R>
+class PooledPromise : public Message
+{
+    F work;
+    R& result;
+    os_semaphore_t complete;
+
+public:
+    template <typename Fn> PooledPromise(Fn&& fn, R& result_, os_semaphore_t complete_) :
+        work(std::forward<Fn>(fn)), result(result_), complete(complete_) {}
+
+    void operator()() override
+    {
+        result = work();
+        os_semaphore_give(complete, false);
+    }
+
+    void wait()
+    {
+        os_semaphore_take(complete, CONCURRENT_WAIT_FOREVER, false);
+    }
+};
+
 /**
  * Abstract task. Subclasses must define invoke() and task_complete()
  */
@@ -234,9 +387,16 @@ class ActiveObjectBase
 {
 public:
     using Item = Message*;
+    using Pool = MessagePool<ACTIVE_OBJECT_POOL_SLOT_SIZE, ACTIVE_OBJECT_POOL_SLOTS>;
 
 protected:
 
+    /**
+     * Storage for the messages in flight. When it is exhausted, or a callable
+     * is too big for a slot, messages are allocated on the heap instead.
+     */
+    Pool pool;
+
     ActiveObjectConfiguration configuration;
 
     /**
@@ -294,7 +454,31 @@ public:
         return started;
     }
 
-    template<typename R> void invoke_async(const std::function<R(void)>& work)
+    /**
+     * Runs work on this active object's thread. work is any callable, including
+     * a std::function. It is moved into a pool slot when one is free.
+     */
+    template<typename F> void invoke_async(F&& work)
+    {
+        using Task = PooledTask<typename std::decay<F>::type, Pool>;
+        void* slot = pool.allocate(sizeof(Task));
+        if (!slot)
+        {
+            invoke_async_allocated(std::function<decltype(work())(void)>(std::forward<F>(work)));
+            return;
+        }
+        Item message = new (slot) Task(std::forward<F>(work), pool);
+        if (!put(message))
+        {
+            message->~Message();
+            pool.release(slot);
+        }
+    }
+
+    /**
+     * Runs work on this active object's thread with a task allocated on the heap.
+     */
+    template<typename R> void invoke_async_allocated(const std::function<R(void)>& work)
     {
         auto task = new AsyncTask<R>(work);
         if (task)
@@ -305,6 +489,41 @@ public:
         }
 	}
 
+    /**
+     * Runs work on this active object's thread and waits for its result.
+     * @return false if the work couldn't be queued, result is then unchanged.
+     */
+    template<typename F, typename R> bool invoke_sync(F&& work, R& result)
+    {
+        using Task = PooledPromise<typename std::decay<F>::type, R>;
+        void* slot = pool.allocate(sizeof(Task));
+        os_semaphore_t complete = slot ? pool.semaphore(slot) : nullptr;
+        if (!complete)
+        {
+            if (slot)
+                pool.release(slot);
+            auto future = invoke_future(std::function<R(void)>(std::forward<F>(work)));
+            if (!future)
+                return false;
+            result = future->get();
+            delete future;
+            return true;
+        }
+        Task* task = new (slot) Task(std::forward<F>(work), result, complete);
+        Item message = task;
+        bool queued = put(message);
+        if (queued)
+            task->wait();
+        task->~Task();
+        pool.release(slot);
+        return queued;
+    }
+
+    const Pool& message_pool() const
+    {
+        return pool;
+    }
+
     template<typename R> Promise<R>* invoke_future(const std::function<R(void)>& work)
     {
         auto promise = new Promise<R>(work);
@@ -0,0 +1,124 @@
+/**
+  Copyright (c) 2015 Particle Industries, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * An open addressed hash index over the fixed length keys of an append_list,
+ * mapping each key to the position of its element.
+ *
+ * Keys compare like strncmp over key_length characters. The table is grown
+ * when elements are added, so finding a key never allocates. The keys
+ * themselves stay in the list, the index only holds a byte per slot.
+ * It is passed a function that returns the key of the element at a position.
+ */
+template <unsigned key_length> class key_index
+{
+    // position+1 of the element in each slot, 0 for an empty slot
+    uint8_t* slots;
+    uint16_t slot_count;
+    uint8_t indexed;
+
+    static unsigned hash(const char* key)
+    {
+        // FNV-1a
+        uint32_t h = 2166136261u;
+        for (unsigned i = 0; i < key_length && key[i]; i++) {
+            h = (h ^ uint8_t(key[i])) * 16777619u;
+        }
+        return h ^ (h >> 16);
+    }
+
+    template <typename Keys> void insert(unsigned position, Keys keys)
+    {
+        unsigned mask = slot_count - 1;
+        unsigned slot = hash(keys(position)) & mask;
+        while (slots[slot]) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = position + 1;
+    }
+
+public:
+
+    key_index() : slots(NULL), slot_count(0), indexed(0) {}
+
+    /**
+     * @return the position of the element with the key, or -1 if there is none.
+     */
+    template <typename Keys> int find(const char* key, Keys keys) const
+    {
+        if (!slot_count)
+            return -1;
+
+        unsigned mask = slot_count - 1;
+        for (unsigned slot = hash(key) & mask; slots[slot]; slot = (slot + 1) & mask) {
+            unsigned position = slots[slot] - 1;
+            if (0 == strncmp(keys(position), key, key_length))
+                return position;
+        }
+        return -1;
+    }
+
+    /**
+     * Makes room for count elements, at most 255, before the element is added
+     * to the list.
+     * @return false if the table couldn't be grown.
+     */
+    template <typename Keys> bool reserve(unsigned count, Keys keys)
+    {
+        if (count > 255)
+            return false;
+        // keep the table at most half full so probe sequences stay short
+        if (count * 2 <= slot_count)
+            return true;
+
+        unsigned new_count = slot_count ? slot_count * 2 : 8;
+        while (count * 2 > new_count) {
+            new_count *= 2;
+        }
+        uint8_t* new_slots = (uint8_t*)realloc(slots, new_count);
+        if (!new_slots)
+            return false;
+        slots = new_slots;
+        slot_count = new_count;
+        memset(slots, 0, slot_count);
+        for (unsigned i = 0; i < indexed; i++) {
+            insert(i, keys);
+        }
+        return true;
+    }
+
+    /**
+     * Indexes the element added after the ones already indexed, once its key
+     * has been set. Room for it must have been reserved.
+     */
+    template <typename Keys> void add(Keys keys)
+    {
+        insert(indexed++, keys);
+    }
+
+    unsigned size() const
+    {
+        return indexed;
+    }
+};
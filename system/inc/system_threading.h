@@ -70,26 +70,27 @@ FFL(F const &func)
     return func;
 }
 
+// the lambdas are passed as they are, so they are stored in the active object's message
+// pool rather than allocated in a std::function
 #define _THREAD_CONTEXT_ASYNC_RESULT(thread, fn, result) \
     if (thread.isStarted() && !thread.isCurrentThread()) { \
         auto lambda = [=]() { (fn); }; \
-        thread.invoke_async(FFL(lambda)); \
+        thread.invoke_async(lambda); \
         return result; \
     }
 
 #define _THREAD_CONTEXT_ASYNC(thread, fn) \
     if (thread.isStarted() && !thread.isCurrentThread()) { \
         auto lambda = [=]() { (fn); }; \
-        thread.invoke_async(FFL(lambda)); \
+        thread.invoke_async(lambda); \
         return; \
     }
 
 #define SYSTEM_THREAD_CONTEXT_SYNC(fn) \
     if (SystemThread.isStarted() && !SystemThread.isCurrentThread()) { \
-        auto callable = FFL([=]() { return (fn); }); \
-        auto future = SystemThread.invoke_future(callable); \
-        auto result = future ? future->get() : 0;  \
-        delete future; \
+        auto callable = [=]() { return (fn); }; \
+        decltype(callable()) result = decltype(callable())(); \
+        SystemThread.invoke_sync(callable, result); \
         return result; \
     }
 
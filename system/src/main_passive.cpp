@@ -48,6 +48,8 @@
 /* Private typedef -----------------------------------------------------------*/
 
 /* Private define ------------------------------------------------------------*/
+// the loop checks the keep-alive and OTA timeouts of the protocol, make sure it runs this often
+#define CLOUD_POLL_INTERVAL 1000
 
 /* Private macro -------------------------------------------------------------*/
 
@@ -56,6 +58,7 @@ volatile uint16_t ledOffTime = 2000, ledOnTime = 200;
 static volatile uint32_t TimingLED;
 static volatile uint32_t TimingIWDGReload;
 static volatile uint32_t SystemSecondsTick;
+static volatile uint32_t LastSysTick;
 static bool CLOUD_CONNECTED = false;
 uint32_t on_mseconds = ledOnTime, off_mseconds = ledOnTime+ledOffTime;
 uint16_t cloudErrors = 0;
@@ -65,8 +68,22 @@ uint16_t cloudErrors = 0;
 /* Private function prototypes -----------------------------------------------*/
 
 /* Private functions ---------------------------------------------------------*/
+static uint32_t earliest(uint32_t next, uint32_t elapsed, uint32_t interval)
+{
+    uint32_t remaining = elapsed < interval ? interval - elapsed : 0;
+    return remaining < next ? remaining : next;
+}
+
+/* Runs when the next of its deadlines is due rather than at a fixed rate, and
+ * schedules itself again for the earliest of the LED pattern, the watchdog,
+ * the seconds counter, the OTA timeout and the cloud poll. Timers of the
+ * application and the radio wake the CPU on their own. */
 extern "C" void HAL_SysTick_Handler(void) {
     uint32_t current_millis = HAL_Timer_Get_Milli_Seconds();
+    uint32_t elapsed = current_millis - LastSysTick;
+    LastSysTick = current_millis;
+    uint32_t next = TIMING_IWDG_RELOAD;
+
     if (!LED_RGB_IsOverRidden()) {
         if (current_millis > off_mseconds) {
             LED_On(LED_RGB);
@@ -75,47 +92,46 @@ extern "C" void HAL_SysTick_Handler(void) {
         } else if (current_millis > on_mseconds) {
             LED_Off(LED_RGB);
         }
+        next = earliest(next, current_millis, (current_millis > on_mseconds ? off_mseconds : on_mseconds) + 1);
     }
 
     //feed the dog
+    TimingIWDGReload+=elapsed;
     if (TimingIWDGReload >= TIMING_IWDG_RELOAD)
     {
         TimingIWDGReload = 0;
         /* Reload WDG counter */
         HAL_Notify_WDT();
     }
-    else
-    {
-        TimingIWDGReload+=HAL_Get_Sys_Tick_Interval();
-    }
+    next = earliest(next, TimingIWDGReload, TIMING_IWDG_RELOAD);
 
     //tick the system seconds (separate from millis() so it won't roll over after 49 days)
-    if (SystemSecondsTick >= 1000)
+    SystemSecondsTick+=elapsed;
+    while (SystemSecondsTick >= 1000)
     {
-        SystemSecondsTick = 0;
-        /* Reload WDG counter */
+        SystemSecondsTick -= 1000;
         HAL_Tick_System_Seconds();
     }
-    else
-    {
-        SystemSecondsTick+=HAL_Get_Sys_Tick_Interval();
-    }
+    next = earliest(next, SystemSecondsTick, 1000);
 
     //check on system updates and reset if necessary
     if(SPARK_FLASH_UPDATE)
     {
+        TimingFlashUpdateTimeout+=elapsed;
         if (TimingFlashUpdateTimeout >= TIMING_FLASH_UPDATE_TIMEOUT)
         {
             //Reset is the only way now to recover from stuck OTA update
             HAL_Core_System_Reset();
         }
-        else
-        {
-            TimingFlashUpdateTimeout+=HAL_Get_Sys_Tick_Interval();
-        }
+        next = earliest(next, TimingFlashUpdateTimeout, TIMING_FLASH_UPDATE_TIMEOUT);
     }
 
+    if (CLOUD_CONNECTED)
+    {
+        next = earliest(next, 0, CLOUD_POLL_INTERVAL);
+    }
 
+    HAL_Schedule_Sys_Tick(next);
 }
 
 //stubs
@@ -193,6 +209,9 @@ void app_setup_and_loop_passive(void)
 //            DEBUG("Entering User Loop");
             loop();
             DECLARE_SYS_HEALTH(RAN_Loop);
+#if !MODULAR_FIRMWARE
+            _post_loop();
+#endif
 //            DEBUG("Exited User Loop");
         }
 
@@ -267,6 +286,11 @@ void app_setup_and_loop_passive(void)
         } else {
             LED_SetRGBColor(HAL_Network_Connection() ? RGB_COLOR_WHITE : RGB_COLOR_GREEN);
         }
+
+        //without the application loop nothing here polls, so sleep until the next event or system tick
+        if (system_mode()==SAFE_MODE || SPARK_FLASH_UPDATE) {
+            HAL_Core_CPU_Sleep();
+        }
     }
 }
 
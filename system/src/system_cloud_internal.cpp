@@ -29,6 +29,7 @@
 #include "spark_wiring_string.h"
 #include "spark_protocol_functions.h"
 #include "append_list.h"
+#include "key_index.h"
 #include "core_hal.h"
 #include "deviceid_hal.h"
 #include "ota_flash_hal.h"
@@ -84,41 +85,56 @@ ProtocolFacade* system_cloud_protocol_instance(void)
 static append_list<User_Var_Lookup_Table_t> vars(5);
 static append_list<User_Func_Lookup_Table_t> funcs(5);
 
+/**
+ * Hash indexes over the keys, so the cloud looking up a variable or function
+ * doesn't scan the whole list. They are updated as entries are registered.
+ */
+static key_index<USER_VAR_KEY_LENGTH> var_index;
+static key_index<USER_FUNC_KEY_LENGTH> func_index;
+
+static const char* var_key(unsigned index)
+{
+    return vars[index].userVarKey;
+}
+
+static const char* func_key(unsigned index)
+{
+    return funcs[index].userFuncKey;
+}
+
 User_Var_Lookup_Table_t* find_var_by_key(const char* varKey)
 {
-    for (int i = vars.size(); i-->0; )
-    {
-        if (0 == strncmp(vars[i].userVarKey, varKey, USER_VAR_KEY_LENGTH))
-        {
-            return &vars[i];
-        }
-    }
-    return NULL;
+    int index = var_index.find(varKey, var_key);
+    return index < 0 ? NULL : &vars[index];
 }
 
 
 User_Var_Lookup_Table_t* find_var_by_key_or_add(const char* varKey)
 {
     User_Var_Lookup_Table_t* result = find_var_by_key(varKey);
-    return result ? result : vars.add();
+    if (!result && var_index.reserve(vars.size()+1, var_key) && (result = vars.add()))
+    {
+        strncpy(result->userVarKey, varKey, USER_VAR_KEY_LENGTH);
+        var_index.add(var_key);
+    }
+    return result;
 }
 
 User_Func_Lookup_Table_t* find_func_by_key(const char* funcKey)
 {
-    for (int i = funcs.size(); i-->0; )
-    {
-        if (0 == strncmp(funcs[i].userFuncKey, funcKey, USER_FUNC_KEY_LENGTH))
-        {
-            return &funcs[i];
-        }
-    }
-    return NULL;
+    int index = func_index.find(funcKey, func_key);
+    return index < 0 ? NULL : &funcs[index];
 }
 
 User_Func_Lookup_Table_t* find_func_by_key_or_add(const char* funcKey)
 {
     User_Func_Lookup_Table_t* result = find_func_by_key(funcKey);
-    return result ? result : funcs.add();
+    if (!result && func_index.reserve(funcs.size()+1, func_key) && (result = funcs.add()))
+    {
+        strncpy(result->userFuncKey, funcKey, USER_FUNC_KEY_LENGTH);
+        func_index.add(func_key);
+    }
+    return result;
 }
 
 int call_raw_user_function(void* data, const char* param, void* reserved)
@@ -139,7 +155,7 @@ bool spark_function_internal(const cloud_function_descriptor* desc, void* reserv
     User_Func_Lookup_Table_t* item = NULL;
     if (NULL != desc->fn && NULL != desc->funcKey && strlen(desc->funcKey)<=USER_FUNC_KEY_LENGTH)
     {
-        if ((item=find_func_by_key(desc->funcKey)) || (item = funcs.add()))
+        if ((item=find_func_by_key_or_add(desc->funcKey)))
         {
             item->pUserFunc = desc->fn;
             item->pUserFuncData = desc->data;
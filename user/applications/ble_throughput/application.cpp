@@ -0,0 +1,135 @@
+/* BLE notification throughput benchmark
+ *
+ * Once a central has subscribed to the custom data service, sends messages
+ * back to back with BLE.sendData() and reports on Serial1 every few seconds:
+ * - payload bytes per second
+ * - notifications per second and per connection interval
+ * - how often the sender had to wait for the TX queue and the queue high water mark
+ *
+ * The central writes any data to the custom data service to start the run,
+ * and again to stop it.
+ *
+ * While stopped, each report also profiles the send path itself: one message
+ * is sent with an empty TX queue, timing it and measuring the stack it used
+ * by painting the free stack below the caller beforehand.
+ */
+
+/* Includes ------------------------------------------------------------------*/
+#include "application.h"
+
+SYSTEM_MODE(MANUAL);
+
+const uint16_t MESSAGE_SIZE = 200;
+const uint32_t REPORT_PERIOD = 5000;
+const uint32_t CPU_MHZ = 16;
+const uint16_t STACK_PAINT_SIZE = 1024;
+const uint8_t STACK_PAINT = 0xA5;
+
+uint8_t message[MESSAGE_SIZE];
+volatile bool running = false;
+
+BLUETOOTH_LE_TX_STATS lastStats;
+uint32_t lastReport = 0;
+
+void dataCallbackHandler(uint8_t *data, uint16_t length)
+{
+    running = !running;
+}
+
+void report()
+{
+    BLUETOOTH_LE_TX_STATS stats;
+    BLE.getTxStats(&stats);
+
+    uint32_t now = millis();
+    uint32_t elapsed = now - lastReport;
+    if (elapsed == 0) {
+        return;
+    }
+
+    uint32_t bytes = stats.bytes - lastStats.bytes;
+    uint32_t notifications = stats.notifications - lastStats.notifications;
+    // the connection interval is in units of 1.25ms
+    uint32_t intervalUs = BLE.getConnectionInterval() * 1250;
+
+    Serial1.print("bytes/s: ");
+    Serial1.print(bytes * 1000 / elapsed);
+    Serial1.print(" notifications/s: ");
+    Serial1.print(notifications * 1000 / elapsed);
+    Serial1.print(" per interval: ");
+    Serial1.print((float)notifications * intervalUs / (elapsed * 1000.0f));
+    Serial1.print(" (interval ");
+    Serial1.print(intervalUs / 1000.0f);
+    Serial1.print("ms) queue waits: ");
+    Serial1.print(stats.queue_full_waits - lastStats.queue_full_waits);
+    Serial1.print(" dropped: ");
+    Serial1.print(stats.dropped_messages - lastStats.dropped_messages);
+    Serial1.print(" high water: ");
+    Serial1.println(stats.queue_high_water);
+
+    lastStats = stats;
+    lastReport = now;
+}
+
+// fill the stack below the caller with a known pattern
+__attribute__((noinline)) uint8_t* paintStack()
+{
+    volatile uint8_t marker;
+    uint8_t* top = (uint8_t*)&marker - 64;
+    for (uint16_t i = 0; i < STACK_PAINT_SIZE; i++) {
+        top[-i] = STACK_PAINT;
+    }
+    return top;
+}
+
+// deepest painted byte that was overwritten
+uint16_t stackUsed(uint8_t* top)
+{
+    uint16_t used = STACK_PAINT_SIZE;
+    while (used > 0 && top[-(used - 1)] == STACK_PAINT) {
+        used--;
+    }
+    return used;
+}
+
+void profileSendPath()
+{
+    uint8_t* top = paintStack();
+    uint32_t start = micros();
+    BLE.sendData(message, MESSAGE_SIZE);
+    uint32_t elapsed = micros() - start;
+    uint16_t stack = stackUsed(top);
+
+    Serial1.print("send path: ");
+    Serial1.print(elapsed * CPU_MHZ * 1024 / MESSAGE_SIZE);
+    Serial1.print(" cycles/KB, stack high water: ");
+    Serial1.print(stack);
+    Serial1.println(" bytes");
+}
+
+/* This function is called once at start up ----------------------------------*/
+void setup()
+{
+    Serial1.begin(38400);
+    for (uint16_t i = 0; i < MESSAGE_SIZE; i++) {
+        message[i] = i;
+    }
+    BLE.registerDataCallback(dataCallbackHandler);
+    BLE.getTxStats(&lastStats);
+    lastReport = millis();
+}
+
+/* This function loops forever --------------------------------------------*/
+void loop()
+{
+    if (running && BLE.getState() == BLE_CONNECTED) {
+        BLE.sendData(message, MESSAGE_SIZE);
+    }
+
+    if (millis() - lastReport >= REPORT_PERIOD) {
+        if (!running && BLE.getState() == BLE_CONNECTED) {
+            profileSendPath();
+        }
+        report();
+    }
+}
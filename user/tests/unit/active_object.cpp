@@ -0,0 +1,351 @@
+// Off device tests and benchmark for the active object message pool, with the
+// concurrent HAL implemented on host threads
+
+#define PLATFORM_THREADING 1
+
+#include "catch.hpp"
+#include "active_object.h"
+#include "timer_hal.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+namespace {
+
+std::atomic<uint64_t> allocations(0);
+
+// a fixed size queue of fixed size items
+struct HostQueue {
+    std::mutex lock;
+    std::condition_variable changed;
+    uint8_t* items;
+    size_t item_size;
+    size_t capacity;
+    size_t head = 0;
+    size_t count = 0;
+};
+
+struct HostSemaphore {
+    std::mutex lock;
+    std::condition_variable given;
+    unsigned count;
+};
+
+template <typename Predicate>
+bool wait_for(std::condition_variable& cv, std::unique_lock<std::mutex>& lock, system_tick_t delay, Predicate ready)
+{
+    if (delay == CONCURRENT_WAIT_FOREVER) {
+        cv.wait(lock, ready);
+        return true;
+    }
+    return cv.wait_for(lock, std::chrono::milliseconds(delay), ready);
+}
+
+} // namespace
+
+void* operator new(size_t size)
+{
+    allocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+extern "C" {
+
+system_tick_t HAL_Timer_Get_Milli_Seconds(void)
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+os_result_t os_thread_yield(void)
+{
+    std::this_thread::yield();
+    return 0;
+}
+
+int os_queue_create(os_queue_t* queue, size_t item_size, size_t item_count)
+{
+    HostQueue* q = new HostQueue();
+    q->items = (uint8_t*)malloc(item_size * item_count);
+    q->item_size = item_size;
+    q->capacity = item_count;
+    *queue = q;
+    return 0;
+}
+
+int os_queue_put(os_queue_t queue, const void* item, system_tick_t delay)
+{
+    HostQueue* q = (HostQueue*)queue;
+    std::unique_lock<std::mutex> lock(q->lock);
+    if (!wait_for(q->changed, lock, delay, [q] { return q->count < q->capacity; }))
+        return 1;
+    memcpy(q->items + ((q->head + q->count) % q->capacity) * q->item_size, item, q->item_size);
+    q->count++;
+    q->changed.notify_all();
+    return 0;
+}
+
+int os_queue_take(os_queue_t queue, void* item, system_tick_t delay)
+{
+    HostQueue* q = (HostQueue*)queue;
+    std::unique_lock<std::mutex> lock(q->lock);
+    if (!wait_for(q->changed, lock, delay, [q] { return q->count > 0; }))
+        return 1;
+    memcpy(item, q->items + q->head * q->item_size, q->item_size);
+    q->head = (q->head + 1) % q->capacity;
+    q->count--;
+    q->changed.notify_all();
+    return 0;
+}
+
+int os_semaphore_create(os_semaphore_t* semaphore, unsigned max_count, unsigned initial_count)
+{
+    HostSemaphore* s = new HostSemaphore();
+    s->count = initial_count;
+    *semaphore = s;
+    return 0;
+}
+
+int os_semaphore_destroy(os_semaphore_t semaphore)
+{
+    delete (HostSemaphore*)semaphore;
+    return 0;
+}
+
+int os_semaphore_take(os_semaphore_t semaphore, system_tick_t timeout, bool reserved)
+{
+    HostSemaphore* s = (HostSemaphore*)semaphore;
+    std::unique_lock<std::mutex> lock(s->lock);
+    if (!wait_for(s->given, lock, timeout, [s] { return s->count > 0; }))
+        return 1;
+    s->count--;
+    return 0;
+}
+
+int os_semaphore_give(os_semaphore_t semaphore, bool reserved)
+{
+    HostSemaphore* s = (HostSemaphore*)semaphore;
+    std::lock_guard<std::mutex> lock(s->lock);
+    s->count++;
+    s->given.notify_one();
+    return 0;
+}
+
+} // extern "C"
+
+namespace {
+
+/**
+ * The active object's thread runs forever, so there is one for all the tests
+ * and it is never destroyed.
+ */
+ActiveObjectThreadQueue& active_object()
+{
+    static ActiveObjectThreadQueue* object = nullptr;
+    if (!object) {
+        object = new ActiveObjectThreadQueue(ActiveObjectConfiguration([]{}, 10, CONCURRENT_WAIT_FOREVER, 64));
+        object->start();
+    }
+    return *object;
+}
+
+// wait for everything posted so far to have run, without the allocations of an assertion
+bool settle(ActiveObjectThreadQueue& ao)
+{
+    int done = 0;
+    return ao.invoke_sync([] { return 1; }, done) && done == 1;
+}
+
+void drain(ActiveObjectThreadQueue& ao)
+{
+    REQUIRE(settle(ao));
+}
+
+} // namespace
+
+TEST_CASE("Async calls run in order on the active object thread", "[active_object]")
+{
+    ActiveObjectThreadQueue& ao = active_object();
+    drain(ao);
+    uint32_t fallbacks = ao.message_pool().fallback_count();
+
+    std::vector<int> order;
+    order.reserve(100);
+    std::thread::id thread;
+    for (int i = 0; i < 100; i++) {
+        ao.invoke_async([i, &order, &thread] {
+            order.push_back(i);
+            thread = std::this_thread::get_id();
+        });
+        // no more in flight than the pool holds
+        if (i % (ACTIVE_OBJECT_POOL_SLOTS / 2) == 0)
+            drain(ao);
+    }
+    drain(ao);
+
+    REQUIRE(order.size() == 100);
+    for (int i = 0; i < 100; i++) {
+        REQUIRE(order[i] == i);
+    }
+    CHECK(thread != std::this_thread::get_id());
+    CHECK(ao.message_pool().fallback_count() == fallbacks);
+}
+
+TEST_CASE("Calls beyond the pool capacity are allocated", "[active_object]")
+{
+    ActiveObjectThreadQueue& ao = active_object();
+    drain(ao);
+    uint32_t fallbacks = ao.message_pool().fallback_count();
+
+    // hold up the active object while more calls are posted than there are slots
+    std::atomic<bool> release(false);
+    std::atomic<int> ran(0);
+    ao.invoke_async([&release] { while (!release) std::this_thread::yield(); });
+    const int calls = ACTIVE_OBJECT_POOL_SLOTS * 2;
+    for (int i = 0; i < calls; i++) {
+        ao.invoke_async([&ran] { ran++; });
+    }
+    uint32_t allocated = ao.message_pool().fallback_count() - fallbacks;
+    release = true;
+    drain(ao);
+
+    CHECK(ran == calls);
+    CHECK(allocated == ACTIVE_OBJECT_POOL_SLOTS + 1);
+}
+
+TEST_CASE("A callable too big for a slot is allocated", "[active_object]")
+{
+    ActiveObjectThreadQueue& ao = active_object();
+    drain(ao);
+    uint32_t fallbacks = ao.message_pool().fallback_count();
+
+    struct { char data[ACTIVE_OBJECT_POOL_SLOT_SIZE]; } big = { { 42 } };
+    char seen = 0;
+    ao.invoke_async([big, &seen] { seen = big.data[0]; });
+    drain(ao);
+
+    CHECK(seen == 42);
+    CHECK(ao.message_pool().fallback_count() == fallbacks + 1);
+}
+
+TEST_CASE("A pool without slots allocates every message", "[active_object]")
+{
+    MessagePool<ACTIVE_OBJECT_POOL_SLOT_SIZE, 0> pool;
+    CHECK(pool.allocate(8) == nullptr);
+    CHECK(pool.pooled_count() == 0u);
+    CHECK(pool.fallback_count() == 1u);
+}
+
+TEST_CASE("Sync and async calls don't allocate once the pool is warm", "[active_object]")
+{
+    ActiveObjectThreadQueue& ao = active_object();
+    // create the semaphores of the first few slots, by making synchronous
+    // calls from several threads while the active object is held up
+    drain(ao);
+    std::atomic<bool> release(false);
+    ao.invoke_async([&release] { while (!release) std::this_thread::yield(); });
+    uint32_t pooled = ao.message_pool().pooled_count();
+    std::vector<std::thread> callers;
+    for (int i = 0; i < 4; i++) {
+        callers.emplace_back([&ao] { settle(ao); });
+    }
+    while (ao.message_pool().pooled_count() - pooled < 4) {
+        std::this_thread::yield();
+    }
+    release = true;
+    for (std::thread& caller : callers) {
+        caller.join();
+    }
+
+    int value = 0;
+    int results[100] = {};
+    bool settled = true;
+    uint64_t before = allocations;
+    for (int i = 0; i < 100; i++) {
+        ao.invoke_sync([i] { return i * 2; }, results[i]);
+        ao.invoke_async([&value] { value++; });
+        settled = settle(ao) && settled;
+    }
+    uint64_t allocated = allocations - before;
+    CHECK(allocated == 0);
+    CHECK(settled);
+    CHECK(value == 100);
+    for (int i = 0; i < 100; i++) {
+        REQUIRE(results[i] == i * 2);
+    }
+}
+
+/**
+ * Messages per second and heap allocations per message through
+ * ActiveObjectThreadQueue, from the message pool and allocated as before.
+ * Async calls are sent in bursts of half the pool, waiting for each burst to
+ * be handled, and as a flood that outruns the active object and so exhausts
+ * the pool.
+ *
+ * Run with: obj/runner "[benchmark]"
+ */
+TEST_CASE("Active object benchmark", "[.][active_object][benchmark]")
+{
+    ActiveObjectThreadQueue& ao = active_object();
+    const unsigned messages = 200000;
+    std::ostringstream report;
+    report << "messages/s, allocations/message" << std::endl;
+
+    auto measure = [&](const char* name, unsigned burst, std::function<void(unsigned)> send) {
+        drain(ao);
+        uint64_t before = allocations;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned i = 0; i < messages; i++) {
+            send(i);
+            if (burst && (i % burst) == burst - 1)
+                settle(ao);
+        }
+        settle(ao);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        double per_message = double(allocations - before) / messages;
+        report << "  " << name << ": " << unsigned(messages / elapsed.count()) << ", " << per_message << std::endl;
+    };
+
+    // a call like Particle.publish, capturing a few arguments
+    std::atomic<unsigned> sum(0);
+    const char* name = "event";
+    auto pooled = [&](unsigned i) {
+        ao.invoke_async([&sum, name, i] { sum += i + name[0]; });
+    };
+    auto allocated = [&](unsigned i) {
+        ao.invoke_async_allocated(std::function<void()>([&sum, name, i] { sum += i + name[0]; }));
+    };
+    const unsigned burst = ACTIVE_OBJECT_POOL_SLOTS / 2;
+    measure("async pooled, bursts", burst, pooled);
+    measure("async allocated, bursts", burst, allocated);
+    measure("async pooled, flood", 0, pooled);
+    measure("async allocated, flood", 0, allocated);
+    measure("sync pooled", 0, [&](unsigned i) {
+        unsigned result = 0;
+        ao.invoke_sync([name, i] { return i + name[0]; }, result);
+        sum += result;
+    });
+    measure("sync allocated", 0, [&](unsigned i) {
+        auto future = ao.invoke_future(std::function<unsigned()>([name, i] { return i + name[0]; }));
+        sum += future->get();
+        delete future;
+    });
+    REQUIRE(sum != 0u);
+    WARN(report.str());
+}
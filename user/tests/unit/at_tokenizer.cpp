@@ -0,0 +1,304 @@
+// Off device tests and replay benchmark for the Electron modem AT response
+// and URC tokenizer
+
+#include "attokenizer_hal.h"
+// the debug log macros of the HAL, not the test ones
+#undef INFO
+#undef WARN
+#include "catch.hpp"
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+/**
+ * The previous MDMParser::_getLine, trying every pattern at every position.
+ */
+int scan_line(Pipe<char>* pipe, char* buf, int len)
+{
+    int unkn = 0;
+    int sz = pipe->size();
+    int fr = pipe->free();
+    if (len > sz)
+        len = sz;
+    while (len > 0)
+    {
+        static struct {
+              const char* fmt;                              int type;
+        } lutF[] = {
+            { "\r\n+USORD: %d,%d,\"%c\"",                   TYPE_PLUS       },
+            { "\r\n+USORF: %d,\"" IPSTR "\",%d,%d,\"%c\"",  TYPE_PLUS       },
+            { "\r\n+URDFILE: %s,%d,\"%c\"",                 TYPE_PLUS       },
+        };
+        static struct {
+              const char* sta;          const char* end;    int type;
+        } lut[] = {
+            { "\r\nOK\r\n",             NULL,               TYPE_OK         },
+            { "\r\nERROR\r\n",          NULL,               TYPE_ERROR      },
+            { "\r\n+CME ERROR:",        "\r\n",             TYPE_ERROR      },
+            { "\r\n+CMS ERROR:",        "\r\n",             TYPE_ERROR      },
+            { "\r\nRING\r\n",           NULL,               TYPE_RING       },
+            { "\r\nCONNECT\r\n",        NULL,               TYPE_CONNECT    },
+            { "\r\nNO CARRIER\r\n",     NULL,               TYPE_NOCARRIER  },
+            { "\r\nNO DIALTONE\r\n",    NULL,               TYPE_NODIALTONE },
+            { "\r\nBUSY\r\n",           NULL,               TYPE_BUSY       },
+            { "\r\nNO ANSWER\r\n",      NULL,               TYPE_NOANSWER   },
+            { "\r\n+",                  "\r\n",             TYPE_PLUS       },
+            { "\r\n@",                  NULL,               TYPE_PROMPT     },
+            { "\r\n>",                  NULL,               TYPE_PROMPT     },
+            { "\n>",                    NULL,               TYPE_PROMPT     },
+            { "\r\nABORTED\r\n",        NULL,               TYPE_ABORTED    },
+        };
+        for (int i = 0; i < (int)(sizeof(lutF)/sizeof(*lutF)); i ++) {
+            pipe->set(unkn);
+            int ln = AtTokenizer::parseFormated(pipe, len, lutF[i].fmt);
+            if (ln == WAIT && fr)
+                return WAIT;
+            if ((ln != NOT_FOUND) && (unkn > 0))
+                return TYPE_UNKNOWN | pipe->get(buf, unkn);
+            if (ln > 0)
+                return lutF[i].type  | pipe->get(buf, ln);
+        }
+        for (int i = 0; i < (int)(sizeof(lut)/sizeof(*lut)); i ++) {
+            pipe->set(unkn);
+            int ln = AtTokenizer::parseMatch(pipe, len, lut[i].sta, lut[i].end);
+            if (ln == WAIT && fr)
+                return WAIT;
+            if ((ln != NOT_FOUND) && (unkn > 0))
+                return TYPE_UNKNOWN | pipe->get(buf, unkn);
+            if (ln > 0)
+                return lut[i].type | pipe->get(buf, ln);
+        }
+        unkn ++;
+        len--;
+    }
+    return WAIT;
+}
+
+uint32_t xorshift(uint32_t& x)
+{
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+std::string payload(uint32_t& x, size_t size)
+{
+    std::string s;
+    for (size_t i = 0; i < size; i++)
+        s += char(xorshift(x));
+    return s;
+}
+
+/**
+ * A session with a SARA-U260 as the modem sends it: the echo of each
+ * command, the responses and URCs, with binary socket data.
+ */
+std::string transcript()
+{
+    uint32_t x = 2463534242u;
+    std::string t;
+    t += "AT\r\r\nOK\r\n";
+    t += "AT+CREG?\r\r\n+CREG: 2,5,\"2B4C\",\"0000C6A5\",2\r\n\r\nOK\r\n";
+    t += "\r\n+CIEV: 9,2\r\n";
+    t += "AT+CSQ\r\r\n+CSQ: 17,99\r\n\r\nOK\r\n";
+    t += "AT+UPSND=0,8\r\r\n+UPSND: 0,8,1\r\n\r\nOK\r\n";
+    t += "AT+USOCR=17\r\r\n+USOCR: 0\r\n\r\nOK\r\n";
+    for (int i = 0; i < 4; i++) {
+        t += "AT+USOST=0,\"52.0.0.1\",5684,64\r\r\n@" + payload(x, 64) + "\r\n+USOST: 0,64\r\n\r\nOK\r\n";
+        t += "\r\n+UUSORF: 0,68\r\n";
+        t += "AT+USORF=0,68\r\r\n+USORF: 0,\"52.0.0.1\",5684,68,\"" + payload(x, 68) + "\"\r\n\r\nOK\r\n";
+    }
+    t += "AT+USOCR=6\r\r\n+USOCR: 1\r\n\r\nOK\r\n";
+    for (int i = 0; i < 4; i++) {
+        t += "AT+USOWR=1,32\r\r\n@" + payload(x, 32) + "\r\n+USOWR: 1,32\r\n\r\nOK\r\n";
+        t += "\r\n+UUSORD: 1,200\r\n";
+        t += "AT+USORD=1,200\r\r\n+USORD: 1,200,\"" + payload(x, 200) + "\"\r\n\r\nOK\r\n";
+    }
+    t += "\r\n+UUSOCL: 1\r\n";
+    t += "AT+USOCL=1\r\r\n+CME ERROR: operation not allowed\r\n";
+    t += "\r\n+CGREG: 1\r\n";
+    t += "AT+COPS?\r\r\nERROR\r\n";
+    return t;
+}
+
+const int PURGED = -10;
+
+struct Line {
+    int ret;
+    std::string data;
+
+    bool operator==(const Line& other) const { return ret == other.ret && data == other.data; }
+};
+
+/**
+ * Feeds data to a 1024 byte receive pipe in chunks, as the UART delivers it
+ * between polls, and splits it into lines.
+ */
+template <typename GetLine> std::vector<Line> replay(const std::string& data, uint32_t seed, unsigned max_chunk, GetLine get_line)
+{
+    Pipe<char> pipe(1024);
+    std::vector<Line> lines;
+    char buf[1024 + 64];
+    size_t sent = 0;
+    uint32_t x = seed;
+    while (sent < data.size() || pipe.readable()) {
+        if (sent < data.size()) {
+            size_t chunk = std::min<size_t>(data.size() - sent, 1 + xorshift(x) % max_chunk);
+            sent += pipe.put(data.data() + sent, chunk);
+        }
+        int ret;
+        while ((ret = get_line(&pipe, buf, sizeof(buf))) != WAIT)
+            lines.push_back(Line { ret, std::string(buf, LENGTH(ret)) });
+        // a partial line at the end, or a full pipe the modem would be stuck on, is purged
+        if (sent == data.size() || !pipe.free()) {
+            char c;
+            while (pipe.get(&c, 1))
+                lines.push_back(Line { PURGED, std::string(1, c) });
+        }
+    }
+    return lines;
+}
+
+std::vector<Line> tokenize(const std::string& data, uint32_t seed=1, unsigned max_chunk=128)
+{
+    return replay(data, seed, max_chunk, [](Pipe<char>* pipe, char* buf, int len) {
+        return AtTokenizer::getLine(pipe, buf, len);
+    });
+}
+
+std::vector<Line> scan(const std::string& data, uint32_t seed=1, unsigned max_chunk=128)
+{
+    return replay(data, seed, max_chunk, scan_line);
+}
+
+} // namespace
+
+TEST_CASE("Tokenizer splits responses from command echo", "[at_tokenizer]")
+{
+    std::vector<Line> lines = tokenize("AT+CSQ\r\r\n+CSQ: 17,99\r\n\r\nOK\r\nAT+USOWR=1,4\r\r\n@\r\n+CME ERROR: 4\r\n");
+    REQUIRE(lines.size() == 6);
+    CHECK(lines[0].ret == (TYPE_UNKNOWN | 7));
+    CHECK(lines[1].ret == (TYPE_PLUS | 15));
+    CHECK(lines[1].data == "\r\n+CSQ: 17,99\r\n");
+    CHECK(lines[2].ret == (TYPE_OK | 6));
+    CHECK(lines[3].data == "AT+USOWR=1,4\r");
+    CHECK(lines[4].ret == (TYPE_PROMPT | 3));
+    CHECK(lines[5].ret == (TYPE_ERROR | 17));
+}
+
+TEST_CASE("Tokenizer takes socket data with line ends as a whole", "[at_tokenizer]")
+{
+    std::string data = "ab\r\nOK\r\n\"cd";
+    std::vector<Line> lines = tokenize("\r\n+USORD: 0,11,\"" + data + "\"\r\n\r\nOK\r\n");
+    REQUIRE(lines.size() == 3);
+    CHECK(lines[0].ret == (TYPE_PLUS | 28));
+    CHECK(lines[0].data.substr(16, 11) == data);
+    // the line end after the data is left over
+    CHECK(lines[1].data == "\r\n");
+    CHECK(lines[2].ret == (TYPE_OK | 6));
+}
+
+TEST_CASE("Tokenizer waits for the rest of a line", "[at_tokenizer]")
+{
+    Pipe<char> pipe(64);
+    char buf[64];
+    pipe.put("\r\n+UUSORD: 0,", 13);
+    CHECK(AtTokenizer::getLine(&pipe, buf, sizeof(buf)) == WAIT);
+    pipe.put("12\r\n\r\nOK", 8);
+    CHECK(AtTokenizer::getLine(&pipe, buf, sizeof(buf)) == (TYPE_PLUS | 17));
+    CHECK(AtTokenizer::getLine(&pipe, buf, sizeof(buf)) == WAIT);
+    pipe.put("\r\n", 2);
+    CHECK(AtTokenizer::getLine(&pipe, buf, sizeof(buf)) == (TYPE_OK | 6));
+}
+
+TEST_CASE("Tokenizer agrees with trying every pattern on a transcript", "[at_tokenizer]")
+{
+    std::string t = transcript();
+    for (uint32_t seed = 1; seed < 200; seed++) {
+        unsigned max_chunk = 1 + seed % 150;
+        std::vector<Line> lines = tokenize(t, seed, max_chunk);
+        REQUIRE(lines == scan(t, seed, max_chunk));
+    }
+    // a final response for each command, and nothing purged
+    unsigned ok = 0, purged = 0;
+    for (const Line& line : tokenize(t)) {
+        ok += line.ret == (TYPE_OK | 6);
+        purged += line.ret == PURGED;
+    }
+    CHECK(ok == 22);
+    CHECK(purged == 0);
+}
+
+TEST_CASE("Tokenizer agrees with trying every pattern on random output", "[at_tokenizer][fuzz]")
+{
+    const char* tokens[] = {
+        "\r", "\n", "+", "OK", "ERROR", "@", ">", "\"", ",", "0", "12", "3", ": ", "x",
+        "USORD", "USORF", "URDFILE", "CME ERROR:", "CMS ERROR:", "RING", "NO ", "CARRIER",
+        "1.2.3.4", "ABORTED", "CONNECT", "BUSY", "ANSWER"
+    };
+    uint32_t x = 88172645u;
+    for (int round = 0; round < 2000; round++) {
+        std::string data;
+        unsigned count = xorshift(x) % 200;
+        for (unsigned i = 0; i < count; i++)
+            data += tokens[xorshift(x) % (sizeof(tokens) / sizeof(*tokens))];
+        unsigned max_chunk = 1 + xorshift(x) % 64;
+        std::vector<Line> lines = tokenize(data, round + 1, max_chunk);
+        REQUIRE(lines == scan(data, round + 1, max_chunk));
+    }
+}
+
+TEST_CASE("URCs are found by name", "[at_tokenizer]")
+{
+    static const struct { const char* name; int id; } urcs[] = {
+        { "UUSORD", 1 }, { "UUSORF", 2 }, { "CREG", 3 }, { "CGREG", 4 }
+    };
+    const char* line = "CGREG: 1\r\n";
+    const auto* urc = AtTokenizer::findUrc(line, strlen(line), urcs);
+    REQUIRE(urc != nullptr);
+    CHECK(urc->id == 4);
+    line = "UUSORD: 0,12\r\n";
+    urc = AtTokenizer::findUrc(line, strlen(line), urcs);
+    REQUIRE(urc != nullptr);
+    CHECK(urc->id == 1);
+    line = "UUSOR: 0\r\n";
+    CHECK(AtTokenizer::findUrc(line, strlen(line), urcs) == nullptr);
+    line = "CREGX: 0\r\n";
+    CHECK(AtTokenizer::findUrc(line, strlen(line), urcs) == nullptr);
+    line = "CREG";
+    CHECK(AtTokenizer::findUrc(line, strlen(line), urcs) == nullptr);
+}
+
+/**
+ * Lines a second split from a replayed modem transcript, delivered 128
+ * bytes between polls, trying every pattern at each position and with the
+ * tokenizer.
+ *
+ * Run with: obj/runner "[benchmark]"
+ */
+TEST_CASE("AT tokenizer benchmark", "[.][at_tokenizer][benchmark]")
+{
+    std::string t = transcript();
+    const unsigned replays = 500;
+    size_t lines = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < replays; i++)
+        lines += scan(t).size();
+    std::chrono::duration<double> scanned = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < replays; i++)
+        lines -= tokenize(t).size();
+    std::chrono::duration<double> tokenized = std::chrono::steady_clock::now() - start;
+
+    REQUIRE(lines == 0);
+    size_t count = tokenize(t).size() * replays;
+    std::ostringstream report;
+    report << "lines/s from a " << t.size() << " byte transcript: every pattern " << count / scanned.count()
+           << ", tokenizer " << count / tokenized.count() << std::endl;
+    WARN(report.str());
+}
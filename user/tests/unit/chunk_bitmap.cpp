@@ -0,0 +1,316 @@
+// Off device tests and benchmark for the OTA chunk bitmap and selective acknowledgements
+
+#include "catch.hpp"
+#include "chunk_bitmap.h"
+#include "spark_protocol_tester.h"
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace particle::protocol;
+
+namespace {
+
+struct Run {
+    chunk_index_t start;
+    chunk_index_t length;
+};
+
+chunk_index_t decode16(const uint8_t* buf)
+{
+    return chunk_index_t(buf[0] << 8 | buf[1]);
+}
+
+/**
+ * Decodes a selective acknowledgement into its limit and missing runs.
+ */
+chunk_index_t decode(const uint8_t* buf, size_t size, std::vector<Run>& runs)
+{
+    runs.clear();
+    for (size_t i = 2; i + 4 <= size; i += 4) {
+        runs.push_back({ decode16(buf + i), decode16(buf + i + 2) });
+    }
+    return decode16(buf);
+}
+
+/**
+ * A server sending chunks over a link that drops some of them. Each round
+ * trip the server sends up to window chunks: first those reported missing,
+ * then new ones. Without a window, each chunk waits for its acknowledgement.
+ * @return the number of round trips until the device has every chunk.
+ */
+unsigned transfer(unsigned count, unsigned window, unsigned loss_percent)
+{
+    ChunkBitmap chunks;
+    chunks.reset(count, false);
+    uint32_t x = 2463534242u;
+    auto lost = [&]() {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        return x % 100 < loss_percent;
+    };
+
+    std::vector<chunk_index_t> resend;
+    chunk_index_t next = 0;
+    chunk_index_t limit = 0;
+    unsigned round_trips = 0;
+    while (chunks.next_missing(0) != NO_CHUNKS_MISSING && round_trips < 100000) {
+        round_trips++;
+        unsigned sent = 0;
+        for (; sent < window && !resend.empty(); sent++) {
+            if (!lost())
+                chunks.set(resend.front());
+            resend.erase(resend.begin());
+        }
+        for (; sent < window && next < count; sent++, next++) {
+            if (!lost()) {
+                chunks.set(next);
+                limit = next + 1;
+            }
+        }
+        if (next == count)
+            limit = count;
+
+        uint8_t ack[2 + (MISSED_CHUNKS_TO_SEND / 2) * 4];
+        chunk_index_t last_missing = 0;
+        size_t size = chunks.encode_missing(ack, MISSED_CHUNKS_TO_SEND / 2, limit, last_missing);
+        std::vector<Run> runs;
+        decode(ack, size, runs);
+        resend.clear();
+        for (const Run& run : runs) {
+            for (chunk_index_t i = 0; i < run.length; i++)
+                resend.push_back(run.start + i);
+        }
+    }
+    return round_trips;
+}
+
+/**
+ * Decodes the selective acknowledgements among the messages sent since the
+ * last call.
+ * @return the limit of each acknowledgement, its runs in runs.
+ */
+std::vector<chunk_index_t> acknowledgements(SparkProtocolTester& t, std::vector<std::vector<Run>>& runs)
+{
+    std::vector<chunk_index_t> limits;
+    runs.clear();
+    for (const std::string& m : t.responses()) {
+        // a confirmable GET to Uri-Path "c" with Uri-Query "r"
+        if (m.size() < 11 || m[0] != 0x40 || m[1] != 0x01 ||
+                m.compare(4, 5, "\xb1" "c" "\x41" "r" "\xff"))
+            continue;
+        runs.push_back(std::vector<Run>());
+        limits.push_back(decode((const uint8_t*)m.data() + 9, m.size() - 9, runs.back()));
+    }
+    return limits;
+}
+
+} // namespace
+
+TEST_CASE("Chunk bitmap tracks received chunks", "[chunk_bitmap]")
+{
+    ChunkBitmap chunks;
+    REQUIRE(chunks.reset(20, false));
+    CHECK(chunks.size() == 20);
+    CHECK(chunks.next_missing(0) == 0);
+
+    for (chunk_index_t i = 0; i < 20; i++) {
+        if (i != 9 && i != 17)
+            chunks.set(i);
+    }
+    CHECK(chunks.is_set(8));
+    CHECK_FALSE(chunks.is_set(9));
+    CHECK(chunks.next_missing(0) == 9);
+    CHECK(chunks.next_missing(10) == 17);
+    CHECK(chunks.next_missing(18) == NO_CHUNKS_MISSING);
+
+    chunks.set(9);
+    chunks.set(17);
+    CHECK(chunks.next_missing(0) == NO_CHUNKS_MISSING);
+}
+
+TEST_CASE("Chunk bitmap starts all received when not fast OTA", "[chunk_bitmap]")
+{
+    ChunkBitmap chunks;
+    chunks.reset(100, true);
+    CHECK(chunks.next_missing(0) == NO_CHUNKS_MISSING);
+}
+
+TEST_CASE("Chunk bitmap only tracks as many chunks as it holds", "[chunk_bitmap]")
+{
+    ChunkBitmap chunks;
+    REQUIRE(chunks.reset(ChunkBitmap::capacity(), false));
+    CHECK_FALSE(chunks.reset(ChunkBitmap::capacity() + 1, false));
+    CHECK(chunks.size() == ChunkBitmap::capacity());
+    // chunks past the end count as received and setting them is ignored
+    chunk_index_t past = ChunkBitmap::capacity();
+    chunks.set(past);
+    CHECK(chunks.is_set(past));
+    CHECK(chunks.next_missing(0) == 0);
+}
+
+TEST_CASE("Missing chunks are encoded as runs", "[chunk_bitmap]")
+{
+    ChunkBitmap chunks;
+    chunks.reset(40, false);
+    for (chunk_index_t i = 0; i < 40; i++) {
+        if (!(i >= 3 && i < 6) && i != 10 && !(i >= 20 && i < 28))
+            chunks.set(i);
+    }
+
+    uint8_t buf[2 + 4 * 4];
+    std::vector<Run> runs;
+    chunk_index_t last_missing = 0;
+
+    GIVEN("a limit past all the gaps") {
+        size_t size = chunks.encode_missing(buf, 4, 30, last_missing);
+        CHECK(size == 14);
+        CHECK(decode(buf, size, runs) == 30);
+        REQUIRE(runs.size() == 3);
+        CHECK(runs[0].start == 3);
+        CHECK(runs[0].length == 3);
+        CHECK(runs[1].start == 10);
+        CHECK(runs[1].length == 1);
+        CHECK(runs[2].start == 20);
+        CHECK(runs[2].length == 8);
+        CHECK(last_missing == 20);
+    }
+    GIVEN("a limit within a gap") {
+        size_t size = chunks.encode_missing(buf, 4, 24, last_missing);
+        CHECK(decode(buf, size, runs) == 24);
+        REQUIRE(runs.size() == 3);
+        CHECK(runs[2].length == 4);
+    }
+    GIVEN("room for fewer runs than are missing") {
+        size_t size = chunks.encode_missing(buf, 2, 40, last_missing);
+        CHECK(decode(buf, size, runs) == 40);
+        CHECK(runs.size() == 2);
+        CHECK(last_missing == 10);
+    }
+    GIVEN("nothing missing below the limit") {
+        size_t size = chunks.encode_missing(buf, 4, 3, last_missing);
+        CHECK(size == 2);
+        CHECK(decode(buf, size, runs) == 3);
+    }
+    GIVEN("a limit past the end") {
+        size_t size = chunks.encode_missing(buf, 4, 1000, last_missing);
+        CHECK(decode(buf, size, runs) == 40);
+    }
+}
+
+TEST_CASE("A windowed transfer completes over a lossy link in far fewer round trips", "[chunk_bitmap]")
+{
+    const unsigned count = 512;
+    unsigned stop_and_wait = transfer(count, 1, 5);
+    unsigned windowed = transfer(count, OTA_WINDOW_CHUNKS, 5);
+    CHECK(stop_and_wait >= count);
+    // several times faster
+    unsigned speedup = stop_and_wait / windowed;
+    CHECK(speedup >= 4);
+    CHECK(transfer(count, OTA_WINDOW_CHUNKS, 50) < 100000);
+}
+
+/**
+ * Round trips for a 512 chunk image by window size and loss rate, the OTA
+ * time over BLE is about this times the round trip through the gateway.
+ *
+ * Run with: obj/runner "[benchmark]"
+ */
+TEST_CASE("Windowed OTA round trips", "[.][chunk_bitmap][benchmark]")
+{
+    std::ostringstream report;
+    report << "round trips for 512 chunks by window (loss 0/2/10%)" << std::endl;
+    for (unsigned window = 1; window <= 64; window *= 2) {
+        report << "  window " << window << ":";
+        for (unsigned loss : { 0, 2, 10 }) {
+            report << " " << transfer(512, window, loss);
+        }
+        report << std::endl;
+    }
+    WARN(report.str());
+}
+
+TEST_CASE("Windowed OTA acknowledges each window with the missing runs", "[chunk_bitmap]")
+{
+    const uint16_t chunk_size = 16;
+    const chunk_index_t count = 40;
+    SparkProtocolTester t;
+    REQUIRE(t.update_begin(UpdateFlag::FAST_OTA | UpdateFlag::WINDOWED, chunk_size, count * chunk_size));
+
+    std::vector<std::string> begin = t.responses();
+    REQUIRE(begin.size() == 2);
+    CHECK(begin[0][1] == 0x00);
+    // update ready echoes the flags, with the window
+    REQUIRE(begin[1].size() == 8);
+    CHECK(begin[1][1] == 0x44);
+    CHECK(begin[1][6] == (UpdateFlag::FAST_OTA | UpdateFlag::WINDOWED));
+    CHECK(begin[1][7] == OTA_WINDOW_CHUNKS);
+
+    std::vector<std::vector<Run>> runs;
+    // a window of chunks with 3-5 lost and 10 corrupted
+    for (chunk_index_t i = 0; i < 20; i++) {
+        if (i < 3 || i > 5)
+            REQUIRE(t.chunk(i, chunk_size, i != 10));
+    }
+    std::vector<chunk_index_t> limits = acknowledgements(t, runs);
+    REQUIRE(limits.size() == 1);
+    CHECK(limits[0] == 20);
+    CHECK(limits[0] == t.window_limit());
+    REQUIRE(runs[0].size() == 2);
+    CHECK(runs[0][0].start == 3);
+    CHECK(runs[0][0].length == 3);
+    CHECK(runs[0][1].start == 10);
+    CHECK(runs[0][1].length == 1);
+    CHECK(t.saved().size() == 16);
+
+    // the acknowledgement counts as sent with each run
+    CHECK(t.send_missing_chunks() == 3);
+    limits = acknowledgements(t, runs);
+    REQUIRE(limits.size() == 1);
+    CHECK(limits[0] == 20);
+    CHECK(runs[0].size() == 2);
+
+    // the missing chunks, one already received, then the rest
+    for (chunk_index_t i : { 3, 4, 5, 10, 0 })
+        REQUIRE(t.chunk(i, chunk_size));
+    for (chunk_index_t i = 20; i < count; i++)
+        REQUIRE(t.chunk(i, chunk_size));
+    limits = acknowledgements(t, runs);
+    REQUIRE(limits.size() == 2);
+    CHECK(limits[0] == 31);
+    CHECK(runs[0].empty());
+    // the last chunk is acknowledged without waiting for the window
+    CHECK(limits[1] == count);
+    CHECK(runs[1].empty());
+
+    // nothing missing is still an acknowledgement
+    CHECK(t.send_missing_chunks() == 1);
+
+    // each chunk was written once, where it belongs
+    REQUIRE(t.saved().size() == count);
+    std::vector<uint32_t> saved = t.saved();
+    std::sort(saved.begin(), saved.end());
+    for (chunk_index_t i = 0; i < count; i++)
+        REQUIRE(saved[i] == 0x80000 + i * chunk_size);
+}
+
+TEST_CASE("Fast OTA with more chunks than the bitmap holds acknowledges each chunk", "[chunk_bitmap]")
+{
+    SparkProtocolTester t;
+    REQUIRE(t.update_begin(UpdateFlag::FAST_OTA | UpdateFlag::WINDOWED, 16, (ChunkBitmap::capacity() + 1) * 16));
+
+    std::vector<std::string> begin = t.responses();
+    REQUIRE(begin.size() == 2);
+    // accepted, without fast OTA
+    CHECK(begin[0][1] == 0x00);
+    REQUIRE(begin[1].size() == 7);
+    CHECK(begin[1][1] == 0x44);
+    CHECK(begin[1][6] == 0);
+
+    REQUIRE(t.chunk(0, 16));
+    std::vector<std::string> ack = t.responses();
+    // the empty ACK and chunk received OK
+    CHECK(ack.size() == 2);
+}
@@ -0,0 +1,27 @@
+#ifndef CONCURRENT_HAL_IMPL_H
+#define	CONCURRENT_HAL_IMPL_H
+
+// Handle types for running the active objects off device, with the
+// concurrent HAL implemented on host threads by active_object.cpp.
+// The host's own gthreads are used as they are.
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+typedef void* os_thread_t;
+typedef int32_t os_result_t;
+typedef uint8_t os_thread_prio_t;
+
+typedef void* os_mutex_t;
+typedef void* os_mutex_recursive_t;
+typedef void* condition_variable_t;
+typedef void* os_timer_t;
+typedef void* os_queue_t;
+typedef void* os_semaphore_t;
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* CONCURRENT_HAL_IMPL_H */
@@ -0,0 +1,110 @@
+// Off device tests and benchmark for the shared CRC32
+
+#include "catch.hpp"
+#include "crc32.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+typedef uint32_t (*Crc32Function)(uint32_t crc, const void* data, size_t length);
+
+struct Variant {
+    const char* name;
+    Crc32Function update;
+};
+
+const Variant variants[] = {
+    { "bytewise", crc32_update_bytewise },
+    { "slice-by-4", crc32_update_slice4 },
+    { "slice-by-8", crc32_update_slice8 },
+    { "default", crc32_update },
+};
+
+std::vector<uint8_t> pseudoRandom(size_t length)
+{
+    std::vector<uint8_t> data(length);
+    uint32_t x = 2463534242u;
+    for (auto& b : data) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        b = x;
+    }
+    return data;
+}
+
+} // namespace
+
+TEST_CASE("CRC32 check value", "[crc32]")
+{
+    const char check[] = "123456789";
+    for (const Variant& v : variants) {
+        INFO(v.name);
+        REQUIRE(v.update(0, check, 9) == 0xCBF43926);
+        REQUIRE(v.update(0, check, 0) == 0);
+    }
+}
+
+TEST_CASE("CRC32 variants agree on every alignment and length", "[crc32]")
+{
+    auto data = pseudoRandom(256);
+    for (size_t offset = 0; offset < 8; offset++) {
+        for (size_t length = 0; length + offset <= 80; length++) {
+            uint32_t expected = crc32_update_bytewise(0, data.data() + offset, length);
+            REQUIRE(crc32_update_slice4(0, data.data() + offset, length) == expected);
+            REQUIRE(crc32_update_slice8(0, data.data() + offset, length) == expected);
+        }
+    }
+}
+
+TEST_CASE("CRC32 can be computed in blocks", "[crc32]")
+{
+    auto data = pseudoRandom(1000);
+    uint32_t expected = crc32_update(0, data.data(), data.size());
+
+    for (const Variant& v : variants) {
+        INFO(v.name);
+        for (size_t block : { 1, 3, 7, 64, 333 }) {
+            uint32_t crc = 0;
+            for (size_t i = 0; i < data.size(); i += block) {
+                crc = v.update(crc, data.data() + i, std::min(block, data.size() - i));
+            }
+            REQUIRE(crc == expected);
+        }
+    }
+}
+
+/**
+ * Throughput of each variant on buffers from 1 KB (an OTA chunk or flash
+ * page) to 256 KB (a whole module image).
+ *
+ * Run with: obj/runner "[benchmark]"
+ */
+TEST_CASE("CRC32 benchmark", "[.][crc32][benchmark]")
+{
+    const size_t total = 64 * 1024 * 1024;
+    std::ostringstream report;
+    report << "MB/s by buffer size" << std::endl;
+
+    for (size_t size = 1024; size <= 256 * 1024; size *= 4) {
+        auto data = pseudoRandom(size);
+        report << "  " << (size / 1024) << " KB:";
+        for (const Variant& v : variants) {
+            uint32_t crc = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (size_t done = 0; done < total; done += size) {
+                crc = v.update(crc, data.data(), size);
+            }
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            report << " " << v.name << " " << unsigned(total / elapsed.count() / 1e6);
+            // keep the result live
+            REQUIRE(crc != 0);
+        }
+        report << std::endl;
+    }
+    WARN(report.str());
+}
@@ -0,0 +1,345 @@
+// Off device tests and benchmark for the EEPROM emulation with a RAM index
+
+#include "catch.hpp"
+#include <sstream>
+#include "eeprom_emulation.h"
+#include "eeprom_emulation_cached.h"
+#include "flash_storage.h"
+
+namespace {
+
+/* Simulate the 2 external Flash sectors used for EEPROM emulation on bluz */
+const size_t SectorSize = 0x1000;
+const uintptr_t SectorBase1 = 0x3E000;
+const uintptr_t SectorBase2 = SectorBase1 + SectorSize;
+
+/**
+ * Counts the store accesses, which are all SPI bus transactions on an
+ * external Flash
+ */
+template<int Base, int Sectors, int SectorSize>
+class CountingFlashStorage : public RAMFlashStorage<Base, Sectors, SectorSize>
+{
+    using Storage = RAMFlashStorage<Base, Sectors, SectorSize>;
+
+public:
+    unsigned reads = 0;
+    unsigned readBytes = 0;
+    unsigned writes = 0;
+    unsigned writtenBytes = 0;
+
+    int write(unsigned offset, const void* data, unsigned size)
+    {
+        writes++;
+        writtenBytes += size;
+        return Storage::write(offset, data, size);
+    }
+
+    int read(unsigned offset, void* data, unsigned size)
+    {
+        reads++;
+        readBytes += size;
+        return Storage::read(offset, data, size);
+    }
+};
+
+using Store = CountingFlashStorage<SectorBase1, 2, SectorSize>;
+using CachedEEPROM = CachedEEPROMEmulation<Store, SectorBase1, SectorSize, SectorBase2, SectorSize>;
+using PlainEEPROM = EEPROMEmulation<Store, SectorBase1, SectorSize, SectorBase2, SectorSize>;
+
+auto CachedPage1 = CachedEEPROM::LogicalPage::Page1;
+auto CachedPage2 = CachedEEPROM::LogicalPage::Page2;
+
+bool sameContents(Store& a, Store& b)
+{
+    return std::memcmp(a.dataAt(SectorBase1), b.dataAt(SectorBase1), 2 * SectorSize) == 0;
+}
+
+} // namespace
+
+TEST_CASE("Cached EEPROM get and put", "[eeprom]")
+{
+    CachedEEPROM eeprom;
+    eeprom.init();
+
+    SECTION("Unprogrammed values read as erased")
+    {
+        uint8_t value = 0;
+        eeprom.get(10, value);
+        REQUIRE(value == 0xFF);
+    }
+
+    SECTION("A byte is read back")
+    {
+        eeprom.put(10, 0xCC);
+
+        uint8_t value = 0;
+        eeprom.get(10, value);
+        REQUIRE(value == 0xCC);
+    }
+
+    SECTION("A block is read back")
+    {
+        uint32_t counter = 0x12345678;
+        eeprom.put(20, &counter, sizeof(counter));
+
+        uint32_t value = 0;
+        eeprom.get(20, &value, sizeof(value));
+        REQUIRE(value == counter);
+    }
+
+    SECTION("Reads past the capacity return erased values")
+    {
+        uint8_t value = 0;
+        eeprom.get(eeprom.capacity(), value);
+        REQUIRE(value == 0xFF);
+    }
+
+    SECTION("Writes past the capacity are ignored")
+    {
+        uintptr_t writeAddress = eeprom.getWriteAddress();
+        uint16_t value = 0;
+        eeprom.put(eeprom.capacity() - 1, &value, sizeof(value));
+
+        REQUIRE(eeprom.getWriteAddress() == writeAddress);
+    }
+
+    SECTION("Capacity matches the uncached emulation")
+    {
+        PlainEEPROM plain;
+        REQUIRE(CachedEEPROM::Capacity == plain.capacity());
+        REQUIRE(eeprom.capacity() == plain.capacity());
+    }
+}
+
+TEST_CASE("Cached EEPROM stores the same records as the uncached emulation", "[eeprom]")
+{
+    CachedEEPROM cached;
+    PlainEEPROM plain;
+    plain.store = cached.store;
+
+    cached.init();
+    plain.init();
+
+    // Enough writes to go through a few page swaps
+    for (uint32_t i = 0; i < 3000; i++)
+    {
+        uint16_t index = (i * 7) % 40;
+        uint16_t value = i;
+        cached.put(index, &value, sizeof(value));
+        plain.put(index, &value, sizeof(value));
+    }
+
+    REQUIRE(sameContents(cached.store, plain.store));
+    REQUIRE(cached.getActivePage() == plain.getActivePage());
+
+    uint8_t cachedData[CachedEEPROM::Capacity];
+    uint8_t plainData[CachedEEPROM::Capacity];
+    cached.get(0, cachedData, sizeof(cachedData));
+    plain.get(0, plainData, sizeof(plainData));
+    REQUIRE(std::memcmp(cachedData, plainData, sizeof(cachedData)) == 0);
+}
+
+TEST_CASE("Cached EEPROM index", "[eeprom]")
+{
+    CachedEEPROM eeprom;
+    eeprom.init();
+
+    uint32_t counter = 42;
+    eeprom.put(0, &counter, sizeof(counter));
+
+    SECTION("Reads don't access the store")
+    {
+        unsigned reads = eeprom.store.reads;
+        uint32_t value;
+        eeprom.get(0, &value, sizeof(value));
+        REQUIRE(eeprom.store.reads == reads);
+        REQUIRE(value == counter);
+    }
+
+    SECTION("Writing an unchanged value doesn't access the store")
+    {
+        unsigned reads = eeprom.store.reads;
+        unsigned writes = eeprom.store.writes;
+        eeprom.put(0, &counter, sizeof(counter));
+        REQUIRE(eeprom.store.reads == reads);
+        REQUIRE(eeprom.store.writes == writes);
+    }
+
+    SECTION("Only changed bytes are appended")
+    {
+        uintptr_t writeAddress = eeprom.getWriteAddress();
+        counter = 43;
+        eeprom.put(0, &counter, sizeof(counter));
+        REQUIRE(eeprom.getWriteAddress() == writeAddress + sizeof(CachedEEPROM::Record));
+    }
+
+    SECTION("The index is rebuilt at boot")
+    {
+        CachedEEPROM rebooted;
+        rebooted.store = eeprom.store;
+        rebooted.init();
+
+        uint32_t value;
+        rebooted.get(0, &value, sizeof(value));
+        REQUIRE(value == counter);
+        REQUIRE(rebooted.getWriteAddress() == eeprom.getWriteAddress());
+    }
+
+    SECTION("A partially written block is discarded")
+    {
+        uint32_t newCounter = 0xAABBCCDD;
+        // The last record to be written, at the lowest address, is left
+        // partially written
+        eeprom.store.discardWritesAfter(3 * sizeof(CachedEEPROM::Record) + 2, [&] {
+            eeprom.put(0, &newCounter, sizeof(newCounter));
+        });
+
+        CachedEEPROM rebooted;
+        rebooted.store = eeprom.store;
+        rebooted.init();
+
+        uint32_t value;
+        rebooted.get(0, &value, sizeof(value));
+        REQUIRE(value == counter);
+
+        THEN("the next put does a page swap")
+        {
+            rebooted.put(0, &newCounter, sizeof(newCounter));
+
+            REQUIRE(rebooted.getActivePage() == CachedPage2);
+            rebooted.get(0, &value, sizeof(value));
+            REQUIRE(value == newCounter);
+        }
+    }
+
+    SECTION("Clear erases the index")
+    {
+        eeprom.clear();
+
+        uint32_t value;
+        eeprom.get(0, &value, sizeof(value));
+        REQUIRE(value == 0xFFFFFFFF);
+    }
+}
+
+TEST_CASE("Cached EEPROM erases only when a page is full", "[eeprom]")
+{
+    CachedEEPROM eeprom;
+    eeprom.init();
+    eeprom.store.resetEraseCount();
+
+    const size_t recordsPerPage = (SectorSize - sizeof(CachedEEPROM::PageHeader)) / sizeof(CachedEEPROM::Record);
+
+    // Fill the page
+    for (size_t i = 0; i < recordsPerPage; i++)
+    {
+        eeprom.put(0, (uint8_t)i);
+    }
+
+    REQUIRE(eeprom.getActivePage() == CachedPage1);
+    REQUIRE(eeprom.store.getEraseCount() == 0);
+
+    eeprom.put(0, (uint8_t)0xA5);
+
+    REQUIRE(eeprom.getActivePage() == CachedPage2);
+    uint8_t value;
+    eeprom.get(0, value);
+    REQUIRE(value == 0xA5);
+}
+
+TEST_CASE("Cached EEPROM import keeps page 1 until the imported page is active", "[eeprom]")
+{
+    CachedEEPROM eeprom;
+    // Data in another format at the start of page 1
+    uint8_t legacy[64];
+    for (size_t i = 0; i < sizeof(legacy); i++)
+    {
+        legacy[i] = uint8_t(i * 3);
+    }
+    eeprom.store.eraseSector(SectorBase1);
+    eeprom.store.write(SectorBase1, legacy, sizeof(legacy));
+
+    SECTION("The data is moved to page 2 and page 1 is erased")
+    {
+        REQUIRE(eeprom.importToPage2(legacy, sizeof(legacy)));
+        eeprom.init();
+
+        REQUIRE(eeprom.getActivePage() == CachedPage2);
+        const uint32_t erased = CachedEEPROM::PageHeader::ERASED;
+        REQUIRE(eeprom.readPageStatus(CachedPage1) == erased);
+        uint8_t value[sizeof(legacy)];
+        eeprom.get(0, value, sizeof(value));
+        REQUIRE(std::memcmp(value, legacy, sizeof(legacy)) == 0);
+    }
+
+    SECTION("A reset during the import leaves page 1 alone")
+    {
+        eeprom.store.discardWritesAfter(10 * sizeof(CachedEEPROM::Record), [&] {
+            eeprom.importToPage2(legacy, sizeof(legacy));
+        });
+
+        const uint32_t active = CachedEEPROM::PageHeader::ACTIVE;
+        REQUIRE(eeprom.readPageStatus(CachedPage2) != active);
+        REQUIRE(std::memcmp(eeprom.store.dataAt(SectorBase1), legacy, sizeof(legacy)) == 0);
+    }
+}
+
+/**
+ * Persists a 4 byte counter repeatedly and reports the Flash operations
+ * for the cached log-structured emulation and for the former bluz
+ * implementation that rewrote the whole 512 byte area on every put
+ * (3 sector erases and 2 buffer writes per put).
+ *
+ * The latency is estimated from the SST25VF datasheet worst cases.
+ *
+ * Run with: obj/runner "[benchmark]"
+ */
+TEST_CASE("Cached EEPROM erase count benchmark", "[.][eeprom][benchmark]")
+{
+    const unsigned Puts = 10000;
+    const double EraseMs = 25.0;        // sector erase
+    const double ProgramUsPerWord = 10.0; // AAI word program
+    const double TransactionUs = 5.0;   // command and address bytes
+    const double ByteUs = 1.0;          // at 8MHz SPI
+
+    CachedEEPROM eeprom;
+    eeprom.init();
+    eeprom.store.resetEraseCount();
+    eeprom.store.reads = eeprom.store.readBytes = 0;
+    eeprom.store.writes = eeprom.store.writtenBytes = 0;
+
+    for (uint32_t counter = 0; counter < Puts; counter++)
+    {
+        eeprom.put(0, &counter, sizeof(counter));
+    }
+
+    auto estimateMs = [&](unsigned erases, unsigned writes, unsigned writtenBytes, unsigned reads, unsigned readBytes) {
+        return erases * EraseMs +
+            (writes + reads) * TransactionUs / 1000 +
+            (writtenBytes / 2) * ProgramUsPerWord / 1000 +
+            readBytes * ByteUs / 1000;
+    };
+
+    unsigned legacyErases = Puts * 3;
+    unsigned legacyWrites = Puts * 2;
+    unsigned legacyWrittenBytes = Puts * (512 + 513);
+    unsigned legacyReads = Puts;
+    unsigned legacyReadBytes = Puts * 512;
+
+    Store& s = eeprom.store;
+    std::ostringstream report;
+    report << Puts << " puts of a 4 byte counter" << std::endl
+           << "  cached: " << s.getEraseCount() << " erases, "
+           << s.writes << " writes (" << s.writtenBytes << " bytes), "
+           << s.reads << " reads (" << s.readBytes << " bytes), ~"
+           << estimateMs(s.getEraseCount(), s.writes, s.writtenBytes, s.reads, s.readBytes) / Puts << " ms/put" << std::endl
+           << "  legacy: " << legacyErases << " erases, "
+           << legacyWrites << " writes (" << legacyWrittenBytes << " bytes), "
+           << legacyReads << " reads (" << legacyReadBytes << " bytes), ~"
+           << estimateMs(legacyErases, legacyWrites, legacyWrittenBytes, legacyReads, legacyReadBytes) / Puts << " ms/put";
+    WARN(report.str());
+
+    unsigned erases = s.getEraseCount();
+    REQUIRE(erases < legacyErases / 100);
+}
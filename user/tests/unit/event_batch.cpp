@@ -0,0 +1,277 @@
+// Off device tests and benchmark for batching published events
+
+#include "catch.hpp"
+#include "event_batch.h"
+#include "message_channel.h"
+#include "events.h"
+#include "messages.h"
+#include "publisher.h"
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace particle::protocol;
+
+namespace {
+
+struct Record {
+    uint16_t offset;
+    std::string name;
+    std::string data;
+};
+
+/**
+ * Splits a batch message into its records, as the cloud does.
+ * @return the length of the options before the payload.
+ */
+size_t split(const uint8_t* buf, size_t size, std::vector<Record>& records)
+{
+    records.clear();
+    size_t i = 6;
+    while (i < size && buf[i] != 0xff) {
+        i += 1 + (buf[i] & 0xf);
+    }
+    size_t options = i;
+    for (i++; i < size; ) {
+        Record r;
+        r.offset = uint16_t(buf[i] << 8 | buf[i + 1]);
+        i += 2;
+        r.name.assign((const char*)buf + i + 1, buf[i]);
+        i += 1 + buf[i];
+        r.data.assign((const char*)buf + i + 1, buf[i]);
+        i += 1 + buf[i];
+        records.push_back(r);
+    }
+    return options;
+}
+
+/**
+ * A channel keeping the messages sent through it.
+ */
+struct SentChannel : public MessageChannel {
+    uint8_t buffer[PROTOCOL_BUFFER_SIZE];
+    std::vector<std::string> sent;
+
+    ProtocolError receive(Message& message) override { return NO_ERROR; }
+    ProtocolError command(Command cmd, void* arg) override { return NO_ERROR; }
+    bool is_unreliable() override { return false; }
+    ProtocolError establish() override { return NO_ERROR; }
+    ProtocolError response(Message& original, Message& response, size_t required) override { return NO_ERROR; }
+    ProtocolError notify_established() override { return NO_ERROR; }
+
+    ProtocolError create(Message& message, size_t minimum_size) override
+    {
+        message.set_buffer(buffer, sizeof(buffer));
+        return NO_ERROR;
+    }
+
+    ProtocolError send(Message& message) override
+    {
+        sent.push_back(std::string((const char*)message.buf(), message.length()));
+        return NO_ERROR;
+    }
+};
+
+/**
+ * The burst limit of the publisher is kept across publishers. Each test starts
+ * its clock well past the events of the tests before.
+ */
+system_tick_t fresh_clock()
+{
+    static system_tick_t start = 0;
+    start += 1000000;
+    return start;
+}
+
+struct Delivery {
+    unsigned published = 0;
+    unsigned delivered = 0;
+    unsigned messages = 0;
+};
+
+/**
+ * An application publishing a reading every period milliseconds for a minute
+ * through the publisher, with the given batch window.
+ */
+Delivery publish_readings(system_tick_t period, system_tick_t window)
+{
+    Delivery d;
+    Publisher publisher;
+    SentChannel channel;
+    publisher.set_batch_window(window);
+    system_tick_t start = fresh_clock();
+    system_tick_t now = start;
+    for (; now - start < 60000; now += period) {
+        REQUIRE(publisher.process(channel, now) == NO_ERROR);
+        d.published++;
+        if (publisher.send_event(channel, "temperature", "21.5", 60, EventType::PRIVATE, 0, now) == NO_ERROR)
+            d.delivered++;
+    }
+    REQUIRE(publisher.process(channel, now + window) == NO_ERROR);
+    d.messages = channel.sent.size();
+    return d;
+}
+
+} // namespace
+
+TEST_CASE("Event batch is off until a window is set", "[event_batch]")
+{
+    EventBatch batch;
+    CHECK_FALSE(batch.accepts("temp", "20", 640));
+    batch.set_window(1000);
+    CHECK(batch.accepts("temp", "20", 640));
+    CHECK(batch.empty());
+}
+
+TEST_CASE("Events in a batch are encoded as records", "[event_batch]")
+{
+    EventBatch batch;
+    batch.set_window(1000);
+    REQUIRE(batch.add("temp", "20.5", 60, EventType::PRIVATE, 0, 5000, 640));
+    REQUIRE(batch.add("humidity", nullptr, 60, EventType::PRIVATE, 0, 5250, 640));
+    REQUIRE(batch.add("temp", "20.7", 60, EventType::PRIVATE, 0, 5999, 640));
+    CHECK(batch.size() == 3);
+
+    uint8_t buf[640];
+    size_t size = batch.encode(buf, 0x1234, true);
+    CHECK(buf[0] == 0x40);
+    CHECK(buf[1] == 0x02);
+    CHECK(buf[2] == 0x12);
+    CHECK(buf[3] == 0x34);
+    CHECK(buf[5] == 'E');
+    // Uri-Query 'b' straight after the Uri-Path
+    CHECK(buf[6] == 0x41);
+    CHECK(buf[7] == 'b');
+
+    std::vector<Record> records;
+    CHECK(split(buf, size, records) == 8);
+    REQUIRE(records.size() == 3);
+    CHECK(records[0].offset == 0);
+    CHECK(records[0].name == "temp");
+    CHECK(records[0].data == "20.5");
+    CHECK(records[1].offset == 250);
+    CHECK(records[1].name == "humidity");
+    CHECK(records[1].data == "");
+    CHECK(records[2].offset == 999);
+    CHECK(records[2].data == "20.7");
+}
+
+TEST_CASE("Event batch TTL is sent as Max-Age", "[event_batch]")
+{
+    EventBatch batch;
+    batch.set_window(1000);
+    REQUIRE(batch.add("temp", "20", 3600, EventType::PUBLIC, 0, 0, 640));
+    uint8_t buf[640];
+    size_t size = batch.encode(buf, 1, false);
+    CHECK(buf[0] == 0x50);
+    CHECK(buf[5] == 'e');
+    CHECK(buf[6] == 0x33);
+    CHECK(buf[9] == (3600 & 0xff));
+    CHECK(buf[10] == 0x11);
+    CHECK(buf[11] == 'b');
+    std::vector<Record> records;
+    CHECK(split(buf, size, records) == 12);
+    CHECK(records.size() == 1);
+}
+
+TEST_CASE("Only like events within the window share a batch", "[event_batch]")
+{
+    EventBatch batch;
+    batch.set_window(1000);
+    REQUIRE(batch.add("temp", "20", 60, EventType::PRIVATE, 0, 100, 640));
+    CHECK_FALSE(batch.add("temp", "20", 60, EventType::PUBLIC, 0, 200, 640));
+    CHECK_FALSE(batch.add("temp", "20", 120, EventType::PRIVATE, 0, 200, 640));
+    CHECK_FALSE(batch.add("temp", "20", 60, EventType::PRIVATE, EventType::NO_ACK, 200, 640));
+    CHECK_FALSE(batch.add("temp", "20", 60, EventType::PRIVATE, 0, 1101, 640));
+    CHECK(batch.add("temp", "20", 60, EventType::PRIVATE, 0, 1100, 640));
+    CHECK(batch.size() == 2);
+
+    CHECK_FALSE(batch.is_due(1099));
+    CHECK(batch.is_due(1100));
+    batch.clear();
+    CHECK_FALSE(batch.is_due(5000));
+}
+
+TEST_CASE("Event batch is bounded by the data length and the message size", "[event_batch]")
+{
+    EventBatch batch;
+    batch.set_window(1000);
+    std::string longest(MAX_EVENT_DATA_LENGTH, 'x');
+    std::string too_long(MAX_EVENT_DATA_LENGTH + 1, 'x');
+    CHECK(batch.accepts("temp", longest.c_str(), 640));
+    CHECK_FALSE(batch.accepts("temp", too_long.c_str(), 640));
+    CHECK_FALSE(batch.accepts("temp", longest.c_str(), 40));
+
+    const size_t limit = 100;
+    unsigned added = 0;
+    while (batch.add("temp", "20", 60, EventType::PRIVATE, 0, 0, limit)) {
+        added++;
+    }
+    CHECK(added > 1);
+    uint8_t buf[640];
+    size_t size = batch.encode(buf, 1, false);
+    CHECK(size <= limit);
+    std::vector<Record> records;
+    split(buf, size, records);
+    CHECK(records.size() == added);
+}
+
+TEST_CASE("An event starting a batch is rate limited", "[event_batch]")
+{
+    Publisher publisher;
+    SentChannel channel;
+    system_tick_t now = fresh_clock();
+    // a burst of single events
+    for (int i = 0; i < 4; i++) {
+        REQUIRE(publisher.send_event(channel, "temp", "20", 60, EventType::PRIVATE, 0, now++) == NO_ERROR);
+    }
+    REQUIRE(channel.sent.size() == 4);
+
+    publisher.set_batch_window(1000);
+    CHECK(publisher.send_event(channel, "temp", "21", 60, EventType::PRIVATE, 0, now) == BANDWIDTH_EXCEEDED);
+    CHECK(publisher.process(channel, now + 1000) == NO_ERROR);
+    CHECK(channel.sent.size() == 4);
+
+    // once the burst has passed a batch is started, and later events join it
+    now += 1000;
+    CHECK(publisher.send_event(channel, "temp", "22", 60, EventType::PRIVATE, 0, now) == NO_ERROR);
+    CHECK(publisher.send_event(channel, "temp", "23", 60, EventType::PRIVATE, 0, now + 1) == NO_ERROR);
+    CHECK(publisher.process(channel, now + 1000) == NO_ERROR);
+    REQUIRE(channel.sent.size() == 5);
+    std::vector<Record> records;
+    split((const uint8_t*)channel.sent[4].data(), channel.sent[4].size(), records);
+    CHECK(records.size() == 2);
+}
+
+TEST_CASE("Batched readings are delivered beyond the burst limit", "[event_batch]")
+{
+    // 10 readings a second, the limit lets through at most 4 messages a second
+    Delivery single = publish_readings(100, 0);
+    Delivery batched = publish_readings(100, 1000);
+    CHECK(single.delivered < single.published / 2);
+    CHECK(batched.delivered == batched.published);
+    // a message, and so a radio wake-up, for every second of readings
+    unsigned readings_per_message = batched.delivered / batched.messages;
+    CHECK(readings_per_message >= 10);
+}
+
+/**
+ * Events delivered a second and messages sent a reading, for readings
+ * published at different rates, without batching and with a 1s window.
+ *
+ * Run with: obj/runner "[benchmark]"
+ */
+TEST_CASE("Event batching delivery", "[.][event_batch][benchmark]")
+{
+    std::ostringstream report;
+    report << "readings/s: delivered/s messages/reading, unbatched then batched" << std::endl;
+    for (system_tick_t period : { 1000, 250, 100, 20 }) {
+        report << "  " << 1000 / period << ":";
+        for (system_tick_t window : { 0, 1000 }) {
+            Delivery d = publish_readings(period, window);
+            report << " " << d.delivered / 60.0 << " " << double(d.messages) / d.published;
+        }
+        report << std::endl;
+    }
+    WARN(report.str());
+}
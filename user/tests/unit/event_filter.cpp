@@ -0,0 +1,351 @@
+// Off device tests, fuzzing and benchmark for the CoAP option iterator and
+// the subscription filter trie
+
+#include "catch.hpp"
+#include "event_filter.h"
+#include "spark_protocol_tester.h"
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace particle::protocol;
+
+namespace {
+
+/**
+ * Builds an event message as the cloud sends it, with the name split into
+ * a Uri-Path option per part.
+ */
+std::vector<uint8_t> event_message(const std::string& name, const char* data, int ttl=60, uint8_t token_length=0)
+{
+    std::vector<uint8_t> m = { uint8_t(0x50 | token_length), 0x02, 0x12, 0x34 };
+    for (uint8_t i = 0; i < token_length; i++)
+        m.push_back(i);
+    m.push_back(0xb1);
+    m.push_back('e');
+    size_t start = 0;
+    do {
+        size_t slash = name.find('/', start);
+        std::string part = name.substr(start, slash == std::string::npos ? std::string::npos : slash - start);
+        if (part.size() < 13) {
+            m.push_back(part.size());
+        }
+        else {
+            m.push_back(0x0d);
+            m.push_back(part.size() - 13);
+        }
+        m.insert(m.end(), part.begin(), part.end());
+        start = slash == std::string::npos ? slash : slash + 1;
+    } while (start != std::string::npos);
+    if (ttl != 60) {
+        m.insert(m.end(), { 0x33, uint8_t(ttl >> 16), uint8_t(ttl >> 8), uint8_t(ttl) });
+    }
+    if (data) {
+        m.push_back(0xff);
+        m.insert(m.end(), data, data + strlen(data));
+    }
+    return m;
+}
+
+const unsigned FILTERS = 5;
+typedef FilterTrie<FILTERS, 64> Trie;
+
+struct Filters {
+    char filter[FILTERS][64] = {};
+    bool used[FILTERS] = {};
+    Trie trie;
+
+    const char* get(unsigned i) const { return used[i] ? filter[i] : nullptr; }
+
+    void set(unsigned i, const char* f) {
+        strncpy(filter[i], f, sizeof(filter[i]));
+        used[i] = true;
+        trie.build([this](unsigned i) { return get(i); });
+    }
+
+    uint32_t match(const char* name) const {
+        return trie.match(name, strlen(name), [this](unsigned i) { return get(i); });
+    }
+
+    // the linear scan the trie replaces
+    uint32_t scan(const char* name) const {
+        uint32_t matches = 0;
+        size_t length = strlen(name);
+        for (unsigned i = 0; i < FILTERS; i++) {
+            size_t filter_length = strnlen(filter[i], 64);
+            if (used[i] && filter_length <= length && !memcmp(filter[i], name, filter_length))
+                matches |= 1u << i;
+        }
+        return matches;
+    }
+};
+
+unsigned events_handled = 0;
+
+void count_event(const char* name, const char* data)
+{
+    events_handled++;
+}
+
+uint32_t xorshift(uint32_t& x)
+{
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+} // namespace
+
+TEST_CASE("Option iterator yields each option and the payload", "[coap]")
+{
+    std::vector<uint8_t> m = event_message("temp", "21.5", 3600, 2);
+    const std::vector<uint8_t> original = m;
+    CoAPOptionIterator options(m.data(), m.size());
+
+    REQUIRE(options.next());
+    CHECK(options.number() == CoAPOption::URI_PATH);
+    CHECK(options.length() == 1);
+    CHECK(options.value()[0] == 'e');
+    REQUIRE(options.next());
+    CHECK(options.number() == CoAPOption::URI_PATH);
+    CHECK(std::string((const char*)options.value(), options.length()) == "temp");
+    REQUIRE(options.next());
+    CHECK(options.number() == CoAPOption::MAX_AGE);
+    CHECK(options.length() == 3);
+    CHECK_FALSE(options.next());
+    CHECK_FALSE(options.is_malformed());
+    REQUIRE(options.payload_length() == 4);
+    CHECK(std::string((const char*)options.payload(), options.payload_length()) == "21.5");
+    CHECK_FALSE(options.next());
+    CHECK(m == original);
+}
+
+TEST_CASE("Option iterator decodes extended lengths", "[coap]")
+{
+    std::string part(300, 'x');
+    std::vector<uint8_t> m = { 0x50, 0x02, 0, 0, 0xbe, 0, 300 - 269 };
+    m.insert(m.end(), part.begin(), part.end());
+    // a second option with an extended delta, number 11 + 13 + 7 = 31
+    m.insert(m.end(), { 0xd1, 7, 'q' });
+
+    CoAPOptionIterator options(m.data(), m.size());
+    REQUIRE(options.next());
+    CHECK(options.length() == 300);
+    REQUIRE(options.next());
+    CHECK(options.number() == 31);
+    CHECK(options.value()[0] == 'q');
+    CHECK_FALSE(options.next());
+    CHECK_FALSE(options.is_malformed());
+    CHECK(options.payload() == nullptr);
+}
+
+TEST_CASE("Option iterator stops at malformed options", "[coap]")
+{
+    GIVEN("an option longer than the message") {
+        std::vector<uint8_t> m = { 0x50, 0x02, 0, 0, 0xb5, 'a', 'b' };
+        CoAPOptionIterator options(m.data(), m.size());
+        CHECK_FALSE(options.next());
+        CHECK(options.is_malformed());
+    }
+    GIVEN("a reserved length") {
+        std::vector<uint8_t> m = { 0x50, 0x02, 0, 0, 0xbf, 'a' };
+        CoAPOptionIterator options(m.data(), m.size());
+        CHECK_FALSE(options.next());
+        CHECK(options.is_malformed());
+    }
+    GIVEN("an extended length cut short") {
+        std::vector<uint8_t> m = { 0x50, 0x02, 0, 0, 0xbe, 0 };
+        CoAPOptionIterator options(m.data(), m.size());
+        CHECK_FALSE(options.next());
+        CHECK(options.is_malformed());
+    }
+    GIVEN("a token longer than the message") {
+        std::vector<uint8_t> m = { 0x58, 0x02, 0, 0, 1, 2 };
+        CoAPOptionIterator options(m.data(), m.size());
+        CHECK_FALSE(options.next());
+        CHECK(options.is_malformed());
+    }
+}
+
+TEST_CASE("Received events are decoded without changing the message", "[coap]")
+{
+    std::vector<uint8_t> m = event_message("spark/device/last_reset", "power_down", 60, 1);
+    const std::vector<uint8_t> original = m;
+    ReceivedEvent event;
+    REQUIRE(event.decode(m.data(), m.size()));
+    CHECK(std::string(event.name) == "spark/device/last_reset");
+    CHECK(event.name_length == 23);
+    CHECK(std::string((const char*)event.data, event.data_length) == "power_down");
+    CHECK(m == original);
+
+    std::vector<uint8_t> no_data = event_message("a/fairly_long_event_name", nullptr, 120);
+    REQUIRE(event.decode(no_data.data(), no_data.size()));
+    CHECK(std::string(event.name) == "a/fairly_long_event_name");
+    CHECK(event.data == nullptr);
+
+    std::vector<uint8_t> no_name = { 0x50, 0x02, 0, 0, 0xb1, 'e', 0xff, 'x' };
+    CHECK_FALSE(event.decode(no_name.data(), no_name.size()));
+}
+
+TEST_CASE("Received event names are truncated", "[coap]")
+{
+    std::string name(40, 'a');
+    name += "/" + std::string(40, 'b');
+    std::vector<uint8_t> m = event_message(name, "1");
+    ReceivedEvent event;
+    REQUIRE(event.decode(m.data(), m.size()));
+    CHECK(event.name_length == MAX_EVENT_NAME_LENGTH);
+    CHECK(std::string(event.name) == name.substr(0, MAX_EVENT_NAME_LENGTH));
+}
+
+TEST_CASE("Filter trie matches the filters that prefix a name", "[event_filter]")
+{
+    Filters f;
+    CHECK(f.match("temp") == 0);
+    f.set(0, "spark/");
+    f.set(1, "temp");
+    f.set(2, "temperature");
+    f.set(3, "te");
+    f.set(4, "spark/device");
+
+    CHECK(f.match("temp") == 0x0A);
+    CHECK(f.match("temperature/kitchen") == 0x0E);
+    CHECK(f.match("tempe") == 0x0A);
+    CHECK(f.match("t") == 0);
+    CHECK(f.match("humidity") == 0);
+    CHECK(f.match("spark/device/name") == 0x11);
+    CHECK(f.match("spark/flash/status") == 0x01);
+    CHECK(f.match("spark") == 0);
+    CHECK(f.trie.size() <= 2 * FILTERS + 1);
+}
+
+TEST_CASE("Filter trie handles empty, duplicate and unused filters", "[event_filter]")
+{
+    Filters f;
+    f.set(0, "");
+    f.set(2, "abc");
+    f.set(3, "abc");
+    CHECK(f.match("abcd") == 0x0D);
+    CHECK(f.match("x") == 0x01);
+    // a full length filter isn't terminated
+    f.set(4, std::string(64, 'z').c_str());
+    CHECK(f.match(std::string(64, 'z').c_str()) == 0x11);
+    CHECK(f.match(std::string(63, 'z').c_str()) == 0x01);
+}
+
+TEST_CASE("Filter trie agrees with a linear scan", "[event_filter]")
+{
+    uint32_t x = 2463534242u;
+    const char alphabet[] = "ab/";
+    auto random_string = [&](unsigned max) {
+        std::string s;
+        unsigned length = xorshift(x) % (max + 1);
+        for (unsigned i = 0; i < length; i++)
+            s += alphabet[xorshift(x) % 3];
+        return s;
+    };
+    for (int round = 0; round < 2000; round++) {
+        Filters f;
+        for (unsigned i = 0; i < FILTERS; i++) {
+            if (xorshift(x) % 4)
+                f.set(i, random_string(6).c_str());
+        }
+        for (int n = 0; n < 20; n++) {
+            std::string name = random_string(8);
+            REQUIRE(f.match(name.c_str()) == f.scan(name.c_str()));
+        }
+    }
+}
+
+TEST_CASE("Event handlers cleared by init are no longer matched", "[event_filter]")
+{
+    SparkProtocolTester t;
+    events_handled = 0;
+    REQUIRE(t.protocol.add_event_handler("temp", count_event));
+    t.event(event_message("temp/kitchen", "21"));
+    CHECK(events_handled == 1u);
+
+    t.init();
+    t.event(event_message("temp/kitchen", "22"));
+    CHECK(events_handled == 1u);
+
+    REQUIRE(t.protocol.add_event_handler("hum", count_event));
+    t.event(event_message("humidity", "40"));
+    t.event(event_message("temp/kitchen", "23"));
+    CHECK(events_handled == 2u);
+}
+
+TEST_CASE("Option iterator and event decoding survive random messages", "[coap][fuzz]")
+{
+    uint32_t x = 88172645u;
+    uint8_t buf[96];
+    for (int round = 0; round < 100000; round++) {
+        size_t length = xorshift(x) % sizeof(buf);
+        for (size_t i = 0; i < length; i++)
+            buf[i] = xorshift(x);
+        // mostly well formed headers so the options are reached
+        if (length && (xorshift(x) % 4))
+            buf[0] = 0x50 | (buf[0] & 0x3);
+
+        CoAPOptionIterator options(buf, length);
+        unsigned count = 0;
+        while (options.next()) {
+            size_t end = options.value() - buf + options.length();
+            REQUIRE(end <= length);
+            count++;
+        }
+        REQUIRE(count <= length);
+        if (options.payload()) {
+            size_t end = options.payload() - buf + options.payload_length();
+            REQUIRE(end == length);
+        }
+
+        ReceivedEvent event;
+        if (event.decode(buf, length)) {
+            REQUIRE(event.name_length <= MAX_EVENT_NAME_LENGTH);
+            REQUIRE(event.name[event.name_length] == 0);
+        }
+    }
+}
+
+/**
+ * Nanoseconds to decode an event and match it against the filters, with the
+ * trie and with the previous linear scan.
+ *
+ * Run with: obj/runner "[benchmark]"
+ */
+TEST_CASE("Event dispatch benchmark", "[.][event_filter][benchmark]")
+{
+    Filters f;
+    f.set(0, "spark/");
+    f.set(1, "sensors/temperature");
+    f.set(2, "sensors/humidity");
+    f.set(3, "alarm");
+    f.set(4, "sensors/");
+    std::vector<uint8_t> m = event_message("sensors/temperature/kitchen", "21.5");
+
+    const unsigned events = 2000000;
+    uint32_t matched = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < events; i++) {
+        ReceivedEvent event;
+        event.decode(m.data(), m.size());
+        matched += f.trie.match(event.name, event.name_length, [&f](unsigned i) { return f.get(i); });
+    }
+    std::chrono::duration<double, std::nano> trie = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < events; i++) {
+        ReceivedEvent event;
+        event.decode(m.data(), m.size());
+        matched -= f.scan(event.name);
+    }
+    std::chrono::duration<double, std::nano> scan = std::chrono::steady_clock::now() - start;
+
+    REQUIRE(matched == 0);
+    std::ostringstream report;
+    report << "ns per event: trie " << trie.count() / events << ", scan " << scan.count() / events << std::endl;
+    WARN(report.str());
+}
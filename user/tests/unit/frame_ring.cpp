@@ -0,0 +1,228 @@
+#include "catch.hpp"
+#include "frame_ring.h"
+#include <deque>
+#include <string>
+#include <thread>
+#include <cstring>
+
+namespace {
+
+struct Ring {
+    uint8_t storage[64];
+    frame_ring_t ring;
+
+    Ring() {
+        frame_ring_init(&ring, storage, sizeof(storage));
+    }
+
+    bool put(const std::string& s) {
+        return frame_ring_put(&ring, (const uint8_t*)s.data(), s.size());
+    }
+
+    std::string pop() {
+        uint16_t size;
+        uint8_t* data = frame_ring_peek(&ring, &size);
+        if (!data)
+            return "<empty>";
+        std::string s((const char*)data, size);
+        frame_ring_consume(&ring);
+        return s;
+    }
+};
+
+} // namespace
+
+SCENARIO("Frame ring is empty after init", "[frame_ring]") {
+    Ring r;
+    uint16_t size;
+    CHECK(frame_ring_empty(&r.ring));
+    CHECK(frame_ring_peek(&r.ring, &size) == nullptr);
+    CHECK(frame_ring_used(&r.ring) == 0);
+}
+
+SCENARIO("Frames are returned in order", "[frame_ring]") {
+    Ring r;
+    CHECK(r.put("hello"));
+    CHECK(r.put(""));
+    CHECK(r.put("world"));
+    CHECK(r.pop() == "hello");
+    CHECK(r.pop() == "");
+    CHECK(r.pop() == "world");
+    CHECK(frame_ring_empty(&r.ring));
+}
+
+SCENARIO("Peek doesn't remove the frame", "[frame_ring]") {
+    Ring r;
+    r.put("abc");
+    uint16_t size;
+    CHECK(frame_ring_peek(&r.ring, &size) == frame_ring_peek(&r.ring, &size));
+    CHECK(size == 3);
+    CHECK(r.pop() == "abc");
+}
+
+SCENARIO("Frames that don't fit are dropped and counted", "[frame_ring]") {
+    Ring r;
+    std::string big(40, 'x');
+    CHECK(r.put(big));
+    CHECK_FALSE(r.put(big));
+    CHECK(r.ring.stats.frames == 1);
+    CHECK(r.ring.stats.dropped_frames == 1);
+    CHECK(r.ring.stats.dropped_bytes == 40);
+    CHECK(r.ring.stats.high_water == 42);
+    CHECK(r.pop() == big);
+}
+
+SCENARIO("Fits predicts put without counting drops", "[frame_ring]") {
+    Ring r;
+    std::string frame;
+    for (int i = 0; i < 200; i++) {
+        frame.assign(1 + (i % 30), char(i));
+        bool fits = frame_ring_fits(&r.ring, frame.size());
+        REQUIRE(r.put(frame) == fits);
+        if (i % 3 == 0) {
+            r.pop();
+        }
+    }
+    CHECK(r.ring.stats.dropped_frames > 0);
+    while (!frame_ring_empty(&r.ring)) {
+        r.pop();
+    }
+    CHECK(frame_ring_fits(&r.ring, 0));
+    CHECK_FALSE(frame_ring_fits(&r.ring, sizeof(r.storage)));
+}
+
+SCENARIO("An empty ring can be rewound to take the largest frame", "[frame_ring]") {
+    Ring r;
+    std::string big(40, 'x');
+    CHECK(r.put(big));
+    CHECK(r.pop() == big);
+    CHECK_FALSE(frame_ring_fits(&r.ring, big.size()));
+    frame_ring_rewind(&r.ring);
+    CHECK(r.put(big));
+
+    // a ring with frames in it is left alone
+    frame_ring_rewind(&r.ring);
+    CHECK(r.pop() == big);
+}
+
+SCENARIO("Space freed by the consumer is reused", "[frame_ring]") {
+    Ring r;
+    std::string frame;
+    // repeatedly fill and drain so frames land at every offset and wrap,
+    // frames of up to a quarter of the capacity always fit in pairs
+    for (int i = 0; i < 200; i++) {
+        frame.assign(1 + (i % 14), char(i));
+        REQUIRE(r.put(frame));
+        REQUIRE(r.put(frame));
+        REQUIRE(r.pop() == frame);
+        REQUIRE(r.pop() == frame);
+    }
+    CHECK(r.ring.stats.dropped_frames == 0);
+    CHECK(frame_ring_empty(&r.ring));
+}
+
+SCENARIO("Frames behind the oldest can be peeked without removing them", "[frame_ring]") {
+    Ring r;
+    std::string frame;
+    // frames at every offset, wrapping, read back with peek_next
+    for (int i = 0; i < 100; i++) {
+        frame.assign(1 + (i % 11), char(i));
+        REQUIRE(r.put(frame));
+        REQUIRE(r.put(frame + "x"));
+        REQUIRE(r.put(frame + "yz"));
+
+        uint16_t size;
+        uint8_t* data = frame_ring_peek(&r.ring, &size);
+        REQUIRE(std::string((const char*)data, size) == frame);
+        data = frame_ring_peek_next(&r.ring, data, &size);
+        REQUIRE(data != nullptr);
+        REQUIRE(std::string((const char*)data, size) == frame + "x");
+        data = frame_ring_peek_next(&r.ring, data, &size);
+        REQUIRE(data != nullptr);
+        REQUIRE(std::string((const char*)data, size) == frame + "yz");
+        REQUIRE(frame_ring_peek_next(&r.ring, data, &size) == nullptr);
+
+        REQUIRE(r.pop() == frame);
+        REQUIRE(r.pop() == frame + "x");
+        REQUIRE(r.pop() == frame + "yz");
+    }
+    CHECK(r.ring.stats.dropped_frames == 0);
+}
+
+SCENARIO("Frames can be filled in place", "[frame_ring]") {
+    Ring r;
+    GIVEN("a frame reserved with alloc") {
+        uint8_t* frame = frame_ring_alloc(&r.ring, 5);
+        REQUIRE(frame != nullptr);
+        memcpy(frame, "hel", 3);
+        memcpy(frame + 3, "lo", 2);
+
+        THEN("it isn't visible until committed") {
+            CHECK(frame_ring_empty(&r.ring));
+            frame_ring_commit(&r.ring);
+            CHECK(r.pop() == "hello");
+        }
+    }
+    GIVEN("a frame bigger than the free space") {
+        CHECK(frame_ring_alloc(&r.ring, sizeof(r.storage)) == nullptr);
+        CHECK(r.ring.stats.dropped_frames == 1);
+        CHECK(frame_ring_empty(&r.ring));
+    }
+}
+
+SCENARIO("The ring never reports more than its capacity in use", "[frame_ring]") {
+    Ring r;
+    std::deque<std::string> expected;
+    for (int i = 0; i < 1000; i++) {
+        std::string frame(i % 17, char('a' + i % 26));
+        if (r.put(frame))
+            expected.push_back(frame);
+        REQUIRE(frame_ring_used(&r.ring) < sizeof(r.storage));
+        if (i % 3 == 0 && !expected.empty()) {
+            REQUIRE(r.pop() == expected.front());
+            expected.pop_front();
+        }
+    }
+    while (!expected.empty()) {
+        REQUIRE(r.pop() == expected.front());
+        expected.pop_front();
+    }
+    CHECK(frame_ring_empty(&r.ring));
+}
+
+SCENARIO("Frame ring passes frames between a producer and a consumer thread", "[frame_ring]") {
+    uint8_t storage[256];
+    frame_ring_t ring;
+    frame_ring_init(&ring, storage, sizeof(storage));
+    const uint32_t count = 20000;
+
+    std::thread producer([&] {
+        for (uint32_t i = 0; i < count; ) {
+            uint8_t frame[16];
+            memset(frame, uint8_t(i), sizeof(frame));
+            if (frame_ring_put(&ring, frame, 1 + i % sizeof(frame)))
+                i++;
+            else
+                std::this_thread::yield();
+        }
+    });
+
+    bool ok = true;
+    for (uint32_t i = 0; i < count && ok; ) {
+        uint16_t size;
+        uint8_t* frame = frame_ring_peek(&ring, &size);
+        if (!frame) {
+            std::this_thread::yield();
+            continue;
+        }
+        ok = size == 1 + i % 16;
+        for (uint16_t j = 0; j < size && ok; j++)
+            ok = frame[j] == uint8_t(i);
+        frame_ring_consume(&ring);
+        i++;
+    }
+    producer.join();
+
+    CHECK(ok);
+    CHECK(frame_ring_empty(&ring));
+}
@@ -0,0 +1,140 @@
+// Off device tests and benchmark for the cloud variable and function key index
+
+#include "catch.hpp"
+#include "key_index.h"
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+const unsigned KEY_LENGTH = 12;
+
+struct Entry {
+    // not terminated when the key is 12 characters, like a function key
+    char key[KEY_LENGTH];
+};
+
+struct Registry {
+    std::vector<Entry> entries;
+    key_index<KEY_LENGTH> index;
+
+    const char* key(unsigned i) const { return entries[i].key; }
+
+    int find(const char* key) const {
+        return index.find(key, [this](unsigned i) { return this->key(i); });
+    }
+
+    int find_or_add(const char* key) {
+        int i = find(key);
+        if (i < 0) {
+            auto keys = [this](unsigned i) { return this->key(i); };
+            if (!index.reserve(entries.size() + 1, keys))
+                return -1;
+            Entry entry = {};
+            strncpy(entry.key, key, KEY_LENGTH);
+            entries.push_back(entry);
+            index.add(keys);
+            i = entries.size() - 1;
+        }
+        return i;
+    }
+
+    // the scan the index replaces
+    int scan(const char* key) const {
+        for (int i = entries.size(); i-- > 0; ) {
+            if (0 == strncmp(entries[i].key, key, KEY_LENGTH))
+                return i;
+        }
+        return -1;
+    }
+};
+
+std::string keyName(unsigned i)
+{
+    char key[16];
+    snprintf(key, sizeof(key), "sensor%u", i);
+    return key;
+}
+
+} // namespace
+
+TEST_CASE("Key index finds the entries added", "[key_index]")
+{
+    Registry r;
+    CHECK(r.find("temp") == -1);
+    CHECK(r.find_or_add("temp") == 0);
+    CHECK(r.find_or_add("humidity") == 1);
+    CHECK(r.find_or_add("temp") == 0);
+    CHECK(r.entries.size() == 2);
+    CHECK(r.find("humidity") == 1);
+    CHECK(r.find("hum") == -1);
+    CHECK(r.find("humidity2") == -1);
+}
+
+TEST_CASE("Key index compares the first 12 characters", "[key_index]")
+{
+    Registry r;
+    CHECK(r.find_or_add("twelve_chars") == 0);
+    CHECK(r.find("twelve_chars") == 0);
+    CHECK(r.find("twelve_char") == -1);
+    CHECK(r.find("twelve_chars_and_more") == 0);
+}
+
+TEST_CASE("Key index keeps every entry as it grows", "[key_index]")
+{
+    Registry r;
+    for (unsigned i = 0; i < 255; i++) {
+        REQUIRE(r.find_or_add(keyName(i).c_str()) == int(i));
+        // everything added so far is still found after the table is rebuilt
+        REQUIRE(r.find(keyName(i / 2).c_str()) == int(i / 2));
+    }
+    CHECK(r.index.size() == 255);
+    for (unsigned i = 0; i < 255; i++) {
+        REQUIRE(r.find(keyName(i).c_str()) == r.scan(keyName(i).c_str()));
+    }
+    CHECK(r.find("sensor255") == -1);
+    CHECK_FALSE(r.index.reserve(256, [&r](unsigned i) { return r.key(i); }));
+}
+
+/**
+ * Nanoseconds per lookup with the index and with the linear scan, for
+ * registries of 1 to 64 entries, looking up each key in turn and a missing key.
+ *
+ * Run with: obj/runner "[benchmark]"
+ */
+TEST_CASE("Key index benchmark", "[.][key_index][benchmark]")
+{
+    const unsigned lookups = 4000000;
+    std::ostringstream report;
+    report << "ns per lookup: entries index scan" << std::endl;
+
+    for (unsigned count = 1; count <= 64; count *= 2) {
+        Registry r;
+        std::vector<std::string> keys;
+        for (unsigned i = 0; i <= count; i++) {
+            keys.push_back(keyName(i));
+            if (i < count)
+                r.find_or_add(keys.back().c_str());
+        }
+
+        int found = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned i = 0; i < lookups; i++) {
+            found += r.find(keys[i % keys.size()].c_str());
+        }
+        std::chrono::duration<double, std::nano> indexed = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        for (unsigned i = 0; i < lookups; i++) {
+            found -= r.scan(keys[i % keys.size()].c_str());
+        }
+        std::chrono::duration<double, std::nano> scanned = std::chrono::steady_clock::now() - start;
+
+        // both found the same entries
+        REQUIRE(found == 0);
+        report << "  " << count << " " << indexed.count() / lookups << " " << scanned.count() / lookups << std::endl;
+    }
+    WARN(report.str());
+}
@@ -0,0 +1,47 @@
+// A host TCP connection for the off device benchmarks
+
+#include "loopback.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+Loopback::Loopback()
+{
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (listener < 0 || bind(listener, (sockaddr*)&addr, len) || listen(listener, 1) ||
+            getsockname(listener, (sockaddr*)&addr, &len))
+        return;
+    client = socket(AF_INET, SOCK_STREAM, 0);
+    if (client >= 0 && !connect(client, (sockaddr*)&addr, len))
+        server = accept(listener, NULL, NULL);
+    close(listener);
+    int one = 1;
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+Loopback::~Loopback()
+{
+    if (client >= 0) close(client);
+    if (server >= 0) close(server);
+}
+
+int Loopback::send(const void* buf, size_t size)
+{
+    return ::send(client, buf, size, 0);
+}
+
+size_t Loopback::drain()
+{
+    char buf[4096];
+    size_t total = 0;
+    ssize_t n;
+    while ((n = recv(server, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+        total += n;
+    return total;
+}
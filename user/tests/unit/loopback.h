@@ -0,0 +1,31 @@
+// A host TCP connection for the off device benchmarks
+
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * A TCP connection over the loopback, as the gcc platform makes for a
+ * TCPClient, with Nagle's algorithm off so each send is a segment.
+ *
+ * Kept apart from the tests, as the host socket headers clash with socket_hal.h.
+ */
+struct Loopback {
+    int client = -1, server = -1;
+
+    Loopback();
+    ~Loopback();
+
+    bool ok() const { return server >= 0; }
+
+    /**
+     * Sends from the client end.
+     */
+    int send(const void* buf, size_t size);
+
+    /**
+     * Reads what has arrived at the server end.
+     * @return the number of bytes read
+     */
+    size_t drain();
+};
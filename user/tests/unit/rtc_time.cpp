@@ -0,0 +1,121 @@
+// Off device tests for the nRF51 RTC tick conversion
+
+#include "catch.hpp"
+#include "rtc_time.h"
+
+namespace {
+
+// exact conversions of the extended tick count
+uint32_t expectedMillis(uint64_t ticks) { return uint32_t(ticks * 1000 / 32768); }
+uint32_t expectedMicros(uint64_t ticks) { return uint32_t(ticks * 1000000 / 32768); }
+
+/**
+ * A 24 bit counter and the overflow count kept by the RTC interrupt, which
+ * can lag behind the counter
+ */
+struct Rtc {
+    uint32_t overflows = 0;
+    uint32_t counter = 0;
+    bool pending = false;
+
+    void tick() {
+        counter = (counter + 1) & RTC_COUNTER_MASK;
+        if (counter == 0) {
+            pending = true;
+        }
+    }
+
+    void interrupt() {
+        if (pending) {
+            overflows++;
+            pending = false;
+        }
+    }
+
+    uint32_t millis() const {
+        return rtc_ticks_to_millis(rtc_resolve_overflows(overflows, counter, pending), counter);
+    }
+
+    uint32_t micros() const {
+        return rtc_ticks_to_micros(rtc_resolve_overflows(overflows, counter, pending), counter);
+    }
+};
+
+} // namespace
+
+TEST_CASE("RTC ticks convert exactly", "[rtc_time]")
+{
+    for (uint32_t overflows : { 0u, 1u, 7u, 8388u, 8389u, 123456u }) {
+        for (uint32_t counter : { 0u, 1u, 32u, 33u, 511u, 512u, 32767u, 32768u, 0x7FFFFFu, 0xFFFFFFu }) {
+            uint64_t ticks = (uint64_t(overflows) << 24) | counter;
+            REQUIRE(rtc_ticks_to_millis(overflows, counter) == expectedMillis(ticks));
+            REQUIRE(rtc_ticks_to_micros(overflows, counter) == expectedMicros(ticks));
+        }
+    }
+}
+
+TEST_CASE("RTC ticks convert exactly for every counter value", "[rtc_time]")
+{
+    for (uint32_t counter = 0; counter <= RTC_COUNTER_MASK; counter++) {
+        uint64_t ticks = (uint64_t(3) << 24) | counter;
+        if (rtc_ticks_to_micros(3, counter) != expectedMicros(ticks)) {
+            FAIL("micros wrong for counter " << counter);
+        }
+        if (rtc_ticks_to_millis(3, counter) != expectedMillis(ticks)) {
+            FAIL("millis wrong for counter " << counter);
+        }
+    }
+}
+
+TEST_CASE("RTC time is monotonic across the counter overflow", "[rtc_time]")
+{
+    Rtc rtc;
+    rtc.overflows = 5;
+    rtc.counter = RTC_COUNTER_MASK - 100;
+
+    uint32_t lastMillis = rtc.millis();
+    uint32_t lastMicros = rtc.micros();
+
+    SECTION("when the overflow interrupt runs late")
+    {
+        for (int i = 0; i < 200; i++) {
+            rtc.tick();
+            // the interrupt only runs 50 ticks after the overflow
+            if (rtc.counter == 50) {
+                rtc.interrupt();
+            }
+            REQUIRE(rtc.millis() >= lastMillis);
+            REQUIRE(rtc.micros() > lastMicros);
+            lastMillis = rtc.millis();
+            lastMicros = rtc.micros();
+        }
+        REQUIRE(rtc.overflows == 6);
+    }
+
+    SECTION("when the overflow interrupt runs right away")
+    {
+        for (int i = 0; i < 200; i++) {
+            rtc.tick();
+            rtc.interrupt();
+            REQUIRE(rtc.micros() > lastMicros);
+            lastMicros = rtc.micros();
+        }
+    }
+
+    SECTION("a counter read just before the overflow isn't moved ahead")
+    {
+        // counter read, then the overflow event is seen before the interrupt ran
+        uint32_t counter = RTC_COUNTER_MASK;
+        REQUIRE(rtc_resolve_overflows(5, counter, true) == 5);
+        REQUIRE(rtc_resolve_overflows(5, 0, true) == 6);
+    }
+}
+
+TEST_CASE("RTC time wraps like a 32 bit counter", "[rtc_time]")
+{
+    // micros wrap after about 71.6 minutes, i.e. between 8 and 9 overflows
+    uint64_t ticks = (uint64_t(8) << 24) | 0x631234;
+    REQUIRE(rtc_ticks_to_micros(8, 0x631234) == expectedMicros(ticks));
+    REQUIRE(rtc_ticks_to_micros(9, 0) == expectedMicros(uint64_t(9) << 24));
+    REQUIRE(rtc_ticks_to_micros(9, 0) == uint32_t(uint64_t(9) * RTC_MICROS_PER_OVERFLOW));
+}
@@ -0,0 +1,160 @@
+// Off device tests and benchmark for persisting the DTLS session counters
+
+#include "mbedtls/ssl.h"
+#include "dtls_session_persist.h"
+// the debug log macros of the protocol, not the test ones
+#undef INFO
+#undef WARN
+#include "catch.hpp"
+#include <sstream>
+#include <vector>
+
+using namespace particle::protocol;
+
+namespace {
+
+const unsigned reserved = SessionPersist::RESERVED_MESSAGES;
+
+/**
+ * Backup RAM, holding the last session saved.
+ */
+struct Store {
+    static std::vector<uint8_t> saved;
+    static unsigned writes;
+
+    static int save(const void* data, size_t length, uint8_t type, void* reserved) {
+        const uint8_t* d = (const uint8_t*)data;
+        saved.assign(d, d + length);
+        writes++;
+        return 0;
+    }
+
+    static const SessionPersistData& session() {
+        return *(const SessionPersistData*)saved.data();
+    }
+};
+
+std::vector<uint8_t> Store::saved;
+unsigned Store::writes;
+
+uint64_t sequence_number(const unsigned char* ctr)
+{
+    uint64_t n = 0;
+    for (int i = 2; i < 8; i++)
+        n = (n << 8) | ctr[i];
+    return n;
+}
+
+/**
+ * An established session sending messages, as DTLSMessageChannel::send does.
+ */
+struct Session {
+    mbedtls_ssl_context context = {};
+    unsigned char out_ctr[8] = { 0, 1 };
+    SessionPersist persist;
+    message_id_t message_id = 0xFFF0;
+
+    Session() {
+        // the counter is in the output buffer of the context
+        context.out_ctr = out_ctr;
+        context.state = MBEDTLS_SSL_HANDSHAKE_OVER;
+        Store::saved.clear();
+        Store::writes = 0;
+        persist.make_persistent();
+    }
+
+    void send() {
+        ++message_id;
+        persist.reserve(&context, Store::save, message_id);
+        // the record written advances the counter
+        for (int i = 7; i >= 0 && !++context.out_ctr[i]; i--);
+    }
+};
+
+} // namespace
+
+TEST_CASE("Session counters are saved once per reservation", "[session_persist]")
+{
+    Session s;
+    s.send();
+    CHECK(Store::writes == 1);
+    for (int i = 1; i < 1000; i++)
+        s.send();
+    // the message IDs wrap around along the way
+    CHECK(s.message_id < 0xFFF0);
+    unsigned expected = (1000 + reserved - 1) / reserved;
+    CHECK(Store::writes == expected);
+}
+
+TEST_CASE("Saved session counters are ahead of those used", "[session_persist]")
+{
+    Session s;
+    for (int i = 0; i < 500; i++) {
+        uint64_t record = sequence_number(s.context.out_ctr);
+        s.send();
+        const SessionPersistData& saved = Store::session();
+        // resuming continues from the saved counter and after the saved message ID
+        uint64_t resumed = sequence_number(saved.out_ctr);
+        REQUIRE(resumed > record);
+        message_id_t ids_ahead = saved.next_coap_id - s.message_id;
+        REQUIRE(ids_ahead <= reserved);
+    }
+}
+
+TEST_CASE("Session counters are saved when the epoch or message ID moves on", "[session_persist]")
+{
+    Session s;
+    s.send();
+    s.send();
+    CHECK(Store::writes == 1);
+
+    s.context.out_ctr[1] = 2;
+    s.send();
+    CHECK(Store::writes == 2);
+    CHECK(Store::session().out_ctr[1] == 2);
+
+    // a message ID outside the reservation, as when the channel is reseeded
+    s.message_id += 1000;
+    s.send();
+    CHECK(Store::writes == 3);
+    CHECK(Store::session().next_coap_id == message_id_t(s.message_id + reserved));
+}
+
+TEST_CASE("Session counters are not saved before the handshake or persistence", "[session_persist]")
+{
+    Session s;
+    s.context.state = MBEDTLS_SSL_CLIENT_HELLO;
+    s.send();
+    CHECK(Store::writes == 0);
+
+    SessionPersist transient;
+    s.context.state = MBEDTLS_SSL_HANDSHAKE_OVER;
+    CHECK_FALSE(transient.reserve(&s.context, Store::save, 1));
+    CHECK(Store::writes == 0);
+}
+
+/**
+ * Persistence writes and bytes written a message, saving the session for
+ * each message as before and with the counters reserved ahead.
+ *
+ * Run with: obj/runner "[benchmark]"
+ */
+TEST_CASE("Session persistence benchmark", "[.][session_persist][benchmark]")
+{
+    const unsigned messages = 10000;
+    Session s;
+    SessionPersistStats before = SessionPersist::stats();
+    for (unsigned i = 0; i < messages; i++)
+        s.send();
+    SessionPersistStats after = SessionPersist::stats();
+    unsigned sent = after.messages - before.messages;
+    REQUIRE(sent == messages);
+
+    std::ostringstream report;
+    report << "per message sent: persistence writes, bytes written" << std::endl;
+    report << "  saved on each send: 1, " << sizeof(SessionPersist) << std::endl;
+    report << "  reserved " << reserved << " ahead: "
+           << double(after.writes - before.writes) / messages << ", "
+           << double(after.bytes - before.bytes) / messages << std::endl;
+    WARN(report.str());
+}
@@ -0,0 +1,301 @@
+// Off device tests and benchmark for the Electron modem socket writes and
+// reads, against a scripted stand-in for the modem
+
+#include "attokenizer_hal.h"
+#include "socketwrite_hal.h"
+// the debug log macros of the HAL, not the test ones
+#undef INFO
+#undef WARN
+#include "catch.hpp"
+#include <cmath>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+const double BYTE_MS = 10.0 / 115.2;    // a byte at 115200 baud, 8N1
+const double POLL_MS = 10;              // waitFinalResp relaxes between lines
+const double PROMPT_DELAY_MS = 50;      // socketSend waits after the prompt
+const double COMMAND_MS = 5;            // the modem taking a command
+const double WRITE_MS = 20;             // the modem taking the data of a block
+
+/**
+ * A u-blox modem taking AT+USOWR blocks, on a simulated clock. Each command
+ * is prompted for once the modem is done with the block before it, and the
+ * data of a block is answered once all of it has arrived.
+ *
+ * Implements the Modem interface of socketWritePipelined, the responses read
+ * back through a receive pipe and the tokenizer, as waitFinalResp does.
+ */
+struct ScriptedModem {
+    struct Block {
+        double command_at;
+        int size;
+        std::string data;
+        double data_at;
+    };
+
+    double now = 0;
+    std::vector<Block> blocks;
+    std::set<int> refused;      //!< blocks answered ERROR rather than prompted
+    std::set<int> failed;       //!< blocks answered ERROR once written
+    bool silent = false;        //!< nothing is answered
+    size_t next = 0;            //!< the block the modem is on
+    bool prompted = false;      //!< the data of the block is expected
+    double prompt_at = 0;
+    double done_at = 0;         //!< when the modem finished the block before
+    std::vector<std::string> responses;
+
+    void send(size_t bytes)
+    {
+        now += bytes * BYTE_MS;
+    }
+
+    void command(int blk)
+    {
+        char cmd[32];
+        int n = sprintf(cmd, "AT+USOWR=0,%d\r\n", blk);
+        send(n);
+        blocks.push_back(Block { now, blk, std::string(), 0 });
+    }
+
+    void data(const char* buf, int blk)
+    {
+        now += PROMPT_DELAY_MS;
+        send(blk);
+        Block& b = blocks[next];
+        b.data.assign(buf, blk);
+        b.data_at = now;
+    }
+
+    /**
+     * The next modem output and when it is done arriving, false if the modem
+     * is waiting on the host.
+     */
+    bool output(std::string& out, double& at)
+    {
+        if (silent || next >= blocks.size())
+            return false;
+        Block& b = blocks[next];
+        if (!prompted) {
+            double start = std::max(b.command_at, done_at) + COMMAND_MS;
+            if (refused.count(next)) {
+                out = "\r\nERROR\r\n";
+                done_at = at = start + out.size() * BYTE_MS;
+                next++;
+                return true;
+            }
+            out = "\r\n@";
+            prompt_at = at = start + out.size() * BYTE_MS;
+            prompted = true;
+            return true;
+        }
+        if (b.data.empty() && b.size)
+            return false;
+        double start = std::max(b.data_at, prompt_at) + WRITE_MS;
+        if (failed.count(next)) {
+            out = "\r\nERROR\r\n";
+        } else {
+            char rsp[48];
+            sprintf(rsp, "\r\n+USOWR: 0,%d\r\n\r\nOK\r\n", b.size);
+            out = rsp;
+        }
+        done_at = at = start + out.size() * BYTE_MS;
+        prompted = false;
+        next++;
+        return true;
+    }
+
+    int response()
+    {
+        std::string out;
+        double at;
+        if (!output(out, at)) {
+            now += 10000;
+            return WAIT;
+        }
+        // seen on the first poll after it has all arrived
+        if (at > now)
+            now += std::ceil((at - now) / POLL_MS) * POLL_MS;
+        Pipe<char> pipe(1024);
+        pipe.put(out.data(), out.size());
+        char buf[1024 + 64];
+        int ret;
+        while ((ret = AtTokenizer::getLine(&pipe, buf, sizeof(buf))) != WAIT) {
+            responses.push_back(std::string(buf, LENGTH(ret)));
+            switch (TYPE(ret)) {
+                case TYPE_OK:       return RESP_OK;
+                case TYPE_ERROR:    return RESP_ERROR;
+                case TYPE_PROMPT:   return RESP_PROMPT;
+            }
+        }
+        return WAIT;
+    }
+
+    std::string written() const
+    {
+        std::string s;
+        for (size_t i = 0; i < next && i < blocks.size(); i++)
+            s += blocks[i].data;
+        return s;
+    }
+};
+
+/**
+ * The previous MDMParser::socketSend, a command for each block once the
+ * block before it is written.
+ */
+template <typename Modem> int socketWriteSequential(Modem& modem, const char* buf, int len, int max_block)
+{
+    int cnt = len;
+    while (cnt > 0) {
+        int blk = max_block;
+        if (cnt < blk)
+            blk = cnt;
+        bool ok = false;
+        modem.command(blk);
+        if (RESP_PROMPT == modem.response()) {
+            modem.data(buf, blk);
+            if (RESP_OK == modem.response())
+                ok = true;
+        }
+        if (!ok)
+            return MDM_SOCKET_ERROR;
+        buf += blk;
+        cnt -= blk;
+    }
+    return len;
+}
+
+std::string payload(size_t size)
+{
+    std::string s;
+    uint32_t x = 2463534242u;
+    for (size_t i = 0; i < size; i++) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        s += char(x);
+    }
+    return s;
+}
+
+} // namespace
+
+TEST_CASE("Pipelined socket write sends every block in order", "[socket_io]")
+{
+    for (int len : { 1, 1023, 1024, 1025, 4096, 5000 }) {
+        std::string data = payload(len);
+        ScriptedModem modem;
+        int ret = socketWritePipelined(modem, data.data(), len, 1024);
+        CHECK(ret == len);
+        CHECK(modem.written() == data);
+        int blocks = (len + 1023) / 1024;
+        CHECK(modem.blocks.size() == size_t(blocks));
+        CHECK(modem.blocks.back().size == len - (blocks - 1) * 1024);
+    }
+}
+
+TEST_CASE("Pipelined socket write queues the next command before the block completes", "[socket_io]")
+{
+    std::string data = payload(3000);
+    ScriptedModem modem;
+    REQUIRE(socketWritePipelined(modem, data.data(), 3000, 1024) == 3000);
+    REQUIRE(modem.blocks.size() == 3);
+    for (size_t i = 1; i < modem.blocks.size(); i++) {
+        // sent while the modem is still writing the block before
+        double lag = modem.blocks[i].command_at - modem.blocks[i-1].data_at;
+        CHECK(lag < WRITE_MS);
+    }
+}
+
+TEST_CASE("Pipelined socket write fails on a refused block and drains the queued one", "[socket_io]")
+{
+    std::string data = payload(4096);
+    ScriptedModem modem;
+    modem.failed.insert(1);
+    int ret = socketWritePipelined(modem, data.data(), 4096, 1024);
+    CHECK(ret == MDM_SOCKET_ERROR);
+    // block 2 was already queued, its prompt is answered so the modem is not left waiting
+    CHECK(modem.blocks.size() == 3);
+    CHECK(modem.next == 3);
+    CHECK(modem.prompted == false);
+
+    ScriptedModem refusing;
+    refusing.refused.insert(0);
+    ret = socketWritePipelined(refusing, data.data(), 4096, 1024);
+    CHECK(ret == MDM_SOCKET_ERROR);
+    CHECK(refusing.blocks.size() == 1);
+}
+
+TEST_CASE("Pipelined socket write stops when the modem does not answer", "[socket_io]")
+{
+    std::string data = payload(100);
+    ScriptedModem modem;
+    modem.silent = true;
+    int ret = socketWritePipelined(modem, data.data(), 100, 1024);
+    CHECK(ret == MDM_SOCKET_ERROR);
+}
+
+TEST_CASE("Tokenizer puts socket read data in the payload buffer", "[socket_io]")
+{
+    Pipe<char> pipe(1024);
+    std::string rsp = "\r\n+USORD: 0,11,\"hello\r\nOK\r\n\"\r\n\r\nOK\r\n";
+    pipe.put(rsp.data(), rsp.size());
+    char line[64];
+    char data[32];
+    AtTokenizer::Payload payload = { data, sizeof(data), -1 };
+    int ret = AtTokenizer::getLine(&pipe, line, sizeof(line), &payload);
+    CHECK(TYPE(ret) == TYPE_PLUS);
+    CHECK(std::string(line, LENGTH(ret)) == "\r\n+USORD: 0,11,\"\"");
+    CHECK(payload.len == 11);
+    CHECK(std::string(data, 11) == "hello\r\nOK\r\n");
+    ret = AtTokenizer::getLine(&pipe, line, sizeof(line), &payload);
+    CHECK(TYPE(ret) == TYPE_UNKNOWN);
+    ret = AtTokenizer::getLine(&pipe, line, sizeof(line), &payload);
+    CHECK(TYPE(ret) == TYPE_OK);
+}
+
+TEST_CASE("Tokenizer keeps socket read data in the line when the payload buffer is short", "[socket_io]")
+{
+    Pipe<char> pipe(1024);
+    std::string rsp = "\r\n+USORF: 0,\"52.0.0.1\",5684,4,\"abcd\"\r\n";
+    pipe.put(rsp.data(), rsp.size());
+    char line[64];
+    char data[2];
+    AtTokenizer::Payload payload = { data, sizeof(data), -1 };
+    int ret = AtTokenizer::getLine(&pipe, line, sizeof(line), &payload);
+    CHECK(TYPE(ret) == TYPE_PLUS);
+    CHECK(std::string(line, LENGTH(ret)) == "\r\n+USORF: 0,\"52.0.0.1\",5684,4,\"abcd\"");
+    CHECK(payload.len == -1);
+
+    // and other responses are left alone
+    std::string urc = "\r\n+UUSORD: 0,12\r\n";
+    pipe.put(urc.data(), urc.size());
+    ret = AtTokenizer::getLine(&pipe, line, sizeof(line), &payload);
+    CHECK(TYPE(ret) == TYPE_UNKNOWN);
+    ret = AtTokenizer::getLine(&pipe, line, sizeof(line), &payload);
+    CHECK(std::string(line, LENGTH(ret)) == urc);
+    CHECK(payload.len == -1);
+}
+
+/**
+ * Socket write throughput on the simulated modem and UART, one block at a
+ * time as before and with the next command queued.
+ *
+ * Run with: obj/runner "[benchmark]"
+ */
+TEST_CASE("Socket write benchmark", "[.][socket_io][benchmark]")
+{
+    std::ostringstream report;
+    report << "write: bytes/s sequential then pipelined, simulated 115200 baud" << std::endl;
+    for (int len : { 512, 4096, 16384 }) {
+        std::string data = payload(len);
+        ScriptedModem sequential, pipelined;
+        socketWriteSequential(sequential, data.data(), len, 1024);
+        socketWritePipelined(pipelined, data.data(), len, 1024);
+        report << "  " << len << "B: " << len * 1000 / sequential.now
+               << ", " << len * 1000 / pipelined.now << std::endl;
+    }
+    WARN(report.str());
+}
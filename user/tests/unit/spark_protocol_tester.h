@@ -0,0 +1,214 @@
+// Drives SparkProtocol off device, as the server and the system would
+
+#pragma once
+
+#include "spark_protocol.h"
+#include <string>
+#include <vector>
+
+/**
+ * Drives the message handlers of a SparkProtocol with messages as the server
+ * sends them, and decrypts what the protocol sends back.
+ */
+class SparkProtocolTester
+{
+    SessionCipher server;
+    uint16_t message_id = 0;
+
+    static int send_bytes(const unsigned char* buf, uint32_t length, void*)
+    {
+        sent().append((const char*)buf, length);
+        return length;
+    }
+
+    static int prepare_update(FileTransfer::Descriptor&, uint32_t, void*)
+    {
+        return 0;
+    }
+
+    static int save_chunk(FileTransfer::Descriptor& file, const unsigned char*, void*)
+    {
+        saved().push_back(file.chunk_address);
+        return 0;
+    }
+
+    static int finish_update(FileTransfer::Descriptor&, uint32_t, void*)
+    {
+        return 0;
+    }
+
+    static system_tick_t no_time()
+    {
+        return 0;
+    }
+
+    static void encode32(std::string& s, uint32_t value)
+    {
+        s += char(value >> 24);
+        s += char(value >> 16);
+        s += char(value >> 8);
+        s += char(value);
+    }
+
+    static void encode16(std::string& s, uint16_t value)
+    {
+        s += char(value >> 8);
+        s += char(value);
+    }
+
+    /**
+     * Places a message in the queue as it is when received, padded.
+     */
+    SparkProtocol::msg receive(std::string m)
+    {
+        size_t padded = (m.size() & ~15) + 16;
+        m.append(padded - m.size(), char(padded - m.size()));   // PKCS #7 padding
+        memcpy(protocol.queue, m.data(), m.size());
+        SparkProtocol::msg message;
+        message.len = m.size();
+        message.token = protocol.queue[4];
+        message.response = protocol.queue + m.size();
+        message.response_len = protocol.QUEUE_SIZE - m.size();
+        return message;
+    }
+
+    std::string header(char path)
+    {
+        std::string m = { 0x41, 0x02 };     // confirmable, one-byte token, POST
+        encode16(m, ++message_id);
+        m += char(7);
+        m += char(0xb1);                   // one-byte Uri-Path option
+        m += path;
+        return m;
+    }
+
+public:
+    SparkProtocol protocol;
+
+    /**
+     * What the protocol sent, framed and encrypted.
+     */
+    static std::string& sent()
+    {
+        static std::string bytes;
+        return bytes;
+    }
+
+    /**
+     * The address of each chunk written.
+     */
+    static std::vector<uint32_t>& saved()
+    {
+        static std::vector<uint32_t> addresses;
+        return addresses;
+    }
+
+    static uint32_t chunk_crc(const unsigned char* buf, uint32_t length)
+    {
+        uint32_t crc = 0;
+        while (length--)
+            crc = crc * 31 + *buf++;
+        return crc;
+    }
+
+    SparkProtocolTester()
+    {
+        init();
+        const unsigned char key[16] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+        const unsigned char iv[16] = { 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1 };
+        protocol.cipher.set_key(key, iv);
+        server.set_key(key, iv);
+        sent().clear();
+        saved().clear();
+    }
+
+    /**
+     * Initializes the protocol as the system does before connecting.
+     */
+    void init()
+    {
+        static unsigned char server_public[MAX_SERVER_PUBLIC_KEY_LENGTH];
+        static unsigned char core_private[MAX_DEVICE_PRIVATE_KEY_LENGTH];
+        SparkKeys keys = {};
+        keys.size = sizeof(keys);
+        keys.server_public = server_public;
+        keys.core_private = core_private;
+
+        SparkCallbacks callbacks = {};
+        callbacks.size = sizeof(callbacks);
+        callbacks.send = send_bytes;
+        callbacks.prepare_for_firmware_update = prepare_update;
+        callbacks.save_firmware_chunk = save_chunk;
+        callbacks.finish_firmware_update = finish_update;
+        callbacks.calculate_crc = chunk_crc;
+        callbacks.millis = no_time;
+
+        SparkDescriptor descriptor = {};
+        descriptor.size = sizeof(descriptor);
+        protocol.init("0123456789ab", keys, callbacks, descriptor);
+    }
+
+    bool update_begin(uint8_t flags, uint16_t chunk_size, uint32_t file_length)
+    {
+        std::string m = header('u');
+        m += char(0xff);
+        m += char(flags);
+        encode16(m, chunk_size);
+        encode32(m, file_length);
+        m += char(FileTransfer::Store::FIRMWARE);
+        encode32(m, 0x80000);
+        SparkProtocol::msg message = receive(m);
+        return protocol.handle_update_begin(message);
+    }
+
+    bool chunk(chunk_index_t index, uint16_t chunk_size, bool crc_valid = true)
+    {
+        std::string data(chunk_size, char(index));
+        std::string m = header('c');
+        m += char(0x44);                   // the CRC
+        encode32(m, chunk_crc((const uint8_t*)data.data(), data.size()) + !crc_valid);
+        m += char(0x02);                   // the chunk index
+        encode16(m, index);
+        m += char(0xff);
+        SparkProtocol::msg message = receive(m + data);
+        return protocol.handle_chunk(message);
+    }
+
+    /**
+     * Delivers an event message to the subscriptions.
+     */
+    void event(const std::vector<uint8_t>& m)
+    {
+        SparkProtocol::msg message = receive(std::string(m.begin(), m.end()));
+        protocol.handle_event(message);
+    }
+
+    chunk_index_t window_limit() const
+    {
+        return protocol.window_limit;
+    }
+
+    int send_missing_chunks()
+    {
+        return protocol.send_missing_chunks(MISSED_CHUNKS_TO_SEND);
+    }
+
+    /**
+     * Decrypts the messages sent since the last call, without their padding.
+     */
+    std::vector<std::string> responses()
+    {
+        std::string& bytes = sent();
+        std::vector<std::string> messages;
+        for (size_t i = 0; i + 2 <= bytes.size(); ) {
+            size_t length = uint8_t(bytes[i]) << 8 | uint8_t(bytes[i + 1]);
+            std::string m = bytes.substr(i + 2, length);
+            server.decrypt((unsigned char*)&m[0], m.size());
+            m.resize(m.size() - uint8_t(m.back()));
+            messages.push_back(m);
+            i += 2 + length;
+        }
+        bytes.clear();
+        return messages;
+    }
+};
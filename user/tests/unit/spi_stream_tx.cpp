@@ -0,0 +1,260 @@
+// Off device tests of the SPI stream transmitter against a stand-in master
+
+#include "catch.hpp"
+#include "spi_stream_tx.h"
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+const uint16_t CHUNK_SIZE = 255;
+
+bool pts, sa, mr;
+
+void set_pts(bool level) { pts = level; }
+void set_sa(bool level) { sa = level; }
+bool master_ready() { return mr; }
+
+const spi_stream_tx_ops_t ops = { set_pts, set_sa, master_ready };
+
+typedef std::vector<uint8_t> Frame;
+
+/**
+ * The slave end with its hardware buffer and queue, and a master that reads
+ * frames from it the way the Photon does. Each step of the master does one
+ * thing, so the test decides how the slave's events interleave with sending.
+ */
+struct Loopback {
+    uint8_t tx_buf[CHUNK_SIZE];
+    uint8_t queue[1096];
+    spi_stream_tx_t tx;
+    // where the driver reads the next transfer from
+    const uint8_t* driver_tx = tx_buf;
+
+    std::deque<Frame> received;
+    Frame frame;
+    bool length_read = false;
+    uint16_t length = 0;
+    bool buffers_pending = false;
+
+    Loopback() {
+        pts = sa = mr = false;
+        spi_stream_tx_init(&tx, &ops, tx_buf, CHUNK_SIZE, queue, sizeof(queue));
+        spi_stream_tx_buffers_set_done(&tx);
+    }
+
+    bool send(const Frame& f) {
+        return spi_stream_tx_send(&tx, f.data(), f.size());
+    }
+
+    // the driver has set the buffers again after a transfer
+    void buffers_set() {
+        buffers_pending = false;
+        spi_stream_tx_buffers_set_done(&tx);
+    }
+
+    // clock out the tx buffer
+    void transfer() {
+        if (!length_read) {
+            REQUIRE(driver_tx == tx_buf);
+            length = (tx_buf[0] << 8) | tx_buf[1];
+            length_read = true;
+            frame.clear();
+        } else {
+            uint16_t n = std::min<uint16_t>(CHUNK_SIZE, length - frame.size());
+            frame.insert(frame.end(), driver_tx, driver_tx + n);
+        }
+        if (frame.size() == length) {
+            received.push_back(frame);
+            length_read = false;
+            mr = false;
+        }
+        REQUIRE(spi_stream_tx_transfer_done(&tx));
+        spi_stream_tx_buffer(&tx, &driver_tx);
+        buffers_pending = true;
+    }
+
+    // returns false when there is nothing to do
+    bool step() {
+        if (buffers_pending) {
+            buffers_set();
+        } else if (sa) {
+            transfer();
+        } else if (pts && !mr) {
+            mr = true;
+            spi_stream_tx_master_ready(&tx);
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    void run() {
+        while (step()) {
+        }
+    }
+};
+
+Frame makeFrame(uint16_t size, uint8_t seed) {
+    Frame f(size);
+    for (uint16_t i = 0; i < size; i++) {
+        f[i] = uint8_t(seed + i * 7);
+    }
+    return f;
+}
+
+} // namespace
+
+SCENARIO("SPI stream frames are received in order", "[spi_stream_tx]") {
+    Loopback l;
+    std::vector<Frame> sent;
+    for (uint16_t size : { 5, 0, 1, 254, 255, 256, 300 }) {
+        sent.push_back(makeFrame(size, size));
+        REQUIRE(l.send(sent.back()));
+    }
+    l.run();
+
+    REQUIRE(l.received.size() == sent.size());
+    for (size_t i = 0; i < sent.size(); i++) {
+        REQUIRE(l.received[i] == sent[i]);
+    }
+    CHECK(spi_stream_tx_idle(&l.tx));
+    CHECK(l.tx.stats.frames == sent.size());
+    // a length and one transfer per chunk: 1+1, 1, 1+1, 1+1, 1+1, 1+2, 1+2
+    CHECK(l.tx.stats.transfers == 15);
+    CHECK_FALSE(pts);
+    CHECK_FALSE(sa);
+}
+
+SCENARIO("Sending an SPI stream frame doesn't wait for the master", "[spi_stream_tx]") {
+    Loopback l;
+    REQUIRE(l.send(makeFrame(10, 1)));
+    REQUIRE(l.send(makeFrame(20, 2)));
+
+    CHECK(pts);
+    CHECK_FALSE(sa);
+    CHECK(l.tx.state == SPI_STREAM_TX_WAIT_MASTER);
+    CHECK_FALSE(spi_stream_tx_idle(&l.tx));
+
+    l.run();
+    CHECK(l.received.size() == 2);
+}
+
+SCENARIO("A transfer from the SPI master is not taken for the stream's", "[spi_stream_tx]") {
+    Loopback l;
+    REQUIRE(l.send(makeFrame(10, 1)));
+
+    // the master sends to us before it gets to our PTS
+    CHECK_FALSE(spi_stream_tx_transfer_done(&l.tx));
+    spi_stream_tx_buffer(&l.tx, &l.driver_tx);
+    CHECK(l.driver_tx == l.tx_buf);
+
+    // and is ready before the driver has handed the buffers back
+    mr = true;
+    spi_stream_tx_master_ready(&l.tx);
+    CHECK_FALSE(sa);
+
+    l.buffers_set();
+    CHECK(sa);
+    l.run();
+    REQUIRE(l.received.size() == 1);
+    CHECK(l.received[0] == makeFrame(10, 1));
+}
+
+SCENARIO("SPI stream chunks are sent from the queue without copying", "[spi_stream_tx]") {
+    Loopback l;
+    REQUIRE(l.send(makeFrame(300, 4)));
+    l.step();   // MR
+    l.step();   // the length
+    l.step();   // buffers set
+
+    const uint8_t* data;
+    uint16_t size;
+    uint8_t* frame = frame_ring_peek(&l.tx.queue, &size);
+    CHECK(l.driver_tx == frame);
+    CHECK(l.tx.offset == CHUNK_SIZE);
+
+    l.step();   // the first chunk
+    CHECK(l.driver_tx == frame + CHUNK_SIZE);
+    CHECK(l.tx.loaded == 300 - CHUNK_SIZE);
+    data = l.driver_tx;
+    CHECK(std::memcmp(data, makeFrame(300, 4).data() + CHUNK_SIZE, 300 - CHUNK_SIZE) == 0);
+
+    l.run();
+    REQUIRE(l.received.size() == 1);
+    CHECK(l.received[0] == makeFrame(300, 4));
+    CHECK(l.driver_tx == l.tx_buf);
+}
+
+SCENARIO("SPI stream frames that don't fit the queue are dropped and counted", "[spi_stream_tx]") {
+    Loopback l;
+    Frame big = makeFrame(700, 3);
+    REQUIRE(spi_stream_tx_fits(&l.tx, big.size()));
+    REQUIRE(l.send(big));
+    CHECK_FALSE(spi_stream_tx_fits(&l.tx, big.size()));
+    CHECK_FALSE(l.send(big));
+    CHECK(l.tx.queue.stats.dropped_frames == 1);
+
+    l.run();
+    CHECK(spi_stream_tx_fits(&l.tx, big.size()));
+    CHECK(l.received.size() == 1);
+}
+
+SCENARIO("SPI stream loopback with frames queued during transfers", "[spi_stream_tx]") {
+    Loopback l;
+    std::deque<Frame> expected;
+    uint32_t x = 2463534242u;
+    for (int i = 0; i < 5000; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        // BLE events queue frames between the steps of a transfer
+        if (x % 3 == 0) {
+            Frame f = makeFrame(x % 400, uint8_t(i));
+            if (l.send(f)) {
+                expected.push_back(f);
+            }
+        }
+        l.step();
+    }
+    l.run();
+
+    REQUIRE(l.received.size() == expected.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        REQUIRE(l.received[i] == expected[i]);
+    }
+    CHECK(spi_stream_tx_idle(&l.tx));
+}
+
+/**
+ * Frames per second through the transmitter and the stand-in master, i.e.
+ * the cost of the state machine and the copies per frame.
+ *
+ * Run with: obj/runner "[benchmark]"
+ */
+TEST_CASE("SPI stream loopback benchmark", "[.][spi_stream_tx][benchmark]")
+{
+    std::ostringstream report;
+    report << "frames/s and MB/s by frame size" << std::endl;
+
+    for (uint16_t size : { 20, 100, 255, 500 }) {
+        Loopback l;
+        Frame f = makeFrame(size, 0);
+        const uint32_t count = 200000;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < count; i++) {
+            l.send(f);
+            l.run();
+            l.received.clear();
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        REQUIRE(l.tx.stats.frames == count);
+        report << "  " << size << " bytes: " << unsigned(count / elapsed.count())
+               << " frames/s " << unsigned(double(count) * size / elapsed.count() / 1e6) << " MB/s"
+               << std::endl;
+    }
+    WARN(report.str());
+}
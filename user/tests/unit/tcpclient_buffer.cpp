@@ -0,0 +1,504 @@
+// Off device tests and benchmark for the output buffer of TCPClient
+
+#include "spark_wiring_tcpclient.h"
+#include "spark_wiring_network.h"
+#include "inet_hal.h"
+#include "net_hal.h"
+// INFO and WARN are Catch's here, not the debug log's
+#undef INFO
+#undef WARN
+#include "catch.hpp"
+#include "loopback.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+/**
+ * Stands in for socket_send, keeping what was sent. Takes at most
+ * accept bytes a call, and fails with error once set.
+ */
+struct Socket {
+    std::string sent;
+    std::vector<size_t> sends;
+    size_t accept = 1 << 20;
+    int error = 0;
+
+    int send(const uint8_t* buf, size_t size)
+    {
+        if (error)
+            return error;
+        if (size > accept)
+            size = accept;
+        sent.append((const char*)buf, size);
+        if (size)
+            sends.push_back(size);
+        return size;
+    }
+};
+
+struct HostSocket;
+HostSocket& host_socket();
+
+/**
+ * The one connected socket of the socket HAL, keeping what is sent, or
+ * passing it on to a host connection when loopback is set.
+ */
+struct HostSocket : Socket {
+    static const sock_handle_t Handle = 7;
+    std::string received;
+    bool active = true;
+    bool closed = false;
+    Loopback* loopback = nullptr;
+
+    static HostSocket& reset()
+    {
+        return host_socket() = HostSocket();
+    }
+};
+
+HostSocket& host_socket()
+{
+    static HostSocket socket;
+    return socket;
+}
+
+class HostNetwork : public spark::NetworkClass
+{
+public:
+    virtual bool ready() override { return true; }
+} host_network;
+
+template <size_t N> struct Buffered {
+    TCPClientWriteBuffer<N> tx;
+    Socket socket;
+
+    int write(const char* s, system_tick_t now = 0, system_tick_t delay = 20)
+    {
+        Socket& sock = socket;
+        return tx.write((const uint8_t*)s, strlen(s), now, delay,
+            [&sock](const uint8_t* buf, size_t size) { return sock.send(buf, size); });
+    }
+
+    int flush()
+    {
+        Socket& sock = socket;
+        return tx.flush([&sock](const uint8_t* buf, size_t size) { return sock.send(buf, size); });
+    }
+};
+
+/**
+ * An HTTP request written as a sketch would.
+ */
+void http_request(TCPClient& client)
+{
+    const char* body = "{\"name\":\"temperature\",\"data\":\"21.5\"}";
+    client.println("POST /v1/devices/events HTTP/1.1");
+    client.print("Host: ");
+    client.println("api.particle.io");
+    client.println("User-Agent: particle-firmware");
+    client.println("Content-Type: application/json");
+    client.print("Content-Length: ");
+    client.println(strlen(body));
+    client.println("Connection: close");
+    client.println();
+    client.print(body);
+    client.flush();
+}
+
+/**
+ * The text of a firmware source file, relative to the project root.
+ */
+std::string source(const char* path)
+{
+    std::ifstream file(std::string("../../../") + path);
+    std::ostringstream text;
+    text << file.rdbuf();
+    return text.str();
+}
+
+/**
+ * The body of the function defined in text.
+ */
+std::string body(const std::string& text, const std::string& function)
+{
+    size_t start = text.find(function + " {");
+    if (start == std::string::npos)
+        return std::string();
+    return text.substr(start, text.find("\n}", start) - start);
+}
+
+struct Rate {
+    unsigned sends;
+    double bytes_per_second;
+};
+
+Rate loopback_requests(bool buffered, unsigned count)
+{
+    Loopback loopback;
+    REQUIRE(loopback.ok());
+    HostSocket::reset();
+    host_socket().loopback = &loopback;
+    size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < count; i++) {
+        TCPClient client(HostSocket::Handle);
+        if (!buffered)
+            client.setWriteDelay(0);
+        http_request(client);
+        bytes += loopback.drain();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    host_socket().loopback = nullptr;
+    return Rate { unsigned(host_socket().sends.size() / count), bytes / elapsed.count() };
+}
+
+} // namespace
+
+spark::NetworkClass& spark::Network = host_network;
+
+uint8_t socket_handle_valid(sock_handle_t handle)
+{
+    return handle == HostSocket::Handle;
+}
+
+sock_handle_t socket_handle_invalid()
+{
+    return sock_handle_t(-1);
+}
+
+uint8_t socket_active_status(sock_handle_t socket)
+{
+    return host_socket().active ? SOCKET_STATUS_ACTIVE : SOCKET_STATUS_INACTIVE;
+}
+
+sock_handle_t socket_create(uint8_t family, uint8_t type, uint8_t protocol, uint16_t port, network_interface_t nif)
+{
+    host_socket().closed = false;
+    return HostSocket::Handle;
+}
+
+sock_result_t socket_connect(sock_handle_t sd, const sockaddr_t* addr, long addrlen)
+{
+    return 0;
+}
+
+sock_result_t socket_receive(sock_handle_t sd, void* buffer, socklen_t len, system_tick_t timeout)
+{
+    std::string& received = host_socket().received;
+    len = std::min<size_t>(len, received.size());
+    memcpy(buffer, received.data(), len);
+    received.erase(0, len);
+    return len;
+}
+
+sock_result_t socket_send(sock_handle_t sd, const void* buffer, socklen_t len)
+{
+    HostSocket& host = host_socket();
+    if (!host.loopback)
+        return host.send((const uint8_t*)buffer, len);
+    host.sends.push_back(len);
+    return host.loopback->send(buffer, len);
+}
+
+sock_result_t socket_close(sock_handle_t sd)
+{
+    host_socket().closed = true;
+    return 0;
+}
+
+int inet_gethostbyname(const char* hostname, uint16_t hostnameLen, HAL_IPAddress* out_ip_addr,
+        network_interface_t nif, void* reserved)
+{
+    return -1;
+}
+
+uint32_t HAL_NET_SetNetWatchDog(uint32_t timeOutInuS)
+{
+    return 0;
+}
+
+TEST_CASE("Write buffer holds small writes until flushed", "[tcpclient_buffer]")
+{
+    Buffered<16> b;
+    CHECK(b.write("GET ") == 4);
+    CHECK(b.write("/ ") == 2);
+    CHECK(b.socket.sends.empty());
+    CHECK(b.tx.count() == 6);
+    CHECK(b.flush() == 6);
+    CHECK(b.socket.sent == "GET / ");
+    CHECK(b.socket.sends.size() == 1);
+    CHECK(b.tx.empty());
+    CHECK(b.flush() == 0);
+    CHECK(b.socket.sends.size() == 1);
+}
+
+TEST_CASE("Write buffer sends when it fills", "[tcpclient_buffer]")
+{
+    Buffered<8> b;
+    CHECK(b.write("abcde") == 5);
+    CHECK(b.write("fgh") == 3);
+    // full, sent in one
+    CHECK(b.socket.sent == "abcdefgh");
+    CHECK(b.tx.empty());
+
+    CHECK(b.write("ijklm") == 5);
+    CHECK(b.write("nopq") == 4);
+    // what was held goes first, the rest is held
+    CHECK(b.socket.sent == "abcdefghijklm");
+    CHECK(b.tx.count() == 4);
+    CHECK(b.flush() == 4);
+    CHECK(b.socket.sent == "abcdefghijklmnopq");
+}
+
+TEST_CASE("Write buffer sends big writes straight out", "[tcpclient_buffer]")
+{
+    Buffered<8> b;
+    CHECK(b.write("ab") == 2);
+    CHECK(b.write("0123456789") == 10);
+    CHECK(b.socket.sent == "ab0123456789");
+    CHECK(b.socket.sends.size() == 2);
+    CHECK(b.tx.empty());
+}
+
+TEST_CASE("Write buffer sends bytes held longer than the delay on the next write", "[tcpclient_buffer]")
+{
+    Buffered<64> b;
+    CHECK(b.write("a", 1000, 20) == 1);
+    CHECK(b.write("b", 1019, 20) == 1);
+    CHECK(b.socket.sends.empty());
+    CHECK(b.write("c", 1020, 20) == 1);
+    CHECK(b.socket.sent == "abc");
+
+    // no delay sends every write
+    CHECK(b.write("d", 1021, 0) == 1);
+    CHECK(b.socket.sent == "abcd");
+
+    // the tick count wrapping is still a delay
+    CHECK(b.write("e", 0xFFFFFFF0, 20) == 1);
+    CHECK(b.write("f", 4, 20) == 1);
+    CHECK(b.socket.sent == "abcdef");
+}
+
+TEST_CASE("Write buffer keeps what the socket does not take", "[tcpclient_buffer]")
+{
+    Buffered<16> b;
+    b.socket.accept = 0;
+    CHECK(b.write("0123456789") == 10);
+    CHECK(b.flush() == 0);
+    CHECK(b.tx.count() == 10);
+    // no room, nothing is taken
+    CHECK(b.write("abcdefgh") == 0);
+
+    b.socket.accept = 4;
+    CHECK(b.flush() == 10);
+    CHECK(b.socket.sent == "0123456789");
+    CHECK(b.socket.sends.size() == 3);
+}
+
+TEST_CASE("Write buffer drops what it holds when a send fails", "[tcpclient_buffer]")
+{
+    Buffered<16> b;
+    CHECK(b.write("abc") == 3);
+    b.socket.error = -1;
+    CHECK(b.flush() == -1);
+    CHECK(b.tx.empty());
+    CHECK(b.write("0123456789abcdefg") == -1);
+}
+
+TEST_CASE("Write buffer copies start empty", "[tcpclient_buffer]")
+{
+    Buffered<16> b;
+    b.write("abc");
+    TCPClientWriteBuffer<16> copy(b.tx);
+    CHECK(copy.empty());
+    b.tx = copy;
+    CHECK(b.tx.empty());
+}
+
+TEST_CASE("TCPClient sends what was written before it reads", "[tcpclient_buffer]")
+{
+    HostSocket& host = HostSocket::reset();
+    TCPClient client(HostSocket::Handle);
+    client.print("GET / ");
+    CHECK(host.sent.empty());
+
+    SECTION("available")
+    {
+        host.received = "HTTP";
+        CHECK(client.available() == 4);
+        CHECK(host.sent == "GET / ");
+    }
+
+    SECTION("read a byte")
+    {
+        host.received = "H";
+        CHECK(client.read() == 'H');
+        CHECK(host.sent == "GET / ");
+    }
+
+    SECTION("read bytes")
+    {
+        uint8_t buf[8];
+        CHECK(client.read(buf, sizeof(buf)) == -1);
+        CHECK(host.sent == "GET / ");
+    }
+
+    SECTION("connected")
+    {
+        CHECK(client.connected());
+        CHECK(host.sent == "GET / ");
+    }
+
+    SECTION("flush")
+    {
+        client.flush();
+        CHECK(host.sent == "GET / ");
+    }
+
+    CHECK(host.sends.size() == 1);
+}
+
+TEST_CASE("TCPClient sends what was written before it closes", "[tcpclient_buffer]")
+{
+    HostSocket& host = HostSocket::reset();
+
+    SECTION("stop")
+    {
+        TCPClient client(HostSocket::Handle);
+        client.print("bye");
+        client.stop();
+        CHECK(host.sent == "bye");
+        CHECK(host.closed);
+    }
+
+    SECTION("going out of scope")
+    {
+        {
+            TCPClient client(HostSocket::Handle);
+            client.print("bye");
+        }
+        CHECK(host.sent == "bye");
+    }
+
+    SECTION("stop drops what the socket does not take")
+    {
+        TCPClient client(HostSocket::Handle);
+        client.print("bye");
+        host.accept = 0;
+        client.stop();
+        host.accept = 1 << 20;
+        CHECK(client.connect(IPAddress(10, 0, 0, 1), 80) == 1);
+        client.flush();
+        CHECK(host.sent.empty());
+    }
+}
+
+TEST_CASE("TCPClient flush_buffer discards unread input only", "[tcpclient_buffer]")
+{
+    HostSocket& host = HostSocket::reset();
+    TCPClient client(HostSocket::Handle);
+    host.received = "HTTP";
+    CHECK(client.available() == 4);
+    client.print("GET / ");
+    client.flush_buffer();
+    CHECK(client.available() == 0);
+    CHECK(host.sent == "GET / ");
+}
+
+TEST_CASE("TCPClient bytes held longer than the write delay are sent after loop", "[tcpclient_buffer]")
+{
+    HostSocket& host = HostSocket::reset();
+    TCPClient client(HostSocket::Handle);
+    client.setWriteDelay(60000);
+    client.print("GET / ");
+
+    TCPClient::flushHeld();
+    CHECK(host.sent.empty());
+
+    client.setWriteDelay(0);
+    TCPClient::flushHeld();
+    CHECK(host.sent == "GET / ");
+
+    SECTION("a client going out of scope is no longer flushed")
+    {
+        {
+            TCPClient other(HostSocket::Handle);
+            other.setWriteDelay(60000);
+            other.print("a");
+            TCPClient copy(other);
+            copy.print("b");
+        }
+        CHECK(host.sent == "GET / ba");
+        client.setWriteDelay(60000);
+        client.print("c");
+        client.setWriteDelay(0);
+        TCPClient::flushHeld();
+        CHECK(host.sent == "GET / bac");
+    }
+}
+
+TEST_CASE("HTTP request goes out in fewer sends with the write buffer", "[tcpclient_buffer]")
+{
+    std::string sent[2];
+    size_t sends[2];
+    for (int buffered = 0; buffered < 2; buffered++) {
+        HostSocket& host = HostSocket::reset();
+        TCPClient client(HostSocket::Handle);
+        if (!buffered)
+            client.setWriteDelay(0);
+        http_request(client);
+        sent[buffered] = host.sent;
+        sends[buffered] = host.sends.size();
+    }
+    CHECK(sent[0] == sent[1]);
+    CHECK(sends[0] == 23);
+    CHECK(sends[1] == 2);
+}
+
+TEST_CASE("TCPClient held bytes are sent by the loop of the part linking the sketch", "[tcpclient_buffer]")
+{
+    // each part links its own TCPClient list, so the user part's loop sends the sketch's
+    for (const char* part : { "modules/bluz/user-part/inc/user_part_export.c",
+            "modules/bluz-gw/user-part/inc/user_part_export.c",
+            "modules/shared/stm32f2xx/inc/user_part_export.c" }) {
+        INFO(part);
+        CHECK(body(source(part), "void module_user_loop()").find("_post_loop();") != std::string::npos);
+    }
+
+    // and the system part only calls it for monolithic firmware, or it would run twice
+    for (const char* main : { "system/src/main.cpp", "system/src/main_passive.cpp" }) {
+        INFO(main);
+        std::string text = source(main);
+        REQUIRE_FALSE(text.empty());
+        for (size_t call = text.find("_post_loop();"); call != std::string::npos;
+                call = text.find("_post_loop();", call + 1)) {
+            size_t guard = text.rfind("#if", call);
+            REQUIRE(guard != std::string::npos);
+            CHECK(text.compare(guard, 21, "#if !MODULAR_FIRMWARE") == 0);
+            CHECK(text.find("#endif", guard) > call);
+        }
+    }
+}
+
+/**
+ * socket_send calls and bytes/s for an HTTP request written as a sketch
+ * would, over a loopback TCP connection, each write sent and then through
+ * the write buffer.
+ *
+ * Run with: obj/runner "[benchmark]"
+ */
+TEST_CASE("TCPClient write buffer benchmark", "[.][tcpclient_buffer][benchmark]")
+{
+    Rate before = loopback_requests(false, 20000);
+    Rate after = loopback_requests(true, 20000);
+    std::ostringstream report;
+    report << "HTTP request: socket_send calls and bytes/s, unbuffered then buffered" << std::endl;
+    report << "  " << before.sends << " " << before.bytes_per_second
+           << ", " << after.sends << " " << after.bytes_per_second << std::endl;
+    WARN(report.str());
+}
@@ -0,0 +1,273 @@
+// Off device tests and benchmark for the block reads and writes of the nRF51
+// UART FIFO
+
+#include "catch.hpp"
+extern "C" {
+#include "app_fifo.h"
+}
+#include "nrf_error.h"
+#include <chrono>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+struct Fifo {
+    std::vector<uint8_t> storage;
+    app_fifo_t fifo;
+
+    explicit Fifo(uint16_t size) : storage(size) {
+        app_fifo_init(&fifo, storage.data(), size);
+    }
+
+    uint32_t length() const { return fifo.write_pos - fifo.read_pos; }
+};
+
+/**
+ * TX wired to RX, as in the loopback test on device. A tick is the time to
+ * send a byte, 87us at 115200 baud, in which the UART moves a byte from the
+ * TX FIFO to the RX FIFO, or counts it dropped when the RX FIFO is full.
+ * The application reads every read_every ticks.
+ */
+struct Loopback {
+    Fifo tx;
+    Fifo rx;
+    unsigned read_every;
+    uint32_t ticks = 0;
+    uint32_t tx_dropped = 0;
+    uint32_t rx_dropped = 0;
+    std::vector<uint8_t> received;
+
+    Loopback(uint16_t tx_size, uint16_t rx_size, unsigned read_every)
+        : tx(tx_size), rx(rx_size), read_every(read_every) {}
+
+    void tick() {
+        uint8_t b;
+        if (app_fifo_get(&tx.fifo, &b) == NRF_SUCCESS && app_fifo_put(&rx.fifo, b) != NRF_SUCCESS)
+            rx_dropped++;
+        if (++ticks % read_every == 0)
+            read();
+    }
+
+    void read() {
+        uint8_t buf[32];
+        uint32_t size;
+        do {
+            size = sizeof(buf);
+            app_fifo_read(&rx.fifo, buf, &size);
+            received.insert(received.end(), buf, buf + size);
+        } while (size == sizeof(buf));
+    }
+
+    // the previous HAL, a byte at a time and dropped when the FIFO is full
+    void write_bytes(const uint8_t* data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            if (app_fifo_put(&tx.fifo, data[i]) != NRF_SUCCESS)
+                tx_dropped++;
+        }
+    }
+
+    // a blocking block write, waiting on the UART for room
+    void write_block(const uint8_t* data, size_t size) {
+        while (size) {
+            uint32_t length = size;
+            if (app_fifo_write(&tx.fifo, data, &length) == NRF_SUCCESS) {
+                data += length;
+                size -= length;
+            }
+            else {
+                tick();
+            }
+        }
+    }
+
+    void drain() {
+        while (tx.length())
+            tick();
+        read();
+    }
+};
+
+struct Delivery {
+    size_t sent = 0;
+    uint32_t dropped = 0;
+    bool intact = false;
+};
+
+/**
+ * A 240 byte burst of debug output every 100ms at 115200 baud, for a second,
+ * with the other end reading every 10 bytes.
+ */
+Delivery debug_output(uint16_t tx_size, uint16_t rx_size, bool block)
+{
+    Loopback wire(tx_size, rx_size, 10);
+    std::vector<uint8_t> sent;
+    for (int burst = 0; burst < 10; burst++) {
+        std::vector<uint8_t> line(240);
+        for (size_t i = 0; i < line.size(); i++)
+            line[i] = uint8_t(burst * 31 + i);
+        sent.insert(sent.end(), line.begin(), line.end());
+        if (block)
+            wire.write_block(line.data(), line.size());
+        else
+            wire.write_bytes(line.data(), line.size());
+        uint32_t next = (burst + 1) * 1152;
+        while (wire.ticks < next)
+            wire.tick();
+    }
+    wire.drain();
+    Delivery d;
+    d.sent = sent.size();
+    d.dropped = wire.tx_dropped + wire.rx_dropped;
+    d.intact = wire.received == sent;
+    return d;
+}
+
+} // namespace
+
+TEST_CASE("FIFO block writes and reads wrap around", "[uart_fifo]")
+{
+    Fifo f(16);
+    uint8_t in[32], out[32];
+    for (int i = 0; i < 32; i++)
+        in[i] = i;
+
+    uint32_t size = 10;
+    REQUIRE(app_fifo_write(&f.fifo, in, &size) == NRF_SUCCESS);
+    CHECK(size == 10);
+    size = 6;
+    REQUIRE(app_fifo_read(&f.fifo, out, &size) == NRF_SUCCESS);
+    CHECK(size == 6);
+    CHECK(out[5] == 5);
+
+    // 12 bytes free, written across the end of the storage
+    size = 12;
+    REQUIRE(app_fifo_write(&f.fifo, in + 10, &size) == NRF_SUCCESS);
+    CHECK(size == 12);
+    CHECK(f.length() == 16);
+
+    size = sizeof(out);
+    REQUIRE(app_fifo_read(&f.fifo, out, &size) == NRF_SUCCESS);
+    REQUIRE(size == 16);
+    for (int i = 0; i < 16; i++)
+        CHECK(out[i] == i + 6);
+}
+
+TEST_CASE("FIFO block writes take what fits", "[uart_fifo]")
+{
+    Fifo f(8);
+    uint8_t in[12] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+    uint32_t size = sizeof(in);
+    REQUIRE(app_fifo_write(&f.fifo, in, &size) == NRF_SUCCESS);
+    CHECK(size == 8);
+    size = 1;
+    CHECK(app_fifo_write(&f.fifo, in, &size) == NRF_ERROR_NO_MEM);
+    CHECK(size == 0);
+
+    uint8_t b;
+    REQUIRE(app_fifo_get(&f.fifo, &b) == NRF_SUCCESS);
+    CHECK(b == 1);
+    size = 0;
+    CHECK(app_fifo_write(&f.fifo, nullptr, &size) == NRF_SUCCESS);
+    CHECK(size == 1);
+    size = 0;
+    CHECK(app_fifo_read(&f.fifo, nullptr, &size) == NRF_SUCCESS);
+    CHECK(size == 7);
+
+    uint8_t out[8];
+    size = sizeof(out);
+    REQUIRE(app_fifo_read(&f.fifo, out, &size) == NRF_SUCCESS);
+    CHECK(size == 7);
+    CHECK(out[6] == 8);
+    size = sizeof(out);
+    CHECK(app_fifo_read(&f.fifo, out, &size) == NRF_ERROR_NOT_FOUND);
+    CHECK(size == 0);
+}
+
+TEST_CASE("FIFO block and byte access agree", "[uart_fifo]")
+{
+    Fifo blocks(32), bytes(32);
+    uint32_t x = 2463534242u;
+    uint8_t next = 0, expected = 0;
+    for (int round = 0; round < 5000; round++) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        uint8_t data[40];
+        uint32_t size = x % sizeof(data);
+        for (uint32_t i = 0; i < size; i++)
+            data[i] = next + i;
+        uint32_t written = size;
+        app_fifo_write(&blocks.fifo, data, &written);
+        for (uint32_t i = 0; i < written; i++)
+            REQUIRE(app_fifo_put(&bytes.fifo, data[i]) == NRF_SUCCESS);
+        next += written;
+
+        uint8_t out[40];
+        uint32_t read = (x >> 8) % sizeof(out);
+        app_fifo_read(&blocks.fifo, out, &read);
+        for (uint32_t i = 0; i < read; i++) {
+            uint8_t b;
+            REQUIRE(app_fifo_get(&bytes.fifo, &b) == NRF_SUCCESS);
+            REQUIRE(out[i] == b);
+            REQUIRE(b == expected++);
+        }
+        REQUIRE(blocks.length() == bytes.length());
+    }
+}
+
+TEST_CASE("Blocking block writes deliver debug output intact", "[uart_fifo]")
+{
+    // the gateway FIFOs before and after
+    Delivery bytes = debug_output(64, 16, false);
+    Delivery blocks = debug_output(128, 64, true);
+    CHECK(bytes.dropped > 0);
+    CHECK_FALSE(bytes.intact);
+    CHECK(blocks.dropped == 0);
+    CHECK(blocks.intact);
+}
+
+/**
+ * Loopback delivery of bursts of debug output at 115200 baud, and the time
+ * to queue bytes one at a time and as a block.
+ *
+ * Run with: obj/runner "[benchmark]"
+ */
+TEST_CASE("UART FIFO benchmark", "[.][uart_fifo][benchmark]")
+{
+    std::ostringstream report;
+    report << "loopback of 10 bursts of 240 bytes: bytes dropped" << std::endl;
+    Delivery d = debug_output(64, 16, false);
+    report << "  byte writes, 64/16 FIFOs: " << d.dropped << " of " << d.sent << std::endl;
+    d = debug_output(256, 128, false);
+    report << "  byte writes, 256/128 FIFOs: " << d.dropped << " of " << d.sent << std::endl;
+    d = debug_output(128, 64, true);
+    report << "  blocking block writes, 128/64 FIFOs: " << d.dropped << " of " << d.sent << std::endl;
+
+    Fifo f(256);
+    uint8_t data[64] = {}, out[256];
+    const unsigned rounds = 200000;
+    uint32_t total = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned r = 0; r < rounds; r++) {
+        for (uint8_t b : data)
+            app_fifo_put(&f.fifo, b);
+        uint32_t size = sizeof(out);
+        app_fifo_read(&f.fifo, out, &size);
+        total += size;
+    }
+    std::chrono::duration<double, std::nano> byte_writes = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (unsigned r = 0; r < rounds; r++) {
+        uint32_t size = sizeof(data);
+        app_fifo_write(&f.fifo, data, &size);
+        size = sizeof(out);
+        app_fifo_read(&f.fifo, out, &size);
+        total -= size;
+    }
+    std::chrono::duration<double, std::nano> block_writes = std::chrono::steady_clock::now() - start;
+
+    REQUIRE(total == 0);
+    report << "ns per byte queued: bytes " << byte_writes.count() / (rounds * sizeof(data))
+           << ", block " << block_writes.count() / (rounds * sizeof(data)) << std::endl;
+    WARN(report.str());
+}
@@ -173,6 +173,41 @@ test(SERIAL1_ReadWriteParity9N2SucceedsInLoopbackWithTxRxShorted) {
         assertTrue(strncmp(test, message, 5)==0);
 }
 
+test(SERIAL1_BlockWritesKeepUpWithTheLineInLoopbackWithTxRxShorted) {
+    // 4KB at 115200 baud, with no more in flight than the receive buffer holds
+    const size_t total = 4096;
+    uint8_t out[32], in[64];
+    size_t sent = 0, received = 0;
+    bool intact = true;
+    // when
+    Serial1.begin(115200);
+    system_tick_t start = millis();
+    while (received < total && millis() - start < 2000) {
+        if (sent < total && sent - received <= sizeof(out) &&
+                Serial1.availableForWrite() >= (int)sizeof(out)) {
+            for (size_t i = 0; i < sizeof(out); i++)
+                out[i] = uint8_t(sent + i);
+            sent += Serial1.write(out, sizeof(out));
+        }
+        size_t n = Serial1.read(in, sizeof(in));
+        for (size_t i = 0; i < n; i++)
+            intact = intact && in[i] == uint8_t(received + i);
+        received += n;
+    }
+    system_tick_t elapsed = millis() - start;
+    HAL_USART_Stats stats;
+    bool counted = Serial1.getStats(stats);
+    Serial1.end();
+    // then
+    assertEqual(received, total);
+    assertTrue(intact);
+    if (counted) {
+        assertEqual(stats.tx_dropped, 0u);
+        assertEqual(stats.rx_dropped, 0u);
+    }
+    // 10 bits a byte on the line, within 80% of the line rate
+    assertLessOrEqual(elapsed, total * 10 * 1000 / 115200 * 5 / 4);
+}
 
 #if (PLATFORM_ID == 0)
 test(SERIAL2_ReadWriteSucceedsInLoopbackWithD0D1Shorted) {
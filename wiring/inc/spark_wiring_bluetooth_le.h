@@ -43,6 +43,7 @@ public:
     
     //information
     static uint32_t getConnectionInterval();
+    static void getTxStats(BLUETOOTH_LE_TX_STATS* stats);
     
     //advertising functions
     static void startAdvertising();
@@ -310,6 +310,18 @@ public:
     }
 #endif
 
+    /**
+     * Events published within this many milliseconds of each other are sent
+     * together in one message, and count once towards the publish rate limit.
+     * 0, the default, sends each event as it is published.
+     */
+    static void publishBatchWindow(unsigned millis)
+    {
+        CLOUD_FN(spark_protocol_set_connection_property(sp(), particle::protocol::Connection::EVENT_BATCH_WINDOW,
+                                                        millis, nullptr, nullptr),
+                 (void)0);
+    }
+
 private:
 
     static bool register_function(cloud_function_t fn, void* data, const char* funcKey);
@@ -30,16 +30,27 @@
 #include "spark_wiring_client.h"
 #include "spark_wiring_ipaddress.h"
 #include "spark_wiring_print.h"
+#include "spark_wiring_tcpclient_buffer.h"
 #include "socket_hal.h"
 
 #define TCPCLIENT_BUF_MAX_SIZE	128
 
+// the most bytes written sent in one socket_send, unless written at once
+#ifndef TCPCLIENT_TX_BUF_MAX_SIZE
+#define TCPCLIENT_TX_BUF_MAX_SIZE	128
+#endif
+
+// the longest written bytes are held for more to send with them, in milliseconds
+#ifndef TCPCLIENT_WRITE_DELAY_DEFAULT
+#define TCPCLIENT_WRITE_DELAY_DEFAULT	20
+#endif
+
 class TCPClient : public Client {
 
 public:
 	TCPClient();
 	TCPClient(sock_handle_t sock);
-        virtual ~TCPClient() {};
+        virtual ~TCPClient();
 
         uint8_t status();
 	virtual int connect(IPAddress ip, uint16_t port, network_interface_t=0);
@@ -52,6 +63,8 @@ public:
 	virtual int peek();
 	virtual void flush();
         void flush_buffer();
+        void setWriteDelay(system_tick_t ms) { _write_delay = ms; }
+        static void flushHeld();
 	virtual void stop();
 	virtual uint8_t connected();
 	virtual operator bool();
@@ -72,7 +85,27 @@ private:
 	uint16_t _offset;
 	uint16_t _total;
         IPAddress _remoteIP;
+        TCPClientWriteBuffer<TCPCLIENT_TX_BUF_MAX_SIZE> _tx;
+        system_tick_t _write_delay;
+
+        /**
+         * Links the clients holding written bytes for flushHeld(). A copy
+         * starts unlinked, as its write buffer starts empty.
+         */
+        struct HeldLink {
+            TCPClient* next;
+            bool linked;
+            HeldLink() : next(nullptr), linked(false) {}
+            HeldLink(const HeldLink&) : HeldLink() {}
+            HeldLink& operator=(const HeldLink&) { return *this; }
+        };
+        static TCPClient* _held;
+        HeldLink _held_link;
+
 	inline int bufferCount();
+        int sendBuffered();
+        void hold();
+        void release();
 
 };
 
@@ -0,0 +1,132 @@
+/**
+ ******************************************************************************
+ * @file    spark_wiring_tcpclient_buffer.h
+ * @brief   The output buffer of a TCPClient
+ ******************************************************************************
+  Copyright (c) 2013-2015 Particle Industries, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#ifndef __SPARK_WIRING_TCPCLIENT_BUFFER_H
+#define __SPARK_WIRING_TCPCLIENT_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "system_tick_hal.h"
+
+/**
+ * Holds the small writes to a TCPClient, such as the characters and numbers
+ * of Print, so they go out in one socket_send rather than one each.
+ *
+ * The bytes are sent when the buffer fills, when flush() is called, or by
+ * the first write that finds them held longer than the write delay. The
+ * owner sends those due() in the meantime.
+ *
+ * A copy starts empty, so buffered bytes are only sent by the client they
+ * were written to.
+ */
+template <size_t N>
+class TCPClientWriteBuffer
+{
+    uint8_t _data[N];
+    uint16_t _count;
+    system_tick_t _since;       // when the oldest byte held was written
+
+    /**
+     * Sends all of the bytes, stopping early if the socket takes none.
+     * @return the number of bytes sent, or the negative result of a failed send
+     */
+    template <typename Send> static int send_all(const uint8_t* buf, size_t size, Send& send)
+    {
+        size_t sent = 0;
+        while (sent < size) {
+            int ret = send(buf + sent, size - sent);
+            if (ret < 0)
+                return ret;
+            if (ret == 0)
+                break;
+            sent += ret;
+        }
+        return sent;
+    }
+
+public:
+    TCPClientWriteBuffer() : _count(0), _since(0) {}
+    TCPClientWriteBuffer(const TCPClientWriteBuffer&) : _count(0), _since(0) {}
+    TCPClientWriteBuffer& operator=(const TCPClientWriteBuffer&) { _count = 0; return *this; }
+
+    size_t count() const { return _count; }
+    bool empty() const { return !_count; }
+    void clear() { _count = 0; }
+
+    /**
+     * Whether bytes have been held for at least the delay.
+     */
+    bool due(system_tick_t now, system_tick_t delay) const { return _count && now - _since >= delay; }
+
+    /**
+     * Holds the bytes, sending what is held first when they do not fit.
+     * Writes too big to hold are sent straight away.
+     * @param now the current time
+     * @param delay the longest the bytes may be held before the next write sends them
+     * @param send sends bytes on the socket, int send(const uint8_t* buf, size_t size)
+     * @return the number of bytes written, or the negative result of a failed send
+     */
+    template <typename Send> int write(const uint8_t* buf, size_t size, system_tick_t now, system_tick_t delay, Send send)
+    {
+        if (_count + size > N) {
+            int ret = flush(send);
+            if (ret < 0)
+                return ret;
+            if (size >= N)
+                return _count ? 0 : send_all(buf, size, send);
+            if (_count + size > N)
+                return 0;
+        }
+        if (!_count)
+            _since = now;
+        memcpy(_data + _count, buf, size);
+        _count += size;
+        if (_count == N || due(now, delay)) {
+            int ret = flush(send);
+            if (ret < 0)
+                return ret;
+        }
+        return size;
+    }
+
+    /**
+     * Sends the bytes held. Those the socket does not take are kept, unless
+     * the send fails, when they are dropped.
+     * @return the number of bytes sent, or the negative result of a failed send
+     */
+    template <typename Send> int flush(Send send)
+    {
+        if (!_count)
+            return 0;
+        int ret = send_all(_data, _count, send);
+        if (ret < 0) {
+            _count = 0;
+            return ret;
+        }
+        _count -= ret;
+        memmove(_data, _data + ret, _count);
+        return ret;
+    }
+};
+
+#endif
@@ -53,6 +53,18 @@ public:
   virtual void flush(void);
   size_t write(uint16_t);
   virtual size_t write(uint8_t);
+  virtual size_t write(const uint8_t *buffer, size_t size);
+
+  /**
+   * Reads the bytes already received, up to size, without waiting.
+   */
+  size_t read(uint8_t *buffer, size_t size);
+
+  /**
+   * Retrieves the counts of bytes lost to full buffers and of receive errors.
+   * Returns false when the platform doesn't count them.
+   */
+  bool getStats(HAL_USART_Stats& stats);
 
   inline size_t write(unsigned long n) { return write((uint16_t)n); }
   inline size_t write(long n) { return write((uint16_t)n); }
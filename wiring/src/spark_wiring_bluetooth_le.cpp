@@ -28,6 +28,11 @@ uint32_t BLEClass::getConnectionInterval()
     return HAL_BLE_GET_CONNECTION_INTERVAL();
 }
 
+void BLEClass::getTxStats(BLUETOOTH_LE_TX_STATS* stats)
+{
+    HAL_BLE_Get_TX_Stats(stats);
+}
+
 void BLEClass::startAdvertising()
 {
     HAL_BLE_Start_Advertising();
@@ -71,4 +76,4 @@ void BLEClass::setConnectionParameters(int minimum, int maximum)
 void BLEClass::setGatewayTargetName(char* name)
 {
     HAL_BLE_Set_Gateway_Target(name);
-}
\ No newline at end of file
+}
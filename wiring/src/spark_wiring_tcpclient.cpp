@@ -31,11 +31,13 @@
 #include "socket_hal.h"
 #include "inet_hal.h"
 #include "spark_macros.h"
+#include "timer_hal.h"
 
 
 using namespace spark;
 
 uint16_t TCPClient::_srcport = 1024;
+TCPClient* TCPClient::_held = nullptr;
 
 static bool inline isOpen(sock_handle_t sd)
 {
@@ -46,11 +48,18 @@ TCPClient::TCPClient() : TCPClient(socket_handle_invalid())
 {
 }
 
-TCPClient::TCPClient(sock_handle_t sock) : _sock(sock)
+TCPClient::TCPClient(sock_handle_t sock) : _sock(sock), _write_delay(TCPCLIENT_WRITE_DELAY_DEFAULT)
 {
   flush_buffer();
 }
 
+TCPClient::~TCPClient()
+{
+  // the bytes written to a client that goes out of scope still go out
+  sendBuffered();
+  release();
+}
+
 int TCPClient::connect(const char* host, uint16_t port, network_interface_t nif)
 {
     stop();
@@ -116,7 +125,67 @@ size_t TCPClient::write(uint8_t b)
 
 size_t TCPClient::write(const uint8_t *buffer, size_t size)
 {
-        return status() ? socket_send(_sock, buffer, size) : -1;
+        if (!status())
+            return -1;
+        sock_handle_t sock = _sock;
+        int ret = _tx.write(buffer, size, HAL_Timer_Get_Milli_Seconds(), _write_delay,
+            [sock](const uint8_t* buf, size_t len) { return int(socket_send(sock, buf, len)); });
+        if (!_tx.empty())
+            hold();
+        return ret;
+}
+
+int TCPClient::sendBuffered()
+{
+        if (_tx.empty() || !isOpen(_sock))
+            return 0;
+        sock_handle_t sock = _sock;
+        return _tx.flush([sock](const uint8_t* buf, size_t len) { return int(socket_send(sock, buf, len)); });
+}
+
+void TCPClient::hold()
+{
+    if (!_held_link.linked)
+    {
+        _held_link.next = _held;
+        _held_link.linked = true;
+        _held = this;
+    }
+}
+
+void TCPClient::release()
+{
+    for (TCPClient** link = &_held; *link; link = &(*link)->_held_link.next)
+    {
+        if (*link == this)
+        {
+            *link = _held_link.next;
+            break;
+        }
+    }
+    _held_link.linked = false;
+}
+
+/**
+ * Sends the bytes held longer than the write delay by each client, so they
+ * go out without waiting for another write. Called by the system after loop().
+ */
+void TCPClient::flushHeld()
+{
+    system_tick_t now = HAL_Timer_Get_Milli_Seconds();
+    for (TCPClient** link = &_held; *link; )
+    {
+        TCPClient* client = *link;
+        if (client->_tx.due(now, client->_write_delay))
+            client->sendBuffered();
+        if (client->_tx.empty() || !isOpen(client->_sock))
+        {
+            *link = client->_held_link.next;
+            client->_held_link.linked = false;
+        }
+        else
+            link = &client->_held_link.next;
+    }
 }
 
 int TCPClient::bufferCount()
@@ -128,6 +197,9 @@ int TCPClient::available()
 {
     int avail = 0;
 
+    // a reply is only coming once the request has gone
+    sendBuffered();
+
     // At EOB => Flush it
     if (_total && (_offset == _total))
     {
@@ -154,12 +226,14 @@ int TCPClient::available()
 
 int TCPClient::read()
 {
+  sendBuffered();
   return (bufferCount() || available()) ? _buffer[_offset++] : -1;
 }
 
 int TCPClient::read(uint8_t *buffer, size_t size)
 {
         int read = -1;
+        sendBuffered();
         if (bufferCount() || available())
         {
           read = (size > (size_t) bufferCount()) ? bufferCount() : size;
@@ -182,6 +256,8 @@ void TCPClient::flush_buffer()
 
 void TCPClient::flush()
 {
+  // send what was written, then discard what has not been read
+  sendBuffered();
   while (available())
     read();
 }
@@ -191,15 +267,19 @@ void TCPClient::stop()
 {
   DEBUG("_sock %d closesocket", _sock);
 
+  sendBuffered();
   if (isOpen(_sock))
       socket_close(_sock);
   _sock = socket_handle_invalid();
   _remoteIP.clear();
   flush_buffer();
+  // output held for the closed socket is dropped, connect() starts empty
+  _tx.clear();
 }
 
 uint8_t TCPClient::connected()
 {
+  sendBuffered();
   // Wlan up, open and not in CLOSE_WAIT or data still in the local buffer
   bool rv = (status() || bufferCount());
   // no data in the local buffer, Socket open but my be in CLOSE_WAIT yet the CC3000 may have data in its buffer
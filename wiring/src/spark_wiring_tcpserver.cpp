@@ -117,5 +117,8 @@ size_t TCPServer::write(uint8_t b)
 
 size_t TCPServer::write(const uint8_t *buffer, size_t size)
 {
-    return _client.write(buffer, size);
+    // the client is replaced by the next accepted one, so nothing is left buffered
+    size_t n = _client.write(buffer, size);
+    _client.sendBuffered();
+    return n;
 }
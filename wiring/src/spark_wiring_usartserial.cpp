@@ -66,7 +66,7 @@ void USARTSerial::blockOnOverrun(bool block)
 
 int USARTSerial::availableForWrite(void)
 {
-  return HAL_USART_Available_Data(_serial);
+  return HAL_USART_Available_Data_For_Write(_serial);
 }
 
 int USARTSerial::available(void)
@@ -84,6 +84,19 @@ int USARTSerial::read(void)
   return HAL_USART_Read_Data(_serial);
 }
 
+size_t USARTSerial::read(uint8_t *buffer, size_t size)
+{
+  int32_t result = HAL_USART_Read_Block(_serial, buffer, size, NULL);
+  if (result >= 0) {
+    return result;
+  }
+  size_t count = 0;
+  for (int c; count < size && available() > 0 && (c = read()) >= 0; count++) {
+    buffer[count] = c;
+  }
+  return count;
+}
+
 void USARTSerial::flush()
 {
   HAL_USART_Flush_Data(_serial);
@@ -99,6 +112,16 @@ size_t USARTSerial::write(uint8_t c)
   return 0;
 }
 
+size_t USARTSerial::write(const uint8_t *buffer, size_t size)
+{
+  // the whole block goes to the HAL at once where it has a block path
+  int32_t result = HAL_USART_Write_Block(_serial, buffer, size, _blocking, NULL);
+  if (result >= 0) {
+    return result;
+  }
+  return Print::write(buffer, size);
+}
+
 size_t USARTSerial::write(uint16_t c)
 {
   return HAL_USART_Write_NineBitData(_serial, c);
@@ -112,6 +135,10 @@ bool USARTSerial::isEnabled() {
   return HAL_USART_Is_Enabled(_serial);
 }
 
+bool USARTSerial::getStats(HAL_USART_Stats& stats) {
+  return HAL_USART_Get_Stats(_serial, &stats, NULL) == 0;
+}
+
 #ifndef SPARK_WIRING_NO_USART_SERIAL
 // Preinstantiate Objects //////////////////////////////////////////////////////
 static Ring_Buffer serial1_rx_buffer;
@@ -28,6 +28,7 @@
 #include "spark_wiring_usbserial.h"
 #include "spark_wiring_usartserial.h"
 #include "spark_wiring_watchdog.h"
+#include "spark_wiring_tcpclient.h"
 #include "rng_hal.h"
 
 
@@ -87,6 +88,7 @@ void serialEvent5() __attribute__((weak));
 void _post_loop()
 {
 	serialEventRun();
+	TCPClient::flushHeld();
 	application_checkin();
 }
 